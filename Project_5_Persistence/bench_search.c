@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h> /* For malloc, free, rand, atoi */
+#include <time.h>   /* For clock */
+
+/* Required Prototypes from btree.c */
+int         BTree_search_kernel(int kernel, const int *keys, int n, int k);
+const char* BTree_search_isa(void);
+
+/* Kernel ids (must match btree.c) */
+#define BTREE_SEARCH_AUTO   0
+#define BTREE_SEARCH_LINEAR 1
+#define BTREE_SEARCH_COUNT  2
+#define BTREE_SEARCH_BINARY 3
+#define NUM_KERNELS 4
+#define NUM_LOOKUPS 4000000
+#define NUM_PROBES 4096 /* Probe set reused round-robin, fits in cache */
+
+/* Micro-benchmark for the intra-node key search kernels */
+int main(int argc, const char *argv[]) {
+    int sizes[] = {3, 7, 15, 31, 63, 127, 255, 339, 511, 1023};
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    const char *names[NUM_KERNELS] = {"auto", "linear", "count", "binary"};
+    int lookups = NUM_LOOKUPS; int *keys = NULL; int *probes = NULL; int s; int n; int i; int kr; int expected;
+    clock_t start, end; double ns[NUM_KERNELS]; unsigned long checksum[NUM_KERNELS];
+
+    if (argc > 1) { lookups = atoi(argv[1]); }
+    if (lookups <= 0) {
+        fprintf(stderr, "Invalid arguments.\n");
+        fprintf(stderr, "Usage: %s [lookups]\n", argv[0]);
+        return 1;
+    }
+    printf("Intra-node key search, %d lookups per cell (ns/lookup), count kernel built for %s\n\n", lookups, BTree_search_isa());
+    keys = malloc(sizes[num_sizes - 1] * sizeof(int)); probes = malloc(NUM_PROBES * sizeof(int));
+    if (!keys || !probes) { perror("Failed to allocate benchmark arrays"); return 1; }
+
+    printf("------------------------------------------------------------\n");
+    printf("| %6s | %9s | %9s | %9s | %9s | %5s |\n", "Keys", names[0], names[1], names[2], names[3], "Best");
+    printf("------------------------------------------------------------\n");
+    for (s = 0; s < num_sizes; ++s) {
+        n = sizes[s];
+        for (i = 0; i < n; ++i) { keys[i] = i * 2; } /* Node keys: even, probes hit and miss */
+        for (i = 0; i < NUM_PROBES; ++i) { probes[i] = rand() % (2 * n + 2) - 1; }
+        for (kr = 0; kr < NUM_KERNELS; ++kr) {
+            checksum[kr] = 0;
+            start = clock();
+            for (i = 0; i < lookups; ++i) { checksum[kr] += (unsigned long)BTree_search_kernel(kr, keys, n, probes[i & (NUM_PROBES - 1)]); }
+            end = clock();
+            ns[kr] = 1e9 * (double)(end - start) / CLOCKS_PER_SEC / lookups;
+        }
+        for (kr = 1; kr < NUM_KERNELS; ++kr) {
+            if (checksum[kr] != checksum[0]) { fprintf(stderr, "Kernel %s disagrees with %s at n=%d\n", names[kr], names[0], n); return 1; }
+        }
+        expected = 1;
+        for (kr = 2; kr < NUM_KERNELS; ++kr) { if (ns[kr] < ns[expected]) { expected = kr; } }
+        printf("| %6d | %9.2f | %9.2f | %9.2f | %9.2f | %5s |\n", n, ns[0], ns[1], ns[2], ns[3], names[expected]);
+    }
+    printf("------------------------------------------------------------\n");
+    free(keys); free(probes); return 0;
+}
@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h> /* For malloc, free, exit */
+#include <string.h> /* For memmove, memcpy */
+#include <assert.h>
+
+/* Required Struct Definitions */
+struct Node { int n; int leaf; int *key; int *value; int *c; };
+struct BETree { int root; int t; struct Storage *store; };
+
+/* Required Prototypes from storage.c */
+struct Storage* Storage_open(const char *fname, int t);
+void          Storage_close(struct Storage *st);
+int           Storage_empty(struct Storage *st);
+int           Storage_alloc(struct Storage *st);
+void          Storage_read (struct Storage *st, int addr, struct Node *x);
+void          Storage_write(struct Storage *st, int addr, const struct Node *x);
+void          Storage_free (struct Storage *st, int addr);
+int           Storage_get_t(struct Storage *st);
+void          Storage_op_begin(struct Storage *st);
+void          Storage_op_end(struct Storage *st);
+void          Storage_commit(struct Storage *st);
+
+/* --- Constants --- */
+#define NULL_ADDR (-1)
+/* Value of a delete message (btree.c marks deleted keys with it too) */
+#define DELETION_SENTINEL ((int)0xDEADDEAD)
+/* Page kinds, kept in the leaf field (btree.c uses 0/1, bptree.c 2/3, vtree.c 4/5) */
+#define BET_INNER 6
+#define BET_LEAF  7
+/* Deepest flush recursion (a tree this tall would need ~4^48 pages) */
+#define BET_MAX_HEIGHT 48
+
+/* --- B-epsilon Tree Layout --- */
+/* A write-optimized tree: inner pages keep a few pivots and spend the */
+/* rest of the page on a buffer of pending messages, sorted by key and */
+/* at most one per key: upserts, and deletes carrying DELETION_SENTINEL. */
+/* A put or delete only adds a message to the root's buffer. When that */
+/* buffer is full, the messages bound for its fullest child move down in */
+/* one batch (the child flushing its own buffer first if it lacks room), */
+/* so each page write carries many updates and a random put costs a */
+/* fraction of an I/O. Messages higher up are newer than anything below */
+/* them, so a lookup stops at the first one it meets on its path. */
+/* With a body of 6t-2 ints, L = 3t-1 and F + B = L: */
+/*   leaf:  key[L], value[L]                        (n = keys) */
+/*   inner: pivot[F-1], c[F], m, mkey[B], mval[B]   (n = pivots) */
+/* F is about the square root of L (epsilon = 1/2), so buffers take most */
+/* of the page. Child c[i] holds the keys in [pivot[i-1], pivot[i]). */
+/* Pages are never merged; a leaf emptied by deletes is released when a */
+/* flush reaches it. As with BPTree, one thread uses a tree at a time. */
+
+/* Geometry of g_buf_t: leaf capacity, fanout and buffer capacity */
+static __thread int g_buf_t = 0;
+static __thread int g_L = 0;
+static __thread int g_F = 0;
+static __thread int g_B = 0;
+/* Per-thread page buffers, two per level of the flush recursion, created */
+/* on first use, and a merge area of 2(L+B) ints */
+static __thread struct Node *g_buf[BET_MAX_HEIGHT][2];
+static __thread int *g_merge = NULL;
+
+static int *BETree_values(const struct Node *x) { return x->key + g_L; }
+static int *BETree_children(const struct Node *x) { return x->key + g_F - 1; }
+static int *BETree_msg_count(const struct Node *x) { return x->key + 2 * g_F - 1; }
+static int *BETree_msg_keys(const struct Node *x) { return x->key + 2 * g_F; }
+static int *BETree_msg_values(const struct Node *x) { return x->key + 2 * g_F + g_B; }
+
+/* Node buffer whose arrays lie back to back, so the body is one array */
+static struct Node* BETree_node_mem(int t) {
+    struct Node *x; int i; int body = 6 * t - 2;
+    x = malloc(sizeof(struct Node) + (size_t)body * sizeof(int));
+    if (!x) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    x->key = (int *)(x + 1); x->value = x->key + (2 * t - 1); x->c = x->value + (2 * t - 1);
+    for (i = 0; i < body; ++i) { x->key[i] = NULL_ADDR; }
+    x->n = 0; x->leaf = BET_LEAF; return x;
+}
+
+static void BETree_buffers_free(void) {
+    int d;
+    for (d = 0; d < BET_MAX_HEIGHT; ++d) { free(g_buf[d][0]); free(g_buf[d][1]); g_buf[d][0] = NULL; g_buf[d][1] = NULL; }
+    free(g_merge); g_merge = NULL; g_buf_t = 0;
+}
+
+/* Binds the geometry of degree t; buffers are dropped when t changes */
+static void BETree_buffers(int t) {
+    if (g_buf_t == t) { return; }
+    BETree_buffers_free();
+    g_L = 3 * t - 1;
+    for (g_F = 4; (g_F + 1) * (g_F + 1) <= g_L; ++g_F) { }
+    g_B = g_L - g_F;
+    g_merge = malloc((size_t)2 * (g_L + g_B) * sizeof(int));
+    if (!g_merge) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    g_buf_t = t;
+}
+
+/* Buffer which (0 or 1) of recursion level depth */
+static struct Node* BETree_level(int depth, int which) {
+    if (depth >= BET_MAX_HEIGHT) { fprintf(stderr, "BTree Error: B-epsilon tree deeper than %d levels.\n", BET_MAX_HEIGHT); exit(EXIT_FAILURE); }
+    if (g_buf[depth][which] == NULL) { g_buf[depth][which] = BETree_node_mem(g_buf_t); }
+    return g_buf[depth][which];
+}
+
+static void BETree_read(struct Storage *st, int addr, struct Node *x) {
+    Storage_read(st, addr, x);
+    if (x->leaf != BET_LEAF && x->leaf != BET_INNER) { fprintf(stderr, "BTree Error: Page %d is not a B-epsilon tree page (kind %d).\n", addr, x->leaf); exit(EXIT_FAILURE); }
+}
+
+static void BETree_write(struct Storage *st, int addr, const struct Node *x) { Storage_write(st, addr, x); }
+
+/* First i with key[i] >= k */
+static int BETree_lower(const int *key, int n, int k) {
+    int lo = 0; int hi = n; int mid;
+    while (lo < hi) { mid = (lo + hi) / 2; if (key[mid] < k) { lo = mid + 1; } else { hi = mid; } }
+    return lo;
+}
+
+/* First i with key[i] > k: the child of an inner page covering k */
+static int BETree_upper(const int *key, int n, int k) {
+    int lo = 0; int hi = n; int mid;
+    while (lo < hi) { mid = (lo + hi) / 2; if (key[mid] <= k) { lo = mid + 1; } else { hi = mid; } }
+    return lo;
+}
+
+/* Adds message (k, v) to x's buffer, replacing an older one for k. */
+/* Returns 0 if k is new and the buffer is full. */
+static int BETree_buffer_add(struct Node *x, int k, int v) {
+    int *m = BETree_msg_count(x); int *mk = BETree_msg_keys(x); int *mv = BETree_msg_values(x); int i = BETree_lower(mk, *m, k);
+    if (i < *m && mk[i] == k) { mv[i] = v; return 1; }
+    if (*m == g_B) { return 0; }
+    memmove(&mk[i + 1], &mk[i], (*m - i) * sizeof(int)); memmove(&mv[i + 1], &mv[i], (*m - i) * sizeof(int));
+    mk[i] = k; mv[i] = v; (*m)++;
+    return 1;
+}
+
+/* Drops messages [from, from+count) from x's buffer */
+static void BETree_buffer_remove(struct Node *x, int from, int count) {
+    int *m = BETree_msg_count(x); int *mk = BETree_msg_keys(x); int *mv = BETree_msg_values(x);
+    memmove(&mk[from], &mk[from + count], (*m - from - count) * sizeof(int));
+    memmove(&mv[from], &mv[from + count], (*m - from - count) * sizeof(int));
+    *m -= count;
+}
+
+/* Applies (k, v) to leaf x. Returns 0 if k is new and x is full. */
+static int BETree_leaf_apply(struct Node *x, int k, int v) {
+    int *val = BETree_values(x); int i = BETree_lower(x->key, x->n, k);
+    if (i < x->n && x->key[i] == k) {
+        if (v != DELETION_SENTINEL) { val[i] = v; return 1; }
+        memmove(&x->key[i], &x->key[i + 1], (x->n - i - 1) * sizeof(int)); memmove(&val[i], &val[i + 1], (x->n - i - 1) * sizeof(int));
+        x->n--; return 1;
+    }
+    if (v == DELETION_SENTINEL) { return 1; }
+    if (x->n == g_L) { return 0; }
+    memmove(&x->key[i + 1], &x->key[i], (x->n - i) * sizeof(int)); memmove(&val[i + 1], &val[i], (x->n - i) * sizeof(int));
+    x->key[i] = k; val[i] = v; x->n++;
+    return 1;
+}
+
+/* Makes addr the child right of new pivot sep at position i of x */
+static void BETree_insert_child(struct Node *x, int i, int sep, int addr) {
+    int *c = BETree_children(x);
+    memmove(&x->key[i + 1], &x->key[i], (x->n - i) * sizeof(int));
+    memmove(&c[i + 2], &c[i + 1], (x->n - i) * sizeof(int));
+    x->key[i] = sep; c[i + 1] = addr; x->n++;
+}
+
+/* Removes child i of x; a neighbour takes over its key range */
+static void BETree_remove_child(struct Node *x, int i) {
+    int *c = BETree_children(x); int p = i < x->n ? i : i - 1;
+    memmove(&x->key[p], &x->key[p + 1], (x->n - p - 1) * sizeof(int));
+    memmove(&c[i], &c[i + 1], (x->n - i) * sizeof(int));
+    x->n--;
+}
+
+/* Merges messages ak/av[0..an) (newer) into y's buffer; the result fits */
+static void BETree_merge_messages(struct Node *y, const int *ak, const int *av, int an) {
+    int *m = BETree_msg_count(y); int *mk = BETree_msg_keys(y); int *mv = BETree_msg_values(y);
+    int *ok = g_merge; int *ov = g_merge + g_L + g_B; int i = 0; int j = 0; int n = 0;
+    while (i < *m || j < an) {
+        if (j >= an || (i < *m && mk[i] < ak[j])) { ok[n] = mk[i]; ov[n] = mv[i]; i++; }
+        else { if (i < *m && mk[i] == ak[j]) { i++; } ok[n] = ak[j]; ov[n] = av[j]; j++; }
+        n++;
+    }
+    memcpy(mk, ok, n * sizeof(int)); memcpy(mv, ov, n * sizeof(int)); *m = n;
+}
+
+/* Applies messages [lo, hi) of x to leaf y (child i of x, at addr_y) and */
+/* drops them from x. A leaf that overflows splits in two (x gains a */
+/* child, z is the second buffer); one left empty is released. */
+static void BETree_flush_leaf(struct Storage *st, struct Node *x, int i, int lo, int hi, struct Node *y, int addr_y, struct Node *z) {
+    int *mk = BETree_msg_keys(x); int *mv = BETree_msg_values(x); int *yv = BETree_values(y);
+    int *ok = g_merge; int *ov = g_merge + g_L + g_B; int a = 0; int j = lo; int n = 0; int half; int addr_z;
+    while (a < y->n || j < hi) {
+        if (j >= hi || (a < y->n && y->key[a] < mk[j])) { ok[n] = y->key[a]; ov[n] = yv[a]; a++; n++; continue; }
+        if (a < y->n && y->key[a] == mk[j]) { a++; } /* The message replaces the stored pair */
+        if (mv[j] != DELETION_SENTINEL) { ok[n] = mk[j]; ov[n] = mv[j]; n++; }
+        j++;
+    }
+    BETree_buffer_remove(x, lo, hi - lo);
+    if (n == 0 && x->n > 0) { Storage_free(st, addr_y); BETree_remove_child(x, i); return; }
+    half = n <= g_L ? n : n / 2; /* n < 2L: halves fit */
+    y->n = half; memcpy(y->key, ok, half * sizeof(int)); memcpy(yv, ov, half * sizeof(int));
+    BETree_write(st, addr_y, y);
+    if (half == n) { return; }
+    z->leaf = BET_LEAF; z->n = n - half;
+    memcpy(z->key, ok + half, z->n * sizeof(int)); memcpy(BETree_values(z), ov + half, z->n * sizeof(int));
+    addr_z = Storage_alloc(st); BETree_write(st, addr_z, z);
+    BETree_insert_child(x, i, z->key[0], addr_z);
+}
+
+/* Splits inner page y (child i of x, F children) around its middle pivot, */
+/* which moves up into x; z receives the upper half and its messages */
+static int BETree_split_inner(struct Storage *st, struct Node *x, int i, struct Node *y, struct Node *z) {
+    int mid = y->n / 2; int sep = y->key[mid]; int *ym = BETree_msg_count(y); int j; int addr_z;
+    z->leaf = BET_INNER; z->n = y->n - mid - 1;
+    memcpy(z->key, y->key + mid + 1, z->n * sizeof(int));
+    memcpy(BETree_children(z), BETree_children(y) + mid + 1, (z->n + 1) * sizeof(int));
+    j = BETree_lower(BETree_msg_keys(y), *ym, sep);
+    *BETree_msg_count(z) = *ym - j;
+    memcpy(BETree_msg_keys(z), BETree_msg_keys(y) + j, (*ym - j) * sizeof(int));
+    memcpy(BETree_msg_values(z), BETree_msg_values(y) + j, (*ym - j) * sizeof(int));
+    y->n = mid; *ym = j;
+    addr_z = Storage_alloc(st);
+    BETree_insert_child(x, i, sep, addr_z);
+    return addr_z;
+}
+
+/* Moves a batch of messages from x's buffer to the child they crowd most. */
+/* x (at recursion level depth) must have room for one more child: it */
+/* gains at most one and loses at least one message. The caller writes x. */
+static void BETree_flush(struct Storage *st, struct Node *x, int depth) {
+    int *mk = BETree_msg_keys(x); int *mv = BETree_msg_values(x); int m = *BETree_msg_count(x);
+    int i; int lo = 0; int hi; int best = 0; int best_lo = 0; int best_hi = 0; int mid; int room; int moved; int addr_y; int addr_z;
+    struct Node *y = BETree_level(depth + 1, 0); struct Node *z = BETree_level(depth + 1, 1); struct Node *tmp;
+    for (i = 0; i <= x->n; ++i) { /* Messages of child i are [lo, hi) */
+        hi = i < x->n ? lo + BETree_lower(mk + lo, m - lo, x->key[i]) : m;
+        if (hi - lo > best_hi - best_lo) { best = i; best_lo = lo; best_hi = hi; }
+        lo = hi;
+    }
+    addr_y = BETree_children(x)[best]; BETree_read(st, addr_y, y);
+    if (y->leaf == BET_LEAF) { BETree_flush_leaf(st, x, best, best_lo, best_hi, y, addr_y, z); return; }
+    if (y->n + 1 == g_F) { /* Full: split first, then follow the half with more messages */
+        addr_z = BETree_split_inner(st, x, best, y, z);
+        mid = best_lo + BETree_lower(mk + best_lo, best_hi - best_lo, x->key[best]);
+        if (best_hi - mid > mid - best_lo) { BETree_write(st, addr_y, y); tmp = y; y = z; z = tmp; addr_y = addr_z; best_lo = mid; }
+        else { BETree_write(st, addr_z, z); best_hi = mid; }
+    }
+    room = g_B - *BETree_msg_count(y);
+    if (room < best_hi - best_lo) { BETree_flush(st, y, depth + 1); room = g_B - *BETree_msg_count(y); }
+    moved = best_hi - best_lo < room ? best_hi - best_lo : room; /* The lowest keys go first */
+    BETree_merge_messages(y, mk + best_lo, mv + best_lo, moved);
+    BETree_buffer_remove(x, best_lo, moved);
+    BETree_write(st, addr_y, y);
+}
+
+/* Adds message (k, v) at the root, flushing or growing it when full */
+static void BETree_upsert(const struct BETree *bt, int k, int v) {
+    struct Node *x; int addr_y; int *mk; int i; struct Storage *st = bt->store;
+    Storage_op_begin(st); BETree_buffers(bt->t);
+    x = BETree_level(0, 0); BETree_read(st, bt->root, x);
+    if (x->leaf == BET_LEAF) {
+        if (BETree_leaf_apply(x, k, v)) { BETree_write(st, bt->root, x); Storage_op_end(st); return; }
+        addr_y = Storage_alloc(st); BETree_write(st, addr_y, x); /* Full root leaf: it moves below an empty buffer */
+        x->leaf = BET_INNER; x->n = 0; BETree_children(x)[0] = addr_y; *BETree_msg_count(x) = 0;
+    } else if (*BETree_msg_count(x) == g_B) {
+        mk = BETree_msg_keys(x); i = BETree_lower(mk, g_B, k);
+        if (i == g_B || mk[i] != k) { /* k needs a slot */
+            if (x->n + 1 == g_F) { /* No room for a child either: the root's contents move down a level */
+                addr_y = Storage_alloc(st); BETree_write(st, addr_y, x);
+                x->n = 0; BETree_children(x)[0] = addr_y; *BETree_msg_count(x) = 0;
+            } else { BETree_flush(st, x, 0); }
+        }
+    }
+    (void) BETree_buffer_add(x, k, v);
+    BETree_write(st, bt->root, x);
+    Storage_op_end(st);
+}
+
+/* Emits the keys of subtree addr in [lo, hi] with the pending messages */
+/* ak/av[0..an) of its ancestors applied (newer, sorted, in range). */
+/* Returns 1 once cb has asked to stop. */
+/* cb may use any tree, so the geometry is bound again here. */
+static int BETree_scan_node(const struct BETree *bt, int addr, int lo, int hi, const int *ak, const int *av, int an,
+                            int (*cb)(int k, int v, void *ctx), void *ctx, int *count) {
+    struct Node *x = BETree_node_mem(bt->t); int *pk = NULL; int *pv = NULL; int *mk; int *mv; int *c; int m; int *xv;
+    int i; int j; int n = 0; int k; int v; int stop = 0; int s; int e; int last;
+    BETree_buffers(bt->t); BETree_read(bt->store, addr, x);
+    if (x->leaf == BET_LEAF) {
+        xv = BETree_values(x); i = BETree_lower(x->key, x->n, lo); j = 0;
+        while (!stop) {
+            if (i < x->n && x->key[i] > hi) { i = x->n; }
+            if (i >= x->n && j >= an) { break; }
+            if (j >= an || (i < x->n && x->key[i] < ak[j])) { k = x->key[i]; v = xv[i]; i++; }
+            else {
+                if (i < x->n && x->key[i] == ak[j]) { i++; }
+                k = ak[j]; v = av[j]; j++;
+                if (v == DELETION_SENTINEL) { continue; }
+            }
+            (*count)++;
+            if (cb(k, v, ctx)) { stop = 1; }
+        }
+        free(x); return stop;
+    }
+    /* Ancestors' messages win over this page's for the same key */
+    mk = BETree_msg_keys(x); mv = BETree_msg_values(x); m = *BETree_msg_count(x);
+    pk = malloc((size_t)(an + m + 1) * 2 * sizeof(int));
+    if (!pk) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    pv = pk + an + m + 1;
+    i = BETree_lower(mk, m, lo); j = 0;
+    while ((i < m && mk[i] <= hi) || j < an) {
+        if (j >= an || (i < m && mk[i] <= hi && mk[i] < ak[j])) { pk[n] = mk[i]; pv[n] = mv[i]; i++; }
+        else { if (i < m && mk[i] == ak[j]) { i++; } pk[n] = ak[j]; pv[n] = av[j]; j++; }
+        n++;
+    }
+    c = BETree_children(x); last = BETree_upper(x->key, x->n, hi); s = 0;
+    for (i = BETree_upper(x->key, x->n, lo); i <= last && !stop; ++i) {
+        e = i < x->n ? s + BETree_lower(pk + s, n - s, x->key[i]) : n;
+        stop = BETree_scan_node(bt, c[i], lo, hi, pk + s, pv + s, e - s, cb, ctx, count);
+        s = e;
+    }
+    free(pk); free(x);
+    return stop;
+}
+
+
+/* --- Public API Implementation --- */
+
+/* BETree_open: Opens or creates a B-epsilon tree file. As with */
+/* BTree_open, t_user applies only to a new file and 0 picks the largest */
+/* t whose page fits. */
+struct BETree BETree_open(const char *name, int t_user) {
+    struct BETree bt; struct Storage *st; struct Node *x;
+    bt.store = st = Storage_open(name, t_user);
+    bt.t = Storage_get_t(st); bt.root = 0;
+    x = BETree_node_mem(bt.t);
+    if (Storage_empty(st)) {
+        if (Storage_alloc(st) != 0) { fprintf(stderr, "BTree Error: Initial root alloc not addr 0.\n"); Storage_close(st); exit(EXIT_FAILURE); }
+        BETree_write(st, 0, x);
+        Storage_commit(st); /* A new file is durable before the first operation */
+    } else {
+        Storage_read(st, 0, x);
+        if (x->leaf != BET_LEAF && x->leaf != BET_INNER) { fprintf(stderr, "BTree Error: %s does not hold a B-epsilon tree.\n", name); Storage_close(st); exit(EXIT_FAILURE); }
+    }
+    free(x); return bt;
+}
+
+void BETree_close(struct BETree *bt) {
+    Storage_close(bt->store);
+    BETree_buffers_free();
+    bt->root = -1; bt->t = 0; bt->store = NULL;
+}
+
+/* BETree_sync: Makes every completed operation durable (see BTree_sync) */
+void BETree_sync(const struct BETree *bt) { assert(bt != NULL && bt->t >= 2); Storage_commit(bt->store); }
+
+/* BETree_put: Inserts or updates k. v must not be DELETION_SENTINEL. */
+void BETree_put(const struct BETree *bt, int k, int v) {
+    assert(bt != NULL); assert(bt->t >= 2);
+    if (v == DELETION_SENTINEL) { fprintf(stderr, "BTree Error: Value %d is reserved for deletes.\n", v); exit(EXIT_FAILURE); }
+    BETree_upsert(bt, k, v);
+}
+
+/* BETree_delete: Removes k if present (a delete message, applied lazily) */
+void BETree_delete(struct BETree *bt, int k) {
+    assert(bt != NULL); assert(bt->t >= 2);
+    BETree_upsert(bt, k, DELETION_SENTINEL);
+}
+
+/* BETree_get: Sets *v if k is present (left untouched otherwise). The */
+/* newest message for k on the path decides; the leaf only if there is none. */
+void BETree_get(const struct BETree *bt, int k, int *v) {
+    struct Node *x; int addr; int i; int m;
+    assert(bt != NULL); assert(v != NULL); assert(bt->t >= 2);
+    BETree_buffers(bt->t);
+    x = BETree_level(0, 0); addr = bt->root;
+    for (;;) {
+        BETree_read(bt->store, addr, x);
+        if (x->leaf == BET_LEAF) { break; }
+        m = *BETree_msg_count(x); i = BETree_lower(BETree_msg_keys(x), m, k);
+        if (i < m && BETree_msg_keys(x)[i] == k) {
+            if (BETree_msg_values(x)[i] != DELETION_SENTINEL) { *v = BETree_msg_values(x)[i]; }
+            return;
+        }
+        addr = BETree_children(x)[BETree_upper(x->key, x->n, k)];
+    }
+    i = BETree_lower(x->key, x->n, k);
+    if (i < x->n && x->key[i] == k) { *v = BETree_values(x)[i]; }
+}
+
+/* BETree_scan: Calls cb(k, v, ctx) for every key in [lo, hi] in order, */
+/* merging each leaf with the messages buffered above it. Only subtrees */
+/* overlapping the range are read. A nonzero return from cb stops the */
+/* scan. Returns the number of calls. */
+int BETree_scan(const struct BETree *bt, int lo, int hi, int (*cb)(int k, int v, void *ctx), void *ctx) {
+    int count = 0;
+    assert(bt != NULL); assert(cb != NULL);
+    if (lo > hi) { return 0; }
+    (void) BETree_scan_node(bt, bt->root, lo, hi, NULL, NULL, 0, cb, ctx, &count); /* Own buffers: cb may use the tree */
+    return count;
+}
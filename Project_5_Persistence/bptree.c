@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h> /* For malloc, free, exit */
+#include <string.h> /* For memmove, memcpy */
+#include <assert.h>
+
+/* Required Struct Definitions */
+struct Node { int n; int leaf; int *key; int *value; int *c; };
+struct BPTree { int root; int t; struct Storage *store; };
+
+/* Required Prototypes from storage.c */
+struct Storage* Storage_open(const char *fname, int t);
+void          Storage_close(struct Storage *st);
+int           Storage_empty(struct Storage *st);
+int           Storage_alloc(struct Storage *st);
+void          Storage_read (struct Storage *st, int addr, struct Node *x);
+void          Storage_write(struct Storage *st, int addr, const struct Node *x);
+void          Storage_free (struct Storage *st, int addr);
+int           Storage_get_t(struct Storage *st);
+void          Storage_op_begin(struct Storage *st);
+void          Storage_op_end(struct Storage *st);
+void          Storage_commit(struct Storage *st);
+
+/* --- Constants --- */
+#define NULL_ADDR (-1)
+/* Page kinds, kept in the leaf field. btree.c pages use 0 and 1, so */
+/* either module can tell a file of the other kind by its root page. */
+#define BPT_INNER 2
+#define BPT_LEAF  3
+
+/* --- B+tree Layout --- */
+/* A storage page holds n, leaf and a body of 6t-2 ints (the key, value */
+/* and c arrays of a CLRS node back to back). B+tree pages split the */
+/* body differently, with cap = 3t-2 in both kinds of page: */
+/*   leaf:  key[cap], value[cap], next   (next = right sibling leaf) */
+/*   inner: key[cap], c[cap+1]           (separators only, no values) */
+/* so a page holds about 3t children instead of 2t. Child c[i] of an */
+/* inner page holds the keys in [key[i-1], key[i]). Full pages are split */
+/* and thin ones topped up on the way down, as in btree.c, so every */
+/* operation is one root-to-leaf pass. Pages are not latched: a BPTree */
+/* is used by one thread at a time (different trees by different threads). */
+
+/* Per-thread page buffers for point operations, sized for g_buf_t */
+#define BPT_BUFFERS 3
+static __thread struct Node *g_buf[BPT_BUFFERS] = { NULL, NULL, NULL };
+static __thread int g_buf_t = 0;
+
+static int BPTree_cap(int t) { return 3 * t - 2; }
+/* Fewest keys a non-root page keeps; two such pages always merge into one */
+static int BPTree_min(int t) { return (BPTree_cap(t) - 1) / 2; }
+static int *BPTree_values(const struct Node *x, int cap) { return x->key + cap; }
+static int *BPTree_children(const struct Node *x, int cap) { return x->key + cap; }
+static int *BPTree_next(const struct Node *x, int cap) { return x->key + 2 * cap; }
+
+/* Node buffer whose arrays lie back to back, so the body is one array */
+static struct Node* BPTree_node_mem(int t) {
+    struct Node *x; int i; int body = 6 * t - 2;
+    x = malloc(sizeof(struct Node) + (size_t)body * sizeof(int));
+    if (!x) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    x->key = (int *)(x + 1); x->value = x->key + (2 * t - 1); x->c = x->value + (2 * t - 1);
+    for (i = 0; i < body; ++i) { x->key[i] = NULL_ADDR; }
+    x->n = 0; x->leaf = BPT_LEAF; return x;
+}
+
+static void BPTree_buffers_free(void) {
+    int i;
+    for (i = 0; i < BPT_BUFFERS; ++i) { free(g_buf[i]); g_buf[i] = NULL; }
+    g_buf_t = 0;
+}
+
+/* Buffers for a tree of degree t; reallocated when t changes */
+static void BPTree_buffers(int t, struct Node **a, struct Node **b, struct Node **c) {
+    int i;
+    if (g_buf_t != t) {
+        BPTree_buffers_free();
+        for (i = 0; i < BPT_BUFFERS; ++i) { g_buf[i] = BPTree_node_mem(t); }
+        g_buf_t = t;
+    }
+    *a = g_buf[0]; if (b != NULL) { *b = g_buf[1]; } if (c != NULL) { *c = g_buf[2]; }
+}
+
+static void BPTree_read(struct Storage *st, int addr, struct Node *x) {
+    Storage_read(st, addr, x);
+    if (x->leaf != BPT_LEAF && x->leaf != BPT_INNER) { fprintf(stderr, "BTree Error: Page %d is not a B+tree page (kind %d).\n", addr, x->leaf); exit(EXIT_FAILURE); }
+}
+
+static void BPTree_write(struct Storage *st, int addr, const struct Node *x) { Storage_write(st, addr, x); }
+
+/* First i with key[i] >= k */
+static int BPTree_lower(const int *key, int n, int k) {
+    int lo = 0; int hi = n; int mid;
+    while (lo < hi) { mid = (lo + hi) / 2; if (key[mid] < k) { lo = mid + 1; } else { hi = mid; } }
+    return lo;
+}
+
+/* First i with key[i] > k: the child of an inner page covering k */
+static int BPTree_upper(const int *key, int n, int k) {
+    int lo = 0; int hi = n; int mid;
+    while (lo < hi) { mid = (lo + hi) / 2; if (key[mid] <= k) { lo = mid + 1; } else { hi = mid; } }
+    return lo;
+}
+
+/* Inserts separator sep and right child addr at position i of inner page x */
+static void BPTree_insert_separator(int cap, struct Node *x, int i, int sep, int addr) {
+    int *c = BPTree_children(x, cap);
+    memmove(&x->key[i + 1], &x->key[i], (x->n - i) * sizeof(int));
+    memmove(&c[i + 2], &c[i + 1], (x->n - i) * sizeof(int));
+    x->key[i] = sep; c[i + 1] = addr; x->n++;
+}
+
+/* Removes separator i and its right child from inner page x */
+static void BPTree_remove_separator(int cap, struct Node *x, int i) {
+    int *c = BPTree_children(x, cap);
+    memmove(&x->key[i], &x->key[i + 1], (x->n - i - 1) * sizeof(int));
+    memmove(&c[i + 1], &c[i + 2], (x->n - i - 1) * sizeof(int));
+    x->n--;
+}
+
+/* Splits the full child *y (c[i] of x) with a new right sibling. A leaf */
+/* copies its first upper key into x; an inner page moves its median up. */
+/* *y is left holding the half k belongs to (still to be written), the */
+/* other half is written and its buffer handed back in *z. */
+static void BPTree_split_child(struct Storage *st, int t, struct Node *x, int i, struct Node **y, int *addr_y, struct Node **z, int k) {
+    int cap = BPTree_cap(t); int m = cap / 2; int sep; int addr_z;
+    struct Node *a = *y; struct Node *b = *z;
+    addr_z = Storage_alloc(st); b->leaf = a->leaf;
+    if (a->leaf == BPT_LEAF) {
+        b->n = cap - m;
+        memcpy(b->key, a->key + m, b->n * sizeof(int));
+        memcpy(BPTree_values(b, cap), BPTree_values(a, cap) + m, b->n * sizeof(int));
+        *BPTree_next(b, cap) = *BPTree_next(a, cap); *BPTree_next(a, cap) = addr_z;
+        sep = b->key[0];
+    } else {
+        sep = a->key[m]; b->n = cap - m - 1;
+        memcpy(b->key, a->key + m + 1, b->n * sizeof(int));
+        memcpy(BPTree_children(b, cap), BPTree_children(a, cap) + m + 1, (b->n + 1) * sizeof(int));
+    }
+    a->n = m;
+    BPTree_insert_separator(cap, x, i, sep, addr_z);
+    if (k >= sep) { BPTree_write(st, *addr_y, a); *y = b; *z = a; *addr_y = addr_z; }
+    else { BPTree_write(st, addr_z, b); }
+}
+
+/* Appends right (c[j+1] of x) to left (c[j]) and frees right's page */
+static void BPTree_merge(struct Storage *st, int cap, struct Node *x, int j, struct Node *left, struct Node *right, int addr_right) {
+    if (left->leaf == BPT_LEAF) {
+        memcpy(left->key + left->n, right->key, right->n * sizeof(int));
+        memcpy(BPTree_values(left, cap) + left->n, BPTree_values(right, cap), right->n * sizeof(int));
+        left->n += right->n; *BPTree_next(left, cap) = *BPTree_next(right, cap);
+    } else {
+        left->key[left->n] = x->key[j];
+        memcpy(left->key + left->n + 1, right->key, right->n * sizeof(int));
+        memcpy(BPTree_children(left, cap) + left->n + 1, BPTree_children(right, cap), (right->n + 1) * sizeof(int));
+        left->n += right->n + 1;
+    }
+    BPTree_remove_separator(cap, x, j);
+    Storage_free(st, addr_right);
+}
+
+/* Gives the child *y (c[*i] of x, at most min keys) one more key: a key */
+/* borrowed from a sibling, or a merge with one. After a merge into the */
+/* left sibling, *y, *addr_y and *i refer to it. s is a spare buffer. */
+static void BPTree_fill_child(struct Storage *st, int t, struct Node *x, int *i, struct Node **y, int *addr_y, struct Node **s) {
+    int cap = BPTree_cap(t); int min = BPTree_min(t); int addr_s = NULL_ADDR; struct Node *a = *y; struct Node *b = *s;
+    int *ac = BPTree_children(a, cap); int *bc = BPTree_children(b, cap); int *av = BPTree_values(a, cap); int *bv = BPTree_values(b, cap);
+    if (*i > 0) {
+        addr_s = BPTree_children(x, cap)[*i - 1]; BPTree_read(st, addr_s, b);
+        if (b->n > min) { /* Borrow the left sibling's last key */
+            memmove(&a->key[1], &a->key[0], a->n * sizeof(int));
+            if (a->leaf == BPT_LEAF) {
+                memmove(&av[1], &av[0], a->n * sizeof(int));
+                a->key[0] = b->key[b->n - 1]; av[0] = bv[b->n - 1]; x->key[*i - 1] = a->key[0];
+            } else {
+                memmove(&ac[1], &ac[0], (a->n + 1) * sizeof(int));
+                a->key[0] = x->key[*i - 1]; ac[0] = bc[b->n]; x->key[*i - 1] = b->key[b->n - 1];
+            }
+            a->n++; b->n--; BPTree_write(st, addr_s, b); return;
+        }
+    }
+    if (*i < x->n) {
+        addr_s = BPTree_children(x, cap)[*i + 1]; BPTree_read(st, addr_s, b);
+        if (b->n > min) { /* Borrow the right sibling's first key */
+            if (a->leaf == BPT_LEAF) {
+                a->key[a->n] = b->key[0]; av[a->n] = bv[0];
+                memmove(&bv[0], &bv[1], (b->n - 1) * sizeof(int));
+            } else {
+                a->key[a->n] = x->key[*i]; ac[a->n + 1] = bc[0];
+                memmove(&bc[0], &bc[1], b->n * sizeof(int));
+            }
+            x->key[*i] = a->leaf == BPT_LEAF ? b->key[1] : b->key[0];
+            memmove(&b->key[0], &b->key[1], (b->n - 1) * sizeof(int));
+            a->n++; b->n--; BPTree_write(st, addr_s, b); return;
+        }
+        BPTree_merge(st, cap, x, *i, a, b, addr_s); /* Merge with the right sibling */
+        return;
+    }
+    BPTree_merge(st, cap, x, *i - 1, b, a, *addr_y); /* Merge into the left sibling (still in b) */
+    *y = b; *s = a; *addr_y = addr_s; (*i)--;
+}
+
+
+/* --- Public API Implementation --- */
+
+/* BPTree_open: Opens or creates a B+tree file. As with BTree_open, t_user */
+/* applies only to a new file and 0 picks the largest t whose page fits. */
+struct BPTree BPTree_open(const char *name, int t_user) {
+    struct BPTree bt; struct Storage *st; struct Node *x;
+    bt.store = st = Storage_open(name, t_user);
+    bt.t = Storage_get_t(st); bt.root = 0;
+    x = BPTree_node_mem(bt.t);
+    if (Storage_empty(st)) {
+        if (Storage_alloc(st) != 0) { fprintf(stderr, "BTree Error: Initial root alloc not addr 0.\n"); Storage_close(st); exit(EXIT_FAILURE); }
+        *BPTree_next(x, BPTree_cap(bt.t)) = NULL_ADDR;
+        BPTree_write(st, 0, x);
+        Storage_commit(st); /* A new file is durable before the first operation */
+    } else {
+        Storage_read(st, 0, x);
+        if (x->leaf != BPT_LEAF && x->leaf != BPT_INNER) { fprintf(stderr, "BTree Error: %s does not hold a B+tree (open it with BTree_open).\n", name); Storage_close(st); exit(EXIT_FAILURE); }
+    }
+    free(x); return bt;
+}
+
+void BPTree_close(struct BPTree *bt) {
+    Storage_close(bt->store);
+    BPTree_buffers_free();
+    bt->root = -1; bt->t = 0; bt->store = NULL;
+}
+
+/* BPTree_sync: Makes every completed operation durable (see BTree_sync) */
+void BPTree_sync(const struct BPTree *bt) { assert(bt != NULL && bt->t >= 2); Storage_commit(bt->store); }
+
+/* BPTree_get: Sets *v if k is present (left untouched otherwise) */
+void BPTree_get(const struct BPTree *bt, int k, int *v) {
+    struct Node *x; struct Storage *st; int cap; int addr; int i;
+    assert(bt != NULL); assert(v != NULL); assert(bt->t >= 2);
+    st = bt->store; cap = BPTree_cap(bt->t);
+    BPTree_buffers(bt->t, &x, NULL, NULL); addr = bt->root;
+    for (;;) {
+        BPTree_read(st, addr, x);
+        if (x->leaf == BPT_LEAF) { break; }
+        addr = BPTree_children(x, cap)[BPTree_upper(x->key, x->n, k)];
+    }
+    i = BPTree_lower(x->key, x->n, k);
+    if (i < x->n && x->key[i] == k) { *v = BPTree_values(x, cap)[i]; }
+}
+
+/* BPTree_put: Inserts or updates k in a single descent. A full root */
+/* moves to a new page below a fresh root, so the root address is fixed. */
+void BPTree_put(const struct BPTree *bt, int k, int v) {
+    struct Node *x; struct Node *y; struct Node *z; struct Node *tmp; struct Storage *st; int cap; int addr_x; int addr_y; int x_dirty = 0; int y_dirty; int i;
+    assert(bt != NULL); assert(bt->t >= 2);
+    st = bt->store; Storage_op_begin(st); cap = BPTree_cap(bt->t);
+    BPTree_buffers(bt->t, &x, &y, &z);
+    addr_x = bt->root; BPTree_read(st, addr_x, x);
+    if (x->n == cap) { /* Root full: its contents become the only child */
+        addr_y = Storage_alloc(st);
+        y->n = x->n; y->leaf = x->leaf; memcpy(y->key, x->key, (size_t)(6 * bt->t - 2) * sizeof(int));
+        x->leaf = BPT_INNER; x->n = 0; BPTree_children(x, cap)[0] = addr_y;
+        BPTree_split_child(st, bt->t, x, 0, &y, &addr_y, &z, k);
+        BPTree_write(st, addr_x, x);
+        tmp = x; x = y; y = tmp; addr_x = addr_y; x_dirty = 1;
+    }
+    while (x->leaf == BPT_INNER) {
+        i = BPTree_upper(x->key, x->n, k); addr_y = BPTree_children(x, cap)[i];
+        BPTree_read(st, addr_y, y); y_dirty = 0;
+        if (y->n == cap) { BPTree_split_child(st, bt->t, x, i, &y, &addr_y, &z, k); x_dirty = 1; y_dirty = 1; }
+        if (x_dirty) { BPTree_write(st, addr_x, x); }
+        tmp = x; x = y; y = tmp; addr_x = addr_y; x_dirty = y_dirty;
+    }
+    i = BPTree_lower(x->key, x->n, k);
+    if (i < x->n && x->key[i] == k) { BPTree_values(x, cap)[i] = v; }
+    else { /* x is not full: full pages were split on the way down */
+        memmove(&x->key[i + 1], &x->key[i], (x->n - i) * sizeof(int));
+        memmove(&BPTree_values(x, cap)[i + 1], &BPTree_values(x, cap)[i], (x->n - i) * sizeof(int));
+        x->key[i] = k; BPTree_values(x, cap)[i] = v; x->n++;
+    }
+    BPTree_write(st, addr_x, x);
+    Storage_op_end(st);
+}
+
+/* BPTree_delete: Removes k if present, in a single descent. Thin pages */
+/* are topped up on the way down; an emptied root takes in its only child. */
+void BPTree_delete(struct BPTree *bt, int k) {
+    struct Node *x; struct Node *y; struct Node *s; struct Node *tmp; struct Storage *st; int cap; int addr_x; int addr_y; int x_dirty = 0; int y_dirty; int i;
+    assert(bt != NULL); assert(bt->t >= 2);
+    st = bt->store; Storage_op_begin(st); cap = BPTree_cap(bt->t);
+    BPTree_buffers(bt->t, &x, &y, &s);
+    addr_x = bt->root; BPTree_read(st, addr_x, x);
+    while (x->leaf == BPT_INNER) {
+        i = BPTree_upper(x->key, x->n, k); addr_y = BPTree_children(x, cap)[i];
+        BPTree_read(st, addr_y, y); y_dirty = 0;
+        if (y->n <= BPTree_min(bt->t)) { BPTree_fill_child(st, bt->t, x, &i, &y, &addr_y, &s); x_dirty = 1; y_dirty = 1; }
+        if (addr_x == bt->root && x->n == 0) { /* Root collapse: y moves to the root address */
+            Storage_free(st, addr_y); addr_y = bt->root; y_dirty = 1;
+        } else if (x_dirty) { BPTree_write(st, addr_x, x); }
+        tmp = x; x = y; y = tmp; addr_x = addr_y; x_dirty = y_dirty;
+    }
+    i = BPTree_lower(x->key, x->n, k);
+    if (i < x->n && x->key[i] == k) {
+        memmove(&x->key[i], &x->key[i + 1], (x->n - i - 1) * sizeof(int));
+        memmove(&BPTree_values(x, cap)[i], &BPTree_values(x, cap)[i + 1], (x->n - i - 1) * sizeof(int));
+        x->n--; x_dirty = 1;
+    }
+    if (x_dirty) { BPTree_write(st, addr_x, x); }
+    Storage_op_end(st);
+}
+
+/* BPTree_scan: Calls cb(k, v, ctx) for every key in [lo, hi] in order, */
+/* descending once to lo and then following the leaf chain. A nonzero */
+/* return from cb stops the scan. Returns the number of calls. */
+int BPTree_scan(const struct BPTree *bt, int lo, int hi, int (*cb)(int k, int v, void *ctx), void *ctx) {
+    struct Node *x; struct Storage *st; int cap; int addr; int i; int count = 0;
+    assert(bt != NULL); assert(cb != NULL);
+    if (lo > hi) { return 0; }
+    st = bt->store; cap = BPTree_cap(bt->t);
+    x = BPTree_node_mem(bt->t); addr = bt->root; /* Own buffer: cb may use the tree */
+    for (;;) {
+        BPTree_read(st, addr, x);
+        if (x->leaf == BPT_LEAF) { break; }
+        addr = BPTree_children(x, cap)[BPTree_upper(x->key, x->n, lo)];
+    }
+    i = BPTree_lower(x->key, x->n, lo);
+    for (;;) {
+        for (; i < x->n; ++i) {
+            if (x->key[i] > hi) { free(x); return count; }
+            count++;
+            if (cb(x->key[i], BPTree_values(x, cap)[i], ctx)) { free(x); return count; }
+        }
+        addr = *BPTree_next(x, cap);
+        if (addr == NULL_ADDR) { break; }
+        BPTree_read(st, addr, x); i = 0;
+    }
+    free(x); return count;
+}
@@ -3,70 +3,231 @@
 #include <string.h> /* For memmove, memcpy */
 #include <limits.h> /* For INT_MIN/MAX */
 #include <assert.h> /* For assert */
+#if defined(__AVX2__)
+#include <immintrin.h> /* AVX2 intra-node key search */
+#elif defined(__SSE2__)
+#include <emmintrin.h> /* SSE2 intra-node key search */
+#endif
 
 /* Required Struct Definitions */
 struct Node { int n; int leaf; int *key; int *value; int *c; };
-struct BTree { int root; int t; };
+struct BTree { int root; int t; struct Storage *store; };
 
 /* Required Prototypes from storage.c */
-void          Storage_open (const char *fname, int t);
-void          Storage_close(void);
-int           Storage_empty(void);
-int           Storage_alloc(void);
-void          Storage_read (int addr, struct Node *x);
-void          Storage_write(int addr, const struct Node *x);
-unsigned long Storage_get_read_count(void);
-unsigned long Storage_get_write_count(void);
-unsigned long Storage_get_alloc_count(void);
-int           Storage_get_t(void);
+struct Storage* Storage_open(const char *fname, int t);
+void          Storage_close(struct Storage *st);
+int           Storage_empty(struct Storage *st);
+int           Storage_alloc(struct Storage *st);
+void          Storage_read (struct Storage *st, int addr, struct Node *x);
+void          Storage_write(struct Storage *st, int addr, const struct Node *x);
+void          Storage_free (struct Storage *st, int addr);
+void          Storage_truncate(struct Storage *st, int count);
+int           Storage_get_node_count(struct Storage *st);
+unsigned long Storage_get_read_count(const struct Storage *st);
+unsigned long Storage_get_write_count(const struct Storage *st);
+unsigned long Storage_get_alloc_count(const struct Storage *st);
+int           Storage_get_t(struct Storage *st);
+int           Storage_pin  (struct Storage *st, int addr, struct Node *view);
+void          Storage_unpin(struct Storage *st, int addr, const struct Node *view, int dirty);
+void          Storage_op_begin(struct Storage *st);
+void          Storage_op_end(struct Storage *st);
+void          Storage_commit(struct Storage *st);
+int           Storage_snapshot_open(struct Storage *st);
+void          Storage_snapshot_close(struct Storage *st, int id);
+int           Storage_set_view(struct Storage *st, int id);
+void          Storage_latch(struct Storage *st, int addr, int exclusive);
+void          Storage_unlatch(struct Storage *st, int addr);
+int           Storage_get_prefetch_depth(struct Storage *st);
+void          Storage_prefetch(struct Storage *st, const int *addrs, int n);
+int           Storage_get_bloom_bits(struct Storage *st);
+int           Storage_bloom_needs_rebuild(struct Storage *st);
+int           Storage_bloom_reset(struct Storage *st, int nkeys);
+void          Storage_bloom_add(struct Storage *st, int key);
+int           Storage_bloom_may_contain(struct Storage *st, int key);
 
 /* --- Constants --- */
 /* Sentinel for unused key/value slots */
 #define SENTINEL_VALUE ((int)0xDEADBEEF)
-/* Sentinel value for marking a key as deleted */
+/* Tombstone value written by older versions of BTree_delete; still honoured on read */
 #define DELETION_SENTINEL ((int)0xDEADDEAD)
 /* Sentinel for invalid/unused child address pointers */
 #define NULL_ADDR (-1)
 
 /* --- Internal Helper Functions --- */
 
-/* Allocate memory for a Node structure AND its internal arrays */
+/* --- Node Buffers --- */
+/* A node buffer is one block: the struct, then key[cap], value[cap] and */
+/* c[cap+1]. Regular buffers (cap = 2t-1 for the open tree's t) go back */
+/* on a small per-thread free stack instead of to malloc; wider ones are freed. */
+#define NODE_POOL_MAX 64
+struct NodeBlock { struct Node node; struct NodeBlock *next; int cap; };
+static __thread struct { int t; int count; struct NodeBlock *head; } g_nodes = { 0, 0, NULL };
+
+static void BTree_node_pool_drain(void) {
+    struct NodeBlock *b;
+    while (g_nodes.head != NULL) { b = g_nodes.head; g_nodes.head = b->next; free(b); }
+    g_nodes.count = 0;
+}
+
+/* Node buffer holding at least cap keys; contents are unspecified */
+static struct Node* BTree_node_buffer(int t, int cap) {
+    struct NodeBlock *b;
+    if (t != g_nodes.t) { BTree_node_pool_drain(); g_nodes.t = t; }
+    if (cap == 2 * t - 1 && g_nodes.head != NULL) {
+        b = g_nodes.head; g_nodes.head = b->next; g_nodes.count--;
+        return &b->node;
+    }
+    b = malloc(sizeof(struct NodeBlock) + (3 * (size_t)cap + 1) * sizeof(int));
+    if (!b) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    b->cap = cap; b->next = NULL;
+    b->node.key = (int *)(b + 1); b->node.value = b->node.key + cap; b->node.c = b->node.value + cap;
+    return &b->node;
+}
+
+/* Allocate a node buffer with every slot set to its sentinel */
 static struct Node* BTree_allocate_node_mem(int t) {
     struct Node *x = NULL; int max_keys; int max_children; int i;
     assert(t >= 2); max_keys = 2 * t - 1; max_children = 2 * t;
-    x = malloc(sizeof(struct Node));
-    if (!x) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
-    x->key = malloc(max_keys * sizeof(int));
-    x->value = malloc(max_keys * sizeof(int));
-    x->c = malloc(max_children * sizeof(int));
-    if (!x->key || !x->value || !x->c) {
-        perror("BTree Memory Error"); free(x->key); free(x->value); free(x->c); free(x); exit(EXIT_FAILURE); }
+    x = BTree_node_buffer(t, max_keys);
     for (i = 0; i < max_keys; ++i) { x->key[i] = SENTINEL_VALUE; x->value[i] = SENTINEL_VALUE; }
     for (i = 0; i < max_children; ++i) { x->c[i] = NULL_ADDR; } /* Use NULL_ADDR */
     x->n = 0; x->leaf = 1; return x;
 }
 
 static void BTree_free_node_mem(struct Node *x) {
-    if (x) { free(x->key); free(x->value); free(x->c); free(x); }
+    struct NodeBlock *b = (struct NodeBlock *)x; /* node is the first member */
+    if (!x) { return; }
+    if (b->cap == 2 * g_nodes.t - 1 && g_nodes.count < NODE_POOL_MAX) {
+        b->next = g_nodes.head; g_nodes.head = b; g_nodes.count++;
+    } else { free(b); }
 }
 
-static struct Node* BTree_disk_read(int t, int addr) {
-    struct Node *x = BTree_allocate_node_mem(t);
-    Storage_read(addr, x); return x;
+/* Storage_read overwrites every slot, so the buffer is not pre-filled */
+static struct Node* BTree_disk_read(struct Storage *st, int t, int addr) {
+    struct Node *x = BTree_node_buffer(t, 2 * t - 1);
+    Storage_read(st, addr, x); return x;
 }
 
-static void BTree_disk_write(int addr, const struct Node *x) {
-    Storage_write(addr, x);
+/* Read-only access: views the node in place (buffer pool frame or mmap) */
+/* when storage allows it, otherwise reads a private copy. */
+/* Release with BTree_release_view; do not modify or write the result. */
+static struct Node* BTree_disk_view(struct Storage *st, int t, int addr, struct Node *view) {
+    if (Storage_pin(st, addr, view)) { return view; }
+    return BTree_disk_read(st, t, addr);
 }
 
+static void BTree_release_view(struct Storage *st, int addr, struct Node *x, struct Node *view) {
+    if (x == view) { Storage_unpin(st, addr, view, 0); } else { BTree_free_node_mem(x); }
+}
+
+static void BTree_disk_write(struct Storage *st, int addr, const struct Node *x) {
+    Storage_write(st, addr, x);
+}
+
+/* --- Latch Coupling --- */
+/* Node latches (Storage_latch) let threads share a tree. Every descent */
+/* starts at the root, whose address never changes, and latches a child */
+/* before letting go of its parent, so latches are taken top-down only */
+/* and cannot deadlock. Readers hold shared latches on at most a parent */
+/* and child. Writers hold exclusive ones; since full children are split */
+/* (and thin ones topped up) on the way down, a parent cannot change */
+/* again once the child is known not to split and is released then. */
+#define LATCH_SHARED    0
+#define LATCH_EXCLUSIVE 1
+
+static void BTree_latch(struct Storage *st, int addr, int mode) { Storage_latch(st, addr, mode); }
+static void BTree_unlatch(struct Storage *st, int addr) { Storage_unlatch(st, addr); }
+
+
+/* --- Intra-Node Key Search --- */
+/* Every kernel returns the first slot i of keys[0..n) with keys[i] >= k */
+/* (n if all keys are smaller). The counting kernel compares all n keys */
+/* without branching, 8 or 4 at a time when built with AVX2 or SSE2. The */
+/* binary kernel halves the range with a conditional move instead of a */
+/* branch. BTree_find_slot halves until BTREE_SEARCH_COUNT_MAX keys remain */
+/* and counts the rest, so small nodes never take the binary path. */
+#define BTREE_SEARCH_AUTO   0
+#define BTREE_SEARCH_LINEAR 1
+#define BTREE_SEARCH_COUNT  2
+#define BTREE_SEARCH_BINARY 3
+/* Node sizes up to which counting beats halving (measured with bench_search) */
+#if defined(__AVX2__)
+#define BTREE_SEARCH_COUNT_MAX 32
+#elif defined(__SSE2__)
+#define BTREE_SEARCH_COUNT_MAX 16
+#else
+#define BTREE_SEARCH_COUNT_MAX 8
+#endif
+
+static int BTree_search_linear(const int *keys, int n, int k) {
+    int i = 0;
+    while (i < n && k > keys[i]) { i++; }
+    return i;
+}
+
+/* Number of keys below k; equals the slot because keys are sorted */
+static int BTree_search_count(const int *keys, int n, int k) {
+    int i = 0; int cnt = 0;
+#if defined(__AVX2__)
+    __m256i kv = _mm256_set1_epi32(k); __m256i acc = _mm256_setzero_si256(); int lanes[8];
+    for (; i + 8 <= n; i += 8) { acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(kv, _mm256_loadu_si256((const __m256i *)(keys + i)))); }
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    cnt = lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+#elif defined(__SSE2__)
+    __m128i kv = _mm_set1_epi32(k); __m128i acc = _mm_setzero_si128(); int lanes[4];
+    for (; i + 4 <= n; i += 4) { acc = _mm_sub_epi32(acc, _mm_cmplt_epi32(_mm_loadu_si128((const __m128i *)(keys + i)), kv)); }
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    cnt = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < n; ++i) { cnt += keys[i] < k; }
+    return cnt;
+}
+
+/* Halves [base, base+n) while more than limit keys remain, then counts */
+static int BTree_search_narrow(const int *keys, int n, int k, int limit) {
+    const int *base = keys; int half;
+    while (n > limit) {
+        half = n / 2;
+        base = (base[half] < k) ? base + half : base;
+        n -= half;
+    }
+    return (int)(base - keys) + BTree_search_count(base, n, k);
+}
+
+static int BTree_find_slot(const int *keys, int n, int k) {
+    return BTree_search_narrow(keys, n, k, BTREE_SEARCH_COUNT_MAX);
+}
+
+/* BTree_search_kernel: Runs one search kernel (BTREE_SEARCH_*) on a sorted */
+/* key array. Exposed for the tests and bench_search. */
+int BTree_search_kernel(int kernel, const int *keys, int n, int k) {
+    switch (kernel) {
+    case BTREE_SEARCH_LINEAR: return BTree_search_linear(keys, n, k);
+    case BTREE_SEARCH_COUNT:  return BTree_search_count(keys, n, k);
+    case BTREE_SEARCH_BINARY: return BTree_search_narrow(keys, n, k, 1);
+    default:                  return BTree_find_slot(keys, n, k);
+    }
+}
+
+/* Instruction set the counting kernel was built for */
+const char* BTree_search_isa(void) {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
 
 /* --- CLRS Algorithm Implementations (ANSI C, Single-Node Buffer) --- */
 
-/* Internal search: checks for DELETION_SENTINEL */
-static int BTree_search_internal(int t, int addr, int k, int *v_out) {
-    struct Node *x = NULL; int found = 0; int i = 0; int child_addr;
-    x = BTree_disk_read(t, addr);
-    while (i < x->n && k > x->key[i]) { i++; }
+/* Internal search: checks for DELETION_SENTINEL. The caller holds a */
+/* shared latch on addr; it is released before returning. */
+static int BTree_search_internal(struct Storage *st, int t, int addr, int k, int *v_out) {
+    struct Node *x = NULL; struct Node view; int found = 0; int i = 0; int child_addr;
+    x = BTree_disk_view(st, t, addr, &view);
+    i = BTree_find_slot(x->key, x->n, k);
     if (i < x->n && k == x->key[i]) {
         if (x->value[i] != DELETION_SENTINEL) {
             *v_out = x->value[i]; found = 1;
@@ -74,285 +235,941 @@ static int BTree_search_internal(int t, int addr, int k, int *v_out) {
     } else if (x->leaf) { found = 0; }
     else { /* Not found or deleted, recurse */
         child_addr = x->c[i];
-        BTree_free_node_mem(x); x = NULL; /* Free BEFORE recursion */
         if (child_addr == NULL_ADDR) { /* Use NULL_ADDR */
              fprintf(stderr, "BTree Error: Invalid child address during search (addr=%d, i=%d).\n", addr, i); exit(EXIT_FAILURE);
         }
-        return BTree_search_internal(t, child_addr, k, v_out);
+        BTree_latch(st, child_addr, LATCH_SHARED);
+        BTree_release_view(st, addr, x, &view); BTree_unlatch(st, addr); /* Release BEFORE recursion */
+        return BTree_search_internal(st, t, child_addr, k, v_out);
     }
-    if (x != NULL) { BTree_free_node_mem(x); } return found;
+    BTree_release_view(st, addr, x, &view); BTree_unlatch(st, addr); return found;
 }
 
 
-/* Internal mark-deleted */
-static int BTree_search_and_mark_deleted_internal(int t, int addr, int k) {
-    struct Node *x = NULL; int marked = 0; int i = 0; int child_addr;
-    x = BTree_disk_read(t, addr);
-    while (i < x->n && k > x->key[i]) { i++; }
-    if (i < x->n && k == x->key[i]) {
-        if (x->value[i] != DELETION_SENTINEL) {
-            x->value[i] = DELETION_SENTINEL; BTree_disk_write(addr, x); marked = 1;
-        } else { marked = 0; /* Already marked */ }
-    } else if (x->leaf) { marked = 0; }
-    else { /* Not found or already marked, recurse */
-        child_addr = x->c[i];
-        BTree_free_node_mem(x); x = NULL; /* Free BEFORE recursion */
-        if (child_addr == NULL_ADDR) { /* Use NULL_ADDR */
-             fprintf(stderr, "BTree Error: Invalid child address during delete search (addr=%d, i=%d).\n", addr, i); exit(EXIT_FAILURE);
-        }
-        return BTree_search_and_mark_deleted_internal(t, child_addr, k);
+/* --- Deletion (CLRS B-TREE-DELETE, single top-down pass) --- */
+/* Every child entered has at least t keys (borrowing from a sibling or */
+/* merging first), so a removal never propagates back up. Pages emptied */
+/* by a merge or a root collapse are released with Storage_free. */
+
+/* What the descent is looking for below the current node */
+#define DEL_FIND 0 /* The key itself */
+#define DEL_MAX  1 /* Largest key of the subtree (predecessor, case 2a) */
+#define DEL_MIN  2 /* Smallest key of the subtree (successor, case 2b) */
+
+/* Removes key/value i from x and, for internal nodes, child i+1 */
+static void BTree_remove_slot(struct Node *x, int i) {
+    memmove(&x->key[i], &x->key[i + 1], (x->n - i - 1) * sizeof(int));
+    memmove(&x->value[i], &x->value[i + 1], (x->n - i - 1) * sizeof(int));
+    if (!x->leaf) { memmove(&x->c[i + 1], &x->c[i + 2], (x->n - i - 1) * sizeof(int)); x->c[x->n] = NULL_ADDR; }
+    x->n--;
+    x->key[x->n] = SENTINEL_VALUE; x->value[x->n] = SENTINEL_VALUE;
+}
+
+/* Merges y = x->c[i], x->key[i] and z = x->c[i+1] into y; frees z */
+static void BTree_merge_children(struct Storage *st, struct Node *x, int i, struct Node *y, int addr_z, struct Node *z) {
+    y->key[y->n] = x->key[i]; y->value[y->n] = x->value[i];
+    memcpy(&y->key[y->n + 1], z->key, z->n * sizeof(int));
+    memcpy(&y->value[y->n + 1], z->value, z->n * sizeof(int));
+    if (!y->leaf) { memcpy(&y->c[y->n + 1], z->c, (z->n + 1) * sizeof(int)); }
+    y->n = y->n + 1 + z->n;
+    BTree_remove_slot(x, i);
+    BTree_free_node_mem(z); Storage_free(st, addr_z);
+}
+
+/* y = x->c[i] borrows x->key[i-1] and its left sibling's last key/child */
+static void BTree_rotate_from_left(struct Node *x, int i, struct Node *y, struct Node *l) {
+    memmove(&y->key[1], &y->key[0], y->n * sizeof(int));
+    memmove(&y->value[1], &y->value[0], y->n * sizeof(int));
+    if (!y->leaf) { memmove(&y->c[1], &y->c[0], (y->n + 1) * sizeof(int)); y->c[0] = l->c[l->n]; l->c[l->n] = NULL_ADDR; }
+    y->key[0] = x->key[i - 1]; y->value[0] = x->value[i - 1]; y->n++;
+    x->key[i - 1] = l->key[l->n - 1]; x->value[i - 1] = l->value[l->n - 1];
+    l->n--; l->key[l->n] = SENTINEL_VALUE; l->value[l->n] = SENTINEL_VALUE;
+}
+
+/* y = x->c[i] borrows x->key[i] and its right sibling's first key/child */
+static void BTree_rotate_from_right(struct Node *x, int i, struct Node *y, struct Node *r) {
+    y->key[y->n] = x->key[i]; y->value[y->n] = x->value[i];
+    if (!y->leaf) { y->c[y->n + 1] = r->c[0]; memmove(&r->c[0], &r->c[1], r->n * sizeof(int)); r->c[r->n] = NULL_ADDR; }
+    y->n++;
+    x->key[i] = r->key[0]; x->value[i] = r->value[0];
+    memmove(&r->key[0], &r->key[1], (r->n - 1) * sizeof(int));
+    memmove(&r->value[0], &r->value[1], (r->n - 1) * sizeof(int));
+    r->n--; r->key[r->n] = SENTINEL_VALUE; r->value[r->n] = SENTINEL_VALUE;
+}
+
+/* Ensures the child c[*i] of x (read into *y) has at least t keys. */
+/* After a merge with the left sibling, y, addr_y and i refer to it. */
+/* x and y are latched exclusively; siblings are latched while used. */
+static void BTree_fill_child(struct Storage *st, int t, struct Node *x, int *i, struct Node **y, int *addr_y) {
+    struct Node *l = NULL; struct Node *r = NULL; int addr_l = NULL_ADDR; int addr_r = NULL_ADDR;
+    if (*i > 0) {
+        addr_l = x->c[*i - 1]; BTree_latch(st, addr_l, LATCH_EXCLUSIVE); l = BTree_disk_read(st, t, addr_l);
+        if (l->n >= t) { BTree_rotate_from_left(x, *i, *y, l); BTree_disk_write(st, addr_l, l); BTree_free_node_mem(l); BTree_unlatch(st, addr_l); return; }
     }
-    if (x != NULL) { BTree_free_node_mem(x); } return marked;
-}
-
-/* B-TREE-SPLIT-CHILD (Strict Memory Budget Version) */
-static void BTree_split_child(int t, int addr_x, int i) {
-    /* --- Declarations (ANSI C) --- */
-    struct Node *y = NULL; /* Only node buffer needed temporarily */
-    int addr_y;
-    int addr_z;
-    int median_key, median_val;
-    int t_minus_1;
-    /* Stack buffers for temporary storage */
-    int *z_keys = NULL;
-    int *z_values = NULL;
-    int *z_children = NULL; /* Only if internal node */
-    int j;
-    int y_is_leaf;
-
-    /* --- Code --- */
-    t_minus_1 = t - 1;
-
-    /* 1. Read child node y */
-    /* (Assume parent x is NOT in memory yet) */
-    /* First, we need the parent temporarily just to get addr_y */
-    {
-        struct Node *temp_x = BTree_disk_read(t, addr_x);
-        addr_y = temp_x->c[i];
-        BTree_free_node_mem(temp_x); /* Free parent immediately */
+    if (*i < x->n) {
+        addr_r = x->c[*i + 1]; BTree_latch(st, addr_r, LATCH_EXCLUSIVE); r = BTree_disk_read(st, t, addr_r);
+        if (r->n >= t) {
+            BTree_rotate_from_right(x, *i, *y, r); BTree_disk_write(st, addr_r, r); BTree_free_node_mem(r); BTree_unlatch(st, addr_r);
+            if (l != NULL) { BTree_free_node_mem(l); BTree_unlatch(st, addr_l); }
+            return;
+        }
     }
-    if (addr_y == NULL_ADDR) { fprintf(stderr, "BTree Error: Invalid child address in parent (addr_x=%d, i=%d) before split.\n", addr_x, i); exit(EXIT_FAILURE); }
-
-    y = BTree_disk_read(t, addr_y); /* Read child */
-
-    /* Sanity check y */
-    if (y->n != 2 * t - 1) { fprintf(stderr, "BTree Internal Error: Attempted to split non-full node y (addr=%d, n=%d, t=%d)\n", addr_y, y->n, t); BTree_free_node_mem(y); exit(EXIT_FAILURE); }
-    y_is_leaf = y->leaf; /* Store leaf status before modifying y */
-
-    /* 2. Allocate stack buffers (careful with size for large t!) */
-    /* Note: Large t might cause stack overflow here. A heap buffer might */
-    /* be needed if t is very large, slightly bending the rules. */
-    /* Assume t is reasonable for stack allocation here. */
-    z_keys = malloc(t_minus_1 * sizeof(int));
-    z_values = malloc(t_minus_1 * sizeof(int));
-    if (!y_is_leaf) { z_children = malloc(t * sizeof(int)); }
-    if (!z_keys || !z_values || (!y_is_leaf && !z_children)) {
-        perror("BTree Memory Error: Failed to allocate stack buffers for split");
-        free(z_keys); free(z_values); free(z_children); BTree_free_node_mem(y); exit(EXIT_FAILURE);
+    if (r != NULL) { /* Merge with the right sibling */
+        BTree_merge_children(st, x, *i, *y, addr_r, r); BTree_unlatch(st, addr_r);
+        if (l != NULL) { BTree_free_node_mem(l); BTree_unlatch(st, addr_l); }
+    } else { /* Merge into the left sibling */
+        BTree_merge_children(st, x, *i - 1, l, *addr_y, *y); BTree_unlatch(st, *addr_y);
+        *y = l; *addr_y = addr_l; (*i)--;
     }
+}
+
+/* Deletes k from the tree rooted at root_addr. Returns 1 if it was present. */
+/* The caller holds an exclusive latch on the root; every latch taken is */
+/* released before returning. Only x, its child and (for cases 2a/2b) the */
+/* node waiting for the predecessor or successor stay latched. */
+static int BTree_delete_internal(struct Storage *st, int t, int root_addr, int k) {
+    struct Node *x = NULL; struct Node *y = NULL; struct Node *z = NULL; struct Node *pending = NULL;
+    int addr_x = root_addr; int addr_y; int addr_z; int pending_addr = NULL_ADDR; int pending_i = 0;
+    int x_dirty = 0; int y_dirty; int i; int j; int mode = DEL_FIND; int deleted = 0;
+
+    x = BTree_disk_read(st, t, root_addr);
+    for (;;) {
+        if (mode == DEL_FIND) { i = BTree_find_slot(x->key, x->n, k); }
+        else { i = (mode == DEL_MAX) ? x->n : 0; }
+
+        if (x->leaf) { /* Case 1: remove from the leaf */
+            if (mode == DEL_FIND) {
+                if (i < x->n && k == x->key[i]) { BTree_remove_slot(x, i); x_dirty = 1; deleted = 1; }
+            } else { /* Move the predecessor/successor up into the pending slot */
+                j = (mode == DEL_MAX) ? x->n - 1 : 0;
+                pending->key[pending_i] = x->key[j]; pending->value[pending_i] = x->value[j];
+                BTree_remove_slot(x, j); x_dirty = 1; deleted = 1;
+            }
+            break;
+        }
 
-    /* 3. Copy upper half of y to stack buffers */
-    memcpy(z_keys, &y->key[t], t_minus_1 * sizeof(int));
-    memcpy(z_values, &y->value[t], t_minus_1 * sizeof(int));
-    if (!y_is_leaf) { memcpy(z_children, &y->c[t], t * sizeof(int)); }
-
-    /* 4. Get median key/value (before clearing y) */
-    median_key = y->key[t_minus_1];
-    median_val = y->value[t_minus_1];
-
-    /* 5. Modify y (lower half) */
-    y->n = t_minus_1;
-    /* Clear upper half keys/values/children in 'y' with sentinels/NULL_ADDR */
-    for (j = t_minus_1; j < 2*t - 1; ++j) { y->key[j] = SENTINEL_VALUE; y->value[j] = SENTINEL_VALUE; }
-    if (!y_is_leaf) { for (j = t; j < 2*t; ++j) { y->c[j] = NULL_ADDR; } }
-
-    /* 6. Write modified y back */
-    BTree_disk_write(addr_y, y);
-    BTree_free_node_mem(y); y = NULL; /* Free y memory */
-
-    /* 7. Allocate disk space and memory for new node z */
-    addr_z = Storage_alloc();
-    /* Use 'y' variable temporarily for node z */
-    y = BTree_allocate_node_mem(t); /* Re-use 'y' pointer for node 'z' */
-    y->leaf = y_is_leaf;
-    y->n = t_minus_1;
-
-    /* 8. Fill z from stack buffers */
-    memcpy(y->key, z_keys, t_minus_1 * sizeof(int));
-    memcpy(y->value, z_values, t_minus_1 * sizeof(int));
-    if (!y_is_leaf) { memcpy(y->c, z_children, t * sizeof(int)); }
-
-    /* 9. Write z to disk */
-    BTree_disk_write(addr_z, y);
-    BTree_free_node_mem(y); y = NULL; /* Free z memory */
-
-    /* 10. Free stack buffers */
-    free(z_keys); free(z_values); free(z_children);
-
-    /* 11. Read parent x */
-    /* Use 'y' variable temporarily for node x */
-    y = BTree_disk_read(t, addr_x); /* Re-use 'y' pointer for node 'x' */
-
-    /* 12. Modify parent x */
-    /* Make space for new child ptr in x */
-    memmove(&y->c[i + 2], &y->c[i + 1], (y->n - i) * sizeof(int));
-    y->c[i + 1] = addr_z; /* Link new node z */
-    /* Make space for median key/value */
-    memmove(&y->key[i + 1], &y->key[i], (y->n - i) * sizeof(int));
-    memmove(&y->value[i + 1], &y->value[i], (y->n - i) * sizeof(int));
-    y->key[i] = median_key; /* Insert median */
-    y->value[i] = median_val;
-    y->n = y->n + 1;
-
-    /* 13. Write modified parent x back */
-    BTree_disk_write(addr_x, y);
-    BTree_free_node_mem(y); y = NULL; /* Free x memory */
-}
-
-
-/* B-TREE-INSERT-NONFULL (Checks for update/undelete) */
-static void BTree_insert_nonfull(int t, int addr_x, int k, int v) {
-    struct Node *x = NULL; int i; int child_addr; struct Node *child = NULL; int needs_split;
-    x = BTree_disk_read(t, addr_x);
-    i = 0; while (i < x->n && k > x->key[i]) { i++; }
-
-    if (i < x->n && k == x->key[i]) { /* Key Found: Update */
-        x->value[i] = v; BTree_disk_write(addr_x, x); BTree_free_node_mem(x); return;
+        addr_y = x->c[i]; y_dirty = 0;
+        if (addr_y == NULL_ADDR) { fprintf(stderr, "BTree Error: Invalid child address during delete (addr=%d, i=%d).\n", addr_x, i); exit(EXIT_FAILURE); }
+        BTree_latch(st, addr_y, LATCH_EXCLUSIVE); y = BTree_disk_read(st, t, addr_y);
+        if (mode == DEL_FIND && i < x->n && k == x->key[i]) { /* Case 2: k in internal node x */
+            if (y->n >= t) { /* 2a: replace with predecessor from y */
+                pending = x; pending_addr = addr_x; pending_i = i; mode = DEL_MAX;
+            } else {
+                addr_z = x->c[i + 1]; BTree_latch(st, addr_z, LATCH_EXCLUSIVE); z = BTree_disk_read(st, t, addr_z);
+                if (z->n >= t) { /* 2b: replace with successor from z */
+                    BTree_free_node_mem(y); BTree_unlatch(st, addr_y); y = z; addr_y = addr_z;
+                    pending = x; pending_addr = addr_x; pending_i = i; mode = DEL_MIN;
+                } else { /* 2c: merge y, k, z and delete k from y */
+                    BTree_merge_children(st, x, i, y, addr_z, z); BTree_unlatch(st, addr_z); x_dirty = 1; y_dirty = 1;
+                }
+                z = NULL;
+            }
+        } else if (y->n < t) { /* Case 3: top up the child before entering it */
+            BTree_fill_child(st, t, x, &i, &y, &addr_y); x_dirty = 1; y_dirty = 1;
+        }
+
+        if (addr_x == root_addr && x->n == 0) { /* Root collapse: y moves to the root address */
+            Storage_free(st, addr_y); BTree_unlatch(st, addr_y); addr_y = root_addr; y_dirty = 1; /* Root latch carries over */
+            BTree_free_node_mem(x);
+        } else if (x != pending) {
+            if (x_dirty) { BTree_disk_write(st, addr_x, x); }
+            BTree_free_node_mem(x); BTree_unlatch(st, addr_x);
+        }
+        x = y; addr_x = addr_y; x_dirty = y_dirty; y = NULL;
     }
-    /* Key Not Found: Insert */
-    if (x->leaf) { /* Case 1: Leaf */
-        if (x->n > i) { memmove(&x->key[i + 1], &x->key[i], (x->n - i) * sizeof(int)); memmove(&x->value[i + 1], &x->value[i], (x->n - i) * sizeof(int)); }
-        x->key[i] = k; x->value[i] = v; x->n = x->n + 1;
-        BTree_disk_write(addr_x, x); BTree_free_node_mem(x);
-    } else { /* Case 2: Internal */
-        child_addr = x->c[i];
-        if (child_addr == NULL_ADDR) { fprintf(stderr, "BTree Error: Invalid child address (insert descent).\n"); BTree_free_node_mem(x); exit(EXIT_FAILURE); }
-        BTree_free_node_mem(x); x = NULL; /* Free parent BEFORE child read */
-        child = BTree_disk_read(t, child_addr); needs_split = (child->n == 2 * t - 1);
-        BTree_free_node_mem(child); child = NULL; /* Free child */
-        if (needs_split) {
-            BTree_split_child(t, addr_x, i); /* Split handles its own memory */
-            /* Re-read parent needed to find correct child after split */
-            x = BTree_disk_read(t, addr_x);
-            if (k > x->key[i]) { i++; } /* Check key that moved up */
-            child_addr = x->c[i];
-            BTree_free_node_mem(x); x = NULL; /* Free parent again */
-             if (child_addr == NULL_ADDR) { fprintf(stderr, "BTree Error: Invalid child address after split.\n"); exit(EXIT_FAILURE); }
+    if (x_dirty) { BTree_disk_write(st, addr_x, x); }
+    BTree_free_node_mem(x); BTree_unlatch(st, addr_x);
+    if (pending != NULL) { BTree_disk_write(st, pending_addr, pending); BTree_free_node_mem(pending); BTree_unlatch(st, pending_addr); }
+    return deleted;
+}
+
+/* B-TREE-SPLIT-CHILD (In-Memory Version) */
+/* Splits the full child y = x->c[i] around its median. x and y are already */
+/* in memory; the new right sibling z is returned in memory with its address */
+/* in *addr_z_out. Nothing is written here: the caller writes whichever of */
+/* y/z it does not descend into, and x once it is done with it. */
+static struct Node* BTree_split_child(struct Storage *st, int t, struct Node *x, int i, struct Node *y, int *addr_z_out) {
+    struct Node *z = NULL; int j;
+    if (y->n != 2 * t - 1) { fprintf(stderr, "BTree Internal Error: Attempted to split non-full node (n=%d, t=%d)\n", y->n, t); exit(EXIT_FAILURE); }
+
+    /* 1. New sibling z takes the upper t-1 keys (and t children) of y */
+    *addr_z_out = Storage_alloc(st);
+    z = BTree_allocate_node_mem(t);
+    z->leaf = y->leaf; z->n = t - 1;
+    memcpy(z->key, &y->key[t], (t - 1) * sizeof(int));
+    memcpy(z->value, &y->value[t], (t - 1) * sizeof(int));
+    if (!y->leaf) { memcpy(z->c, &y->c[t], t * sizeof(int)); }
+
+    /* 2. Make room in x and move the median up */
+    memmove(&x->c[i + 2], &x->c[i + 1], (x->n - i) * sizeof(int));
+    x->c[i + 1] = *addr_z_out;
+    memmove(&x->key[i + 1], &x->key[i], (x->n - i) * sizeof(int));
+    memmove(&x->value[i + 1], &x->value[i], (x->n - i) * sizeof(int));
+    x->key[i] = y->key[t - 1]; x->value[i] = y->value[t - 1];
+    x->n = x->n + 1;
+
+    /* 3. Truncate y to the lower half, clearing the moved slots */
+    y->n = t - 1;
+    for (j = t - 1; j < 2 * t - 1; ++j) { y->key[j] = SENTINEL_VALUE; y->value[j] = SENTINEL_VALUE; }
+    if (!y->leaf) { for (j = t; j < 2 * t; ++j) { y->c[j] = NULL_ADDR; } }
+    return z;
+}
+
+
+/* B-TREE-INSERT-NONFULL (Single-Descent Version, checks for update/undelete) */
+/* x (at addr_x, not full) is owned by this function and freed before return. */
+/* Only the parent/child pair on the path is held: because full children are */
+/* split on the way down, ancestors never change again once left. Each node */
+/* on the path is read once and written at most once. The caller holds an */
+/* exclusive latch on addr_x; latches are coupled down and all released. */
+static void BTree_insert_nonfull(struct Storage *st, int t, int addr_x, struct Node *x, int x_dirty, int k, int v) {
+    int i; int addr_y; int addr_z; struct Node *y = NULL; struct Node *z = NULL; int y_dirty;
+    for (;;) {
+        i = BTree_find_slot(x->key, x->n, k);
+
+        if (i < x->n && k == x->key[i]) { /* Key Found: Update */
+            x->value[i] = v; BTree_disk_write(st, addr_x, x); BTree_free_node_mem(x); BTree_unlatch(st, addr_x); return;
+        }
+        if (x->leaf) { /* Case 1: Leaf */
+            if (x->n > i) { memmove(&x->key[i + 1], &x->key[i], (x->n - i) * sizeof(int)); memmove(&x->value[i + 1], &x->value[i], (x->n - i) * sizeof(int)); }
+            x->key[i] = k; x->value[i] = v; x->n = x->n + 1;
+            BTree_disk_write(st, addr_x, x); BTree_free_node_mem(x); BTree_unlatch(st, addr_x); return;
+        }
+        /* Case 2: Internal */
+        addr_y = x->c[i];
+        if (addr_y == NULL_ADDR) { fprintf(stderr, "BTree Error: Invalid child address (insert descent).\n"); BTree_free_node_mem(x); exit(EXIT_FAILURE); }
+        BTree_latch(st, addr_y, LATCH_EXCLUSIVE); y = BTree_disk_read(st, t, addr_y); y_dirty = 0;
+        if (y->n == 2 * t - 1) { /* z is unreachable until x is written */
+            z = BTree_split_child(st, t, x, i, y, &addr_z); x_dirty = 1;
+            if (k == x->key[i]) { /* Key is the median that moved up */
+                x->value[i] = v;
+                BTree_disk_write(st, addr_y, y); BTree_disk_write(st, addr_z, z); BTree_disk_write(st, addr_x, x);
+                BTree_free_node_mem(y); BTree_free_node_mem(z); BTree_free_node_mem(x); BTree_unlatch(st, addr_y); BTree_unlatch(st, addr_x); return;
+            }
+            if (k > x->key[i]) { /* Descend into z, y is final */
+                BTree_latch(st, addr_z, LATCH_EXCLUSIVE);
+                BTree_disk_write(st, addr_y, y); BTree_free_node_mem(y); BTree_unlatch(st, addr_y);
+                y = z; addr_y = addr_z;
+            } else { /* Descend into y, z is final */
+                BTree_disk_write(st, addr_z, z); BTree_free_node_mem(z);
+            }
+            z = NULL; y_dirty = 1;
         }
-        BTree_insert_nonfull(t, child_addr, k, v); /* Recurse */
+        if (x_dirty) { BTree_disk_write(st, addr_x, x); }
+        BTree_free_node_mem(x); BTree_unlatch(st, addr_x); /* y cannot split: x is final */
+        x = y; addr_x = addr_y; x_dirty = y_dirty; y = NULL;
     }
 }
 
 
 /* --- Public API Implementation --- */
 void BTree_delete(struct BTree *bt, int k); /* Prototype */
+int BTree_bloom_rebuild(const struct BTree *bt); /* Prototype */
+static void BTree_bloom_fill(const struct BTree *bt, int nkeys); /* Prototype */
 
+/* t_user applies only when the file is created; 0 picks the largest t */
+/* whose node fits one page (see Storage_set_page_size). */
 struct BTree BTree_open(const char *name, int t_user) {
-    struct BTree bt; int root_addr; struct Node *root_node_mem = NULL;
-    Storage_open(name, t_user);
-    bt.t = Storage_get_t(); bt.root = 0;
-    if (Storage_empty()) {
-        root_addr = Storage_alloc(); if (root_addr != 0) { fprintf(stderr, "BTree Error: Initial root alloc not addr 0.\n"); Storage_close(); exit(EXIT_FAILURE); }
+    struct BTree bt; struct Storage *st; int root_addr; struct Node *root_node_mem = NULL; struct Node view; int kind;
+    bt.store = st = Storage_open(name, t_user);
+    bt.t = Storage_get_t(st); bt.root = 0;
+    if (Storage_empty(st)) {
+        root_addr = Storage_alloc(st); if (root_addr != 0) { fprintf(stderr, "BTree Error: Initial root alloc not addr 0.\n"); Storage_close(st); exit(EXIT_FAILURE); }
         root_node_mem = BTree_allocate_node_mem(bt.t); root_node_mem->leaf = 1; root_node_mem->n = 0;
-        BTree_disk_write(root_addr, root_node_mem); BTree_free_node_mem(root_node_mem);
-    } return bt;
+        BTree_disk_write(st, root_addr, root_node_mem); BTree_free_node_mem(root_node_mem);
+        Storage_commit(st); /* A new file is durable before the first operation */
+    } else { /* B+tree files (bptree.c) mark their pages with other kinds */
+        root_node_mem = BTree_disk_view(st, bt.t, 0, &view); kind = root_node_mem->leaf; BTree_release_view(st, 0, root_node_mem, &view);
+        if (kind != 0 && kind != 1) { fprintf(stderr, "BTree Error: %s does not hold a B-tree (open it with BPTree_open).\n", name); Storage_close(st); exit(EXIT_FAILURE); }
+    }
+    if (Storage_bloom_needs_rebuild(st)) { (void) BTree_bloom_rebuild(&bt); }
+    return bt;
+}
+
+void BTree_close(struct BTree *bt) {
+    Storage_close(bt->store);
+    BTree_node_pool_drain(); bt->root = -1; bt->t = 0; bt->store = NULL;
 }
 
-void BTree_close(struct BTree *bt) { Storage_close(); bt->root = -1; bt->t = 0; }
+/* BTree_thread_exit: Frees the calling thread's node buffers. A thread that */
+/* used a tree it does not close calls it before it ends. */
+void BTree_thread_exit(void) { BTree_node_pool_drain(); }
 
-/* BTree_put (Strict Memory Budget Root Split Version) */
+/* BTree_sync: Makes every completed operation durable (commits the open */
+/* write-ahead log group, see Storage_set_wal). */
+void BTree_sync(const struct BTree *bt) { assert(bt != NULL && bt->t >= 2); Storage_commit(bt->store); }
+
+/* BTree_put (Single-Descent Version) */
+/* The root stays at its address: when it is full, its contents move to a */
+/* new node y, a fresh root s with y as only child takes its place, and y is */
+/* split in memory like any other child before the descent continues. */
 void BTree_put(const struct BTree *bt, int k, int v) {
-    int root_addr = bt->root; int t = bt->t;
-    struct Node *r = NULL; /* Only node buffer needed */
-    int addr_r_new; int addr_z;
-    /* Stack buffers for root split */
-    int *z_keys = NULL; int *z_values = NULL; int *z_children = NULL;
-    int median_key, median_val;
-    int root_is_leaf;
-    int j;
+    int root_addr = bt->root; int t = bt->t; struct Storage *st = bt->store;
+    struct Node *r = NULL; struct Node *s = NULL; struct Node *z = NULL;
+    int addr_y; int addr_z;
 
-    r = BTree_disk_read(t, root_addr);
-
-    if (r->n == 2 * t - 1) { /* Root is full, handle split */
-        /* 1. Allocate disk space for the two children */
-        addr_r_new = Storage_alloc();
-        addr_z = Storage_alloc();
-
-        /* 2. Allocate stack buffers */
-        z_keys = malloc((t - 1) * sizeof(int));
-        z_values = malloc((t - 1) * sizeof(int));
-        root_is_leaf = r->leaf;
-        if (!root_is_leaf) { z_children = malloc(t * sizeof(int)); }
-        if (!z_keys || !z_values || (!root_is_leaf && !z_children)) {
-             perror("BTree Memory Error: Failed stack buffers for root split");
-             free(z_keys); free(z_values); free(z_children); BTree_free_node_mem(r); exit(EXIT_FAILURE);
-        }
+    Storage_op_begin(st);
+    Storage_bloom_add(st, k); /* Before the key becomes visible to readers */
+    BTree_latch(st, root_addr, LATCH_EXCLUSIVE);
+    r = BTree_disk_read(st, t, root_addr);
+    if (r->n < 2 * t - 1) { BTree_insert_nonfull(st, t, root_addr, r, 0, k, v); Storage_op_end(st); return; }
 
-        /* 3. Copy upper half of r to stack buffers */
-        memcpy(z_keys, &r->key[t], (t - 1) * sizeof(int));
-        memcpy(z_values, &r->value[t], (t - 1) * sizeof(int));
-        if (!root_is_leaf) { memcpy(z_children, &r->c[t], t * sizeof(int)); }
-
-        /* 4. Get median key/value */
-        median_key = r->key[t - 1];
-        median_val = r->value[t - 1];
-
-        /* 5. Modify original root 'r' to become the left child */
-        r->n = t - 1;
-        /* Clear upper half in 'r' */
-        for(j = t - 1; j < 2*t - 1; ++j) { r->key[j] = SENTINEL_VALUE; r->value[j] = SENTINEL_VALUE; }
-        if (!root_is_leaf) { for(j = t; j < 2*t; ++j) { r->c[j] = NULL_ADDR; } }
-
-        /* 6. Write modified r to its NEW address */
-        BTree_disk_write(addr_r_new, r);
-        BTree_free_node_mem(r); r = NULL; /* Free r's memory */
-
-        /* 7. Allocate memory for new sibling z (use 'r' pointer temporarily) */
-        r = BTree_allocate_node_mem(t);
-        r->leaf = root_is_leaf; r->n = t - 1;
-
-        /* 8. Fill z from stack buffers */
-        memcpy(r->key, z_keys, (t - 1) * sizeof(int));
-        memcpy(r->value, z_values, (t - 1) * sizeof(int));
-        if (!root_is_leaf) { memcpy(r->c, z_children, t * sizeof(int)); }
-
-        /* 9. Write z to its address */
-        BTree_disk_write(addr_z, r);
-        BTree_free_node_mem(r); r = NULL; /* Free z's memory */
-
-        /* 10. Free stack buffers */
-        free(z_keys); free(z_values); free(z_children);
-
-        /* 11. Allocate memory for new root s (use 'r' pointer temporarily) */
-        r = BTree_allocate_node_mem(t);
-        r->leaf = 0; r->n = 1;
-        r->key[0] = median_key; r->value[0] = median_val;
-        r->c[0] = addr_r_new; r->c[1] = addr_z;
-
-        /* 12. Write new root s to address 0 */
-        BTree_disk_write(root_addr /* 0 */, r);
-        BTree_free_node_mem(r); r = NULL; /* Free s's memory */
-
-        /* 13. Insertion must now start from the new root */
-        BTree_insert_nonfull(t, root_addr, k, v);
-
-    } else { /* Root is not full */
-        BTree_free_node_mem(r); r = NULL;
-        BTree_insert_nonfull(t, root_addr, k, v);
+    /* Root is full: s becomes the new root above the old contents (now y). */
+    /* y and z are unreachable until s is written under the root latch. */
+    addr_y = Storage_alloc(st);
+    s = BTree_allocate_node_mem(t);
+    s->leaf = 0; s->n = 0; s->c[0] = addr_y;
+    z = BTree_split_child(st, t, s, 0, r, &addr_z);
+    if (k == s->key[0]) { /* Key is the median that moved up */
+        s->value[0] = v;
+        BTree_disk_write(st, addr_y, r); BTree_disk_write(st, addr_z, z); BTree_disk_write(st, root_addr, s);
+        BTree_free_node_mem(r); BTree_free_node_mem(z); BTree_free_node_mem(s); BTree_unlatch(st, root_addr);
+    } else if (k > s->key[0]) { /* Descend into z, y is final */
+        BTree_latch(st, addr_z, LATCH_EXCLUSIVE);
+        BTree_disk_write(st, addr_y, r); BTree_free_node_mem(r);
+        BTree_disk_write(st, root_addr, s); BTree_free_node_mem(s); BTree_unlatch(st, root_addr);
+        BTree_insert_nonfull(st, t, addr_z, z, 1, k, v);
+    } else { /* Descend into y, z is final */
+        BTree_latch(st, addr_y, LATCH_EXCLUSIVE);
+        BTree_disk_write(st, addr_z, z); BTree_free_node_mem(z);
+        BTree_disk_write(st, root_addr, s); BTree_free_node_mem(s); BTree_unlatch(st, root_addr);
+        BTree_insert_nonfull(st, t, addr_y, r, 1, k, v);
     }
+    Storage_op_end(st);
 }
 
 
 void BTree_get(const struct BTree *bt, int k, int *v) {
-    int root_addr; int t;
+    int root_addr; int t; struct Storage *st;
     assert(bt != NULL); assert(v != NULL); assert(bt->t >= 2);
-    root_addr = bt->root; t = bt->t;
-    (void) BTree_search_internal(t, root_addr, k, v);
+    root_addr = bt->root; t = bt->t; st = bt->store;
+    if (!Storage_bloom_may_contain(st, k)) { return; } /* Certainly absent */
+    BTree_latch(st, root_addr, LATCH_SHARED);
+    (void) BTree_search_internal(st, t, root_addr, k, v);
 }
 
 void BTree_delete(struct BTree *bt, int k) {
-    int root_addr; int t;
+    int root_addr; int t; struct Storage *st;
     assert(bt != NULL); assert(bt->t >= 2);
-    root_addr = bt->root; t = bt->t;
-    (void) BTree_search_and_mark_deleted_internal(t, root_addr, k);
-}
\ No newline at end of file
+    root_addr = bt->root; t = bt->t; st = bt->store; Storage_op_begin(st);
+    BTree_latch(st, root_addr, LATCH_EXCLUSIVE);
+    (void) BTree_delete_internal(st, t, root_addr, k);
+    Storage_op_end(st);
+}
+
+/* --- Bulk Loading --- */
+
+/* Growable int array used for the per-level child/separator lists */
+struct IntVec { int *data; int len; int cap; };
+
+static void BTree_vec_push(struct IntVec *vec, int val) {
+    if (vec->len == vec->cap) {
+        int new_cap = vec->cap > 0 ? vec->cap * 2 : 64; int *grown = realloc(vec->data, new_cap * sizeof(int));
+        if (!grown) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+        vec->data = grown; vec->cap = new_cap;
+    }
+    vec->data[vec->len++] = val;
+}
+
+/* Resets unused slots to sentinels before a node assembled in a reused */
+/* buffer is written */
+static void BTree_disk_write_clean(struct Storage *st, int t, int addr, struct Node *x) {
+    int j;
+    for (j = x->n; j < 2 * t - 1; ++j) { x->key[j] = SENTINEL_VALUE; x->value[j] = SENTINEL_VALUE; }
+    for (j = x->leaf ? 0 : x->n + 1; j < 2 * t; ++j) { x->c[j] = NULL_ADDR; }
+    BTree_disk_write(st, addr, x);
+}
+
+/* Rebalances the last two leaves when the final one is underfull (< t-1). */
+/* sep is the separator between them. Returns 0 if both remain (sep updated), */
+/* 1 if cur was merged into prev (sep consumed). */
+static int BTree_bulk_fix_last_leaf(int t, struct Node *prev, struct Node *cur, int *sep_k, int *sep_v) {
+    int total = prev->n + 1 + cur->n; int left; int *keys = NULL; int *vals = NULL;
+    keys = malloc(total * sizeof(int)); vals = malloc(total * sizeof(int));
+    if (!keys || !vals) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    memcpy(keys, prev->key, prev->n * sizeof(int)); memcpy(vals, prev->value, prev->n * sizeof(int));
+    keys[prev->n] = *sep_k; vals[prev->n] = *sep_v;
+    memcpy(&keys[prev->n + 1], cur->key, cur->n * sizeof(int)); memcpy(&vals[prev->n + 1], cur->value, cur->n * sizeof(int));
+    if (total - 1 >= 2 * (t - 1)) { /* Redistribute: both halves reach t-1 */
+        left = (total - 1) / 2;
+        prev->n = left; memcpy(prev->key, keys, left * sizeof(int)); memcpy(prev->value, vals, left * sizeof(int));
+        *sep_k = keys[left]; *sep_v = vals[left];
+        cur->n = total - left - 1; memcpy(cur->key, &keys[left + 1], cur->n * sizeof(int)); memcpy(cur->value, &vals[left + 1], cur->n * sizeof(int));
+        free(keys); free(vals); return 0;
+    }
+    /* Merge: total <= 2t-2 keys fit one leaf */
+    prev->n = total; memcpy(prev->key, keys, total * sizeof(int)); memcpy(prev->value, vals, total * sizeof(int));
+    free(keys); free(vals); return 1;
+}
+
+/* BTree_bulk_load_stream: Builds a new tree bottom-up from strictly */
+/* increasing (key, value) pairs produced by next(ctx, &k, &v) until it */
+/* returns 0. Leaves and internal nodes are packed to fill_pct percent of */
+/* 2t-1 keys (clamped so every node stays legal) and written once, in */
+/* allocation order; the root is written last at address 0. The target */
+/* file must not exist or be empty. Returns the open tree. */
+struct BTree BTree_bulk_load_stream(const char *name, int t_user, int fill_pct,
+                                    int (*next)(void *ctx, int *k, int *v), void *ctx) {
+    struct BTree bt; struct Storage *st; struct Node *cur = NULL; struct Node *prev = NULL; struct Node *tmp = NULL;
+    int m; int t; int k; int v; int last_k = 0; int have_last = 0; int have_prev = 0; int addr;
+    struct IntVec child = { NULL, 0, 0 }; struct IntVec sep_k = { NULL, 0, 0 }; struct IntVec sep_v = { NULL, 0, 0 };
+    struct IntVec up_child = { NULL, 0, 0 }; struct IntVec up_k = { NULL, 0, 0 }; struct IntVec up_v = { NULL, 0, 0 };
+    struct IntVec swap; int nodes; int j; int cc; int pos; int root_done = 0; int loaded = 0;
+
+    if (next == NULL || fill_pct < 1 || fill_pct > 100) { fprintf(stderr, "BTree Error: Invalid bulk load arguments (fill=%d%%).\n", fill_pct); exit(EXIT_FAILURE); }
+    bt.store = st = Storage_open(name, t_user);
+    t = Storage_get_t(st); bt.t = t; bt.root = 0;
+    if (!Storage_empty(st)) { fprintf(stderr, "BTree Error: Bulk load target '%s' is not empty.\n", name); Storage_close(st); exit(EXIT_FAILURE); }
+    Storage_op_begin(st);
+    if (Storage_alloc(st) != 0) { fprintf(stderr, "BTree Error: Bulk load root alloc not addr 0.\n"); Storage_close(st); exit(EXIT_FAILURE); }
+    m = (fill_pct * (2 * t - 1) + 50) / 100;
+    if (m < t - 1) { m = t - 1; }
+    if (m > 2 * t - 1) { m = 2 * t - 1; }
+
+    /* 1. Leaf level: fill m keys per leaf; the key after a full leaf becomes */
+    /* its separator. The previous leaf is held back (address assigned when it */
+    /* is written) so the last one can be rebalanced against it. */
+    cur = BTree_allocate_node_mem(t); prev = BTree_allocate_node_mem(t);
+    while (next(ctx, &k, &v)) {
+        if (have_last && k <= last_k) { fprintf(stderr, "BTree Error: Bulk load keys not strictly increasing (%d after %d).\n", k, last_k); exit(EXIT_FAILURE); }
+        last_k = k; have_last = 1; loaded++;
+        if (cur->n < m) { cur->key[cur->n] = k; cur->value[cur->n] = v; cur->n++; continue; }
+        if (have_prev) { addr = Storage_alloc(st); BTree_disk_write_clean(st, t, addr, prev); BTree_vec_push(&child, addr); }
+        tmp = prev; prev = cur; cur = tmp; cur->n = 0; have_prev = 1;
+        BTree_vec_push(&sep_k, k); BTree_vec_push(&sep_v, v);
+    }
+    if (!have_prev) { /* Everything fits in a single leaf root */
+        BTree_disk_write_clean(st, t, 0, cur); root_done = 1;
+    } else {
+        if (cur->n < t - 1 && BTree_bulk_fix_last_leaf(t, prev, cur, &sep_k.data[sep_k.len - 1], &sep_v.data[sep_v.len - 1])) {
+            sep_k.len--; sep_v.len--; cur->n = 0;
+            if (child.len == 0) { BTree_disk_write_clean(st, t, 0, prev); root_done = 1; } /* Merged into one leaf root */
+        }
+        if (!root_done) {
+            addr = Storage_alloc(st); BTree_disk_write_clean(st, t, addr, prev); BTree_vec_push(&child, addr);
+            if (sep_k.len == child.len) { addr = Storage_alloc(st); BTree_disk_write_clean(st, t, addr, cur); BTree_vec_push(&child, addr); }
+        }
+    }
+
+    /* 2. Internal levels: counts are now known, so children are spread evenly */
+    /* over as few nodes as the fill target allows, each with t..2t children. */
+    cur->leaf = 0;
+    while (!root_done) {
+        nodes = (child.len + m) / (m + 1);
+        if (child.len < nodes * t) { nodes = child.len / t; }
+        if (nodes < 1) { nodes = 1; }
+        up_child.len = 0; up_k.len = 0; up_v.len = 0; pos = 0;
+        for (j = 0; j < nodes; ++j) {
+            cc = child.len / nodes + (j < child.len % nodes ? 1 : 0);
+            cur->n = cc - 1;
+            memcpy(cur->c, &child.data[pos], cc * sizeof(int));
+            memcpy(cur->key, &sep_k.data[pos], (cc - 1) * sizeof(int));
+            memcpy(cur->value, &sep_v.data[pos], (cc - 1) * sizeof(int));
+            if (nodes == 1) { BTree_disk_write_clean(st, t, 0, cur); root_done = 1; break; }
+            addr = Storage_alloc(st); BTree_disk_write_clean(st, t, addr, cur); BTree_vec_push(&up_child, addr);
+            pos += cc;
+            if (j < nodes - 1) { BTree_vec_push(&up_k, sep_k.data[pos - 1]); BTree_vec_push(&up_v, sep_v.data[pos - 1]); }
+        }
+        swap = child; child = up_child; up_child = swap;
+        swap = sep_k; sep_k = up_k; up_k = swap;
+        swap = sep_v; sep_v = up_v; up_v = swap;
+    }
+
+    BTree_free_node_mem(cur); BTree_free_node_mem(prev);
+    free(child.data); free(sep_k.data); free(sep_v.data); free(up_child.data); free(up_k.data); free(up_v.data);
+    Storage_op_end(st);
+    BTree_bloom_fill(&bt, loaded);
+    return bt;
+}
+
+/* Array source for BTree_bulk_load */
+struct BulkArraySource { const int *keys; const int *values; int n; int pos; };
+
+static int BTree_bulk_array_next(void *ctx, int *k, int *v) {
+    struct BulkArraySource *src = ctx;
+    if (src->pos >= src->n) return 0;
+    *k = src->keys[src->pos]; *v = src->values[src->pos]; src->pos++; return 1;
+}
+
+/* BTree_bulk_load: BTree_bulk_load_stream over sorted keys[]/values[] */
+struct BTree BTree_bulk_load(const char *name, int t, int fill_pct, const int *keys, const int *values, int n) {
+    struct BulkArraySource src;
+    assert(n >= 0 && (n == 0 || (keys != NULL && values != NULL)));
+    src.keys = keys; src.values = values; src.n = n; src.pos = 0;
+    return BTree_bulk_load_stream(name, t, fill_pct, BTree_bulk_array_next, &src);
+}
+
+
+/* --- Ordered Cursor and Range Scan --- */
+/* The cursor keeps the root-to-current path as private node copies: each */
+/* node is read when the traversal first enters it and freed once all of */
+/* its keys and children have been emitted, so a range costs one read per */
+/* node it touches. Keys marked with DELETION_SENTINEL are skipped. */
+/* With a prefetch depth K (Storage_set_prefetch), entering child i of a */
+/* node hints children i+1..i+K to the OS, so the next subtrees are being */
+/* read while this one is emitted. */
+/* Each read is latched on its own, so a cursor on the live tree sees no */
+/* torn nodes but may miss or repeat keys moved by concurrent writers; */
+/* scan a snapshot for a consistent view. */
+
+/* Upper bound on tree height (t >= 2 gives far more than 2^31 keys at 32) */
+#define BTREE_MAX_HEIGHT 32
+
+struct BTreeCursor {
+    struct Storage *store;
+    int t;
+    int root;
+    int depth;                             /* Nodes on the stack */
+    struct Node *node[BTREE_MAX_HEIGHT];
+    int idx[BTREE_MAX_HEIGHT];             /* Next key to emit in node[d] */
+    int pending;                           /* Subtree to enter before the next key, or NULL_ADDR */
+    int view;                              /* Storage view read through (0 = live tree) */
+    int prefetch;                          /* Children hinted ahead (0 = off) */
+};
+
+/* Hints up to count children of x starting at c[from] */
+static void BTree_cursor_prefetch(const struct BTreeCursor *cur, const struct Node *x, int from, int count) {
+    int prev;
+    if (x->leaf || count <= 0 || from > x->n) { return; }
+    if (count > x->n + 1 - from) { count = x->n + 1 - from; }
+    if (cur->view == 0) { Storage_prefetch(cur->store, x->c + from, count); return; }
+    prev = Storage_set_view(cur->store, cur->view); /* Snapshot cursors hint the pinned version */
+    Storage_prefetch(cur->store, x->c + from, count);
+    Storage_set_view(cur->store, prev);
+}
+
+static void BTree_cursor_push(struct BTreeCursor *cur, int addr, int idx) {
+    struct Storage *st = cur->store;
+    if (cur->depth == BTREE_MAX_HEIGHT) { fprintf(stderr, "BTree Error: Cursor stack overflow (height > %d).\n", BTREE_MAX_HEIGHT); exit(EXIT_FAILURE); }
+    if (addr == NULL_ADDR) { fprintf(stderr, "BTree Error: Invalid child address during cursor descent.\n"); exit(EXIT_FAILURE); }
+    if (cur->view != 0) { /* Writers may run between calls: read the pinned version */
+        int prev = Storage_set_view(st, cur->view);
+        cur->node[cur->depth] = BTree_disk_read(st, cur->t, addr);
+        Storage_set_view(st, prev);
+    } else {
+        BTree_latch(st, addr, LATCH_SHARED); cur->node[cur->depth] = BTree_disk_read(st, cur->t, addr); BTree_unlatch(st, addr);
+    }
+    cur->idx[cur->depth] = idx;
+    cur->depth++;
+}
+
+static void BTree_cursor_clear(struct BTreeCursor *cur) {
+    while (cur->depth > 0) { cur->depth--; BTree_free_node_mem(cur->node[cur->depth]); }
+}
+
+/* Pushes the leftmost path of the subtree at addr */
+static void BTree_cursor_descend_left(struct BTreeCursor *cur, int addr) {
+    BTree_cursor_push(cur, addr, 0);
+    while (!cur->node[cur->depth - 1]->leaf) {
+        BTree_cursor_prefetch(cur, cur->node[cur->depth - 1], 1, cur->prefetch);
+        BTree_cursor_push(cur, cur->node[cur->depth - 1]->c[0], 0);
+    }
+}
+
+/* Unpositioned cursor on the live tree: nothing read yet (seek it first) */
+static struct BTreeCursor* BTree_cursor_alloc(const struct BTree *bt) {
+    struct BTreeCursor *cur = NULL;
+    assert(bt != NULL); assert(bt->t >= 2);
+    cur = malloc(sizeof(struct BTreeCursor));
+    if (!cur) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    cur->store = bt->store; cur->t = bt->t; cur->root = bt->root; cur->depth = 0; cur->pending = NULL_ADDR; cur->view = 0;
+    cur->prefetch = Storage_get_prefetch_depth(bt->store);
+    return cur;
+}
+
+/* BTree_cursor_open: Cursor positioned before the smallest key */
+struct BTreeCursor* BTree_cursor_open(const struct BTree *bt) {
+    struct BTreeCursor *cur = BTree_cursor_alloc(bt);
+    BTree_cursor_descend_left(cur, cur->root);
+    return cur;
+}
+
+/* BTree_cursor_seek: Repositions before the smallest key >= k */
+void BTree_cursor_seek(struct BTreeCursor *cur, int k) {
+    struct Node *x = NULL; int i; int addr;
+    assert(cur != NULL);
+    BTree_cursor_clear(cur);
+    cur->pending = NULL_ADDR; addr = cur->root;
+    for (;;) {
+        BTree_cursor_push(cur, addr, 0);
+        x = cur->node[cur->depth - 1];
+        i = BTree_find_slot(x->key, x->n, k);
+        cur->idx[cur->depth - 1] = i;
+        if (x->leaf || (i < x->n && k == x->key[i])) { return; }
+        BTree_cursor_prefetch(cur, x, i + 1, cur->prefetch);
+        addr = x->c[i];
+    }
+}
+
+/* BTree_cursor_next: Emits the next live pair in key order. */
+/* Returns 1 with k and v set, or 0 when the cursor is exhausted. */
+int BTree_cursor_next(struct BTreeCursor *cur, int *k, int *v) {
+    struct Node *x = NULL; int i;
+    assert(cur != NULL);
+    for (;;) {
+        if (cur->pending != NULL_ADDR) { /* Enter the subtree right of the last emitted key */
+            i = cur->pending; cur->pending = NULL_ADDR; BTree_cursor_descend_left(cur, i);
+        }
+        if (cur->depth == 0) { return 0; }
+        x = cur->node[cur->depth - 1]; i = cur->idx[cur->depth - 1];
+        if (i >= x->n) { cur->depth--; BTree_free_node_mem(x); continue; } /* Node done */
+        cur->idx[cur->depth - 1] = i + 1;
+        /* Defer reading the right subtree so a scan ending here reads nothing past it */
+        if (!x->leaf) { cur->pending = x->c[i + 1]; BTree_cursor_prefetch(cur, x, i + 1 + cur->prefetch, cur->prefetch > 0); }
+        if (x->value[i] == DELETION_SENTINEL) { continue; }
+        if (k) { *k = x->key[i]; }
+        if (v) { *v = x->value[i]; }
+        return 1;
+    }
+}
+
+void BTree_cursor_close(struct BTreeCursor *cur) {
+    if (cur) { BTree_cursor_clear(cur); free(cur); }
+}
+
+/* BTree_scan: Calls cb(k, v, ctx) for every live key in [lo, hi] in order. */
+/* A nonzero return from cb stops the scan. Returns the number of calls. */
+int BTree_scan(const struct BTree *bt, int lo, int hi, int (*cb)(int k, int v, void *ctx), void *ctx) {
+    struct BTreeCursor *cur = NULL; int k; int v; int count = 0;
+    assert(bt != NULL); assert(cb != NULL);
+    if (lo > hi) { return 0; }
+    cur = BTree_cursor_alloc(bt); /* Only the path to lo is read */
+    BTree_cursor_seek(cur, lo);
+    while (BTree_cursor_next(cur, &k, &v) && k <= hi) {
+        count++;
+        if (cb(k, v, ctx)) { break; }
+    }
+    BTree_cursor_close(cur);
+    return count;
+}
+
+
+/* --- Batched Lookup --- */
+
+/* A probe key with its position in the caller's arrays */
+struct Probe { int key; int idx; };
+
+static int BTree_compare_probes(const void *a, const void *b) {
+    const struct Probe *pa = a; const struct Probe *pb = b;
+    return (pa->key > pb->key) - (pa->key < pb->key);
+}
+
+/* Resolves sorted probes p[0..np) against the subtree at addr. The node is */
+/* read once; probes that stop here are answered from it, the rest are */
+/* grouped by child and each group descends together. Returns hits. */
+/* The caller holds a shared latch on addr, kept while the groups below */
+/* are searched and released before returning. */
+static int BTree_get_many_internal(struct Storage *st, int t, int addr, const struct Probe *p, int np, int *values) {
+    struct Node *x = NULL; struct Node view; int found = 0; int i = 0; int j = 0; int start;
+    int ngroups = 0; int *group_addr = NULL; int *group_start = NULL; int *group_len = NULL;
+    x = BTree_disk_view(st, t, addr, &view);
+    if (!x->leaf) {
+        group_addr = malloc((x->n + 1) * sizeof(int)); group_start = malloc((x->n + 1) * sizeof(int)); group_len = malloc((x->n + 1) * sizeof(int));
+        if (!group_addr || !group_start || !group_len) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    }
+    while (j < np) {
+        i += BTree_find_slot(x->key + i, x->n - i, p[j].key); /* Probes ascend: search the rest */
+        if (i < x->n && p[j].key == x->key[i]) { /* Resolved in this node */
+            if (x->value[i] != DELETION_SENTINEL) { values[p[j].idx] = x->value[i]; found++; }
+            j++;
+        } else if (x->leaf) { j++; } /* Not present */
+        else { /* Every probe below key[i] shares child c[i] */
+            start = j;
+            while (j < np && (i == x->n || p[j].key < x->key[i])) { j++; }
+            if (x->c[i] == NULL_ADDR) { fprintf(stderr, "BTree Error: Invalid child address during batched search (addr=%d, i=%d).\n", addr, i); exit(EXIT_FAILURE); }
+            group_addr[ngroups] = x->c[i]; group_start[ngroups] = start; group_len[ngroups] = j - start; ngroups++;
+        }
+    }
+    BTree_release_view(st, addr, x, &view); /* Release BEFORE recursion; the latch stays */
+    for (i = 0; i < ngroups; ++i) {
+        BTree_latch(st, group_addr[i], LATCH_SHARED);
+        found += BTree_get_many_internal(st, t, group_addr[i], p + group_start[i], group_len[i], values);
+    }
+    BTree_unlatch(st, addr);
+    free(group_addr); free(group_start); free(group_len);
+    return found;
+}
+
+/* BTree_get_many: Looks up keys[0..n) in one shared descent. values[i] is */
+/* set for every key found (left untouched otherwise, like BTree_get). */
+/* Returns the number of keys found. */
+int BTree_get_many(const struct BTree *bt, const int *keys, int *values, int n) {
+    struct Probe *probes = NULL; int i; int m = 0; int found; struct Storage *st = bt->store;
+    assert(bt != NULL); assert(bt->t >= 2); assert(n >= 0);
+    if (n == 0) { return 0; }
+    assert(keys != NULL && values != NULL);
+    probes = malloc(n * sizeof(struct Probe));
+    if (!probes) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    for (i = 0; i < n; ++i) { /* Keys the filter rules out are not searched */
+        if (Storage_bloom_may_contain(st, keys[i])) { probes[m].key = keys[i]; probes[m].idx = i; m++; }
+    }
+    if (m == 0) { free(probes); return 0; }
+    qsort(probes, m, sizeof(struct Probe), BTree_compare_probes);
+    BTree_latch(st, bt->root, LATCH_SHARED);
+    found = BTree_get_many_internal(st, bt->t, bt->root, probes, m, values);
+    free(probes);
+    return found;
+}
+
+
+/* --- Batched Upsert --- */
+/* Pairs are sorted and routed down together. Each touched node is read */
+/* once into an oversized ("wide") buffer, absorbs every change for its */
+/* subtree, and is written once: either in place, or cut into several */
+/* legal nodes whose separators are handed back to the parent. */
+
+/* An upsert with its position in the caller's arrays (for last-wins ties) */
+struct Pair { int key; int value; int idx; };
+
+static int BTree_compare_pairs(const void *a, const void *b) {
+    const struct Pair *pa = a; const struct Pair *pb = b;
+    if (pa->key != pb->key) { return (pa->key > pb->key) - (pa->key < pb->key); }
+    return (pa->idx > pb->idx) - (pa->idx < pb->idx);
+}
+
+/* Node buffer able to hold cap keys (and cap+1 children), never smaller */
+/* than a regular node so it can be written directly */
+static struct Node* BTree_allocate_wide_mem(int t, int cap) {
+    struct Node *x;
+    if (cap < 2 * t - 1) { cap = 2 * t - 1; }
+    x = BTree_node_buffer(t, cap);
+    x->n = 0; x->leaf = 1; return x;
+}
+
+/* Writes wide node w (K keys) as ceil((K+1)/2t) nodes of t-1..2t-1 keys. */
+/* The first piece goes to addr unless addr is NULL_ADDR; separators and */
+/* addresses of the remaining pieces are appended to the out vectors. */
+static void BTree_put_many_emit(struct Storage *st, int t, int addr, const struct Node *w, struct IntVec *out_k, struct IntVec *out_v, struct IntVec *out_addr) {
+    struct Node *x = NULL; int pieces; int base; int rem; int j; int q; int pos = 0; int a;
+    pieces = (w->n + 1 + 2 * t - 1) / (2 * t);
+    base = (w->n - (pieces - 1)) / pieces; rem = (w->n - (pieces - 1)) % pieces;
+    x = BTree_allocate_node_mem(t); x->leaf = w->leaf;
+    for (j = 0; j < pieces; ++j) {
+        q = base + (j < rem ? 1 : 0);
+        x->n = q;
+        memcpy(x->key, &w->key[pos], q * sizeof(int)); memcpy(x->value, &w->value[pos], q * sizeof(int));
+        if (!w->leaf) { memcpy(x->c, &w->c[pos], (q + 1) * sizeof(int)); }
+        if (j == 0 && addr != NULL_ADDR) { a = addr; }
+        else { a = Storage_alloc(st); BTree_vec_push(out_addr, a); }
+        BTree_disk_write_clean(st, t, a, x);
+        pos += q;
+        if (j < pieces - 1) { BTree_vec_push(out_k, w->key[pos]); BTree_vec_push(out_v, w->value[pos]); pos++; }
+    }
+    BTree_free_node_mem(x);
+}
+
+static void BTree_put_many_grow_root(struct Storage *st, int t, int root_addr, struct Node *w, struct IntVec *sub_k, struct IntVec *sub_v, struct IntVec *sub_addr); /* Prototype */
+
+/* Applies sorted, distinct pairs p[0..np) to the subtree at addr. */
+/* Splits of addr are reported through the out vectors (see emit). */
+/* The caller holds an exclusive latch on addr, released before returning. */
+static void BTree_put_many_internal(struct Storage *st, int t, int addr, int is_root, const struct Pair *p, int np,
+                                    struct IntVec *out_k, struct IntVec *out_v, struct IntVec *out_addr) {
+    struct Node *x = NULL; struct Node *w = NULL; int i = 0; int j = 0; int start; int dirty = 1;
+    struct IntVec sub_k = { NULL, 0, 0 }; struct IntVec sub_v = { NULL, 0, 0 }; struct IntVec sub_addr = { NULL, 0, 0 }; int s;
+    x = BTree_disk_read(st, t, addr);
+    w = BTree_allocate_wide_mem(t, x->n + np); w->leaf = x->leaf;
+    if (x->leaf) { /* Merge the pairs into the leaf's keys */
+        while (i < x->n || j < np) {
+            if (j < np && (i == x->n || p[j].key < x->key[i])) { w->key[w->n] = p[j].key; w->value[w->n] = p[j].value; j++; }
+            else if (j < np && p[j].key == x->key[i]) { w->key[w->n] = p[j].key; w->value[w->n] = p[j].value; i++; j++; }
+            else { w->key[w->n] = x->key[i]; w->value[w->n] = x->value[i]; i++; }
+            w->n++;
+        }
+    } else { /* Route groups to children; splits below widen this node */
+        dirty = 0; /* Written only if a child split or a key here was updated */
+        for (i = 0; i <= x->n; ++i) {
+            start = j;
+            while (j < np && (i == x->n || p[j].key < x->key[i])) { j++; }
+            w->c[w->n] = x->c[i];
+            if (j > start) {
+                if (x->c[i] == NULL_ADDR) { fprintf(stderr, "BTree Error: Invalid child address during batched insert (addr=%d, i=%d).\n", addr, i); exit(EXIT_FAILURE); }
+                sub_k.len = 0; sub_v.len = 0; sub_addr.len = 0;
+                BTree_latch(st, x->c[i], LATCH_EXCLUSIVE);
+                BTree_put_many_internal(st, t, x->c[i], 0, p + start, j - start, &sub_k, &sub_v, &sub_addr);
+                if (sub_k.len > 0) { dirty = 1; }
+                for (s = 0; s < sub_k.len; ++s) {
+                    w->key[w->n] = sub_k.data[s]; w->value[w->n] = sub_v.data[s]; w->n++;
+                    w->c[w->n] = sub_addr.data[s];
+                }
+            }
+            if (i < x->n) {
+                w->key[w->n] = x->key[i]; w->value[w->n] = x->value[i];
+                if (j < np && p[j].key == x->key[i]) { w->value[w->n] = p[j].value; j++; dirty = 1; } /* Update in place */
+                w->n++;
+            }
+        }
+    }
+    BTree_free_node_mem(x);
+
+    if (w->n <= 2 * t - 1) { if (dirty) { BTree_disk_write_clean(st, t, addr, w); } }
+    else if (!is_root) { BTree_put_many_emit(st, t, addr, w, out_k, out_v, out_addr); }
+    else { BTree_put_many_grow_root(st, t, addr, w, &sub_k, &sub_v, &sub_addr); }
+    BTree_unlatch(st, addr); /* New pieces become reachable once the parent is written */
+    BTree_free_node_mem(w); free(sub_k.data); free(sub_v.data); free(sub_addr.data);
+}
+
+/* Root overflow: the pieces move to new addresses and new levels are */
+/* stacked above them until the top fits at the root address */
+static void BTree_put_many_grow_root(struct Storage *st, int t, int root_addr, struct Node *w, struct IntVec *sub_k, struct IntVec *sub_v, struct IntVec *sub_addr) {
+    while (w->n > 2 * t - 1) {
+        sub_k->len = 0; sub_v->len = 0; sub_addr->len = 0;
+        BTree_put_many_emit(st, t, NULL_ADDR, w, sub_k, sub_v, sub_addr);
+        w->leaf = 0; w->n = sub_k->len;
+        memcpy(w->key, sub_k->data, sub_k->len * sizeof(int)); memcpy(w->value, sub_v->data, sub_v->len * sizeof(int));
+        memcpy(w->c, sub_addr->data, sub_addr->len * sizeof(int));
+    }
+    BTree_disk_write_clean(st, t, root_addr, w);
+}
+
+/* BTree_put_many: Upserts keys[i] -> values[i] for i in [0, n). When a key */
+/* repeats, the last occurrence wins (as with successive BTree_put calls). */
+/* Splits may reach the root, so the batch keeps the root latched until it */
+/* is done: other threads wait, readers already below finish first. */
+void BTree_put_many(const struct BTree *bt, const int *keys, const int *values, int n) {
+    struct Pair *pairs = NULL; int i; int m = 0; struct Storage *st = bt->store;
+    assert(bt != NULL); assert(bt->t >= 2); assert(n >= 0);
+    if (n == 0) { return; }
+    assert(keys != NULL && values != NULL);
+    pairs = malloc(n * sizeof(struct Pair));
+    if (!pairs) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    for (i = 0; i < n; ++i) { pairs[i].key = keys[i]; pairs[i].value = values[i]; pairs[i].idx = i; }
+    qsort(pairs, n, sizeof(struct Pair), BTree_compare_pairs);
+    for (i = 0; i < n; ++i) { /* Keep the last occurrence of each key */
+        if (m > 0 && pairs[m - 1].key == pairs[i].key) { pairs[m - 1] = pairs[i]; } else { pairs[m++] = pairs[i]; }
+    }
+    Storage_op_begin(st);
+    for (i = 0; i < m; ++i) { Storage_bloom_add(st, pairs[i].key); }
+    BTree_latch(st, bt->root, LATCH_EXCLUSIVE);
+    BTree_put_many_internal(st, bt->t, bt->root, 1, pairs, m, NULL, NULL, NULL);
+    Storage_op_end(st);
+    free(pairs);
+}
+
+/* --- Snapshots (shadow-paged files) --- */
+/* A snapshot reads the tree as of its creation while the live tree keeps */
+/* changing; see Storage_set_shadow. */
+
+struct BTreeSnapshot { struct Storage *store; int t; int root; int view; };
+
+/* BTree_snapshot_open: Commits pending operations and pins that version */
+struct BTreeSnapshot* BTree_snapshot_open(const struct BTree *bt) {
+    struct BTreeSnapshot *snap = NULL;
+    assert(bt != NULL); assert(bt->t >= 2);
+    snap = malloc(sizeof(struct BTreeSnapshot));
+    if (!snap) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    snap->store = bt->store; snap->t = bt->t; snap->root = bt->root; snap->view = Storage_snapshot_open(bt->store);
+    return snap;
+}
+
+/* BTree_snapshot_get: BTree_get against the snapshot; returns 1 if found */
+int BTree_snapshot_get(const struct BTreeSnapshot *snap, int k, int *v) {
+    int prev; int found; struct Storage *st;
+    assert(snap != NULL); assert(v != NULL);
+    st = snap->store; prev = Storage_set_view(st, snap->view);
+    BTree_latch(st, snap->root, LATCH_SHARED);
+    found = BTree_search_internal(st, snap->t, snap->root, k, v);
+    Storage_set_view(st, prev);
+    return found;
+}
+
+/* BTree_snapshot_cursor_open: Ordered cursor over the snapshot; it stays */
+/* consistent across writes to the live tree. Close it before the snapshot. */
+struct BTreeCursor* BTree_snapshot_cursor_open(const struct BTreeSnapshot *snap) {
+    struct BTreeCursor *cur = NULL;
+    assert(snap != NULL);
+    cur = malloc(sizeof(struct BTreeCursor));
+    if (!cur) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    cur->store = snap->store; cur->t = snap->t; cur->root = snap->root; cur->depth = 0; cur->pending = NULL_ADDR; cur->view = snap->view;
+    cur->prefetch = Storage_get_prefetch_depth(snap->store);
+    BTree_cursor_descend_left(cur, cur->root);
+    return cur;
+}
+
+void BTree_snapshot_close(struct BTreeSnapshot *snap) {
+    if (snap) { Storage_snapshot_close(snap->store, snap->view); free(snap); }
+}
+
+/* --- Key Filter --- */
+/* With Storage_set_bloom, BTree_get and BTree_get_many skip the descent */
+/* for keys the filter rules out. Puts add their key before it reaches */
+/* the tree, so a reader never finds a key the filter misses; deleted keys */
+/* stay in it until the next rebuild. Snapshots do not consult it, as an */
+/* older version may hold keys dropped by a rebuild. */
+
+/* Empties the filter, sized for nkeys, and adds every key of the tree */
+static void BTree_bloom_fill(const struct BTree *bt, int nkeys) {
+    struct BTreeCursor *cur = NULL; int k;
+    if (!Storage_bloom_reset(bt->store, nkeys)) { return; }
+    cur = BTree_cursor_open(bt);
+    while (BTree_cursor_next(cur, &k, NULL)) { Storage_bloom_add(bt->store, k); }
+    BTree_cursor_close(cur);
+}
+
+/* BTree_bloom_rebuild: Rebuilds the key filter from the keys in the tree, */
+/* dropping those deleted since the last rebuild. BTree_open, bulk loads */
+/* and BTree_vacuum do this when needed; no writer may run meanwhile. */
+/* Returns the number of keys, or 0 if the filter is off. */
+int BTree_bloom_rebuild(const struct BTree *bt) {
+    struct BTreeCursor *cur = NULL; int nkeys = 0;
+    assert(bt != NULL); assert(bt->t >= 2);
+    if (Storage_get_bloom_bits(bt->store) == 0) { return 0; }
+    cur = BTree_cursor_open(bt);
+    while (BTree_cursor_next(cur, NULL, NULL)) { nkeys++; }
+    BTree_cursor_close(cur);
+    BTree_bloom_fill(bt, nkeys);
+    return nkeys;
+}
+
+/* --- Vacuum (Offline Compaction) --- */
+
+/* Marks every node reachable from addr in live[] and counts them */
+static void BTree_vacuum_mark(struct Storage *st, int t, int addr, char *live, int count, int *nlive) {
+    struct Node *x; int i;
+    if (addr < 0 || addr >= count || live[addr]) { fprintf(stderr, "BTree Error: Vacuum found invalid or shared child address %d.\n", addr); exit(EXIT_FAILURE); }
+    live[addr] = 1; (*nlive)++;
+    x = BTree_disk_read(st, t, addr);
+    if (!x->leaf) { for (i = 0; i <= x->n; ++i) { BTree_vacuum_mark(st, t, x->c[i], live, count, nlive); } }
+    BTree_free_node_mem(x);
+}
+
+/* BTree_vacuum: Compacts the live nodes of an existing file into its first */
+/* pages and truncates the rest. Live nodes above the cut move into the */
+/* holes below it; each live node is then read once and rewritten only if */
+/* it moved or one of its children did. Pages unreachable from the root */
+/* (free-listed or leaked) are reclaimed as well. Returns the number of */
+/* pages removed; *live_pages (if non-NULL) gets the new page count. */
+int BTree_vacuum(const char *name, int *live_pages) {
+    struct BTree bt; struct Storage *st; struct Node *x; FILE *probe; char *live = NULL; int *remap = NULL; int *source = NULL;
+    int count; int nlive = 0; int hole; int addr; int i; int dirty;
+    probe = fopen(name, "rb");
+    if (probe == NULL) { fprintf(stderr, "BTree Error: Cannot vacuum %s: ", name); perror(NULL); exit(EXIT_FAILURE); }
+    fclose(probe);
+    bt = BTree_open(name, 2); st = bt.store; /* t comes from the file header */
+    count = Storage_get_node_count(st);
+    live = calloc(count, 1); remap = malloc(count * sizeof(int)); source = malloc(count * sizeof(int));
+    if (!live || !remap || !source) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    BTree_vacuum_mark(st, bt.t, bt.root, live, count, &nlive);
+    /* Pair live nodes at or above the cut with the holes below it */
+    for (addr = 0; addr < count; ++addr) { remap[addr] = addr; source[addr] = addr; }
+    hole = 0;
+    for (addr = nlive; addr < count; ++addr) {
+        if (!live[addr]) { continue; }
+        while (live[hole]) { hole++; }
+        remap[addr] = hole; source[hole] = addr; hole++;
+    }
+    for (addr = 0; addr < nlive; ++addr) {
+        x = BTree_disk_read(st, bt.t, source[addr]); dirty = source[addr] != addr;
+        if (!x->leaf) {
+            for (i = 0; i <= x->n; ++i) { if (remap[x->c[i]] != x->c[i]) { x->c[i] = remap[x->c[i]]; dirty = 1; } }
+        }
+        if (dirty) { BTree_disk_write(st, addr, x); }
+        BTree_free_node_mem(x);
+    }
+    Storage_truncate(st, nlive);
+    (void) BTree_bloom_rebuild(&bt); /* Also forgets deleted keys */
+    BTree_close(&bt);
+    free(live); free(remap); free(source);
+    if (live_pages != NULL) { *live_pages = nlive; }
+    return count - nlive;
+}
@@ -6,7 +6,7 @@
 
 /* Required Struct Definitions */
 struct Node { int n; int leaf; int *key; int *value; int *c; };
-struct BTree { int root; int t; };
+struct BTree { int root; int t; struct Storage *store; };
 
 /* Required Prototypes from btree.c */
 struct BTree BTree_open (const char *name, int t);
@@ -15,9 +15,9 @@ void        BTree_put  (const struct BTree *bt, int k, int v);
 void        BTree_get  (const struct BTree *bt, int k, int *v);
 
 /* Required Prototypes from storage.c */
-unsigned long Storage_get_read_count(void);
-unsigned long Storage_get_write_count(void);
-unsigned long Storage_get_alloc_count(void);
+unsigned long Storage_get_read_count(const struct Storage *st);
+unsigned long Storage_get_write_count(const struct Storage *st);
+unsigned long Storage_get_alloc_count(const struct Storage *st);
 
 #define EXAMPLE_DB_FILE "main_example.db"
 #define EXAMPLE_T 170
@@ -54,14 +54,14 @@ int main() {
     for(i=0; i<NUM_KEYS_TO_INSERT; ++i) { shuffle_idx = (size_t)i + rand() % (NUM_KEYS_TO_INSERT - i); tmp = keys_inserted[shuffle_idx]; keys_inserted[shuffle_idx] = keys_inserted[i]; keys_inserted[i] = tmp; }
 
     printf("Opening B-tree file '%s' with t=%d...\n", EXAMPLE_DB_FILE, EXAMPLE_T); remove(EXAMPLE_DB_FILE);
-    bt = BTree_open(EXAMPLE_DB_FILE, EXAMPLE_T); initial_reads = Storage_get_read_count(); initial_writes = Storage_get_write_count(); initial_allocs = Storage_get_alloc_count(); printf("B-tree opened.\n");
+    bt = BTree_open(EXAMPLE_DB_FILE, EXAMPLE_T); initial_reads = Storage_get_read_count(bt.store); initial_writes = Storage_get_write_count(bt.store); initial_allocs = Storage_get_alloc_count(bt.store); printf("B-tree opened.\n");
     printf("Inserting %d keys...\n", NUM_KEYS_TO_INSERT); start = clock();
     for (i = 0; i < NUM_KEYS_TO_INSERT; ++i) { BTree_put(&bt, keys_inserted[i], keys_inserted[i] * 2); if ((i + 1) % (NUM_KEYS_TO_INSERT / 10) == 0) { printf("  Inserted %d / %d\n", i + 1, NUM_KEYS_TO_INSERT); } }
     end = clock(); cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC; printf("Insertion finished in %.2f seconds.\n", cpu_time_used);
     printf("Querying %d keys...\n", NUM_KEYS_TO_QUERY); start = clock();
     for (i = 0; i < NUM_KEYS_TO_QUERY; ++i) { value = not_found_marker; BTree_get(&bt, keys_to_query[i], &value); if (value == keys_to_query[i] * 2) { found_count++; } else { fprintf(stderr, "Verification failed: Key %d not found or wrong value %d (expected %d)\n", keys_to_query[i], value, keys_to_query[i] * 2); } }
     end = clock(); cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC; printf("Querying finished in %.2f seconds.\n", cpu_time_used); printf("Verified %d out of %d keys.\n", found_count, NUM_KEYS_TO_QUERY); assert(found_count == NUM_KEYS_TO_QUERY);
-    final_reads = Storage_get_read_count(); final_writes = Storage_get_write_count(); final_allocs = Storage_get_alloc_count();
+    final_reads = Storage_get_read_count(bt.store); final_writes = Storage_get_write_count(bt.store); final_allocs = Storage_get_alloc_count(bt.store);
     printf("Closing B-tree...\n"); BTree_close(&bt); printf("B-tree closed.\n");
     printf("\n--- Storage Statistics ---\n"); printf("Total Reads: %lu\n", final_reads); printf("Total Writes: %lu\n", final_writes); printf("Total Allocs: %lu\n", final_allocs);
     printf("Reads during operations: %lu\n", final_reads - initial_reads); printf("Writes during operations: %lu\n", final_writes - initial_writes); printf("Allocs during operations: %lu\n", final_allocs - initial_allocs);
@@ -0,0 +1,252 @@
+/* POSIX threads for the background flusher */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h> /* For malloc, free, exit */
+#include <string.h> /* For memset */
+#include <assert.h>
+#include <pthread.h>
+
+/* Required Struct Definitions */
+struct BTree { int root; int t; struct Storage *store; };
+
+/* Required Prototypes from btree.c */
+void        BTree_get  (const struct BTree *bt, int k, int *v);
+void        BTree_delete(struct BTree *bt, int k);
+void        BTree_put_many(const struct BTree *bt, const int *keys, const int *values, int n);
+void        BTree_thread_exit(void);
+
+/* --- Memtable --- */
+/* A write buffer in front of one open tree. Puts and deletes land in an */
+/* in-memory skip list; once it holds max_entries keys it becomes the */
+/* immutable table, which a background thread writes into the tree in key */
+/* order while a fresh table takes new writes. Reads try the active table, */
+/* then the immutable one, then the tree. A writer only waits when both */
+/* tables are full, so a burst runs at memory speed until the flusher falls */
+/* a whole table behind. Buffered writes reach the file only through */
+/* BTree_memtable_flush (then BTree_sync); a crash loses them. */
+
+/* Marks a buffered delete. The value is reserved and never reaches the */
+/* tree: a flush turns it into BTree_delete */
+#define DELETION_SENTINEL ((int)0xDEADDEAD)
+/* Skip list height: ample for 4^16 entries at p = 1/4 */
+#define MEM_LEVELS 16
+/* Puts written per BTree_put_many call: each batch holds the root latch, */
+/* so readers of the tree get in between batches */
+#define MEM_FLUSH_BATCH 1024
+
+/* Skip list in fixed arrays; entry 0 is the head, link 0 ends a list */
+struct MemTable {
+    int n;                 /* Entries in use, head excluded */
+    int cap;
+    int level;             /* Levels in use */
+    int *key;
+    int *value;            /* DELETION_SENTINEL for a delete */
+    int *next;             /* MEM_LEVELS links per entry */
+    unsigned int seed;     /* xorshift state for entry heights */
+};
+
+struct BTreeMemtable {
+    struct BTree bt;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct MemTable *active;   /* Takes writes; guarded by lock */
+    struct MemTable *imm;      /* Being written to the tree, or NULL */
+    struct MemTable *spare;    /* Empty table for the next switch, or NULL */
+    int stop;
+    int *keys;                 /* Flusher batch */
+    int *values;
+    unsigned long flushes;
+    unsigned long stalls;      /* Writes that waited for the flusher */
+};
+
+static struct MemTable* mem_table_new(int cap) {
+    struct MemTable *mt = malloc(sizeof(struct MemTable));
+    if (!mt) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    mt->key = malloc(((size_t)cap + 1) * sizeof(int)); mt->value = malloc(((size_t)cap + 1) * sizeof(int));
+    mt->next = malloc(((size_t)cap + 1) * MEM_LEVELS * sizeof(int));
+    if (!mt->key || !mt->value || !mt->next) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    mt->cap = cap; mt->seed = 2463534242U;
+    mt->n = 0; mt->level = 1; memset(mt->next, 0, MEM_LEVELS * sizeof(int));
+    return mt;
+}
+
+static void mem_table_free(struct MemTable *mt) { if (mt) { free(mt->key); free(mt->value); free(mt->next); free(mt); } }
+
+static void mem_table_reset(struct MemTable *mt) { mt->n = 0; mt->level = 1; memset(mt->next, 0, MEM_LEVELS * sizeof(int)); }
+
+/* Last entry below k on each level (into prev); returns the entry holding k or 0 */
+static int mem_table_seek(const struct MemTable *mt, int k, int *prev) {
+    int x = 0; int l; int y;
+    for (l = mt->level - 1; l >= 0; --l) {
+        while ((y = mt->next[x * MEM_LEVELS + l]) != 0 && mt->key[y] < k) { x = y; }
+        if (prev != NULL) { prev[l] = x; }
+    }
+    y = mt->next[x * MEM_LEVELS];
+    return y != 0 && mt->key[y] == k ? y : 0;
+}
+
+/* 1 if the table decides k (sets *v unless it is a delete), 0 if k is not buffered */
+static int mem_table_get(const struct MemTable *mt, int k, int *v) {
+    int e = mem_table_seek(mt, k, NULL);
+    if (e == 0) { return 0; }
+    if (mt->value[e] != DELETION_SENTINEL) { *v = mt->value[e]; }
+    return 1;
+}
+
+/* Sets k to v; returns 0 if k is new and the table is full */
+static int mem_table_put(struct MemTable *mt, int k, int v) {
+    int prev[MEM_LEVELS]; int e; int h = 1; int l;
+    e = mem_table_seek(mt, k, prev);
+    if (e != 0) { mt->value[e] = v; return 1; }
+    if (mt->n == mt->cap) { return 0; }
+    while (h < MEM_LEVELS) { /* Each level with probability 1/4 */
+        mt->seed ^= mt->seed << 13; mt->seed ^= mt->seed >> 17; mt->seed ^= mt->seed << 5;
+        if ((mt->seed & 3U) != 0) { break; }
+        h++;
+    }
+    for (l = mt->level; l < h; ++l) { prev[l] = 0; }
+    if (h > mt->level) { mt->level = h; }
+    e = ++mt->n; mt->key[e] = k; mt->value[e] = v;
+    for (l = 0; l < h; ++l) { mt->next[e * MEM_LEVELS + l] = mt->next[prev[l] * MEM_LEVELS + l]; mt->next[prev[l] * MEM_LEVELS + l] = e; }
+    for (; l < MEM_LEVELS; ++l) { mt->next[e * MEM_LEVELS + l] = 0; }
+    return 1;
+}
+
+/* Writes mt into the tree in key order: puts in batches, deletes one by one */
+static void mem_table_write(struct BTreeMemtable *m, const struct MemTable *mt) {
+    int e; int n = 0;
+    for (e = mt->next[0]; e != 0; e = mt->next[e * MEM_LEVELS]) {
+        if (mt->value[e] == DELETION_SENTINEL) { BTree_delete(&m->bt, mt->key[e]); continue; } /* Keys are unique: order across kinds is free */
+        m->keys[n] = mt->key[e]; m->values[n] = mt->value[e];
+        if (++n == MEM_FLUSH_BATCH) { BTree_put_many(&m->bt, m->keys, m->values, n); n = 0; }
+    }
+    if (n > 0) { BTree_put_many(&m->bt, m->keys, m->values, n); }
+}
+
+static void* BTree_memtable_main(void *arg) {
+    struct BTreeMemtable *m = arg; struct MemTable *mt;
+    pthread_mutex_lock(&m->lock);
+    for (;;) {
+        while (m->imm == NULL && !m->stop) { pthread_cond_wait(&m->cond, &m->lock); }
+        if (m->imm == NULL) { break; }
+        mt = m->imm;
+        pthread_mutex_unlock(&m->lock);
+        mem_table_write(m, mt); /* Readers still find these keys in imm meanwhile */
+        pthread_mutex_lock(&m->lock);
+        mem_table_reset(mt); m->spare = mt; m->imm = NULL; m->flushes++;
+        pthread_cond_broadcast(&m->cond);
+    }
+    pthread_mutex_unlock(&m->lock);
+    BTree_thread_exit();
+    return NULL;
+}
+
+/* Hands the active table to the flusher once it is idle. Caller holds lock. */
+static void BTree_memtable_switch(struct BTreeMemtable *m) {
+    while (m->imm != NULL) { pthread_cond_wait(&m->cond, &m->lock); }
+    m->imm = m->active; m->active = m->spare; m->spare = NULL;
+    pthread_cond_broadcast(&m->cond);
+}
+
+/* BTree_memtable_open: Puts a memtable of up to max_entries keys (two */
+/* tables of that size are kept) in front of the open tree bt, which must */
+/* stay open until BTree_memtable_close. While the memtable is open, */
+/* write to the tree only through it. */
+struct BTreeMemtable* BTree_memtable_open(const struct BTree *bt, int max_entries) {
+    struct BTreeMemtable *m;
+    assert(bt != NULL); assert(bt->t >= 2);
+    if (max_entries < 1) { fprintf(stderr, "BTree Error: Invalid memtable size %d.\n", max_entries); exit(EXIT_FAILURE); }
+    m = malloc(sizeof(struct BTreeMemtable));
+    if (!m) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    m->bt = *bt; m->stop = 0; m->flushes = 0; m->stalls = 0; m->imm = NULL;
+    m->active = mem_table_new(max_entries); m->spare = mem_table_new(max_entries);
+    m->keys = malloc(MEM_FLUSH_BATCH * sizeof(int)); m->values = malloc(MEM_FLUSH_BATCH * sizeof(int));
+    if (!m->keys || !m->values) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    if (pthread_mutex_init(&m->lock, NULL) != 0 || pthread_cond_init(&m->cond, NULL) != 0 ||
+        pthread_create(&m->thread, NULL, BTree_memtable_main, m) != 0) {
+        fprintf(stderr, "BTree Error: Cannot start memtable flusher.\n"); exit(EXIT_FAILURE);
+    }
+    return m;
+}
+
+/* BTree_memtable_put: Buffers k -> v. v must not be DELETION_SENTINEL. */
+void BTree_memtable_put(struct BTreeMemtable *m, int k, int v) {
+    assert(m != NULL);
+    if (v == DELETION_SENTINEL) { fprintf(stderr, "BTree Error: Value %d is reserved for deletes.\n", v); exit(EXIT_FAILURE); }
+    pthread_mutex_lock(&m->lock);
+    while (!mem_table_put(m->active, k, v)) {
+        if (m->imm != NULL) { m->stalls++; }
+        BTree_memtable_switch(m);
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+/* BTree_memtable_delete: Buffers a delete of k */
+void BTree_memtable_delete(struct BTreeMemtable *m, int k) {
+    assert(m != NULL);
+    pthread_mutex_lock(&m->lock);
+    while (!mem_table_put(m->active, k, DELETION_SENTINEL)) {
+        if (m->imm != NULL) { m->stalls++; }
+        BTree_memtable_switch(m);
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+/* BTree_memtable_get: As BTree_get, with buffered writes applied */
+void BTree_memtable_get(struct BTreeMemtable *m, int k, int *v) {
+    int decided;
+    assert(m != NULL); assert(v != NULL);
+    pthread_mutex_lock(&m->lock);
+    decided = mem_table_get(m->active, k, v) || (m->imm != NULL && mem_table_get(m->imm, k, v));
+    pthread_mutex_unlock(&m->lock);
+    if (!decided) { BTree_get(&m->bt, k, v); }
+}
+
+/* BTree_memtable_flush: Returns once every buffered write is in the tree */
+/* (BTree_sync then makes them durable) */
+void BTree_memtable_flush(struct BTreeMemtable *m) {
+    assert(m != NULL);
+    pthread_mutex_lock(&m->lock);
+    if (m->active->n > 0) { BTree_memtable_switch(m); }
+    while (m->imm != NULL) { pthread_cond_wait(&m->cond, &m->lock); }
+    pthread_mutex_unlock(&m->lock);
+}
+
+/* Keys buffered in memory (both tables) */
+int BTree_memtable_size(struct BTreeMemtable *m) {
+    int n;
+    pthread_mutex_lock(&m->lock);
+    n = m->active->n + (m->imm != NULL ? m->imm->n : 0);
+    pthread_mutex_unlock(&m->lock);
+    return n;
+}
+
+/* Tables written to the tree so far */
+unsigned long BTree_memtable_flush_count(struct BTreeMemtable *m) {
+    unsigned long n;
+    pthread_mutex_lock(&m->lock); n = m->flushes; pthread_mutex_unlock(&m->lock);
+    return n;
+}
+
+/* Writes that found both tables full and waited for the flusher */
+unsigned long BTree_memtable_stall_count(struct BTreeMemtable *m) {
+    unsigned long n;
+    pthread_mutex_lock(&m->lock); n = m->stalls; pthread_mutex_unlock(&m->lock);
+    return n;
+}
+
+/* BTree_memtable_close: Flushes, stops the flusher and frees the memtable; */
+/* the tree stays open */
+void BTree_memtable_close(struct BTreeMemtable *m) {
+    if (!m) { return; }
+    BTree_memtable_flush(m);
+    pthread_mutex_lock(&m->lock);
+    m->stop = 1; pthread_cond_broadcast(&m->cond);
+    pthread_mutex_unlock(&m->lock);
+    pthread_join(m->thread, NULL);
+    pthread_mutex_destroy(&m->lock); pthread_cond_destroy(&m->cond);
+    mem_table_free(m->active); mem_table_free(m->spare);
+    free(m->keys); free(m->values); free(m);
+}
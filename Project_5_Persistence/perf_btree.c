@@ -1,48 +1,187 @@
+/* POSIX for clock_gettime (wall time of fsync-bound runs) */
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h> /* For rand, srand, malloc, free, exit, atoi */
-#include <time.h>   /* For time */
+#include <time.h>   /* For time, clock_gettime */
 #include <string.h> /* For memcpy, sprintf */
 #include <assert.h>
+#include <limits.h> /* For INT_MIN, INT_MAX */
+#include <pthread.h>
+#include <sys/stat.h> /* For stat (file and allocated size) */
+#include <fcntl.h>    /* For open, posix_fadvise (cold-cache scans) */
+#include <unistd.h>   /* For close, fdatasync */
 
 /* Required Struct Definitions */
 struct Node { int n; int leaf; int *key; int *value; int *c; };
-struct BTree { int root; int t; };
+struct BTree { int root; int t; struct Storage *store; };
+struct BPTree { int root; int t; struct Storage *store; };
+struct BETree { int root; int t; struct Storage *store; };
 
 /* Required Prototypes from btree.c */
 struct BTree BTree_open (const char *name, int t);
 void        BTree_close(struct BTree *bt);
 void        BTree_put  (const struct BTree *bt, int k, int v);
 void        BTree_get  (const struct BTree *bt, int k, int *v);
+void        BTree_delete(struct BTree *bt, int k);
+int         BTree_get_many(const struct BTree *bt, const int *keys, int *values, int n);
+void        BTree_put_many(const struct BTree *bt, const int *keys, const int *values, int n);
+int         BTree_vacuum(const char *name, int *live_pages);
+struct BTree BTree_bulk_load(const char *name, int t, int fill_pct, const int *keys, const int *values, int n);
+void        BTree_sync(const struct BTree *bt);
+int         BTree_scan(const struct BTree *bt, int lo, int hi, int (*cb)(int k, int v, void *ctx), void *ctx);
+int         BTree_bloom_rebuild(const struct BTree *bt);
+
+/* Required Prototypes from bptree.c */
+struct BPTree BPTree_open(const char *name, int t);
+void        BPTree_close(struct BPTree *bt);
+void        BPTree_put  (const struct BPTree *bt, int k, int v);
+void        BPTree_get  (const struct BPTree *bt, int k, int *v);
+int         BPTree_scan (const struct BPTree *bt, int lo, int hi, int (*cb)(int k, int v, void *ctx), void *ctx);
+
+/* Required Prototypes from memtable.c */
+struct BTreeMemtable; /* Opaque, defined in memtable.c */
+struct BTreeMemtable* BTree_memtable_open(const struct BTree *bt, int max_entries);
+void        BTree_memtable_put(struct BTreeMemtable *m, int k, int v);
+void        BTree_memtable_flush(struct BTreeMemtable *m);
+unsigned long BTree_memtable_flush_count(struct BTreeMemtable *m);
+unsigned long BTree_memtable_stall_count(struct BTreeMemtable *m);
+void        BTree_memtable_close(struct BTreeMemtable *m);
+
+/* Required Prototypes from betree.c */
+struct BETree BETree_open(const char *name, int t);
+void        BETree_close(struct BETree *bt);
+void        BETree_put  (const struct BETree *bt, int k, int v);
+void        BETree_get  (const struct BETree *bt, int k, int *v);
+
+/* Required Prototypes from shard.c */
+struct BTreeShards; /* Opaque, defined in shard.c */
+struct BTreeShards* BTree_shards_open(const char *prefix, int nshards, int t, const int *splits);
+void        BTree_shards_put_many(struct BTreeShards *sh, const int *keys, const int *values, int n);
+int         BTree_shards_get_many(struct BTreeShards *sh, const int *keys, int *values, int n);
+void        BTree_shards_sync(struct BTreeShards *sh);
+void        BTree_shards_close(struct BTreeShards *sh);
 
 /* Required Prototypes from storage.c */
-unsigned long Storage_get_read_count(void);
-unsigned long Storage_get_write_count(void);
-unsigned long Storage_get_alloc_count(void);
+unsigned long Storage_get_read_count(const struct Storage *st);
+unsigned long Storage_get_write_count(const struct Storage *st);
+unsigned long Storage_get_alloc_count(const struct Storage *st);
+unsigned long Storage_get_free_count(const struct Storage *st);
+int           Storage_get_node_count(struct Storage *st);
+int           Storage_get_free_page_count(struct Storage *st);
+unsigned long Storage_get_cache_hit_count(const struct Storage *st);
+unsigned long Storage_get_cache_miss_count(const struct Storage *st);
+void          Storage_set_cache_size(int frames);
+void          Storage_set_backend(int backend);
+void          Storage_set_page_size(int bytes);
+void          Storage_set_wal(int group_ops, long window_us);
+unsigned long Storage_get_wal_commit_count(const struct Storage *st);
+unsigned long Storage_get_sync_count(const struct Storage *st);
+unsigned long Storage_get_wal_bytes(const struct Storage *st);
+void          Storage_set_compression(int on);
+unsigned long Storage_get_io_read_bytes(const struct Storage *st);
+unsigned long Storage_get_io_write_bytes(const struct Storage *st);
+void          Storage_flush(struct Storage *st);
+void          Storage_set_prefetch(int depth);
+unsigned long Storage_get_prefetch_count(const struct Storage *st);
+unsigned long Storage_get_prefetch_hit_count(const struct Storage *st);
+void          Storage_set_bloom(int bits_per_key);
+long          Storage_get_bloom_bytes(struct Storage *st);
+unsigned long Storage_get_bloom_skip_count(const struct Storage *st);
 
 #define PERF_DB_FILE_PREFIX "perf_btree_t"
 #define NUM_KEYS 100000
 #define NUM_QUERIES 10000
+#define CACHE_FRAMES 256
+#define BULK_FILL_PCT 100
+#define GET_BATCH 256
+#define PUT_BATCH 256
+/* Puts per group commit run (each group costs an fdatasync, so bounded) */
+#define WAL_OPS 5000
+/* Keys handed to the sharded index per call (split across the shards) */
+#define SHARD_BATCH 4096
+/* Shared-tree run: one operation in MT_PUT_EVERY is a put, the rest gets */
+#define MT_PUT_EVERY 10
+/* Storage backends (must match storage.c) */
+#define STORAGE_BACKEND_STDIO 0
+#define STORAGE_BACKEND_MMAP  1
+
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int *)a; int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Hit percentage over a counter window (0 when no lookups happened) */
+static double hit_rate(unsigned long hits, unsigned long misses) {
+    return (hits + misses) > 0 ? 100.0 * (double)hits / (double)(hits + misses) : 0.0;
+}
+
+/* Elapsed wall time; clock() would not see time spent waiting in fsync */
+static double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Scan callback: counts keys */
+static int count_cb(int k, int v, void *ctx) { (void)k; (void)v; ++*(int *)ctx; return 0; }
+
+/* Drops a file from the OS page cache so the next reads go to the device */
+static void evict_os_cache(const char *name) {
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) { perror("open"); return; }
+    if (fdatasync(fd) != 0 || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0) { fprintf(stderr, "WARN: cannot evict %s from the page cache\n", name); }
+    close(fd);
+}
+
+/* One thread of the shared-tree run: ops mixed gets and puts on keys */
+struct PerfWorker { pthread_t thread; const struct BTree *bt; const int *keys; int nkeys; int ops; unsigned int seed; int found; };
+
+static void* perf_worker(void *arg) {
+    struct PerfWorker *w = arg; int i; int k; int v;
+    for (i = 0; i < w->ops; ++i) { /* rand() is not thread-safe: private LCG */
+        w->seed = w->seed * 1103515245u + 12345u; k = w->keys[(w->seed >> 8) % (unsigned int)w->nkeys];
+        if (i % MT_PUT_EVERY == 0) { BTree_put(w->bt, k, k); w->found++; }
+        else { v = k - 1; BTree_get(w->bt, k, &v); if (v != k - 1) { w->found++; } } /* Stored values are k or k+1 */
+    }
+    return NULL;
+}
 
 /* Use standard rand/srand */
 
 int main(int argc, const char *argv[]) {
     /* --- Declarations at top (ANSI C) --- */
     int min_t = 4; int max_t = 128; int step_t = 2;
-    int num_keys = NUM_KEYS; int num_queries = NUM_QUERIES;
+    int num_keys = NUM_KEYS; int num_queries = NUM_QUERIES; int cache_frames = CACHE_FRAMES;
+    int backend = STORAGE_BACKEND_STDIO; int page_size = 0;
     int *keys_to_insert = NULL; int *keys_to_query = NULL;
-    char db_filename[256]; int i; int j; int t; int k; int unique;
-    size_t shuffle_idx; int tmp; struct BTree bt; clock_t start, end;
+    char db_filename[256]; int i; int j; int t;
+    size_t shuffle_idx; int tmp; struct BTree bt; double start, end; /* Wall time (wall_seconds) */
     double insert_time, query_time;
     unsigned long reads_start_ins, writes_start_ins, allocs_start_ins;
     unsigned long reads_end_ins, writes_end_ins, allocs_end_ins;
     unsigned long reads_start_qry, writes_start_qry, allocs_start_qry;
     unsigned long reads_end_qry, writes_end_qry, allocs_end_qry; int val;
+    unsigned long hits_start, misses_start; double ins_hit, qry_hit;
+    int *sorted_keys = NULL; int *sorted_values = NULL; int num_sorted; double bulk_time;
+    int num_deletes; unsigned long frees_start; double delete_time; int pages; int free_pages; int live_pages; double vacuum_time;
+    int *batch_vals = NULL; int batch; unsigned long single_reads; double single_time; double batch_time;
+    int wal_groups[] = {0, 1, 8, 64, 512}; int g; int wal_ops; double wall_start; double wal_time;
+    struct BPTree bpt; const char *layouts[2] = { "B-tree", "B+tree" }; int layout; double scan_time; int scanned;
+    unsigned long reads_qry; unsigned long reads_scan;
+    const char *encodings[2] = { "plain", "varint" }; int enc; struct stat file_stat; unsigned long io_bytes;
+    int prefetch_depths[] = {0, 4, 16, 64}; int pd;
+    struct BETree bet; const char *ingest_layouts[2] = { "B-tree", "Be-tree" }; unsigned long misses_ins;
+    int memtable_sizes[] = {0, 1024, 16384, 262144}; int ms; struct BTreeMemtable *mem; double burst_time; double drain_time;
+    int bloom_bits[] = {0, 4, 8, 10, 16}; int bb; unsigned long reads_nofilter = 0; unsigned long skipped; long filter_bytes;
+    int thread_counts[] = {1, 2, 4, 8}; struct PerfWorker workers[8]; int mt_ops; double mt_time; double base_mt_time = 0.0;
+    int shard_counts[] = {1, 2, 4, 8}; struct BTreeShards *sh; double shard_put_time; double shard_get_time; double base_put_time = 0.0; int found; char shard_name[300];
 
     /* --- Code --- */
     printf("Performance Harness\n");
-    printf("Usage: %s [num_keys] [num_queries] [min_t] [max_t] [step_t]\n", argv[0]);
-    printf("Defaults: N=%d, Q=%d, min_t=%d, max_t=%d, step=x%d\n\n",
-           NUM_KEYS, NUM_QUERIES, min_t, max_t, step_t);
+    printf("Usage: %s [num_keys] [num_queries] [min_t] [max_t] [step_t] [cache_frames] [stdio|mmap] [page_size]\n", argv[0]);
+    printf("Defaults: N=%d, Q=%d, min_t=%d, max_t=%d, step=x%d, cache=%d frames, backend=stdio, page_size=0 (packed)\n\n",
+           NUM_KEYS, NUM_QUERIES, min_t, max_t, step_t, CACHE_FRAMES);
 
     /* --- Argument Parsing (Fixed Indentation) --- */
     if (argc > 1) num_keys = atoi(argv[1]);
@@ -50,9 +189,12 @@ int main(int argc, const char *argv[]) {
     if (argc > 3) min_t = atoi(argv[3]);
     if (argc > 4) max_t = atoi(argv[4]);
     if (argc > 5) step_t = atoi(argv[5]);
+    if (argc > 6) cache_frames = atoi(argv[6]);
+    if (argc > 7) backend = (strcmp(argv[7], "mmap") == 0) ? STORAGE_BACKEND_MMAP : STORAGE_BACKEND_STDIO;
+    if (argc > 8) page_size = atoi(argv[8]);
     /* --- End Argument Parsing Fix --- */
 
-    if (num_keys <= 0 || num_queries <= 0 || num_queries > num_keys || min_t < 2 || max_t < min_t || step_t < 1) {
+    if (num_keys <= 0 || num_queries <= 0 || num_queries > num_keys || min_t < 2 || max_t < min_t || step_t < 1 || cache_frames < 0) {
         fprintf(stderr, "Invalid arguments.\n"); return 1;
     }
 
@@ -61,34 +203,364 @@ int main(int argc, const char *argv[]) {
 
     printf("Generating %d unique random keys for insertion...\n", num_keys);
     srand((unsigned int)time(NULL)); /* Seed rand once */
-    for (i = 0; i < num_keys; ++i) {
-        do { unique = 1; k = rand() % (num_keys * 10); /* Use rand */
-            for (j = 0; j < i; ++j) { if (keys_to_insert[j] == k) { unique = 0; break; } } if (!unique) continue;
-        } while(0); keys_to_insert[i] = k;
-    }
+    for (i = 0; i < num_keys; ++i) { keys_to_insert[i] = i * 10 + rand() % 10; } /* One key per slot of 10: unique in O(n); the shuffles below randomize the order */
     printf("Generating %d keys for querying...\n", num_queries);
     for(i=0; i<num_keys; ++i) { shuffle_idx = (size_t)i + rand() % (num_keys - i); tmp = keys_to_insert[shuffle_idx]; keys_to_insert[shuffle_idx] = keys_to_insert[i]; keys_to_insert[i] = tmp; }
     memcpy(keys_to_query, keys_to_insert, num_queries * sizeof(int));
     for(i=0; i<num_keys; ++i) { shuffle_idx = (size_t)i + rand() % (num_keys - i); tmp = keys_to_insert[shuffle_idx]; keys_to_insert[shuffle_idx] = keys_to_insert[i]; keys_to_insert[i] = tmp; }
 
-    printf("------------------------------------------------------------------------------------------------------------------------------\n");
-    printf("| %4s | %12s | %12s | %10s | %10s | %10s | %12s | %12s | %10s | %10s | %10s |\n", "T", "Ins Time (s)", "Ins Ops/s", "Ins Reads", "Ins Writes", "Ins Allocs", "Qry Time (s)", "Qry Ops/s", "Qry Reads", "Qry Writes", "Qry Allocs");
-    printf("------------------------------------------------------------------------------------------------------------------------------\n");
+    Storage_set_cache_size(cache_frames);
+    Storage_set_backend(backend);
+    Storage_set_page_size(page_size); /* Validated here; applies to every file created below */
+    printf("------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
+    printf("| %4s | %12s | %12s | %10s | %10s | %10s | %6s | %6s | %7s | %12s | %12s | %10s | %10s | %10s | %7s |\n", "T", "Ins Time (s)", "Ins Ops/s", "Ins Reads", "Ins Writes", "Ins Allocs", "Rd/Put", "Wr/Put", "Ins Hit", "Qry Time (s)", "Qry Ops/s", "Qry Reads", "Qry Writes", "Qry Allocs", "Qry Hit");
+    printf("------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
 
     for (t = min_t; t <= max_t; t = (step_t == 1 ? t + 1 : t * step_t)) {
         sprintf(db_filename, "%s%d.db", PERF_DB_FILE_PREFIX, t); remove(db_filename);
         bt = BTree_open(db_filename, t);
-        reads_start_ins = Storage_get_read_count(); writes_start_ins = Storage_get_write_count(); allocs_start_ins = Storage_get_alloc_count();
-        start = clock(); for (i = 0; i < num_keys; ++i) { BTree_put(&bt, keys_to_insert[i], keys_to_insert[i] + 1); } end = clock();
-        reads_end_ins = Storage_get_read_count(); writes_end_ins = Storage_get_write_count(); allocs_end_ins = Storage_get_alloc_count(); insert_time = (double)(end - start) / CLOCKS_PER_SEC;
-        reads_start_qry = Storage_get_read_count(); writes_start_qry = Storage_get_write_count(); allocs_start_qry = Storage_get_alloc_count();
-        start = clock(); for (i = 0; i < num_queries; ++i) { val = -1; BTree_get(&bt, keys_to_query[i], &val); if (val != keys_to_query[i] + 1) { fprintf(stderr, "WARN: Query failed for key %d (t=%d, val=%d)\n", keys_to_query[i], t, val); } } end = clock();
-        reads_end_qry = Storage_get_read_count(); writes_end_qry = Storage_get_write_count(); allocs_end_qry = Storage_get_alloc_count(); query_time = (double)(end - start) / CLOCKS_PER_SEC;
+        reads_start_ins = Storage_get_read_count(bt.store); writes_start_ins = Storage_get_write_count(bt.store); allocs_start_ins = Storage_get_alloc_count(bt.store);
+        hits_start = Storage_get_cache_hit_count(bt.store); misses_start = Storage_get_cache_miss_count(bt.store);
+        start = wall_seconds(); for (i = 0; i < num_keys; ++i) { BTree_put(&bt, keys_to_insert[i], keys_to_insert[i] + 1); } end = wall_seconds();
+        reads_end_ins = Storage_get_read_count(bt.store); writes_end_ins = Storage_get_write_count(bt.store); allocs_end_ins = Storage_get_alloc_count(bt.store); insert_time = (end - start);
+        ins_hit = hit_rate(Storage_get_cache_hit_count(bt.store) - hits_start, Storage_get_cache_miss_count(bt.store) - misses_start);
+        hits_start = Storage_get_cache_hit_count(bt.store); misses_start = Storage_get_cache_miss_count(bt.store);
+        reads_start_qry = Storage_get_read_count(bt.store); writes_start_qry = Storage_get_write_count(bt.store); allocs_start_qry = Storage_get_alloc_count(bt.store);
+        start = wall_seconds(); for (i = 0; i < num_queries; ++i) { val = -1; BTree_get(&bt, keys_to_query[i], &val); if (val != keys_to_query[i] + 1) { fprintf(stderr, "WARN: Query failed for key %d (t=%d, val=%d)\n", keys_to_query[i], t, val); } } end = wall_seconds();
+        reads_end_qry = Storage_get_read_count(bt.store); writes_end_qry = Storage_get_write_count(bt.store); allocs_end_qry = Storage_get_alloc_count(bt.store); query_time = (end - start);
+        qry_hit = hit_rate(Storage_get_cache_hit_count(bt.store) - hits_start, Storage_get_cache_miss_count(bt.store) - misses_start);
         BTree_close(&bt);
-        printf("| %4d | %12.4f | %12.1f | %10lu | %10lu | %10lu | %12.4f | %12.1f | %10lu | %10lu | %10lu |\n", t, insert_time, insert_time > 0 ? (double)num_keys / insert_time : 0.0, reads_end_ins - reads_start_ins, writes_end_ins - writes_start_ins, allocs_end_ins - allocs_start_ins, query_time, query_time > 0 ? (double)num_queries / query_time : 0.0, reads_end_qry - reads_start_qry, writes_end_qry - writes_start_qry, allocs_end_qry - allocs_start_qry);
+        printf("| %4d | %12.4f | %12.1f | %10lu | %10lu | %10lu | %6.2f | %6.2f | %6.1f%% | %12.4f | %12.1f | %10lu | %10lu | %10lu | %6.1f%% |\n", t, insert_time, insert_time > 0 ? (double)num_keys / insert_time : 0.0, reads_end_ins - reads_start_ins, writes_end_ins - writes_start_ins, allocs_end_ins - allocs_start_ins, (double)(reads_end_ins - reads_start_ins) / num_keys, (double)(writes_end_ins - writes_start_ins) / num_keys, ins_hit, query_time, query_time > 0 ? (double)num_queries / query_time : 0.0, reads_end_qry - reads_start_qry, writes_end_qry - writes_start_qry, allocs_end_qry - allocs_start_qry, qry_hit);
         /* remove(db_filename); */
     }
-    printf("------------------------------------------------------------------------------------------------------------------------------\n");
+    printf("------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
+
+    /* --- Batched lookups against the files built above --- */
+    batch_vals = malloc(num_queries * sizeof(int));
+    if (!batch_vals) { perror("Failed to allocate batch value array"); return 1; }
+    printf("\nBatched lookup (BTree_get_many, batch=%d) vs BTree_get, same %d keys\n", GET_BATCH, num_queries);
+    printf("-------------------------------------------------------------------------------------------\n");
+    printf("| %4s | %12s | %12s | %12s | %12s | %10s | %7s |\n", "T", "Get Reads", "Get Time (s)", "Batch Reads", "Batch Tm (s)", "Saved", "Saved %");
+    printf("-------------------------------------------------------------------------------------------\n");
+    for (t = min_t; t <= max_t; t = (step_t == 1 ? t + 1 : t * step_t)) {
+        sprintf(db_filename, "%s%d.db", PERF_DB_FILE_PREFIX, t);
+        bt = BTree_open(db_filename, t);
+        reads_start_qry = Storage_get_read_count(bt.store); start = wall_seconds();
+        for (i = 0; i < num_queries; ++i) { val = -1; BTree_get(&bt, keys_to_query[i], &val); }
+        end = wall_seconds(); single_reads = Storage_get_read_count(bt.store) - reads_start_qry; single_time = (end - start);
+        reads_start_qry = Storage_get_read_count(bt.store); start = wall_seconds();
+        for (i = 0; i < num_queries; i += GET_BATCH) {
+            batch = num_queries - i < GET_BATCH ? num_queries - i : GET_BATCH;
+            if (BTree_get_many(&bt, &keys_to_query[i], &batch_vals[i], batch) != batch) { fprintf(stderr, "WARN: Batched query missed keys (t=%d, offset=%d)\n", t, i); }
+        }
+        end = wall_seconds(); reads_end_qry = Storage_get_read_count(bt.store) - reads_start_qry; batch_time = (end - start);
+        BTree_close(&bt);
+        printf("| %4d | %12lu | %12.4f | %12lu | %12.4f | %10lu | %6.1f%% |\n", t, single_reads, single_time, reads_end_qry, batch_time,
+               single_reads - reads_end_qry, single_reads > 0 ? 100.0 * (double)(single_reads - reads_end_qry) / (double)single_reads : 0.0);
+    }
+    printf("-------------------------------------------------------------------------------------------\n");
+    free(batch_vals);
+
+    /* --- Batched upserts of the same keys into fresh files --- */
+    batch_vals = malloc(num_keys * sizeof(int));
+    if (!batch_vals) { perror("Failed to allocate batch value array"); return 1; }
+    for (i = 0; i < num_keys; ++i) { batch_vals[i] = keys_to_insert[i] + 1; }
+    printf("\nBatched upsert (BTree_put_many, batch=%d), same %d keys\n", PUT_BATCH, num_keys);
+    printf("------------------------------------------------------------------------------------------\n");
+    printf("| %4s | %12s | %12s | %10s | %10s | %10s | %6s | %6s |\n", "T", "Put Time (s)", "Put Ops/s", "Reads", "Writes", "Allocs", "Rd/Put", "Wr/Put");
+    printf("------------------------------------------------------------------------------------------\n");
+    for (t = min_t; t <= max_t; t = (step_t == 1 ? t + 1 : t * step_t)) {
+        sprintf(db_filename, "%s%d_batch.db", PERF_DB_FILE_PREFIX, t); remove(db_filename);
+        bt = BTree_open(db_filename, t);
+        reads_start_ins = Storage_get_read_count(bt.store); writes_start_ins = Storage_get_write_count(bt.store); allocs_start_ins = Storage_get_alloc_count(bt.store);
+        start = wall_seconds();
+        for (i = 0; i < num_keys; i += PUT_BATCH) {
+            batch = num_keys - i < PUT_BATCH ? num_keys - i : PUT_BATCH;
+            BTree_put_many(&bt, &keys_to_insert[i], &batch_vals[i], batch);
+        }
+        end = wall_seconds(); insert_time = (end - start);
+        reads_end_ins = Storage_get_read_count(bt.store) - reads_start_ins; writes_end_ins = Storage_get_write_count(bt.store) - writes_start_ins; allocs_end_ins = Storage_get_alloc_count(bt.store) - allocs_start_ins;
+        for (i = 0; i < num_queries; ++i) { val = -1; BTree_get(&bt, keys_to_query[i], &val); if (val != keys_to_query[i] + 1) { fprintf(stderr, "WARN: Query failed for key %d after batched put (t=%d, val=%d)\n", keys_to_query[i], t, val); } }
+        BTree_close(&bt);
+        printf("| %4d | %12.4f | %12.1f | %10lu | %10lu | %10lu | %6.2f | %6.2f |\n", t, insert_time, insert_time > 0 ? (double)num_keys / insert_time : 0.0,
+               reads_end_ins, writes_end_ins, allocs_end_ins, (double)reads_end_ins / num_keys, (double)writes_end_ins / num_keys);
+    }
+    printf("------------------------------------------------------------------------------------------\n");
+    free(batch_vals);
+
+    /* --- Bulk load of the same keys, sorted --- */
+    sorted_keys = malloc(num_keys * sizeof(int)); sorted_values = malloc(num_keys * sizeof(int));
+    if (!sorted_keys || !sorted_values) { perror("Failed to allocate bulk load arrays"); return 1; }
+    memcpy(sorted_keys, keys_to_insert, num_keys * sizeof(int));
+    qsort(sorted_keys, num_keys, sizeof(int), compare_ints);
+    /* The generator above can repeat keys; bulk load needs strictly increasing input */
+    for (i = 0, j = 0; i < num_keys; ++i) { if (j == 0 || sorted_keys[i] != sorted_keys[j - 1]) { sorted_keys[j++] = sorted_keys[i]; } }
+    num_sorted = j;
+    for (i = 0; i < num_sorted; ++i) { sorted_values[i] = sorted_keys[i] + 1; }
+    printf("\nBulk load (%d sorted unique keys, fill=%d%%)\n", num_sorted, BULK_FILL_PCT);
+    printf("-------------------------------------------------------------------------\n");
+    printf("| %4s | %13s | %12s | %10s | %10s | %10s |\n", "T", "Load Time (s)", "Keys/s", "Writes", "Allocs", "Qry Reads");
+    printf("-------------------------------------------------------------------------\n");
+    for (t = min_t; t <= max_t; t = (step_t == 1 ? t + 1 : t * step_t)) {
+        sprintf(db_filename, "%s%d_bulk.db", PERF_DB_FILE_PREFIX, t); remove(db_filename);
+        start = wall_seconds(); bt = BTree_bulk_load(db_filename, t, BULK_FILL_PCT, sorted_keys, sorted_values, num_sorted); end = wall_seconds();
+        bulk_time = (end - start);
+        writes_end_ins = Storage_get_write_count(bt.store); allocs_end_ins = Storage_get_alloc_count(bt.store);
+        reads_start_qry = Storage_get_read_count(bt.store);
+        for (i = 0; i < num_queries; ++i) { val = -1; BTree_get(&bt, keys_to_query[i], &val); if (val != keys_to_query[i] + 1) { fprintf(stderr, "WARN: Query failed for key %d after bulk load (t=%d, val=%d)\n", keys_to_query[i], t, val); } }
+        reads_end_qry = Storage_get_read_count(bt.store);
+        BTree_close(&bt);
+        printf("| %4d | %13.4f | %12.1f | %10lu | %10lu | %10lu |\n", t, bulk_time, bulk_time > 0 ? (double)num_sorted / bulk_time : 0.0, writes_end_ins, allocs_end_ins, reads_end_qry - reads_start_qry);
+    }
+    printf("-------------------------------------------------------------------------\n");
+
+    /* --- Delete-heavy: remove half of the inserted keys in random order --- */
+    num_deletes = num_keys / 2;
+    printf("\nDelete-heavy (%d deletes in insertion order, reopening the insert files), then vacuum\n", num_deletes);
+    printf("--------------------------------------------------------------------------------------------------------------------------------\n");
+    printf("| %4s | %12s | %12s | %10s | %10s | %10s | %6s | %6s | %10s | %10s | %10s | %8s |\n", "T", "Del Time (s)", "Del Ops/s", "Reads", "Writes", "Frees", "Rd/Del", "Wr/Del", "Pages", "Free Pages", "Vac Pages", "Vac (s)");
+    printf("--------------------------------------------------------------------------------------------------------------------------------\n");
+    for (t = min_t; t <= max_t; t = (step_t == 1 ? t + 1 : t * step_t)) {
+        sprintf(db_filename, "%s%d.db", PERF_DB_FILE_PREFIX, t);
+        bt = BTree_open(db_filename, t);
+        reads_start_ins = Storage_get_read_count(bt.store); writes_start_ins = Storage_get_write_count(bt.store); frees_start = Storage_get_free_count(bt.store);
+        start = wall_seconds(); for (i = 0; i < num_deletes; ++i) { BTree_delete(&bt, keys_to_insert[i]); } end = wall_seconds();
+        delete_time = (end - start);
+        reads_end_ins = Storage_get_read_count(bt.store) - reads_start_ins; writes_end_ins = Storage_get_write_count(bt.store) - writes_start_ins;
+        pages = Storage_get_node_count(bt.store); free_pages = Storage_get_free_page_count(bt.store); frees_start = Storage_get_free_count(bt.store) - frees_start;
+        BTree_close(&bt);
+        start = wall_seconds(); BTree_vacuum(db_filename, &live_pages); end = wall_seconds(); vacuum_time = (end - start);
+        printf("| %4d | %12.4f | %12.1f | %10lu | %10lu | %10lu | %6.2f | %6.2f | %10d | %10d | %10d | %8.4f |\n", t, delete_time, delete_time > 0 ? (double)num_deletes / delete_time : 0.0,
+               reads_end_ins, writes_end_ins, frees_start, (double)reads_end_ins / num_deletes, (double)writes_end_ins / num_deletes,
+               pages, free_pages, live_pages, vacuum_time);
+    }
+    printf("--------------------------------------------------------------------------------------------------------------------------------\n");
+
+    /* --- Group commit: durable puts with the write-ahead log --- */
+    wal_ops = num_keys < WAL_OPS ? num_keys : WAL_OPS; t = max_t;
+    printf("\nGroup commit (%d puts into a fresh file, t=%d, synced at the end; group 0 = no log)\n", wal_ops, t);
+    printf("-----------------------------------------------------------------------------------\n");
+    printf("| %6s | %12s | %12s | %10s | %10s | %10s | %7s |\n", "Group", "Wall Time(s)", "Put Ops/s", "Commits", "Syncs", "Log MB", "Ops/Syn");
+    printf("-----------------------------------------------------------------------------------\n");
+    for (g = 0; g < (int)(sizeof(wal_groups) / sizeof(wal_groups[0])); ++g) {
+        sprintf(db_filename, "%s%d_wal.db", PERF_DB_FILE_PREFIX, t); remove(db_filename);
+        Storage_set_wal(wal_groups[g], 0);
+        bt = BTree_open(db_filename, t);
+        wall_start = wall_seconds();
+        for (i = 0; i < wal_ops; ++i) { BTree_put(&bt, keys_to_insert[i], keys_to_insert[i] + 1); }
+        BTree_sync(&bt);
+        wal_time = wall_seconds() - wall_start;
+        printf("| %6d | %12.4f | %12.1f | %10lu | %10lu | %10.2f | %7.1f |\n", wal_groups[g], wal_time, wal_time > 0 ? (double)wal_ops / wal_time : 0.0,
+               Storage_get_wal_commit_count(bt.store), Storage_get_sync_count(bt.store), (double)Storage_get_wal_bytes(bt.store) / (1024.0 * 1024.0),
+               Storage_get_sync_count(bt.store) > 0 ? (double)wal_ops / (double)Storage_get_sync_count(bt.store) : 0.0);
+        BTree_close(&bt); remove(db_filename);
+    }
+    Storage_set_wal(0, 0);
+    printf("-----------------------------------------------------------------------------------\n");
+
+    /* --- Sharded index: hash partitioned, one worker thread per shard --- */
+    t = max_t;
+    printf("\nSharded ingest (%d keys in batches of %d, t=%d, hash partitioned)\n", num_keys, SHARD_BATCH, t);
+    printf("-------------------------------------------------------------------------\n");
+    printf("| %6s | %12s | %12s | %12s | %12s | %8s |\n", "Shards", "Put Time(s)", "Put Ops/s", "Get Time(s)", "Get Ops/s", "Speedup");
+    printf("-------------------------------------------------------------------------\n");
+    batch_vals = malloc(SHARD_BATCH * sizeof(int)); if (!batch_vals) { perror("Failed to allocate batch buffer"); return 1; }
+    for (g = 0; g < (int)(sizeof(shard_counts) / sizeof(shard_counts[0])); ++g) {
+        sprintf(db_filename, "%s%d_shard.db", PERF_DB_FILE_PREFIX, t);
+        for (i = 0; i < shard_counts[g]; ++i) { sprintf(shard_name, "%s.%d", db_filename, i); remove(shard_name); }
+        sh = BTree_shards_open(db_filename, shard_counts[g], t, NULL);
+        wall_start = wall_seconds();
+        for (i = 0; i < num_keys; i += SHARD_BATCH) {
+            batch = num_keys - i < SHARD_BATCH ? num_keys - i : SHARD_BATCH;
+            BTree_shards_put_many(sh, keys_to_insert + i, keys_to_insert + i, batch);
+        }
+        BTree_shards_sync(sh);
+        shard_put_time = wall_seconds() - wall_start;
+        wall_start = wall_seconds(); found = 0;
+        for (i = 0; i < num_queries; i += SHARD_BATCH) {
+            batch = num_queries - i < SHARD_BATCH ? num_queries - i : SHARD_BATCH;
+            found += BTree_shards_get_many(sh, keys_to_query + i, batch_vals, batch);
+        }
+        shard_get_time = wall_seconds() - wall_start;
+        assert(found == num_queries);
+        if (g == 0) { base_put_time = shard_put_time; }
+        printf("| %6d | %12.4f | %12.1f | %12.4f | %12.1f | %7.2fx |\n", shard_counts[g], shard_put_time,
+               shard_put_time > 0 ? (double)num_keys / shard_put_time : 0.0, shard_get_time,
+               shard_get_time > 0 ? (double)num_queries / shard_get_time : 0.0, shard_put_time > 0 ? base_put_time / shard_put_time : 0.0);
+        BTree_shards_close(sh);
+        for (i = 0; i < shard_counts[g]; ++i) { sprintf(shard_name, "%s.%d", db_filename, i); remove(shard_name); }
+    }
+    free(batch_vals); batch_vals = NULL;
+    printf("-------------------------------------------------------------------------\n");
+
+    /* --- One shared tree, latch-coupled threads --- */
+    t = max_t; mt_ops = num_keys;
+    printf("\nShared tree (%d ops split over the threads, 1 put per %d, t=%d)\n", mt_ops, MT_PUT_EVERY, t);
+    printf("----------------------------------------------------------\n");
+    printf("| %7s | %12s | %12s | %8s | %7s |\n", "Threads", "Time(s)", "Ops/s", "Speedup", "Hit %");
+    printf("----------------------------------------------------------\n");
+    for (g = 0; g < (int)(sizeof(thread_counts) / sizeof(thread_counts[0])); ++g) {
+        sprintf(db_filename, "%s%d_mt.db", PERF_DB_FILE_PREFIX, t); remove(db_filename);
+        bt = BTree_bulk_load(db_filename, t, BULK_FILL_PCT, sorted_keys, sorted_values, num_sorted);
+        wall_start = wall_seconds(); found = 0;
+        for (i = 0; i < thread_counts[g]; ++i) {
+            workers[i].bt = &bt; workers[i].keys = keys_to_insert; workers[i].nkeys = num_keys;
+            workers[i].ops = mt_ops / thread_counts[g]; workers[i].seed = 7919u * (unsigned int)(i + 1); workers[i].found = 0;
+            if (pthread_create(&workers[i].thread, NULL, perf_worker, &workers[i]) != 0) { fprintf(stderr, "Failed to start worker thread\n"); return 1; }
+        }
+        for (i = 0; i < thread_counts[g]; ++i) { pthread_join(workers[i].thread, NULL); found += workers[i].found; }
+        mt_time = wall_seconds() - wall_start;
+        if (g == 0) { base_mt_time = mt_time; }
+        printf("| %7d | %12.4f | %12.1f | %7.2fx | %6.1f%% |\n", thread_counts[g], mt_time,
+               mt_time > 0 ? (double)mt_ops / mt_time : 0.0, mt_time > 0 ? base_mt_time / mt_time : 0.0,
+               100.0 * (double)found / (double)(mt_ops / thread_counts[g] * thread_counts[g]));
+        BTree_close(&bt); remove(db_filename);
+    }
+    printf("----------------------------------------------------------\n");
+
+    /* --- CLRS B-tree against the B+tree layout (bptree.c) on one page size --- */
+    t = max_t;
+    printf("\nB-tree vs B+tree (%d random puts, %d gets, one full scan, t=%d)\n", num_keys, num_queries, t);
+    printf("-----------------------------------------------------------------------------------------\n");
+    printf("| %6s | %8s | %12s | %12s | %10s | %12s | %12s |\n", "Layout", "Pages", "Put Time(s)", "Get Time(s)", "Reads/Get", "Scan Time(s)", "Scan Reads");
+    printf("-----------------------------------------------------------------------------------------\n");
+    for (layout = 0; layout < 2; ++layout) {
+        sprintf(db_filename, "%s%d_layout.db", PERF_DB_FILE_PREFIX, t); remove(db_filename);
+        if (layout == 0) { bt = BTree_open(db_filename, t); } else { bpt = BPTree_open(db_filename, t); }
+        wall_start = wall_seconds();
+        for (i = 0; i < num_keys; ++i) { if (layout == 0) { BTree_put(&bt, keys_to_insert[i], i); } else { BPTree_put(&bpt, keys_to_insert[i], i); } }
+        insert_time = wall_seconds() - wall_start;
+        reads_qry = Storage_get_read_count(layout == 0 ? bt.store : bpt.store); wall_start = wall_seconds();
+        for (i = 0; i < num_queries; ++i) { if (layout == 0) { BTree_get(&bt, keys_to_query[i], &val); } else { BPTree_get(&bpt, keys_to_query[i], &val); } }
+        query_time = wall_seconds() - wall_start; reads_qry = Storage_get_read_count(layout == 0 ? bt.store : bpt.store) - reads_qry;
+        reads_scan = Storage_get_read_count(layout == 0 ? bt.store : bpt.store); wall_start = wall_seconds(); scanned = 0;
+        if (layout == 0) { BTree_scan(&bt, INT_MIN, INT_MAX, count_cb, &scanned); } else { BPTree_scan(&bpt, INT_MIN, INT_MAX, count_cb, &scanned); }
+        scan_time = wall_seconds() - wall_start; reads_scan = Storage_get_read_count(layout == 0 ? bt.store : bpt.store) - reads_scan;
+        pages = Storage_get_node_count(layout == 0 ? bt.store : bpt.store);
+        printf("| %6s | %8d | %12.4f | %12.4f | %10.2f | %12.4f | %12lu |\n", layouts[layout], pages, insert_time, query_time,
+               num_queries > 0 ? (double)reads_qry / num_queries : 0.0, scan_time, reads_scan);
+        assert(scanned == num_sorted);
+        if (layout == 0) { BTree_close(&bt); } else { BPTree_close(&bpt); }
+        remove(db_filename);
+    }
+    printf("-----------------------------------------------------------------------------------------\n");
+
+    /* Node encoding on a sequential-ID table: file size, bytes allocated on */
+    /* disk, and bytes moved by puts and by gets after a reopen */
+    printf("\nPlain vs compressed nodes (%d sequential IDs, %d random gets after reopen, t=%d)\n", num_keys, num_queries, t);
+    printf("--------------------------------------------------------------------------------------------------\n");
+    printf("| %8s | %10s | %10s | %12s | %10s | %12s | %10s |\n", "Encoding", "File KB", "Disk KB", "Put Time(s)", "Put KB", "Get Time(s)", "Get KB");
+    printf("--------------------------------------------------------------------------------------------------\n");
+    for (enc = 0; enc < 2; ++enc) {
+        sprintf(db_filename, "%s%d_encoding.db", PERF_DB_FILE_PREFIX, t); remove(db_filename);
+        Storage_set_compression(enc); bt = BTree_open(db_filename, t);
+        wall_start = wall_seconds();
+        for (i = 0; i < num_keys; ++i) { BTree_put(&bt, i, 3 * i + 1); }
+        Storage_flush(bt.store); insert_time = wall_seconds() - wall_start; io_bytes = Storage_get_io_write_bytes(bt.store);
+        BTree_close(&bt); bt = BTree_open(db_filename, 0); wall_start = wall_seconds();
+        for (i = 0; i < num_queries; ++i) { val = -1; BTree_get(&bt, keys_to_query[i] % num_keys, &val); assert(val == 3 * (keys_to_query[i] % num_keys) + 1); }
+        query_time = wall_seconds() - wall_start; reads_qry = Storage_get_io_read_bytes(bt.store);
+        BTree_close(&bt);
+        if (stat(db_filename, &file_stat) != 0) { perror("stat"); return 1; }
+        printf("| %8s | %10ld | %10ld | %12.4f | %10lu | %12.4f | %10lu |\n", encodings[enc], (long)file_stat.st_size / 1024, (long)file_stat.st_blocks / 2,
+               insert_time, io_bytes / 1024, query_time, reads_qry / 1024);
+        remove(db_filename);
+    }
+    Storage_set_compression(0);
+    printf("--------------------------------------------------------------------------------------------------\n");
+
+    /* Child prefetch on a full scan that starts with the file out of the OS cache */
+    printf("\nFull scan with child prefetch (%d random keys, t=%d, cold OS cache)\n", num_keys, t);
+    printf("----------------------------------------------------------------------------\n");
+    printf("| %6s | %12s | %12s | %12s | %12s | %8s |\n", "Depth", "Scan Time(s)", "Pages Read", "Hinted", "Hits", "Hit Rate");
+    printf("----------------------------------------------------------------------------\n");
+    sprintf(db_filename, "%s%d_prefetch.db", PERF_DB_FILE_PREFIX, t); remove(db_filename);
+    bt = BTree_open(db_filename, t);
+    for (i = 0; i < num_keys; ++i) { BTree_put(&bt, keys_to_insert[i], i); }
+    BTree_close(&bt);
+    for (pd = 0; pd < (int)(sizeof(prefetch_depths) / sizeof(prefetch_depths[0])); ++pd) {
+        evict_os_cache(db_filename); Storage_set_prefetch(prefetch_depths[pd]);
+        bt = BTree_open(db_filename, 0); scanned = 0; wall_start = wall_seconds();
+        BTree_scan(&bt, INT_MIN, INT_MAX, count_cb, &scanned);
+        scan_time = wall_seconds() - wall_start; assert(scanned == num_sorted);
+        reads_scan = backend == STORAGE_BACKEND_MMAP ? Storage_get_read_count(bt.store) : Storage_get_cache_miss_count(bt.store);
+        printf("| %6d | %12.4f | %12lu | %12lu | %12lu | %7.1f%% |\n", prefetch_depths[pd], scan_time, reads_scan,
+               Storage_get_prefetch_count(bt.store), Storage_get_prefetch_hit_count(bt.store),
+               reads_scan > 0 ? 100.0 * Storage_get_prefetch_hit_count(bt.store) / reads_scan : 0.0);
+        BTree_close(&bt);
+    }
+    Storage_set_prefetch(0); remove(db_filename);
+    printf("----------------------------------------------------------------------------\n");
+
+    /* Key filter: half of the lookups are for absent keys (above the key range) */
+    printf("\nKey filter (%d random keys, %d present + %d absent gets, t=%d; rebuilt filters leave 2x room to grow)\n", num_keys, num_queries, num_queries, t);
+    printf("-------------------------------------------------------------------------------------------------\n");
+    printf("| %8s | %9s | %10s | %12s | %12s | %13s | %9s |\n", "Bits/Key", "Filter KB", "Actual B/K", "Get Time(s)", "Node Reads", "Reads Avoided", "FP Rate");
+    printf("-------------------------------------------------------------------------------------------------\n");
+    sprintf(db_filename, "%s%d_bloom.db", PERF_DB_FILE_PREFIX, t); remove(db_filename);
+    bt = BTree_open(db_filename, t);
+    for (i = 0; i < num_keys; ++i) { BTree_put(&bt, keys_to_insert[i], i); }
+    BTree_close(&bt);
+    for (bb = 0; bb < (int)(sizeof(bloom_bits) / sizeof(bloom_bits[0])); ++bb) {
+        Storage_set_bloom(bloom_bits[bb]);
+        bt = BTree_open(db_filename, 0); (void) BTree_bloom_rebuild(&bt); /* Sized for this row */
+        filter_bytes = Storage_get_bloom_bytes(bt.store);
+        reads_start_qry = Storage_get_read_count(bt.store); skipped = Storage_get_bloom_skip_count(bt.store);
+        wall_start = wall_seconds();
+        for (i = 0; i < num_queries; ++i) { BTree_get(&bt, keys_to_query[i], &val); BTree_get(&bt, num_keys * 10 + i, &val); }
+        query_time = wall_seconds() - wall_start;
+        reads_qry = Storage_get_read_count(bt.store) - reads_start_qry; skipped = Storage_get_bloom_skip_count(bt.store) - skipped;
+        if (bloom_bits[bb] == 0) { reads_nofilter = reads_qry; }
+        printf("| %8d | %9.1f | %10.1f | %12.4f | %12lu | %13ld | %8.3f%% |\n", bloom_bits[bb], filter_bytes / 1024.0, 8.0 * filter_bytes / num_sorted,
+               query_time, reads_qry, (long)reads_nofilter - (long)reads_qry, bloom_bits[bb] > 0 ? 100.0 * (double)(num_queries - skipped) / num_queries : 100.0);
+        BTree_close(&bt);
+    }
+    Storage_set_bloom(0); remove(db_filename); strcat(db_filename, "-bloom"); remove(db_filename);
+    printf("-------------------------------------------------------------------------------------------------\n");
+
+    /* Random ingest: bytes written and cache misses per put (writes flushed */
+    /* before measuring), then the cost of reads through the buffers */
+    printf("\nB-tree vs B-epsilon tree ingest (%d random puts, %d gets, t=%d, %d cache frames)\n", num_keys, num_queries, t, cache_frames);
+    printf("---------------------------------------------------------------------------------------------\n");
+    printf("| %7s | %8s | %12s | %12s | %12s | %12s | %10s |\n", "Layout", "Pages", "Put Time(s)", "Write B/Put", "Misses/Put", "Get Time(s)", "Reads/Get");
+    printf("---------------------------------------------------------------------------------------------\n");
+    for (layout = 0; layout < 2; ++layout) {
+        sprintf(db_filename, "%s%d_ingest.db", PERF_DB_FILE_PREFIX, t); remove(db_filename);
+        if (layout == 0) { bt = BTree_open(db_filename, t); } else { bet = BETree_open(db_filename, t); bt.store = bet.store; }
+        misses_ins = Storage_get_cache_miss_count(bt.store); wall_start = wall_seconds();
+        for (i = 0; i < num_keys; ++i) { if (layout == 0) { BTree_put(&bt, keys_to_insert[i], i); } else { BETree_put(&bet, keys_to_insert[i], i); } }
+        Storage_flush(bt.store); insert_time = wall_seconds() - wall_start;
+        misses_ins = Storage_get_cache_miss_count(bt.store) - misses_ins; io_bytes = Storage_get_io_write_bytes(bt.store);
+        reads_qry = Storage_get_read_count(bt.store); wall_start = wall_seconds();
+        for (i = 0; i < num_queries; ++i) { if (layout == 0) { BTree_get(&bt, keys_to_query[i], &val); } else { BETree_get(&bet, keys_to_query[i], &val); } }
+        query_time = wall_seconds() - wall_start; reads_qry = Storage_get_read_count(bt.store) - reads_qry;
+        printf("| %7s | %8d | %12.4f | %12.1f | %12.3f | %12.4f | %10.2f |\n", ingest_layouts[layout], Storage_get_node_count(bt.store), insert_time,
+               (double)io_bytes / num_keys, (double)misses_ins / num_keys, query_time, num_queries > 0 ? (double)reads_qry / num_queries : 0.0);
+        if (layout == 0) { BTree_close(&bt); } else { BETree_close(&bet); }
+        remove(db_filename);
+    }
+    printf("---------------------------------------------------------------------------------------------\n");
+
+    /* Write burst: time until the caller gets control back, then until */
+    /* every write is in the tree (memtable size 0: plain BTree_put) */
+    printf("\nMemtable write burst (%d random puts, t=%d, %d cache frames)\n", num_keys, t, cache_frames);
+    printf("---------------------------------------------------------------------------------------\n");
+    printf("| %9s | %12s | %12s | %12s | %12s | %10s |\n", "Memtable", "Burst(s)", "Puts/sec", "Drained(s)", "Tables", "Stalls");
+    printf("---------------------------------------------------------------------------------------\n");
+    for (ms = 0; ms < (int)(sizeof(memtable_sizes) / sizeof(memtable_sizes[0])); ++ms) {
+        sprintf(db_filename, "%s%d_memtable.db", PERF_DB_FILE_PREFIX, t); remove(db_filename);
+        bt = BTree_open(db_filename, t); mem = memtable_sizes[ms] > 0 ? BTree_memtable_open(&bt, memtable_sizes[ms]) : NULL;
+        wall_start = wall_seconds();
+        for (i = 0; i < num_keys; ++i) { if (mem != NULL) { BTree_memtable_put(mem, keys_to_insert[i], i); } else { BTree_put(&bt, keys_to_insert[i], i); } }
+        burst_time = wall_seconds() - wall_start;
+        if (mem != NULL) { BTree_memtable_flush(mem); }
+        drain_time = wall_seconds() - wall_start;
+        printf("| %9d | %12.4f | %12.1f | %12.4f | %12lu | %10lu |\n", memtable_sizes[ms], burst_time, burst_time > 0 ? num_keys / burst_time : 0.0, drain_time,
+               mem != NULL ? BTree_memtable_flush_count(mem) : 0UL, mem != NULL ? BTree_memtable_stall_count(mem) : 0UL);
+        BTree_memtable_close(mem); BTree_close(&bt); remove(db_filename);
+    }
+    printf("---------------------------------------------------------------------------------------\n");
 
+    free(sorted_keys); free(sorted_values);
     free(keys_to_insert); free(keys_to_query); printf("Performance Harness Finished.\n"); return 0;
 }
\ No newline at end of file
@@ -0,0 +1,219 @@
+/* POSIX threads for the per-shard workers */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h> /* For malloc, free, exit */
+#include <string.h> /* For strlen, sprintf */
+#include <assert.h>
+#include <pthread.h>
+
+/* Required Struct Definitions */
+struct BTree { int root; int t; struct Storage *store; };
+
+/* Required Prototypes from btree.c */
+struct BTree BTree_open (const char *name, int t);
+void        BTree_close(struct BTree *bt);
+int         BTree_get_many(const struct BTree *bt, const int *keys, int *values, int n);
+void        BTree_put_many(const struct BTree *bt, const int *keys, const int *values, int n);
+void        BTree_sync(const struct BTree *bt);
+
+/* --- Sharded Index --- */
+/* Keys are split across N independent tree files (<prefix>.0 .. .N-1), */
+/* either by a hash of the key or by key ranges. Each shard is opened, */
+/* used and closed by its own worker thread, so batches run on all shards */
+/* in parallel while every tree is still touched by a single thread. */
+
+/* Work posted to a shard; the worker resets op to SHARD_OP_IDLE when done */
+#define SHARD_OP_IDLE  0
+#define SHARD_OP_OPEN  1
+#define SHARD_OP_PUT   2
+#define SHARD_OP_GET   3
+#define SHARD_OP_SYNC  4
+#define SHARD_OP_CLOSE 5
+
+struct Shard {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char *name;
+    int t_user;
+    struct BTree bt;       /* Owned by the worker */
+    int op;                /* SHARD_OP_*, guarded by lock */
+    int *keys;             /* Batch routed to this shard */
+    int *values;
+    int *slot;             /* Position of each batch entry in the caller's arrays */
+    int n;
+    int cap;
+    int found;             /* Result of SHARD_OP_GET */
+};
+
+struct BTreeShards {
+    int nshards;
+    int *splits;           /* nshards-1 increasing bounds, or NULL for hash partitioning */
+    struct Shard *shard;
+};
+
+static void* BTree_shard_main(void *arg) {
+    struct Shard *s = arg; int op;
+    s->bt = BTree_open(s->name, s->t_user);
+    for (op = SHARD_OP_OPEN; op != SHARD_OP_CLOSE; ) {
+        pthread_mutex_lock(&s->lock);
+        s->op = SHARD_OP_IDLE; pthread_cond_broadcast(&s->cond);
+        while (s->op == SHARD_OP_IDLE) { pthread_cond_wait(&s->cond, &s->lock); }
+        op = s->op;
+        pthread_mutex_unlock(&s->lock);
+        if (op == SHARD_OP_PUT) { BTree_put_many(&s->bt, s->keys, s->values, s->n); }
+        else if (op == SHARD_OP_GET) { s->found = BTree_get_many(&s->bt, s->keys, s->values, s->n); }
+        else if (op == SHARD_OP_SYNC) { BTree_sync(&s->bt); }
+    }
+    BTree_close(&s->bt); /* Also frees this thread's node buffers */
+    pthread_mutex_lock(&s->lock);
+    s->op = SHARD_OP_IDLE; pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+static void BTree_shard_post(struct Shard *s, int op) {
+    pthread_mutex_lock(&s->lock);
+    s->op = op; pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void BTree_shard_wait(struct Shard *s) {
+    pthread_mutex_lock(&s->lock);
+    while (s->op != SHARD_OP_IDLE) { pthread_cond_wait(&s->cond, &s->lock); }
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void BTree_shard_reserve(struct Shard *s, int n) {
+    if (n <= s->cap) { return; }
+    free(s->keys); free(s->values); free(s->slot);
+    s->keys = malloc(n * sizeof(int)); s->values = malloc(n * sizeof(int)); s->slot = malloc(n * sizeof(int));
+    if (!s->keys || !s->values || !s->slot) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    s->cap = n;
+}
+
+/* Shard owning key k */
+static int BTree_shard_of(const struct BTreeShards *sh, int k) {
+    unsigned long h; int lo; int hi; int mid;
+    if (sh->splits == NULL) { /* Fibonacci hashing spreads runs of keys */
+        h = ((unsigned long)(unsigned int)k * 2654435769UL) & 0xFFFFFFFFUL;
+        return (int)((h >> 16) % (unsigned long)sh->nshards);
+    }
+    lo = 0; hi = sh->nshards - 1; /* First split above k */
+    while (lo < hi) { mid = (lo + hi) / 2; if (k < sh->splits[mid]) { hi = mid; } else { lo = mid + 1; } }
+    return lo;
+}
+
+/* Splits keys[0..n) (and values) into the per-shard batches */
+static void BTree_shards_route(struct BTreeShards *sh, const int *keys, const int *values, int n) {
+    int *count; int i; int s; struct Shard *d;
+    count = calloc(sh->nshards, sizeof(int));
+    if (!count) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    for (i = 0; i < n; ++i) { count[BTree_shard_of(sh, keys[i])]++; }
+    for (s = 0; s < sh->nshards; ++s) { BTree_shard_reserve(&sh->shard[s], count[s]); sh->shard[s].n = 0; }
+    for (i = 0; i < n; ++i) { /* Caller order is kept, so last-wins ties still hold */
+        d = &sh->shard[BTree_shard_of(sh, keys[i])];
+        d->keys[d->n] = keys[i]; d->values[d->n] = values[i]; d->slot[d->n] = i; d->n++;
+    }
+    free(count);
+}
+
+/* Runs op on every shard with a non-empty batch (all shards if all is set) */
+static void BTree_shards_run(struct BTreeShards *sh, int op, int all) {
+    int s;
+    for (s = 0; s < sh->nshards; ++s) { if (all || sh->shard[s].n > 0) { BTree_shard_post(&sh->shard[s], op); } }
+    for (s = 0; s < sh->nshards; ++s) { BTree_shard_wait(&sh->shard[s]); }
+}
+
+/* BTree_shards_open: Opens (or creates) nshards trees named <prefix>.<i>. */
+/* splits == NULL partitions by key hash; otherwise splits[0..nshards-1) */
+/* must increase strictly and shard i holds splits[i-1] <= k < splits[i]. */
+/* The partitioning is not stored: reopen with the same nshards and splits. */
+/* Storage settings (Storage_set_*) must be made before this call. */
+struct BTreeShards* BTree_shards_open(const char *prefix, int nshards, int t, const int *splits) {
+    struct BTreeShards *sh = NULL; struct Shard *s; int i;
+    if (prefix == NULL || nshards < 1) { fprintf(stderr, "BTree Error: Invalid shard count %d.\n", nshards); exit(EXIT_FAILURE); }
+    sh = malloc(sizeof(struct BTreeShards));
+    if (!sh) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    sh->nshards = nshards; sh->splits = NULL;
+    sh->shard = calloc(nshards, sizeof(struct Shard));
+    if (!sh->shard) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    if (splits != NULL && nshards > 1) {
+        for (i = 1; i < nshards - 1; ++i) {
+            if (splits[i] <= splits[i - 1]) { fprintf(stderr, "BTree Error: Shard splits not strictly increasing (%d after %d).\n", splits[i], splits[i - 1]); exit(EXIT_FAILURE); }
+        }
+        sh->splits = malloc((nshards - 1) * sizeof(int));
+        if (!sh->splits) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+        memcpy(sh->splits, splits, (nshards - 1) * sizeof(int));
+    }
+    for (i = 0; i < nshards; ++i) {
+        s = &sh->shard[i];
+        s->name = malloc(strlen(prefix) + 16);
+        if (!s->name) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+        sprintf(s->name, "%s.%d", prefix, i);
+        s->t_user = t; s->op = SHARD_OP_OPEN;
+        if (pthread_mutex_init(&s->lock, NULL) != 0 || pthread_cond_init(&s->cond, NULL) != 0 ||
+            pthread_create(&s->thread, NULL, BTree_shard_main, s) != 0) {
+            fprintf(stderr, "BTree Error: Cannot start worker for shard %s.\n", s->name); exit(EXIT_FAILURE);
+        }
+    }
+    for (i = 0; i < nshards; ++i) { BTree_shard_wait(&sh->shard[i]); }
+    return sh;
+}
+
+int BTree_shards_count(const struct BTreeShards *sh) { assert(sh != NULL); return sh->nshards; }
+
+/* BTree_shards_shard_of: Index of the shard (file <prefix>.<i>) holding k */
+int BTree_shards_shard_of(const struct BTreeShards *sh, int k) { assert(sh != NULL); return BTree_shard_of(sh, k); }
+
+/* BTree_shards_put_many: BTree_put_many across the shards, in parallel */
+void BTree_shards_put_many(struct BTreeShards *sh, const int *keys, const int *values, int n) {
+    assert(sh != NULL); assert(n >= 0);
+    if (n == 0) { return; }
+    assert(keys != NULL && values != NULL);
+    BTree_shards_route(sh, keys, values, n);
+    BTree_shards_run(sh, SHARD_OP_PUT, 0);
+}
+
+/* BTree_shards_get_many: BTree_get_many across the shards, in parallel. */
+/* values[i] is set for every key found; returns the number found. */
+int BTree_shards_get_many(struct BTreeShards *sh, const int *keys, int *values, int n) {
+    struct Shard *d; int s; int i; int found = 0;
+    assert(sh != NULL); assert(n >= 0);
+    if (n == 0) { return 0; }
+    assert(keys != NULL && values != NULL);
+    BTree_shards_route(sh, keys, values, n); /* Misses keep the caller's value */
+    BTree_shards_run(sh, SHARD_OP_GET, 0);
+    for (s = 0; s < sh->nshards; ++s) {
+        d = &sh->shard[s]; if (d->n == 0) { continue; }
+        for (i = 0; i < d->n; ++i) { values[d->slot[i]] = d->values[i]; }
+        found += d->found;
+    }
+    return found;
+}
+
+void BTree_shards_put(struct BTreeShards *sh, int k, int v) { BTree_shards_put_many(sh, &k, &v, 1); }
+
+void BTree_shards_get(struct BTreeShards *sh, int k, int *v) {
+    assert(v != NULL); (void) BTree_shards_get_many(sh, &k, v, 1);
+}
+
+/* BTree_shards_sync: BTree_sync on every shard */
+void BTree_shards_sync(struct BTreeShards *sh) {
+    assert(sh != NULL);
+    BTree_shards_run(sh, SHARD_OP_SYNC, 1);
+}
+
+void BTree_shards_close(struct BTreeShards *sh) {
+    struct Shard *s; int i;
+    if (!sh) { return; }
+    BTree_shards_run(sh, SHARD_OP_CLOSE, 1);
+    for (i = 0; i < sh->nshards; ++i) {
+        s = &sh->shard[i];
+        pthread_join(s->thread, NULL);
+        pthread_mutex_destroy(&s->lock); pthread_cond_destroy(&s->cond);
+        free(s->name); free(s->keys); free(s->values); free(s->slot);
+    }
+    free(sh->shard); free(sh->splits); free(sh);
+}
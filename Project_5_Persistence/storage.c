@@ -1,8 +1,16 @@
+/* POSIX for fileno, ftruncate, pread/pwrite, mmap (not part of ANSI C) */
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> /* For memset, memcpy, perror */
 #include <errno.h>
 #include <assert.h> /* For assert */
+#include <unistd.h>   /* For ftruncate, pread, pwrite, fsync, fdatasync */
+#include <fcntl.h>    /* For open (write-ahead log) */
+#include <time.h>     /* For clock_gettime (group commit window) */
+#include <sys/mman.h> /* For mmap, munmap, msync */
+#include <pthread.h>  /* Handle lock and page latches */
 
 /* Required struct definition (repeated for no-header build) */
 struct Node {
@@ -13,26 +21,221 @@ struct Node {
     int *c;
 };
 
-/* --- Combined Static Global State (Singleton) --- */
-/* Combine core state variables into one struct */
-static struct {
-    FILE *dataFile;
-    int degree;      /* Minimum degree 't' */
-    long nodeSize;   /* Calculated size of a node on disk */
-} g_storage = { NULL, 0, 0 };
+/* --- Per-File State --- */
+/* Everything about one open file lives in its struct Storage handle, so */
+/* a process can keep any number of trees open. Every helper below takes */
+/* the handle it works on. A handle may be shared by threads: calls that */
+/* touch its state hold the handle's lock. */
 
-/* Combine statistics counters into one struct */
-static struct {
+/* Statistics counters */
+struct StorageStats {
     unsigned long reads;
     unsigned long writes;
     unsigned long allocs;
-} g_stats = { 0, 0, 0 };
+    unsigned long cache_hits;
+    unsigned long cache_misses;
+    unsigned long cache_evictions;
+    unsigned long cache_writebacks;
+    unsigned long frees;
+    unsigned long io_read_bytes;   /* Node image bytes moved by pread */
+    unsigned long io_write_bytes;  /* Node image bytes moved by pwrite */
+    unsigned long prefetches;      /* Pages hinted by Storage_prefetch */
+    unsigned long prefetch_hits;   /* Hinted pages later fetched from the file */
+    unsigned long bloom_checks;    /* Keys looked up in the key filter */
+    unsigned long bloom_skips;     /* Of those, keys it ruled out */
+};
+
+/* --- Buffer Pool (CLOCK replacement) --- */
+/* Each frame caches one node image laid out exactly as on disk: */
+/* n, leaf, key[2t-1], value[2t-1], c[2t]. */
+struct Frame {
+    int addr;      /* Cached node address, NULL_ADDR if frame is free */
+    int pin_count; /* Frame cannot be evicted while > 0 */
+    int dirty;     /* Image differs from disk, written back on eviction/flush */
+    int ref;       /* CLOCK reference bit */
+    int next;      /* Next frame index in the same hash bucket, -1 terminates */
+    int *image;    /* Node image, nodeSize bytes */
+};
+
+struct BufferPool {
+    int nframes;          /* Active frame count, 0 = cache disabled */
+    int hand;             /* CLOCK hand */
+    int nbuckets;         /* Power of two */
+    int *bucket;          /* Hash bucket heads (frame index or -1) */
+    struct Frame *frames;
+    int *scratch;         /* Image buffer for uncached reads/writes */
+};
+
+/* Write-ahead log (see its section below) */
+struct WalState {
+    int enabled;
+    int fd;                /* Log file descriptor, -1 when closed */
+    char *path;
+    int groupOps;          /* Operations per group */
+    long windowUs;         /* Maximum group age, 0 = no time limit */
+    int ops;               /* Completed operations in the open group */
+    struct timespec groupStart;
+    int count;             /* Staged images */
+    int cap;
+    int *addr;             /* Staged addresses */
+    int *images;           /* cap images of image_ints(st) ints each */
+    int *next;             /* Hash chain per staged image */
+    int nbuckets;
+    int *bucket;
+    long logSize;          /* Bytes appended since the last checkpoint */
+    int seq;               /* Sequence number of the open group */
+    int *buf;              /* Group record buffer */
+    size_t bufCap;
+};
+
+struct WalStats {
+    unsigned long commits;   /* Groups committed (one fdatasync each) */
+    unsigned long syncs;     /* fsync/fdatasync calls on any of the files */
+    unsigned long logBytes;  /* Bytes appended to the log */
+    unsigned long recovered; /* Groups replayed at the last open */
+};
+
+/* Shadow paging (see its section below) */
+#define SHADOW_MAX_SNAPSHOTS 64
+
+struct Snapshot {
+    int live;
+    int gen;   /* Generation of the committed version it reads */
+    int count; /* Logical pages in that version */
+    int *map;  /* Logical -> physical */
+};
+
+/* A thread reading through a snapshot (Storage_set_view) */
+struct ThreadView { pthread_t thread; int id; };
+
+struct ShadowState {
+    int enabled;
+    int groupOps;        /* Operations per commit */
+    int ops;             /* Completed operations since the last commit */
+    int changed;         /* Working version differs from the committed one */
+    int *map; int mapCap;             /* Working table, nodeCount entries */
+    int *committed; int committedCount; int committedCap;
+    int *chunk; int chunkCount; int chunkCap;  /* Chunk slots of the committed table */
+    int *chunkDirty; int chunkDirtyCap;        /* Chunk differs from the working table */
+    int *dir; int dirCount; int dirCap;        /* Directory slots of the committed table */
+    int physCount;                             /* Slots in the file */
+    int *birth; int birthCap;                  /* First generation holding each slot */
+    int *physFree; int physFreeCount; int physFreeCap;
+    int *retired; int retiredCount; int retiredCap; /* (slot, last generation holding it) pairs */
+    int gen;                                   /* Generation of the committed version */
+    int *buf;                                  /* Chunk/directory image */
+    struct Snapshot snaps[SHADOW_MAX_SNAPSHOTS];
+    struct ThreadView *views; int viewCount; int viewCap; /* Threads not on the working version */
+};
+
+/* Page latches (see their section below) */
+struct LatchTable {
+    pthread_mutex_t lock;      /* Guards the chunk directory only */
+    pthread_rwlock_t **chunk;  /* nchunks pointers, NULL until first used */
+    int nchunks;
+};
+
+/* Key filter (see its section below) */
+struct BloomState {
+    int fd;              /* "<file>-bloom", -1 until it exists */
+    char *path;
+    int bitsPerKey;      /* Sizing used by Storage_bloom_reset, 0 = filter off */
+    int valid;           /* Holds every key of the tree (reset and refilled, or loaded clean) */
+    int clean;           /* The file on disk is marked clean */
+    int changed;         /* Bits differ from the file */
+    int hashes;          /* Bits set per key */
+    int nblocks;         /* BLOOM_BLOCK_BYTES blocks */
+    int capacity;        /* Keys it was sized for */
+    int added;           /* Keys added since the reset, repeats included */
+    unsigned char *bits;
+};
+
+/* Mappings replaced by a larger one; unmapped at close so views stay valid */
+struct OldMap { char *base; size_t length; struct OldMap *next; };
+
+struct Storage {
+    FILE *dataFile;  /* Used for open/header/close only */
+    int fd;          /* fileno(dataFile): node I/O goes through pread/pwrite */
+    int degree;      /* Minimum degree 't' */
+    long nodeSize;   /* Calculated size of a node image */
+    long slotSize;   /* Distance between node images: nodeSize, or padded to whole pages */
+    int pageSize;    /* Page size of a version 3 file, 0 for packed layouts */
+    int version;     /* Format version of the open file */
+    int nodeCount;   /* Allocated node slots (logical file length) */
+    int backend;     /* STORAGE_BACKEND_* in use */
+    char *map;       /* mmap backend: base of the file mapping */
+    int mapCapacity; /* mmap backend: node slots covered by the mapping */
+    int *freeList;   /* Released node slots, reused LIFO by Storage_alloc */
+    int freeCount;
+    int freeCap;
+    long headerSize; /* HEADER_SIZE (v2), HEADER_SIZE_V1 (v1), HEADER_SIZE_SHADOW (v4), HEADER_SIZE_COMPRESSED (v5) or one page */
+    int compressed;  /* Version 5: node images are encoded on disk */
+    int readHint;    /* Version 5: bytes read up front per node */
+    long readAvg;    /* Version 5: running average of encoded slot lengths, times 8 */
+    unsigned char *codec; /* Version 5: encoded node buffer */
+    int prefetchDepth;    /* Children traversals hint ahead (Storage_set_prefetch) */
+    int *prefetched;      /* Hinted pages not yet fetched, direct mapped by address */
+    int prefetchSlots;    /* Power of two, 0 until the first hint */
+    struct StorageStats stats;
+    struct BufferPool pool;
+    struct WalState wal;
+    struct WalStats walStats;
+    struct ShadowState shadow;
+    struct BloomState bloom;
+    pthread_mutex_t lock;  /* Held by every call that reads or changes the state above */
+    pthread_cond_t idle;   /* Signalled when a commit finishes or no operation is in flight */
+    int activeOps;         /* Operations between Storage_op_begin and Storage_op_end */
+    int commitDue;         /* A commit waits for activeOps to drain; new operations wait for it */
+    struct LatchTable latches;
+    struct OldMap *oldMaps;
+};
+
+/* Settings read by the next Storage_open. They are process wide: set */
+/* them before starting threads that open files. */
+static struct {
+    int pageSize;      /* Page size used when a file is created, 0 = packed */
+    int backend;       /* STORAGE_BACKEND_* */
+    int cacheFrames;   /* Buffer pool frames, 0 = cache disabled */
+    int walOps;        /* WAL group size, 0 = WAL off */
+    long walWindowUs;  /* WAL group age limit, 0 = none */
+    int shadowOps;     /* > 0: new files are shadow-paged (version 4) */
+    int compress;      /* New files store encoded nodes (version 5) */
+    int prefetchDepth; /* Children ordered traversals hint ahead, 0 = off */
+    int bloomBits;     /* Key filter bits per key, 0 = no filter */
+} g_config = { 0, 0, 256, 0, 0, 0, 0, 0, 0 };
 
 /* --- Constants --- */
 static const int MAGIC_NUMBER = 0xBEEFCAFE;
-static const int VERSION = 1;
-/* Header Layout: magic(int), version(int), t(int) */
-static const long HEADER_SIZE = sizeof(int) * 3;
+static const int VERSION = 2;        /* Packed: nodes back to back after a 16 byte header */
+static const int VERSION_PAGED = 3;  /* Page aligned: header and every node start on a page */
+static const int VERSION_V1 = 1;     /* Still readable; its free list is not persisted */
+static const int VERSION_SHADOW = 4; /* Copy-on-write: node addresses go through a page table */
+static const int VERSION_COMPRESSED = 5; /* Nodes encoded on disk (see Compressed Node Encoding) */
+/* Header Layout: magic(int), version(int), t(int), free_head(int) */
+/* Version 3 adds page_size(int) and pads the header to one page */
+/* Version 4 adds page_size (0 = packed), table root, page count and */
+/* generation; the last three are rewritten together at each commit */
+/* Version 5 adds page_size (0 = packed) to the version 2 header */
+/* Free pages are chained through their first int, ending in NULL_ADDR */
+static const long HEADER_SIZE = sizeof(int) * 4;
+static const long HEADER_SIZE_V1 = sizeof(int) * 3;
+static const long FREE_HEAD_OFFSET = sizeof(int) * 3;
+static const long HEADER_SIZE_SHADOW = sizeof(int) * 8;
+static const long SHADOW_ROOT_OFFSET = sizeof(int) * 5;
+static const long HEADER_SIZE_COMPRESSED = sizeof(int) * 5;
+/* Page size assumed when t is derived for a packed file */
+#define DEFAULT_PAGE_SIZE 4096
+#define MIN_PAGE_SIZE 512
+#define MAX_PAGE_SIZE (1 << 20)
+/* Sentinel for invalid/unused addresses (must match btree.c) */
+#define NULL_ADDR (-1)
+/* Backends selectable with Storage_set_backend */
+#define STORAGE_BACKEND_STDIO 0
+#define STORAGE_BACKEND_MMAP  1
+/* mmap backend grows the file by at least this many node slots at a time */
+#define MMAP_GROW_NODES 1024
+
+static void flush_all(struct Storage *st); /* Prototype */
 
 /* --- Helper Functions --- */
 
@@ -43,273 +246,1815 @@ static long calculate_node_size(int t) {
      return (long)(6 * t) * sizeof(int);
 }
 
+/* Distance between node images: packed, or rounded up to whole pages so */
+/* every node starts on a page boundary and never straddles one it need not */
+static long calculate_slot_size(long node_size, int page_size) {
+    if (page_size <= 0) { return node_size; }
+    return (node_size + page_size - 1) / page_size * page_size;
+}
+
 /* Calculates disk offset for a given node address */
-static long calculate_offset(int addr) {
+static long calculate_offset(struct Storage *st, int addr) {
     /* Access global state via struct */
-    if (g_storage.nodeSize <= 0) {
+    if (st->nodeSize <= 0) {
         fprintf(stderr, "Storage Error: Node size not initialized or invalid.\n");
         exit(EXIT_FAILURE);
     }
     assert(addr >= 0);
-    return HEADER_SIZE + (long)addr * g_storage.nodeSize;
+    return st->headerSize + (long)addr * st->slotSize;
+}
+
+/* --- mmap Backend Helpers --- */
+
+/* Address of a node image inside the mapping */
+static int *map_image(struct Storage *st, int addr) {
+    if (addr < 0 || addr >= st->nodeCount) { fprintf(stderr, "Storage Error: Address %d outside mapped file (%d nodes).\n", addr, st->nodeCount); exit(EXIT_FAILURE); }
+    return (int *)(st->map + calculate_offset(st, addr));
+}
+
+/* (Re)maps the file to cover capacity node slots, growing it with ftruncate */
+static void map_resize(struct Storage *st, int capacity) {
+    int fd = st->fd;
+    long length = calculate_offset(st, capacity);
+    struct OldMap *old;
+    if (st->map != NULL) { /* Another thread may still view a node through it */
+        old = malloc(sizeof(struct OldMap));
+        if (!old) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+        old->base = st->map; old->length = (size_t)calculate_offset(st, st->mapCapacity);
+        old->next = st->oldMaps; st->oldMaps = old;
+        st->map = NULL;
+    }
+    if (ftruncate(fd, (off_t)length) != 0) { perror("Storage Error: ftruncate failed growing mapped file"); exit(EXIT_FAILURE); }
+    st->map = mmap(NULL, (size_t)length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (st->map == MAP_FAILED) { st->map = NULL; perror("Storage Error: mmap failed"); exit(EXIT_FAILURE); }
+    st->mapCapacity = capacity;
+}
+
+static void map_open(struct Storage *st) {
+    if (fflush(st->dataFile) != 0) { perror("Storage Error: fflush before mmap failed"); exit(EXIT_FAILURE); }
+    map_resize(st, st->nodeCount > MMAP_GROW_NODES ? st->nodeCount : MMAP_GROW_NODES);
+}
+
+/* Syncs and unmaps, trimming the preallocated tail back to the logical size */
+static void map_close(struct Storage *st) {
+    long length = calculate_offset(st, st->mapCapacity);
+    struct OldMap *old;
+    if (msync(st->map, (size_t)length, MS_SYNC) != 0) { perror("Storage Warning: msync failed"); }
+    if (munmap(st->map, (size_t)length) != 0) { perror("Storage Warning: munmap failed"); }
+    while ((old = st->oldMaps) != NULL) {
+        st->oldMaps = old->next;
+        if (munmap(old->base, old->length) != 0) { perror("Storage Warning: munmap failed"); }
+        free(old);
+    }
+    st->map = NULL; st->mapCapacity = 0;
+    if (ftruncate(st->fd, (off_t)calculate_offset(st, st->nodeCount)) != 0) {
+        perror("Storage Warning: ftruncate failed trimming mapped file");
+    }
+}
+
+/* pread/pwrite the whole range, retrying short transfers and EINTR. */
+/* Returns the number of bytes moved (less than len only at EOF or error). */
+static size_t fd_transfer(int fd, int write, void *buf, size_t len, long offset) {
+    size_t done = 0; ssize_t r;
+    while (done < len) {
+        if (write) { r = pwrite(fd, (char *)buf + done, len - done, (off_t)(offset + (long)done)); }
+        else { r = pread(fd, (char *)buf + done, len - done, (off_t)(offset + (long)done)); }
+        if (r < 0 && errno == EINTR) { continue; }
+        if (r <= 0) { break; }
+        done += (size_t)r;
+    }
+    return done;
+}
+
+/* --- Compressed Node Encoding (version 5) --- */
+/* A version 5 slot starts with an int h. h > 0: h bytes of encoded node */
+/* follow; h == 0: the plain image follows (pages of other kinds, unsorted */
+/* keys, or no saving), so slots are nodeSize + sizeof(int) bytes. */
+/* Encoding of a B-tree page (leaf 0 or 1): varint n, leaf byte, first key */
+/* (zigzag varint), gaps to each next key (varint), values (zigzag varint), */
+/* and for inner pages only, children + 1 (varint). Key, value and child */
+/* slots past n are not stored; they read back as 0, 0 and NULL_ADDR. */
+/* Writes move only the encoding. Reads fetch readHint bytes, a quarter */
+/* over the running average length, and a second pread when that is short. */
+#define CODEC_READ_ALIGN 64 /* Read hints are rounded up to this */
+
+static unsigned char *varint_put(unsigned char *p, unsigned int v) {
+    while (v >= 0x80) { *p++ = (unsigned char)(v | 0x80); v >>= 7; }
+    *p++ = (unsigned char)v; return p;
+}
+
+/* Reads a varint from [*p, end); returns 0 if it runs past end or 5 bytes */
+static int varint_get(const unsigned char **p, const unsigned char *end, unsigned int *v) {
+    int shift = 0;
+    *v = 0;
+    while (*p < end && shift < 35) {
+        *v |= (unsigned int)(**p & 0x7F) << shift; shift += 7;
+        if ((*(*p)++ & 0x80) == 0) { return 1; }
+    }
+    return 0;
+}
+
+static unsigned int zigzag(int v) { return ((unsigned int)v << 1) ^ (v < 0 ? 0xFFFFFFFFu : 0u); }
+static int unzigzag(unsigned int z) { return (int)((z >> 1) ^ (0u - (z & 1u))); }
+
+/* Encodes img into out; returns the length, or 0 to store the plain image */
+static int node_encode(struct Storage *st, const int *img, unsigned char *out) {
+    int max_keys = 2 * st->degree - 1; int n = img[0]; int leaf = img[1]; int i;
+    const int *key = img + 2; const int *value = img + 2 + max_keys; const int *c = img + 2 + 2 * max_keys;
+    unsigned char *p = out;
+    if ((leaf != 0 && leaf != 1) || n < 0 || n > max_keys) { return 0; }
+    for (i = 1; i < n; ++i) { if (key[i] <= key[i - 1]) { return 0; } }
+    p = varint_put(p, (unsigned int)n); *p++ = (unsigned char)leaf;
+    for (i = 0; i < n; ++i) { p = varint_put(p, i == 0 ? zigzag(key[0]) : (unsigned int)key[i] - (unsigned int)key[i - 1]); }
+    for (i = 0; i < n; ++i) { p = varint_put(p, zigzag(value[i])); }
+    if (!leaf) { for (i = 0; i <= n; ++i) { p = varint_put(p, (unsigned int)c[i] + 1u); } }
+    return p - out < st->nodeSize ? (int)(p - out) : 0;
+}
+
+/* Decodes len bytes into a full image; returns 0 if they are malformed */
+static int node_decode(struct Storage *st, const unsigned char *in, int len, int *img) {
+    int max_keys = 2 * st->degree - 1; const unsigned char *p = in; const unsigned char *end = in + len;
+    unsigned int v; int n; int leaf; int i; int *key = img + 2; int *value = img + 2 + max_keys; int *c = img + 2 + 2 * max_keys;
+    if (!varint_get(&p, end, &v) || v > (unsigned int)max_keys || p >= end) { return 0; }
+    n = (int)v; leaf = *p++;
+    if (leaf != 0 && leaf != 1) { return 0; }
+    memset(img, 0, (size_t)(2 + 2 * max_keys) * sizeof(int));
+    img[0] = n; img[1] = leaf;
+    for (i = 0; i < n; ++i) {
+        if (!varint_get(&p, end, &v)) { return 0; }
+        key[i] = i == 0 ? unzigzag(v) : (int)((unsigned int)key[i - 1] + v);
+    }
+    for (i = 0; i < n; ++i) { if (!varint_get(&p, end, &v)) { return 0; } value[i] = unzigzag(v); }
+    for (i = 0; i <= max_keys; ++i) {
+        c[i] = NULL_ADDR;
+        if (!leaf && i <= n) { if (!varint_get(&p, end, &v)) { return 0; } c[i] = (int)(v - 1u); }
+    }
+    return p == end;
+}
+
+/* Version 5 read: one pread of readHint bytes, a second for a longer slot */
+static void disk_read_encoded(struct Storage *st, int addr, int *buf) {
+    long offset = calculate_offset(st, addr); int h; long need; long got = st->readHint;
+    if (fd_transfer(st->fd, 0, st->codec, (size_t)got, offset) != (size_t)got) {
+        fprintf(stderr, "Storage Error: Failed to read node at addr %d (offset %ld).\n", addr, offset); exit(EXIT_FAILURE);
+    }
+    memcpy(&h, st->codec, sizeof(int));
+    need = (long)sizeof(int) + (h == 0 ? st->nodeSize : (long)h);
+    if (h < 0 || need > st->nodeSize + (long)sizeof(int)) { fprintf(stderr, "Storage Error: Corrupt encoded node at addr %d (length %d).\n", addr, h); exit(EXIT_FAILURE); }
+    if (need > got) {
+        if (fd_transfer(st->fd, 0, st->codec + got, (size_t)(need - got), offset + got) != (size_t)(need - got)) {
+            fprintf(stderr, "Storage Error: Failed to read node at addr %d (offset %ld).\n", addr, offset); exit(EXIT_FAILURE);
+        }
+        got = need;
+    }
+    st->readAvg += need - st->readAvg / 8;
+    st->readHint = (int)((st->readAvg / 8 * 5 / 4 + CODEC_READ_ALIGN - 1) / CODEC_READ_ALIGN * CODEC_READ_ALIGN);
+    if (st->readHint > st->nodeSize + (long)sizeof(int)) { st->readHint = (int)(st->nodeSize + (long)sizeof(int)); }
+    st->stats.io_read_bytes += (unsigned long)got;
+    if (h == 0) { memcpy(buf, st->codec + sizeof(int), (size_t)st->nodeSize); }
+    else if (!node_decode(st, st->codec + sizeof(int), h, buf)) { fprintf(stderr, "Storage Error: Corrupt encoded node at addr %d.\n", addr); exit(EXIT_FAILURE); }
+}
+
+/* Version 5 write: the length int and the encoding (or the plain image) */
+static void disk_write_encoded(struct Storage *st, int addr, const int *buf) {
+    long offset = calculate_offset(st, addr); int h = node_encode(st, buf, st->codec + sizeof(int));
+    size_t len = sizeof(int) + (h > 0 ? (size_t)h : (size_t)st->nodeSize);
+    memcpy(st->codec, &h, sizeof(int));
+    if (h == 0) { memcpy(st->codec + sizeof(int), buf, (size_t)st->nodeSize); }
+    if (fd_transfer(st->fd, 1, st->codec, len, offset) != len) {
+        fprintf(stderr, "Storage Error: Failed to write node at addr %d (offset %ld).\n", addr, offset); perror(" pwrite error"); exit(EXIT_FAILURE);
+    }
+    st->stats.io_write_bytes += (unsigned long)len;
+}
+
+/* --- Prefetch --- */
+/* Storage_prefetch hints pages a traversal will reach soon to the OS */
+/* (posix_fadvise, or posix_madvise on the mapping) so their reads can */
+/* start before they are needed. Hinted pages are remembered in a small */
+/* direct-mapped table; a later fetch of one from the file is a hit. */
+
+static int prefetch_slot(struct Storage *st, int addr) {
+    return (int)(((unsigned int)addr * 2654435761u) & (unsigned int)(st->prefetchSlots - 1));
+}
+
+/* Counts a fetch of addr from the file, a hit if it was hinted */
+static void prefetch_consume(struct Storage *st, int addr) {
+    int s;
+    if (st->prefetchSlots == 0) { return; }
+    s = prefetch_slot(st, addr);
+    if (st->prefetched[s] == addr) { st->prefetched[s] = NULL_ADDR; st->stats.prefetch_hits++; }
+}
+
+/* Reads one node image from disk into buf (nodeSize bytes): one pread */
+static void disk_read_image(struct Storage *st, int addr, int *buf) {
+    long offset = calculate_offset(st, addr);
+    size_t bytes_read;
+    prefetch_consume(st, addr);
+    if (st->compressed) { disk_read_encoded(st, addr, buf); return; }
+    errno = 0;
+    bytes_read = fd_transfer(st->fd, 0, buf, (size_t)st->nodeSize, offset);
+    if (bytes_read != (size_t)st->nodeSize) {
+        fprintf(stderr, "Storage Error: Failed to read node image at addr %d (offset %ld). Bytes read: %lu / Expected: %lu\n", addr, offset, (unsigned long)bytes_read, (unsigned long)st->nodeSize);
+        if (errno != 0) perror(" pread error"); else fprintf(stderr, " Read past EOF.\n");
+        exit(EXIT_FAILURE);
+    }
+    st->stats.io_read_bytes += (unsigned long)bytes_read;
+}
+
+/* Writes one node image from buf (nodeSize bytes) to disk: one pwrite */
+static void disk_write_image(struct Storage *st, int addr, const int *buf) {
+    long offset = calculate_offset(st, addr);
+    size_t bytes_written;
+    if (st->compressed) { disk_write_encoded(st, addr, buf); return; }
+    bytes_written = fd_transfer(st->fd, 1, (void *)buf, (size_t)st->nodeSize, offset);
+    if (bytes_written != (size_t)st->nodeSize) {
+        fprintf(stderr, "Storage Error: Failed to write node image at addr %d (offset %ld). Bytes written: %lu / Expected: %lu\n", addr, offset, (unsigned long)bytes_written, (unsigned long)st->nodeSize);
+        perror(" pwrite error"); exit(EXIT_FAILURE);
+    }
+    st->stats.io_write_bytes += (unsigned long)bytes_written;
+}
+
+/* Reads/writes a single int at a file offset (header fields, free chain links) */
+static int disk_read_int(struct Storage *st, long offset) {
+    int v;
+    if (fd_transfer(st->fd, 0, &v, sizeof(int), offset) != sizeof(int)) {
+        fprintf(stderr, "Storage Error: Cannot read int at offset %ld.\n", offset); exit(EXIT_FAILURE);
+    }
+    return v;
+}
+static void disk_write_int(struct Storage *st, long offset, int v) {
+    if (fd_transfer(st->fd, 1, &v, sizeof(int), offset) != sizeof(int)) {
+        fprintf(stderr, "Storage Error: Cannot write int at offset %ld.\n", offset); perror(" pwrite error"); exit(EXIT_FAILURE);
+    }
+}
+
+/* --- Free List --- */
+/* In memory the free pages form a LIFO stack (top = next page handed out). */
+/* On disk the top is stored in the header and each free page holds the */
+/* address of the page below it in its first int. */
+
+static void freelist_push(struct Storage *st, int addr) {
+    int *grown;
+    if (st->freeCount == st->freeCap) {
+        st->freeCap = st->freeCap > 0 ? st->freeCap * 2 : 64;
+        grown = realloc(st->freeList, st->freeCap * sizeof(int));
+        if (!grown) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+        st->freeList = grown;
+    }
+    st->freeList[st->freeCount++] = addr;
+}
+
+/* Walks the on-disk chain starting at head into the in-memory stack */
+static void freelist_load(struct Storage *st, int head) {
+    int addr = head; int i; int tmp;
+    while (addr != NULL_ADDR) {
+        if (addr < 0 || addr >= st->nodeCount || st->freeCount >= st->nodeCount) {
+            fprintf(stderr, "Storage Error: Corrupt free list (page %d, %d nodes).\n", addr, st->nodeCount); exit(EXIT_FAILURE);
+        }
+        freelist_push(st, addr);
+        addr = disk_read_int(st, calculate_offset(st, addr));
+    }
+    for (i = 0; i < st->freeCount / 2; ++i) { /* Chain order is top first */
+        tmp = st->freeList[i];
+        st->freeList[i] = st->freeList[st->freeCount - 1 - i];
+        st->freeList[st->freeCount - 1 - i] = tmp;
+    }
+}
+
+/* Links the free pages on disk and records the head in the header */
+static void freelist_save(struct Storage *st) {
+    int i; int next = NULL_ADDR;
+    if (st->version == VERSION_V1 || st->version == VERSION_SHADOW) { return; } /* No header slot / kept in the page table */
+    for (i = 0; i < st->freeCount; ++i) {
+        disk_write_int(st, calculate_offset(st, st->freeList[i]), next);
+        next = st->freeList[i];
+    }
+    disk_write_int(st, FREE_HEAD_OFFSET, next);
+}
+
+/* --- Write-Ahead Log (redo, group commit) --- */
+/* With the WAL on, node writes of the current group are staged in memory */
+/* (latest image per address) and never reach the data file directly. A */
+/* group closes at an operation boundary (Storage_op_end) once it holds */
+/* groupOps operations or is older than windowUs. Its images and a commit */
+/* record are appended to "<file>-wal" with one write and one fdatasync, */
+/* and only then copied into the data file. On open, committed groups */
+/* found in the log are replayed and a torn tail is ignored. The log is */
+/* truncated at checkpoints, after the data file has been fsynced. */
+/* Record layout (ints): PAGE  = magic, WAL_PAGE, addr, seq, image, sum */
+/*                       COMMIT = magic, WAL_COMMIT, count, seq, sum */
+#define WAL_MAGIC ((int)0x57414C31)
+#define WAL_PAGE 1
+#define WAL_COMMIT 2
+#define WAL_CHECKPOINT_BYTES (8L * 1024 * 1024)
+
+static int image_ints(struct Storage *st) {
+    return (int)(st->nodeSize / (long)sizeof(int));
+}
+
+/* FNV-1a over n ints */
+static int wal_checksum(const int *p, int n) {
+    unsigned long h = 2166136261UL; const unsigned char *b = (const unsigned char *)p; size_t i;
+    for (i = 0; i < (size_t)n * sizeof(int); ++i) { h = ((h ^ b[i]) * 16777619UL) & 0xFFFFFFFFUL; }
+    return (int)(h & 0x7FFFFFFFUL);
+}
+
+static void wal_sync(struct Storage *st, int fd, const char *what) {
+    if (fdatasync(fd) != 0) { fprintf(stderr, "Storage Error: fdatasync of %s failed: ", what); perror(NULL); exit(EXIT_FAILURE); }
+    st->walStats.syncs++;
+}
+
+static int wal_hash(struct Storage *st, int addr) {
+    return (int)(((unsigned int)addr * 2654435761u) & (unsigned int)(st->wal.nbuckets - 1));
+}
+
+/* Index of the staged image of addr, or -1 */
+static int wal_lookup(struct Storage *st, int addr) {
+    int i;
+    if (!st->wal.enabled || st->wal.count == 0) { return -1; }
+    i = st->wal.bucket[wal_hash(st, addr)];
+    while (i != -1 && st->wal.addr[i] != addr) { i = st->wal.next[i]; }
+    return i;
+}
+
+static int *wal_image(struct Storage *st, int i) {
+    return st->wal.images + (size_t)i * image_ints(st);
+}
+
+/* Image slot for addr in the open group (existing one is overwritten) */
+static int *wal_stage(struct Storage *st, int addr) {
+    int i = wal_lookup(st, addr); int b; int *grown_a; int *grown_n; int *grown_i;
+    if (i != -1) { return wal_image(st, i); }
+    if (st->wal.count == st->wal.cap) {
+        st->wal.cap = st->wal.cap > 0 ? st->wal.cap * 2 : 64;
+        grown_a = realloc(st->wal.addr, st->wal.cap * sizeof(int)); if (grown_a) { st->wal.addr = grown_a; }
+        grown_n = realloc(st->wal.next, st->wal.cap * sizeof(int)); if (grown_n) { st->wal.next = grown_n; }
+        grown_i = realloc(st->wal.images, (size_t)st->wal.cap * st->nodeSize); if (grown_i) { st->wal.images = grown_i; }
+        if (!grown_a || !grown_n || !grown_i) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+        free(st->wal.bucket);
+        st->wal.nbuckets = 2 * st->wal.cap;
+        st->wal.bucket = malloc(st->wal.nbuckets * sizeof(int));
+        if (!st->wal.bucket) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+        for (b = 0; b < st->wal.nbuckets; ++b) { st->wal.bucket[b] = -1; }
+        for (i = 0; i < st->wal.count; ++i) { b = wal_hash(st, st->wal.addr[i]); st->wal.next[i] = st->wal.bucket[b]; st->wal.bucket[b] = i; }
+    }
+    if (st->wal.count == 0 && st->wal.ops == 0) { clock_gettime(CLOCK_MONOTONIC, &st->wal.groupStart); }
+    i = st->wal.count++;
+    b = wal_hash(st, addr);
+    st->wal.addr[i] = addr; st->wal.next[i] = st->wal.bucket[b]; st->wal.bucket[b] = i;
+    return wal_image(st, i);
+}
+
+/* Reads a node image, preferring the staged copy of the open group */
+static void load_image(struct Storage *st, int addr, int *buf) {
+    int i = wal_lookup(st, addr);
+    if (i != -1) { memcpy(buf, wal_image(st, i), (size_t)st->nodeSize); }
+    else { disk_read_image(st, addr, buf); }
+}
+
+/* Makes the data file durable and empties the log */
+static void wal_checkpoint(struct Storage *st) {
+    if (st->backend == STORAGE_BACKEND_MMAP && st->map != NULL) {
+        if (msync(st->map, (size_t)calculate_offset(st, st->mapCapacity), MS_SYNC) != 0) { perror("Storage Error: msync failed at checkpoint"); exit(EXIT_FAILURE); }
+    }
+    if (fsync(st->fd) != 0) { perror("Storage Error: fsync of data file failed"); exit(EXIT_FAILURE); }
+    st->walStats.syncs++;
+    if (ftruncate(st->wal.fd, 0) != 0) { perror("Storage Error: Cannot truncate log"); exit(EXIT_FAILURE); }
+    wal_sync(st, st->wal.fd, "log");
+    st->wal.logSize = 0;
+}
+
+/* Appends the open group to the log, syncs it, then applies it */
+static void wal_commit(struct Storage *st) {
+    int ni = image_ints(st); size_t need; int *p; int i;
+    if (!st->wal.enabled || (st->wal.count == 0 && st->wal.ops == 0)) { return; }
+    if (st->wal.count > 0) {
+        need = ((size_t)st->wal.count * (ni + 5) + 5) * sizeof(int);
+        if (need > st->wal.bufCap) {
+            free(st->wal.buf); st->wal.buf = malloc(need); st->wal.bufCap = need;
+            if (!st->wal.buf) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+        }
+        p = st->wal.buf;
+        for (i = 0; i < st->wal.count; ++i) {
+            p[0] = WAL_MAGIC; p[1] = WAL_PAGE; p[2] = st->wal.addr[i]; p[3] = st->wal.seq;
+            memcpy(p + 4, wal_image(st, i), (size_t)st->nodeSize);
+            p[4 + ni] = wal_checksum(p, 4 + ni);
+            p += ni + 5;
+        }
+        p[0] = WAL_MAGIC; p[1] = WAL_COMMIT; p[2] = st->wal.count; p[3] = st->wal.seq;
+        p[4] = wal_checksum(p, 4);
+        if (fd_transfer(st->wal.fd, 1, st->wal.buf, need, st->wal.logSize) != need) { perror("Storage Error: Cannot append to log"); exit(EXIT_FAILURE); }
+        wal_sync(st, st->wal.fd, "log");
+        st->wal.logSize += (long)need; st->walStats.logBytes += need; st->walStats.commits++;
+        for (i = 0; i < st->wal.count; ++i) { /* Now safe to overwrite the data file */
+            if (st->backend == STORAGE_BACKEND_MMAP) { memcpy(map_image(st, st->wal.addr[i]), wal_image(st, i), (size_t)st->nodeSize); }
+            else { disk_write_image(st, st->wal.addr[i], wal_image(st, i)); }
+        }
+        for (i = 0; i < st->wal.count; ++i) { st->wal.bucket[wal_hash(st, st->wal.addr[i])] = -1; }
+        st->wal.count = 0; st->wal.seq++;
+    }
+    st->wal.ops = 0;
+    if (st->wal.logSize > WAL_CHECKPOINT_BYTES) { wal_checkpoint(st); }
+}
+
+/* Replays committed groups of the log at path into the data file. */
+/* Returns the number of groups applied; stops at the first bad record. */
+static int wal_recover(struct Storage *st, const char *path) {
+    FILE *f; long size; int *log = NULL; long nints; long pos = 0; long group_start; int ni = image_ints(st);
+    int groups = 0; int pages; int i; int addr; int fd;
+    f = fopen(path, "rb");
+    if (f == NULL) { return 0; }
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0) { perror("Storage Error: Cannot size log"); exit(EXIT_FAILURE); }
+    nints = size / (long)sizeof(int);
+    if (nints > 0) {
+        log = malloc((size_t)nints * sizeof(int));
+        if (!log) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+        if (fseek(f, 0, SEEK_SET) != 0 || fread(log, sizeof(int), (size_t)nints, f) != (size_t)nints) { perror("Storage Error: Cannot read log"); exit(EXIT_FAILURE); }
+    }
+    fclose(f);
+    group_start = 0; pages = 0;
+    while (pos + 5 <= nints && log[pos] == WAL_MAGIC) {
+        if (log[pos + 1] == WAL_PAGE) {
+            if (pos + 5 + ni > nints || log[pos + 4 + ni] != wal_checksum(log + pos, 4 + ni)) { break; }
+            pos += ni + 5; pages++;
+        } else if (log[pos + 1] == WAL_COMMIT) {
+            if (log[pos + 4] != wal_checksum(log + pos, 4) || log[pos + 2] != pages) { break; }
+            for (i = 0; i < pages; ++i) { /* The group is complete: apply it */
+                addr = log[group_start + (long)i * (ni + 5) + 2];
+                disk_write_image(st, addr, log + group_start + (long)i * (ni + 5) + 4);
+                if (addr >= st->nodeCount) { st->nodeCount = addr + 1; }
+            }
+            pos += 5; group_start = pos; pages = 0; groups++;
+        } else { break; }
+    }
+    free(log);
+    if (groups > 0 && fsync(st->fd) != 0) { perror("Storage Error: fsync after recovery failed"); exit(EXIT_FAILURE); }
+    fd = open(path, O_WRONLY | O_TRUNC); /* Replayed groups must not run twice */
+    if (fd < 0 || fsync(fd) != 0) { perror("Storage Error: Cannot reset log after recovery"); exit(EXIT_FAILURE); }
+    close(fd); remove(path); /* Should the unlink be lost, an empty log is harmless */
+    return groups;
+}
+
+/* Starts an empty log at path (recovery has already run); takes ownership of path */
+static void wal_open(struct Storage *st, char *path) {
+    int b;
+    st->wal.path = path;
+    st->wal.fd = open(st->wal.path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (st->wal.fd < 0) { fprintf(stderr, "Storage Error: Cannot open log %s: ", st->wal.path); perror(NULL); exit(EXIT_FAILURE); }
+    st->wal.enabled = 1; st->wal.groupOps = g_config.walOps; st->wal.windowUs = g_config.walWindowUs;
+    st->wal.ops = 0; st->wal.count = 0; st->wal.logSize = 0; st->wal.seq = 0;
+    if (st->wal.bucket != NULL) { for (b = 0; b < st->wal.nbuckets; ++b) { st->wal.bucket[b] = -1; } }
+    /* Pages freed in this session may be reused at once; until a clean */
+    /* close rewrites it, the header lists none, so a crash only leaks them */
+    if (st->version != VERSION_V1) { disk_write_int(st, FREE_HEAD_OFFSET, NULL_ADDR); }
+    if (fsync(st->fd) != 0) { perror("Storage Error: fsync of data file failed"); exit(EXIT_FAILURE); }
+    st->walStats.syncs++;
+}
+
+static void wal_close(struct Storage *st) {
+    if (!st->wal.enabled) { return; }
+    close(st->wal.fd); st->wal.fd = -1;
+    remove(st->wal.path); free(st->wal.path); st->wal.path = NULL;
+    free(st->wal.addr); free(st->wal.next); free(st->wal.images); free(st->wal.bucket); free(st->wal.buf);
+    st->wal.addr = NULL; st->wal.next = NULL; st->wal.images = NULL; st->wal.bucket = NULL; st->wal.buf = NULL;
+    st->wal.cap = 0; st->wal.count = 0; st->wal.nbuckets = 0; st->wal.bufCap = 0;
+    st->wal.enabled = 0;
+}
+
+/* Microseconds since the open group started */
+static long wal_group_age_us(struct Storage *st) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)(now.tv_sec - st->wal.groupStart.tv_sec) * 1000000L + (now.tv_nsec - st->wal.groupStart.tv_nsec) / 1000L;
+}
+
+/* Copies a node image into the caller's node buffers */
+static void image_to_node(struct Storage *st, const int *img, struct Node *x) {
+    int max_keys = 2 * st->degree - 1;
+    x->n = img[0];
+    x->leaf = img[1];
+    memcpy(x->key, img + 2, max_keys * sizeof(int));
+    memcpy(x->value, img + 2 + max_keys, max_keys * sizeof(int));
+    memcpy(x->c, img + 2 + 2 * max_keys, (max_keys + 1) * sizeof(int));
+}
+
+/* Serializes a node into an image buffer */
+static void node_to_image(struct Storage *st, const struct Node *x, int *img) {
+    int max_keys = 2 * st->degree - 1;
+    img[0] = x->n;
+    img[1] = x->leaf;
+    memcpy(img + 2, x->key, max_keys * sizeof(int));
+    memcpy(img + 2 + max_keys, x->value, max_keys * sizeof(int));
+    memcpy(img + 2 + 2 * max_keys, x->c, (max_keys + 1) * sizeof(int));
+}
+
+/* Points a node's arrays directly into an image (no copy) */
+static void image_view(struct Storage *st, int *img, struct Node *view) {
+    int max_keys = 2 * st->degree - 1;
+    view->n = img[0];
+    view->leaf = img[1];
+    view->key = img + 2;
+    view->value = img + 2 + max_keys;
+    view->c = img + 2 + 2 * max_keys;
+}
+
+static int pool_hash(struct Storage *st, int addr) {
+    return (int)(((unsigned int)addr * 2654435761u) & (unsigned int)(st->pool.nbuckets - 1));
+}
+
+static void pool_init(struct Storage *st) {
+    int i;
+    st->pool.scratch = malloc((size_t)st->nodeSize);
+    if (!st->pool.scratch) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+    st->pool.nframes = (g_config.cacheFrames > 0 && st->backend != STORAGE_BACKEND_MMAP) ? g_config.cacheFrames : 0;
+    st->pool.hand = 0;
+    if (st->pool.nframes == 0) return;
+    st->pool.nbuckets = 1;
+    while (st->pool.nbuckets < 2 * st->pool.nframes) st->pool.nbuckets <<= 1;
+    st->pool.bucket = malloc(st->pool.nbuckets * sizeof(int));
+    st->pool.frames = malloc(st->pool.nframes * sizeof(struct Frame));
+    if (!st->pool.bucket || !st->pool.frames) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+    for (i = 0; i < st->pool.nbuckets; ++i) st->pool.bucket[i] = -1;
+    for (i = 0; i < st->pool.nframes; ++i) {
+        st->pool.frames[i].addr = NULL_ADDR;
+        st->pool.frames[i].pin_count = 0;
+        st->pool.frames[i].dirty = 0;
+        st->pool.frames[i].ref = 0;
+        st->pool.frames[i].next = -1;
+        st->pool.frames[i].image = malloc((size_t)st->nodeSize);
+        if (!st->pool.frames[i].image) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+    }
+}
+
+static void pool_destroy(struct Storage *st) {
+    int i;
+    for (i = 0; i < st->pool.nframes; ++i) free(st->pool.frames[i].image);
+    free(st->pool.frames); free(st->pool.bucket); free(st->pool.scratch);
+    st->pool.frames = NULL; st->pool.bucket = NULL; st->pool.scratch = NULL;
+    st->pool.nframes = 0; st->pool.nbuckets = 0; st->pool.hand = 0;
+}
+
+/* Returns the frame index caching addr, or -1 */
+static int pool_lookup(struct Storage *st, int addr) {
+    int f = st->pool.bucket[pool_hash(st, addr)];
+    while (f != -1 && st->pool.frames[f].addr != addr) f = st->pool.frames[f].next;
+    return f;
+}
+
+static void pool_unlink(struct Storage *st, int f) {
+    int *link = &st->pool.bucket[pool_hash(st, st->pool.frames[f].addr)];
+    while (*link != f) link = &st->pool.frames[*link].next;
+    *link = st->pool.frames[f].next;
+    st->pool.frames[f].next = -1;
+}
+
+/* CLOCK sweep: finds an unpinned frame, writing back its contents if dirty. */
+/* Returns -1 when every frame is pinned. */
+static int pool_victim(struct Storage *st) {
+    int scanned;
+    struct Frame *fr;
+    for (scanned = 0; scanned < 2 * st->pool.nframes; ++scanned) {
+        int f = st->pool.hand;
+        fr = &st->pool.frames[f];
+        st->pool.hand = (st->pool.hand + 1) % st->pool.nframes;
+        if (fr->pin_count > 0) continue;
+        if (fr->addr != NULL_ADDR && fr->ref) { fr->ref = 0; continue; }
+        if (fr->addr != NULL_ADDR) {
+            if (fr->dirty) { disk_write_image(st, fr->addr, fr->image); st->stats.cache_writebacks++; }
+            pool_unlink(st, f);
+            st->stats.cache_evictions++;
+        }
+        fr->addr = NULL_ADDR; fr->dirty = 0; fr->ref = 0;
+        return f;
+    }
+    return -1;
+}
+
+/* Binds a free frame to addr; loads the image from disk if load is set. */
+/* Returns -1 when no frame can be freed. */
+static int pool_install(struct Storage *st, int addr, int load) {
+    int f = pool_victim(st);
+    int b = pool_hash(st, addr);
+    if (f == -1) { return -1; }
+    if (load) load_image(st, addr, st->pool.frames[f].image);
+    st->pool.frames[f].addr = addr;
+    st->pool.frames[f].next = st->pool.bucket[b];
+    st->pool.bucket[b] = f;
+    return f;
+}
+
+/* Returns a frame holding addr, reading it on a miss, or -1 when the */
+/* pool is fully pinned */
+static int pool_fetch(struct Storage *st, int addr) {
+    int f = pool_lookup(st, addr);
+    if (f != -1) { st->stats.cache_hits++; }
+    else { st->stats.cache_misses++; f = pool_install(st, addr, 1); }
+    if (f != -1) { st->pool.frames[f].ref = 1; }
+    return f;
+}
+
+/* Validates a handle */
+static void check_open(struct Storage *st, const char *fn) {
+    if (st == NULL) { fprintf(stderr, "Storage Error: No storage handle in %s.\n", fn); exit(EXIT_FAILURE); }
+    if (st->dataFile == NULL) { fprintf(stderr, "Storage Error: Storage not open in %s.\n", fn); exit(EXIT_FAILURE); }
+    if (st->degree <= 1 || st->nodeSize <= 0) { fprintf(stderr, "Storage Error: Storage not properly initialized (t=%d, nodeSize=%ld).\n", st->degree, st->nodeSize); exit(EXIT_FAILURE); }
+}
+
+/* check_open, then takes the handle's lock until storage_leave */
+static void storage_enter(struct Storage *st, const char *fn) {
+    check_open(st, fn);
+    pthread_mutex_lock(&st->lock);
+}
+
+static void storage_leave(struct Storage *st) { pthread_mutex_unlock(&st->lock); }
+
+/* --- Page Latches --- */
+/* One reader/writer latch per node address for latch coupling in */
+/* btree.c. Latches come in chunks created on first use and kept until */
+/* close, so the table lock is held to find a latch, never while waiting */
+/* on one. They are independent of the handle lock. */
+#define LATCH_CHUNK 1024
+
+static pthread_rwlock_t *latch_find(struct Storage *st, int addr) {
+    struct LatchTable *lt = &st->latches; pthread_rwlock_t **grown; pthread_rwlock_t *l;
+    int c = addr / LATCH_CHUNK; int n; int i;
+    if (addr < 0) { fprintf(stderr, "Storage Error: Latch on invalid address %d.\n", addr); exit(EXIT_FAILURE); }
+    pthread_mutex_lock(&lt->lock);
+    if (c >= lt->nchunks) {
+        for (n = lt->nchunks > 0 ? lt->nchunks : 16; n <= c; n *= 2) { }
+        grown = realloc(lt->chunk, (size_t)n * sizeof(pthread_rwlock_t *));
+        if (!grown) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+        for (i = lt->nchunks; i < n; ++i) { grown[i] = NULL; }
+        lt->chunk = grown; lt->nchunks = n;
+    }
+    if (lt->chunk[c] == NULL) {
+        lt->chunk[c] = malloc(LATCH_CHUNK * sizeof(pthread_rwlock_t));
+        if (!lt->chunk[c]) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+        for (i = 0; i < LATCH_CHUNK; ++i) {
+            if (pthread_rwlock_init(&lt->chunk[c][i], NULL) != 0) { fprintf(stderr, "Storage Error: Cannot create page latch.\n"); exit(EXIT_FAILURE); }
+        }
+    }
+    l = &lt->chunk[c][addr % LATCH_CHUNK];
+    pthread_mutex_unlock(&lt->lock);
+    return l;
+}
+
+static void latch_destroy(struct Storage *st) {
+    struct LatchTable *lt = &st->latches; int c; int i;
+    for (c = 0; c < lt->nchunks; ++c) {
+        if (lt->chunk[c] == NULL) { continue; }
+        for (i = 0; i < LATCH_CHUNK; ++i) { pthread_rwlock_destroy(&lt->chunk[c][i]); }
+        free(lt->chunk[c]);
+    }
+    free(lt->chunk); lt->chunk = NULL; lt->nchunks = 0;
+    pthread_mutex_destroy(&lt->lock);
+}
+
+/* --- Shadow Paging (copy-on-write, version 4 files) --- */
+/* A version 4 file never overwrites a committed node. The addresses */
+/* btree.c sees are logical: a page table maps each one to a physical */
+/* slot (NULL_ADDR = free). The first write of a logical page after a */
+/* commit goes to a fresh physical slot, its shadow. A commit writes the */
+/* changed page table chunks and a new directory of chunks to fresh */
+/* slots, fsyncs, then swaps the directory root in the header with one */
+/* write, so a crash leaves the previous version intact and unused slots */
+/* are simply free at the next open. Snapshots keep a copy of a committed */
+/* table; a slot a newer version dropped stays retired while an open */
+/* snapshot's generation lies within the slot's lifetime. */
+/* Chunk slot: image_ints(st) physical addresses. */
+/* Directory slot: next directory slot, then image_ints(st)-1 chunk slots. */
+/* Ensures p holds at least need ints (doubling); returns the moved array */
+static int *ints_reserve(int *p, int *cap, int need) {
+    int c = *cap; int *grown;
+    if (need <= c) { return p; }
+    while (c < need) { c = c > 0 ? c * 2 : 64; }
+    grown = realloc(p, (size_t)c * sizeof(int));
+    if (!grown) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+    *cap = c; return grown;
+}
+
+/* Drops any cached image of addr without write-back */
+static void pool_drop(struct Storage *st, int addr, const char *what) {
+    int f;
+    if (st->pool.nframes == 0 || (f = pool_lookup(st, addr)) == -1) { return; }
+    if (st->pool.frames[f].pin_count > 0) { fprintf(stderr, "Storage Error: %s of pinned address %d.\n", what, addr); exit(EXIT_FAILURE); }
+    pool_unlink(st, f);
+    st->pool.frames[f].addr = NULL_ADDR; st->pool.frames[f].dirty = 0; st->pool.frames[f].ref = 0;
+}
+
+static void phys_release(struct Storage *st, int p) {
+    pool_drop(st, p, "Release");
+    st->shadow.physFree = ints_reserve(st->shadow.physFree, &st->shadow.physFreeCap, st->shadow.physFreeCount + 1);
+    st->shadow.physFree[st->shadow.physFreeCount++] = p;
+}
+
+/* A free physical slot, growing the file when none is left */
+static int phys_alloc(struct Storage *st) {
+    if (st->shadow.physFreeCount > 0) { return st->shadow.physFree[--st->shadow.physFreeCount]; }
+    if (ftruncate(st->fd, (off_t)calculate_offset(st, st->shadow.physCount + 1)) != 0) { perror("Storage Error: ftruncate failed to extend shadow file"); exit(EXIT_FAILURE); }
+    st->shadow.birth = ints_reserve(st->shadow.birth, &st->shadow.birthCap, st->shadow.physCount + 1);
+    return st->shadow.physCount++;
+}
+
+/* Keeps slot p while a snapshot of a generation in [birth, gen] is open; */
+/* gen -1 frees it at the end of the commit (table slots) */
+static void shadow_retire(struct Storage *st, int p, int gen) {
+    st->shadow.retired = ints_reserve(st->shadow.retired, &st->shadow.retiredCap, 2 * st->shadow.retiredCount + 2);
+    st->shadow.retired[2 * st->shadow.retiredCount] = p;
+    st->shadow.retired[2 * st->shadow.retiredCount + 1] = gen;
+    st->shadow.retiredCount++;
+}
+
+/* Frees the retired slots no open snapshot can reach */
+static void shadow_reclaim(struct Storage *st) {
+    int i; int s; int p; int needed; int kept = 0;
+    for (i = 0; i < st->shadow.retiredCount; ++i) {
+        p = st->shadow.retired[2 * i]; needed = 0;
+        for (s = 0; s < SHADOW_MAX_SNAPSHOTS && !needed; ++s) {
+            needed = st->shadow.snaps[s].live && st->shadow.birth[p] <= st->shadow.snaps[s].gen && st->shadow.snaps[s].gen <= st->shadow.retired[2 * i + 1];
+        }
+        if (!needed) { phys_release(st, p); continue; }
+        st->shadow.retired[2 * kept] = st->shadow.retired[2 * i]; st->shadow.retired[2 * kept + 1] = st->shadow.retired[2 * i + 1]; kept++;
+    }
+    st->shadow.retiredCount = kept;
+}
+
+static void shadow_mark_dirty(struct Storage *st, int addr) {
+    int c = addr / image_ints(st);
+    st->shadow.chunkDirty = ints_reserve(st->shadow.chunkDirty, &st->shadow.chunkDirtyCap, c + 1);
+    st->shadow.chunkDirty[c] = 1; st->shadow.changed = 1;
+}
+
+/* Snapshot the calling thread reads through, 0 = the working version */
+static int shadow_view(struct Storage *st) {
+    int i;
+    for (i = 0; i < st->shadow.viewCount; ++i) { if (pthread_equal(st->shadow.views[i].thread, pthread_self())) { return st->shadow.views[i].id; } }
+    return 0;
+}
+
+/* Points the calling thread at snapshot id; returns its previous view */
+static int shadow_set_view(struct Storage *st, int id) {
+    int i; int prev; struct ThreadView *grown;
+    for (i = 0; i < st->shadow.viewCount && !pthread_equal(st->shadow.views[i].thread, pthread_self()); ++i) { }
+    prev = i < st->shadow.viewCount ? st->shadow.views[i].id : 0;
+    if (id == 0) {
+        if (i < st->shadow.viewCount) { st->shadow.views[i] = st->shadow.views[--st->shadow.viewCount]; }
+        return prev;
+    }
+    if (i == st->shadow.viewCount) {
+        if (st->shadow.viewCount == st->shadow.viewCap) {
+            grown = realloc(st->shadow.views, (size_t)(st->shadow.viewCap > 0 ? 2 * st->shadow.viewCap : 8) * sizeof(struct ThreadView));
+            if (!grown) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+            st->shadow.views = grown; st->shadow.viewCap = st->shadow.viewCap > 0 ? 2 * st->shadow.viewCap : 8;
+        }
+        st->shadow.views[i].thread = pthread_self(); st->shadow.viewCount++;
+    }
+    st->shadow.views[i].id = id;
+    return prev;
+}
+
+/* Physical slot of logical addr in the version being read */
+static int shadow_resolve(struct Storage *st, int addr) {
+    int count = st->nodeCount; int *map = st->shadow.map; int view = shadow_view(st);
+    if (view != 0) { count = st->shadow.snaps[view - 1].count; map = st->shadow.snaps[view - 1].map; }
+    if (addr < 0 || addr >= count || map[addr] == NULL_ADDR) { fprintf(stderr, "Storage Error: Logical page %d has no physical page (view %d, %d pages).\n", addr, view, count); exit(EXIT_FAILURE); }
+    return map[addr];
+}
+
+/* Physical slot a write of logical addr goes to: a committed page gets a shadow */
+static int shadow_target(struct Storage *st, int addr) {
+    int p; int view = shadow_view(st);
+    if (view != 0) { fprintf(stderr, "Storage Error: Write while reading snapshot %d.\n", view); exit(EXIT_FAILURE); }
+    if (addr < 0 || addr >= st->nodeCount) { fprintf(stderr, "Storage Error: Write to invalid address %d (%d nodes).\n", addr, st->nodeCount); exit(EXIT_FAILURE); }
+    p = st->shadow.map[addr];
+    if (p == NULL_ADDR || (addr < st->shadow.committedCount && st->shadow.committed[addr] == p)) {
+        p = phys_alloc(st); st->shadow.map[addr] = p; shadow_mark_dirty(st, addr);
+    }
+    return p;
+}
+
+/* Unmaps logical addr; an uncommitted shadow is released at once */
+static void shadow_unmap(struct Storage *st, int addr) {
+    int p = st->shadow.map[addr];
+    if (p != NULL_ADDR && !(addr < st->shadow.committedCount && st->shadow.committed[addr] == p)) { phys_release(st, p); }
+    st->shadow.map[addr] = NULL_ADDR; shadow_mark_dirty(st, addr);
+}
+
+/* Writes the working table as the next version and swaps the header to it */
+static void shadow_commit(struct Storage *st) {
+    int per = image_ints(st); int nchunks; int ndir; int i; int j; int p; int next; int root[3];
+    if (!st->shadow.enabled) { return; }
+    st->shadow.ops = 0;
+    if (!st->shadow.changed) { return; }
+    flush_all(st); /* Shadows reach the file before the table that points at them */
+    nchunks = (st->nodeCount + per - 1) / per;
+    st->shadow.chunk = ints_reserve(st->shadow.chunk, &st->shadow.chunkCap, nchunks);
+    st->shadow.chunkDirty = ints_reserve(st->shadow.chunkDirty, &st->shadow.chunkDirtyCap, nchunks);
+    for (i = 0; i < nchunks; ++i) {
+        if (i < st->shadow.chunkCount && !st->shadow.chunkDirty[i]) { continue; }
+        if (i < st->shadow.chunkCount) { shadow_retire(st, st->shadow.chunk[i], -1); }
+        for (j = 0; j < per; ++j) { st->shadow.buf[j] = i * per + j < st->nodeCount ? st->shadow.map[i * per + j] : NULL_ADDR; }
+        p = phys_alloc(st); disk_write_image(st, p, st->shadow.buf);
+        st->shadow.chunk[i] = p; st->shadow.chunkDirty[i] = 0;
+    }
+    for (i = nchunks; i < st->shadow.chunkCount; ++i) { shadow_retire(st, st->shadow.chunk[i], -1); }
+    st->shadow.chunkCount = nchunks;
+    for (i = 0; i < st->shadow.dirCount; ++i) { shadow_retire(st, st->shadow.dir[i], -1); }
+    ndir = (nchunks + per - 2) / (per - 1);
+    st->shadow.dir = ints_reserve(st->shadow.dir, &st->shadow.dirCap, ndir);
+    next = NULL_ADDR;
+    for (i = ndir - 1; i >= 0; --i) { /* Back to front: each slot links its successor */
+        st->shadow.buf[0] = next;
+        for (j = 0; j < per - 1; ++j) { st->shadow.buf[1 + j] = i * (per - 1) + j < nchunks ? st->shadow.chunk[i * (per - 1) + j] : NULL_ADDR; }
+        p = phys_alloc(st); disk_write_image(st, p, st->shadow.buf);
+        st->shadow.dir[i] = p; next = p;
+    }
+    st->shadow.dirCount = ndir;
+    if (fsync(st->fd) != 0) { perror("Storage Error: fsync before root swap failed"); exit(EXIT_FAILURE); }
+    root[0] = next; root[1] = st->nodeCount; root[2] = st->shadow.gen + 1;
+    if (fd_transfer(st->fd, 1, root, sizeof(root), SHADOW_ROOT_OFFSET) != sizeof(root)) { perror("Storage Error: Cannot write table root"); exit(EXIT_FAILURE); }
+    if (fsync(st->fd) != 0) { perror("Storage Error: fsync after root swap failed"); exit(EXIT_FAILURE); }
+    /* The new version is durable: pages only the old one used retire */
+    for (i = 0; i < st->nodeCount; ++i) {
+        p = st->shadow.map[i];
+        if (p != NULL_ADDR && (i >= st->shadow.committedCount || st->shadow.committed[i] != p)) { st->shadow.birth[p] = st->shadow.gen + 1; }
+    }
+    for (i = 0; i < st->shadow.committedCount; ++i) {
+        p = st->shadow.committed[i];
+        if (p != NULL_ADDR && (i >= st->nodeCount || st->shadow.map[i] != p)) { shadow_retire(st, p, st->shadow.gen); }
+    }
+    st->shadow.committed = ints_reserve(st->shadow.committed, &st->shadow.committedCap, st->nodeCount);
+    memcpy(st->shadow.committed, st->shadow.map, (size_t)st->nodeCount * sizeof(int));
+    st->shadow.committedCount = st->nodeCount;
+    st->shadow.gen++; st->shadow.changed = 0;
+    shadow_reclaim(st);
+}
+
+/* Loads the committed table rooted at dir_root and derives both free lists */
+static void shadow_load(struct Storage *st, int dir_root, int count, int gen) {
+    int per = image_ints(st); int nchunks = (count + per - 1) / per; int addr = dir_root; int i; int j; int p; char *live;
+    st->shadow.buf = malloc((size_t)st->nodeSize);
+    live = calloc((size_t)st->shadow.physCount + 1, 1);
+    if (!st->shadow.buf || !live) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+    st->shadow.chunk = ints_reserve(st->shadow.chunk, &st->shadow.chunkCap, nchunks);
+    st->shadow.chunkDirty = ints_reserve(st->shadow.chunkDirty, &st->shadow.chunkDirtyCap, nchunks);
+    st->shadow.map = ints_reserve(st->shadow.map, &st->shadow.mapCap, count);
+    st->shadow.birth = ints_reserve(st->shadow.birth, &st->shadow.birthCap, st->shadow.physCount);
+    for (p = 0; p < st->shadow.physCount; ++p) { st->shadow.birth[p] = gen; }
+    for (i = 0; i < nchunks; ) { /* Directory chain */
+        if (addr < 0 || addr >= st->shadow.physCount || live[addr]) { fprintf(stderr, "Storage Error: Corrupt page table directory (slot %d).\n", addr); exit(EXIT_FAILURE); }
+        live[addr] = 1; disk_read_image(st, addr, st->shadow.buf);
+        st->shadow.dir = ints_reserve(st->shadow.dir, &st->shadow.dirCap, st->shadow.dirCount + 1);
+        st->shadow.dir[st->shadow.dirCount++] = addr;
+        for (j = 1; j < per && i < nchunks; ++j) { st->shadow.chunk[i++] = st->shadow.buf[j]; }
+        addr = st->shadow.buf[0];
+    }
+    for (i = 0; i < nchunks; ++i) {
+        p = st->shadow.chunk[i];
+        if (p < 0 || p >= st->shadow.physCount || live[p]) { fprintf(stderr, "Storage Error: Corrupt page table chunk (slot %d).\n", p); exit(EXIT_FAILURE); }
+        live[p] = 1; disk_read_image(st, p, st->shadow.buf); st->shadow.chunkDirty[i] = 0;
+        for (j = 0; j < per && i * per + j < count; ++j) { st->shadow.map[i * per + j] = st->shadow.buf[j]; }
+    }
+    st->shadow.chunkCount = nchunks;
+    for (i = count - 1; i >= 0; --i) {
+        p = st->shadow.map[i];
+        if (p == NULL_ADDR) { freelist_push(st, i); continue; } /* Unbacked logical pages are free */
+        if (p < 0 || p >= st->shadow.physCount || live[p]) { fprintf(stderr, "Storage Error: Corrupt page table entry %d -> %d.\n", i, p); exit(EXIT_FAILURE); }
+        live[p] = 1;
+    }
+    for (p = st->shadow.physCount - 1; p >= 0; --p) { if (!live[p]) { phys_release(st, p); } }
+    free(live);
+    st->shadow.committed = ints_reserve(st->shadow.committed, &st->shadow.committedCap, count);
+    if (count > 0) { memcpy(st->shadow.committed, st->shadow.map, (size_t)count * sizeof(int)); }
+    st->shadow.committedCount = count; st->shadow.gen = gen;
+    st->nodeCount = count;
+    st->shadow.enabled = 1; st->shadow.groupOps = g_config.shadowOps > 0 ? g_config.shadowOps : 1;
+    st->shadow.ops = 0; st->shadow.changed = 0; st->shadow.viewCount = 0;
+}
+
+/* Commits, closes every snapshot and trims free slots off the file end */
+static void shadow_close(struct Storage *st) {
+    int i; int last = -1;
+    shadow_commit(st);
+    for (i = 0; i < SHADOW_MAX_SNAPSHOTS; ++i) { free(st->shadow.snaps[i].map); st->shadow.snaps[i].map = NULL; st->shadow.snaps[i].live = 0; }
+    for (i = 0; i < st->shadow.committedCount; ++i) { if (st->shadow.committed[i] > last) { last = st->shadow.committed[i]; } }
+    for (i = 0; i < st->shadow.chunkCount; ++i) { if (st->shadow.chunk[i] > last) { last = st->shadow.chunk[i]; } }
+    for (i = 0; i < st->shadow.dirCount; ++i) { if (st->shadow.dir[i] > last) { last = st->shadow.dir[i]; } }
+    if (ftruncate(st->fd, (off_t)calculate_offset(st, last + 1)) != 0) { perror("Storage Warning: ftruncate failed trimming shadow file"); }
+    free(st->shadow.map); free(st->shadow.committed); free(st->shadow.chunk); free(st->shadow.chunkDirty); free(st->shadow.dir);
+    free(st->shadow.physFree); free(st->shadow.retired); free(st->shadow.buf); free(st->shadow.birth);
+    st->shadow.birth = NULL; st->shadow.birthCap = 0;
+    st->shadow.map = NULL; st->shadow.committed = NULL; st->shadow.chunk = NULL; st->shadow.chunkDirty = NULL; st->shadow.dir = NULL;
+    free(st->shadow.views); st->shadow.views = NULL; st->shadow.viewCount = 0; st->shadow.viewCap = 0;
+    st->shadow.physFree = NULL; st->shadow.retired = NULL; st->shadow.buf = NULL;
+    st->shadow.mapCap = 0; st->shadow.committedCap = 0; st->shadow.committedCount = 0; st->shadow.chunkCap = 0; st->shadow.chunkCount = 0;
+    st->shadow.chunkDirtyCap = 0; st->shadow.dirCap = 0; st->shadow.dirCount = 0; st->shadow.physCount = 0;
+    st->shadow.physFreeCap = 0; st->shadow.physFreeCount = 0; st->shadow.retiredCap = 0; st->shadow.retiredCount = 0;
+    st->shadow.enabled = 0;
+}
+
+/* --- Key Filter (blocked Bloom) --- */
+/* An optional filter of the keys in the tree, kept in memory and in */
+/* "<file>-bloom", lets lookups of absent keys skip the descent. A key sets */
+/* its bits in a single 64-byte block picked by its hash, so a check */
+/* touches one cache line. The filter only grows (deleted keys keep their */
+/* bits) and is trusted only when its file is marked clean: the first page */
+/* write of a session marks it dirty on disk (one fdatasync), and close */
+/* writes it back clean after syncing the data file. A filter that is */
+/* dirty, missing or past its capacity is rebuilt by the tree layer */
+/* (see BTree_bloom_rebuild). */
+/* Layout (ints): magic, clean, hashes, nblocks, capacity, added, blocks */
+#define BLOOM_MAGIC ((int)0x424C4F4D)
+#define BLOOM_HEADER_INTS 6
+#define BLOOM_BLOCK_BYTES 64
+#define BLOOM_MIN_KEYS 1024
+#define BLOOM_MAX_BITS 64
+/* Capacity and added count stay ints in the file */
+#define INT_MAX_KEYS 0x7FFFFFFF
+
+/* murmur3 finalizer: every input bit affects every output bit */
+static unsigned int bloom_mix(unsigned int h) {
+    h ^= h >> 16; h *= 0x85EBCA6Bu; h ^= h >> 13; h *= 0xC2B2AE35u; h ^= h >> 16;
+    return h & 0xFFFFFFFFu;
+}
+
+/* Sets the bits of key (add != 0), or returns 1 if they are all set */
+static int bloom_probe(struct Storage *st, int key, int add) {
+    unsigned int h1 = bloom_mix((unsigned int)key); unsigned int h2 = bloom_mix(h1 ^ 0x9E3779B9u);
+    unsigned int a = h2 & 511u; unsigned int b = ((h2 >> 9) & 511u) | 1u; unsigned int bit; int i;
+    unsigned char *block = st->bloom.bits + (size_t)(h1 % (unsigned int)st->bloom.nblocks) * BLOOM_BLOCK_BYTES;
+    for (i = 0; i < st->bloom.hashes; ++i) { /* b is odd: distinct bits within the block */
+        bit = (a + (unsigned int)i * b) & 511u;
+        if (add) { block[bit >> 3] |= (unsigned char)(1u << (bit & 7u)); }
+        else if (!(block[bit >> 3] & (1u << (bit & 7u)))) { return 0; }
+    }
+    return 1;
+}
+
+/* Opens the filter file of fname and loads it if it is clean */
+static void bloom_open(struct Storage *st, const char *fname, int created) {
+    int hdr[BLOOM_HEADER_INTS]; size_t bytes;
+    st->bloom.path = malloc(strlen(fname) + 7);
+    if (!st->bloom.path) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+    strcpy(st->bloom.path, fname); strcat(st->bloom.path, "-bloom");
+    st->bloom.bitsPerKey = g_config.bloomBits;
+    if (created) { remove(st->bloom.path); } /* One next to a new file is stale */
+    st->bloom.fd = open(st->bloom.path, O_RDWR);
+    if (st->bloom.fd < 0) {
+        if (errno != ENOENT) { fprintf(stderr, "Storage Error: Cannot open key filter %s: ", st->bloom.path); perror(NULL); exit(EXIT_FAILURE); }
+        return;
+    }
+    if (fd_transfer(st->bloom.fd, 0, hdr, sizeof(hdr), 0) != sizeof(hdr) || hdr[0] != BLOOM_MAGIC) { return; }
+    st->bloom.clean = hdr[1] == 1;
+    if (!st->bloom.clean || st->bloom.bitsPerKey == 0 || hdr[2] < 1 || hdr[3] < 1) { return; }
+    bytes = (size_t)hdr[3] * BLOOM_BLOCK_BYTES;
+    st->bloom.bits = malloc(bytes);
+    if (!st->bloom.bits) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+    if (fd_transfer(st->bloom.fd, 0, st->bloom.bits, bytes, (long)sizeof(hdr)) != bytes) { free(st->bloom.bits); st->bloom.bits = NULL; return; }
+    st->bloom.hashes = hdr[2]; st->bloom.nblocks = hdr[3];
+    st->bloom.capacity = hdr[4]; st->bloom.added = hdr[5]; st->bloom.valid = 1;
+}
+
+/* Marks the filter file dirty before the first page of a session changes */
+static void bloom_touch(struct Storage *st) {
+    int dirty = 0;
+    if (!st->bloom.clean) { return; }
+    if (fd_transfer(st->bloom.fd, 1, &dirty, sizeof(int), (long)sizeof(int)) != sizeof(int)) { perror("Storage Error: Cannot mark key filter dirty"); exit(EXIT_FAILURE); }
+    wal_sync(st, st->bloom.fd, "key filter");
+    st->bloom.clean = 0;
+}
+
+/* Writes a changed filter back and marks it clean (see Storage_close). */
+/* A failure only leaves it dirty, to be rebuilt at the next open. */
+static void bloom_save(struct Storage *st) {
+    int hdr[BLOOM_HEADER_INTS]; size_t bytes; int clean = 1;
+    if (!st->bloom.valid || (st->bloom.clean && !st->bloom.changed)) { return; }
+    if (fsync(st->fd) != 0) { perror("Storage Warning: fsync before saving key filter failed"); return; }
+    if (st->bloom.fd < 0) { st->bloom.fd = open(st->bloom.path, O_RDWR | O_CREAT, 0644); }
+    if (st->bloom.fd < 0) { perror("Storage Warning: Cannot create key filter"); return; }
+    bloom_touch(st);
+    hdr[0] = BLOOM_MAGIC; hdr[1] = 0; hdr[2] = st->bloom.hashes; hdr[3] = st->bloom.nblocks;
+    hdr[4] = st->bloom.capacity; hdr[5] = st->bloom.added;
+    bytes = (size_t)st->bloom.nblocks * BLOOM_BLOCK_BYTES;
+    if (ftruncate(st->bloom.fd, (off_t)(sizeof(hdr) + bytes)) != 0 ||
+        fd_transfer(st->bloom.fd, 1, hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        fd_transfer(st->bloom.fd, 1, st->bloom.bits, bytes, (long)sizeof(hdr)) != bytes) {
+        perror("Storage Warning: Cannot write key filter"); return;
+    }
+    wal_sync(st, st->bloom.fd, "key filter"); /* Bits first, then the flag */
+    if (fd_transfer(st->bloom.fd, 1, &clean, sizeof(int), (long)sizeof(int)) != sizeof(int)) { perror("Storage Warning: Cannot mark key filter clean"); return; }
+    wal_sync(st, st->bloom.fd, "key filter");
+    st->bloom.clean = 1; st->bloom.changed = 0;
+}
+
+static void bloom_close(struct Storage *st) {
+    if (st->bloom.fd >= 0) { close(st->bloom.fd); }
+    free(st->bloom.bits); free(st->bloom.path);
+    st->bloom.fd = -1; st->bloom.bits = NULL; st->bloom.path = NULL; st->bloom.valid = 0;
 }
 
 /* --- API Implementation --- */
 
-int Storage_get_t(void) {
-     if (g_storage.dataFile == NULL) {
+int Storage_get_t(struct Storage *st) {
+     if (st == NULL || st->dataFile == NULL) {
         fprintf(stderr, "Storage Error: Cannot get t, storage not open.\n");
         exit(EXIT_FAILURE);
      }
-     if (g_storage.degree < 2) {
-         fprintf(stderr, "Storage Error: Invalid degree t=%d stored internally.\n", g_storage.degree);
+     if (st->degree < 2) {
+         fprintf(stderr, "Storage Error: Invalid degree t=%d stored internally.\n", st->degree);
          exit(EXIT_FAILURE);
      }
-    return g_storage.degree;
+    return st->degree;
 }
 
-void Storage_open(const char *fname, int t_user) {
+/* Storage_open: Opens or creates fname and returns its handle. Any */
+/* number of files may be open at once, and a handle may be used by */
+/* several threads until Storage_close. */
+struct Storage* Storage_open(const char *fname, int t_user) {
     int stored_t = 0;
     int magic = 0, version = 0;
+    int free_head = NULL_ADDR;
+    int page_size = 0;
+    int created = 0;
+    char *log_path;
+    int shadow_root[3] = { NULL_ADDR, 0, 0 }; /* Version 4: table root, page count, generation */
+    struct Storage *st = calloc(1, sizeof(struct Storage));
 
-    if (g_storage.dataFile != NULL) {
-        fprintf(stderr, "Storage Error: Storage already open.\n");
-        exit(EXIT_FAILURE);
+    if (!st) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+    st->fd = -1; st->wal.fd = -1; st->bloom.fd = -1;
+    if (pthread_mutex_init(&st->lock, NULL) != 0 || pthread_cond_init(&st->idle, NULL) != 0 || pthread_mutex_init(&st->latches.lock, NULL) != 0) {
+        fprintf(stderr, "Storage Error: Cannot create handle lock.\n"); exit(EXIT_FAILURE);
     }
 
     /* Try opening existing file first */
-    g_storage.dataFile = fopen(fname, "r+b");
-    if (g_storage.dataFile != NULL) {
+    st->dataFile = fopen(fname, "r+b");
+    if (st->dataFile != NULL) {
         /* File exists */
-        if (fseek(g_storage.dataFile, 0, SEEK_SET) != 0) {
+        if (fseek(st->dataFile, 0, SEEK_SET) != 0) {
             perror("Storage Error: Cannot seek to header (r+b)");
-            fclose(g_storage.dataFile); g_storage.dataFile = NULL; exit(EXIT_FAILURE);
+            fclose(st->dataFile); st->dataFile = NULL; exit(EXIT_FAILURE);
         }
-        if (fread(&magic, sizeof(int), 1, g_storage.dataFile) != 1 ||
-            fread(&version, sizeof(int), 1, g_storage.dataFile) != 1 ||
-            fread(&stored_t, sizeof(int), 1, g_storage.dataFile) != 1)
+        if (fread(&magic, sizeof(int), 1, st->dataFile) != 1 ||
+            fread(&version, sizeof(int), 1, st->dataFile) != 1 ||
+            fread(&stored_t, sizeof(int), 1, st->dataFile) != 1)
         {
             fprintf(stderr, "Storage Error: Cannot read header from existing file %s\n", fname);
-            if (ferror(g_storage.dataFile)) perror("fread error");
-            fclose(g_storage.dataFile); g_storage.dataFile = NULL; exit(EXIT_FAILURE);
+            if (ferror(st->dataFile)) perror("fread error");
+            fclose(st->dataFile); st->dataFile = NULL; exit(EXIT_FAILURE);
         }
-        if (magic != MAGIC_NUMBER || version != VERSION) {
+        if (magic != MAGIC_NUMBER || (version != VERSION && version != VERSION_PAGED && version != VERSION_V1 && version != VERSION_SHADOW && version != VERSION_COMPRESSED)) {
             fprintf(stderr, "Storage Error: Invalid file format or version (Magic: %x, Version: %d).\n", magic, version);
-            fclose(g_storage.dataFile); g_storage.dataFile = NULL; exit(EXIT_FAILURE);
+            fclose(st->dataFile); st->dataFile = NULL; exit(EXIT_FAILURE);
+        }
+        st->headerSize = HEADER_SIZE_V1;
+        if (version != VERSION_V1) {
+            if (fread(&free_head, sizeof(int), 1, st->dataFile) != 1 ||
+                ((version == VERSION_PAGED || version == VERSION_SHADOW || version == VERSION_COMPRESSED) && fread(&page_size, sizeof(int), 1, st->dataFile) != 1) ||
+                (version == VERSION_SHADOW && fread(shadow_root, sizeof(int), 3, st->dataFile) != 3)) {
+                fprintf(stderr, "Storage Error: Cannot read header from existing file %s\n", fname);
+                fclose(st->dataFile); st->dataFile = NULL; exit(EXIT_FAILURE);
+            }
+            st->headerSize = version == VERSION_SHADOW ? HEADER_SIZE_SHADOW : (version == VERSION_COMPRESSED ? HEADER_SIZE_COMPRESSED : HEADER_SIZE);
+        }
+        if (version == VERSION_PAGED || ((version == VERSION_SHADOW || version == VERSION_COMPRESSED) && page_size != 0)) {
+            if (page_size < MIN_PAGE_SIZE || page_size > MAX_PAGE_SIZE || (page_size & (page_size - 1)) != 0) {
+                fprintf(stderr, "Storage Error: Invalid page size %d found in file header.\n", page_size);
+                fclose(st->dataFile); st->dataFile = NULL; exit(EXIT_FAILURE);
+            }
+            st->headerSize = page_size;
         }
         if (stored_t < 2) {
             fprintf(stderr, "Storage Error: Invalid minimum degree t=%d found in file header.\n", stored_t);
-            fclose(g_storage.dataFile); g_storage.dataFile = NULL; exit(EXIT_FAILURE);
+            fclose(st->dataFile); st->dataFile = NULL; exit(EXIT_FAILURE);
         }
-        g_storage.degree = stored_t;
-        g_storage.nodeSize = calculate_node_size(g_storage.degree);
+        st->degree = stored_t;
+        st->nodeSize = calculate_node_size(st->degree);
+        st->compressed = version == VERSION_COMPRESSED;
+        st->slotSize = calculate_slot_size(st->nodeSize + (st->compressed ? (long)sizeof(int) : 0), page_size);
 
         /* Check file size consistency */
         {
             long file_size;
-            if (fseek(g_storage.dataFile, 0, SEEK_END) != 0) {
+            if (fseek(st->dataFile, 0, SEEK_END) != 0) {
                  perror("Storage Error: Cannot seek to end (size check)");
-                 fclose(g_storage.dataFile); g_storage.dataFile = NULL; exit(EXIT_FAILURE);
+                 fclose(st->dataFile); st->dataFile = NULL; exit(EXIT_FAILURE);
             }
-            file_size = ftell(g_storage.dataFile);
+            file_size = ftell(st->dataFile);
              if (file_size < 0) {
                  perror("Storage Error: Cannot get file size (size check)");
-                 fclose(g_storage.dataFile); g_storage.dataFile = NULL; exit(EXIT_FAILURE);
+                 fclose(st->dataFile); st->dataFile = NULL; exit(EXIT_FAILURE);
             }
-            if ((file_size - HEADER_SIZE) % g_storage.nodeSize != 0) {
-                fprintf(stderr, "Storage Warning: File size %ld does not align with header (t=%d, nodeSize=%ld).\n",
-                        file_size, g_storage.degree, g_storage.nodeSize);
+            if ((file_size - st->headerSize) % st->slotSize != 0) {
+                fprintf(stderr, "Storage Warning: File size %ld does not align with header (t=%d, slotSize=%ld).\n",
+                        file_size, st->degree, st->slotSize);
             }
+            st->nodeCount = (int)((file_size - st->headerSize) / st->slotSize);
         }
 
+
     } else {
         /* File doesn't exist or couldn't open r+b */
         if (errno != ENOENT) {
              perror("Storage Error: Cannot open existing file (r+b)"); exit(EXIT_FAILURE);
         }
         /* Create new file */
-        g_storage.dataFile = fopen(fname, "w+b");
-        if (g_storage.dataFile == NULL) {
+        st->dataFile = fopen(fname, "w+b");
+        if (st->dataFile == NULL) {
             perror("Storage Error: Cannot create new file (w+b)"); exit(EXIT_FAILURE);
         }
+        page_size = g_config.pageSize;
+        if (t_user == 0) { /* Largest t whose node image fits one page */
+            t_user = (int)((page_size > 0 ? page_size : DEFAULT_PAGE_SIZE) / (long)(6 * sizeof(int)));
+        }
         if (t_user < 2) {
              fprintf(stderr, "Storage Error: Minimum degree t must be >= 2 for new file.\n");
-             fclose(g_storage.dataFile); g_storage.dataFile = NULL; remove(fname); exit(EXIT_FAILURE);
-        }
-        magic = MAGIC_NUMBER; version = VERSION; stored_t = t_user;
-        g_storage.degree = t_user;
-        g_storage.nodeSize = calculate_node_size(g_storage.degree);
-        if (fwrite(&magic, sizeof(int), 1, g_storage.dataFile) != 1 ||
-            fwrite(&version, sizeof(int), 1, g_storage.dataFile) != 1 ||
-            fwrite(&stored_t, sizeof(int), 1, g_storage.dataFile) != 1)
+             fclose(st->dataFile); st->dataFile = NULL; remove(fname); exit(EXIT_FAILURE);
+        }
+        if (g_config.shadowOps > 0 && g_config.compress) {
+            fprintf(stderr, "Storage Error: Shadow paging and compressed nodes cannot be combined.\n");
+            fclose(st->dataFile); st->dataFile = NULL; remove(fname); exit(EXIT_FAILURE);
+        }
+        magic = MAGIC_NUMBER; stored_t = t_user;
+        version = g_config.shadowOps > 0 ? VERSION_SHADOW : (g_config.compress ? VERSION_COMPRESSED : (page_size > 0 ? VERSION_PAGED : VERSION));
+        st->degree = t_user;
+        st->nodeSize = calculate_node_size(st->degree);
+        st->compressed = version == VERSION_COMPRESSED;
+        st->slotSize = calculate_slot_size(st->nodeSize + (st->compressed ? (long)sizeof(int) : 0), page_size);
+        st->headerSize = page_size > 0 ? page_size : (version == VERSION_SHADOW ? HEADER_SIZE_SHADOW : (version == VERSION_COMPRESSED ? HEADER_SIZE_COMPRESSED : HEADER_SIZE));
+        if (fwrite(&magic, sizeof(int), 1, st->dataFile) != 1 ||
+            fwrite(&version, sizeof(int), 1, st->dataFile) != 1 ||
+            fwrite(&stored_t, sizeof(int), 1, st->dataFile) != 1 ||
+            fwrite(&free_head, sizeof(int), 1, st->dataFile) != 1 ||
+            ((version == VERSION_PAGED || version == VERSION_SHADOW || version == VERSION_COMPRESSED) && fwrite(&page_size, sizeof(int), 1, st->dataFile) != 1) ||
+            (version == VERSION_SHADOW && fwrite(shadow_root, sizeof(int), 3, st->dataFile) != 3))
         {
             fprintf(stderr, "Storage Error: Cannot write header to new file.\n");
-            perror("fwrite"); fclose(g_storage.dataFile); g_storage.dataFile = NULL; remove(fname); exit(EXIT_FAILURE);
+            perror("fwrite"); fclose(st->dataFile); st->dataFile = NULL; remove(fname); exit(EXIT_FAILURE);
         }
-         if (fflush(g_storage.dataFile) != 0) {
+         if (fflush(st->dataFile) != 0 || ftruncate(fileno(st->dataFile), (off_t)st->headerSize) != 0) {
             perror("Storage Error: Cannot flush header");
-            fclose(g_storage.dataFile); g_storage.dataFile = NULL; remove(fname); exit(EXIT_FAILURE);
+            fclose(st->dataFile); st->dataFile = NULL; remove(fname); exit(EXIT_FAILURE);
         }
+        st->nodeCount = 0; created = 1;
     }
+    st->version = version; st->pageSize = page_size;
+    /* From here on all file access is positional on the raw descriptor */
+    st->fd = fileno(st->dataFile);
+    if (st->compressed) {
+        if (g_config.backend == STORAGE_BACKEND_MMAP) { fprintf(stderr, "Storage Error: Compressed file %s needs the stdio backend.\n", fname); exit(EXIT_FAILURE); }
+        /* Room for the longest encoding node_encode may produce before giving up */
+        st->codec = malloc((size_t)(st->nodeSize / (long)sizeof(int)) * 5 + 16);
+        if (!st->codec) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+        st->readHint = (int)(st->nodeSize + (long)sizeof(int) < CODEC_READ_ALIGN ? st->nodeSize + (long)sizeof(int) : CODEC_READ_ALIGN);
+        st->readAvg = 8L * st->readHint;
+    }
+    /* A log left behind by a crash is replayed; one next to a new file is stale */
+    log_path = malloc(strlen(fname) + 5);
+    if (!log_path) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+    strcpy(log_path, fname); strcat(log_path, "-wal");
+    if (created) { remove(log_path); st->walStats.recovered = 0; }
+    else if (version != VERSION_SHADOW) { st->walStats.recovered = (unsigned long)wal_recover(st, log_path); }
+    st->backend = g_config.backend;
+    if (version == VERSION_SHADOW) {
+        /* Commits already switch versions atomically; mapped writes would */
+        /* land in place and the log would replay logical addresses */
+        if (st->backend == STORAGE_BACKEND_MMAP || g_config.walOps > 0) {
+            fprintf(stderr, "Storage Error: Shadow-paged file %s needs the stdio backend without a write-ahead log.\n", fname); exit(EXIT_FAILURE);
+        }
+        st->shadow.physCount = st->nodeCount;
+        shadow_load(st, shadow_root[0], shadow_root[1], shadow_root[2]);
+    } else {
+        freelist_load(st, free_head);
+    }
+    if (st->backend == STORAGE_BACKEND_MMAP) { map_open(st); }
+    bloom_open(st, fname, created);
 
     /* Reset statistics */
-    g_stats.reads = 0;
-    g_stats.writes = 0;
-    g_stats.allocs = 0;
+    st->stats.reads = 0;
+    st->stats.writes = 0;
+    st->stats.allocs = 0;
+    st->stats.cache_hits = 0;
+    st->stats.cache_misses = 0;
+    st->stats.cache_evictions = 0;
+    st->stats.cache_writebacks = 0;
+    st->stats.frees = 0;
+    st->stats.io_read_bytes = 0;
+    st->stats.io_write_bytes = 0;
+    st->stats.prefetches = 0;
+    st->stats.prefetch_hits = 0;
+    st->stats.bloom_checks = 0;
+    st->stats.bloom_skips = 0;
+    st->walStats.commits = 0;
+    st->walStats.syncs = 0;
+    st->walStats.logBytes = 0;
+
+    if (g_config.walOps > 0) { wal_open(st, log_path); } else { free(log_path); }
+    pool_init(st);
+    st->prefetchDepth = g_config.prefetchDepth;
+    return st;
 }
 
-void Storage_close(void) {
-    if (g_storage.dataFile != NULL) {
-        if (fflush(g_storage.dataFile) != 0) {
-             perror("Storage Warning: Error flushing file before close");
-        }
-        if (fclose(g_storage.dataFile) != 0) {
-            perror("Storage Warning: Error closing file");
-        }
-        /* Reset global state */
-        g_storage.dataFile = NULL;
-        g_storage.degree = 0;
-        g_storage.nodeSize = 0;
+/* Storage_set_page_size: Layout of files created by the next Storage_open. */
+/* A power of two from 512 (typically 4096, 8192 or 16384) creates a */
+/* version 3 file whose header and nodes each start on a page boundary; */
+/* 0 keeps the packed version 2 layout. Existing files keep their layout. */
+void Storage_set_page_size(int bytes) {
+    if (bytes != 0 && (bytes < MIN_PAGE_SIZE || bytes > MAX_PAGE_SIZE || (bytes & (bytes - 1)) != 0)) {
+        fprintf(stderr, "Storage Error: Invalid page size %d (0 or a power of two in [%d, %d]).\n", bytes, MIN_PAGE_SIZE, MAX_PAGE_SIZE); exit(EXIT_FAILURE);
     }
+    g_config.pageSize = bytes;
 }
 
-int Storage_empty(void) {
-    long file_size;
-    if (g_storage.dataFile == NULL) {
-        fprintf(stderr, "Storage Error: Storage not open in Storage_empty.\n");
-        exit(EXIT_FAILURE);
-    }
-    if (fflush(g_storage.dataFile) != 0) {
-         perror("Storage Warning: fflush failed in Storage_empty");
+/* Storage_get_page_size: Page size of the open file (0 if packed) */
+int Storage_get_page_size(struct Storage *st) {
+    check_open(st, "Storage_get_page_size");
+    return st->pageSize;
+}
+
+/* Storage_set_compression: on != 0 creates files with the next */
+/* Storage_open in version 5, whose B-tree nodes are stored delta and */
+/* varint encoded (see Compressed Node Encoding): sorted, dense keys cost */
+/* a byte or two instead of four, and unused slots nothing. Only the */
+/* encoding is written and read, so with pages of several file system */
+/* blocks (Storage_set_page_size) the rest of each page stays a hole and */
+/* disk usage shrinks as well; the file's length does not. Combines with */
+/* the page size and the WAL, not with the mmap backend or shadow paging. */
+/* Existing files keep their format. */
+void Storage_set_compression(int on) { g_config.compress = on != 0; }
+
+/* Storage_is_compressed: 1 if the open file stores encoded nodes */
+int Storage_is_compressed(struct Storage *st) {
+    check_open(st, "Storage_is_compressed");
+    return st->compressed;
+}
+
+/* Storage_set_backend: Backend used by the next Storage_open. */
+/* STORAGE_BACKEND_MMAP maps the file and serves node accesses from the */
+/* mapping (the OS page cache replaces the buffer pool). */
+void Storage_set_backend(int backend) {
+    if (backend != STORAGE_BACKEND_STDIO && backend != STORAGE_BACKEND_MMAP) { fprintf(stderr, "Storage Error: Unknown backend %d.\n", backend); exit(EXIT_FAILURE); }
+    g_config.backend = backend;
+}
+
+/* Storage_close: Flushes and closes the file and frees the handle */
+void Storage_close(struct Storage *st) {
+    check_open(st, "Storage_close");
+    if (st->shadow.enabled) { shadow_close(st); }
+    flush_all(st);
+    /* Empty the log before free pages get their chain links, so a crash */
+    /* during close cannot replay stale images over them */
+    if (st->wal.enabled) { wal_checkpoint(st); }
+    pool_destroy(st);
+    if (st->backend == STORAGE_BACKEND_MMAP) { map_close(st); }
+    freelist_save(st);
+    if (fflush(st->dataFile) != 0) {
+         perror("Storage Warning: Error flushing file before close");
     }
-    if (fseek(g_storage.dataFile, 0, SEEK_END) != 0) {
-        perror("Storage Error: fseek failed in Storage_empty"); exit(EXIT_FAILURE);
+    if (st->wal.enabled) {
+        if (fsync(st->fd) != 0) { perror("Storage Warning: fsync before close failed"); }
+        wal_close(st);
     }
-    file_size = ftell(g_storage.dataFile);
-    if (file_size < 0) {
-         perror("Storage Error: ftell failed in Storage_empty"); exit(EXIT_FAILURE);
+    bloom_save(st); bloom_close(st);
+    if (fclose(st->dataFile) != 0) {
+        perror("Storage Warning: Error closing file");
     }
-    return (file_size == HEADER_SIZE);
+    latch_destroy(st);
+    pthread_mutex_destroy(&st->lock); pthread_cond_destroy(&st->idle);
+    free(st->freeList); free(st->codec); free(st->prefetched);
+    free(st);
 }
 
-/* Storage_alloc: Use efficient fseek/fputc method */
-int Storage_alloc(void) {
-    long file_size;
+int Storage_empty(struct Storage *st) {
+    int empty;
+    storage_enter(st, "Storage_empty");
+    empty = (st->nodeCount == 0);
+    storage_leave(st);
+    return empty;
+}
+
+/* Storage_alloc: Reuses a free slot or extends the file by one node */
+int Storage_alloc(struct Storage *st) {
     int addr;
-    long target_offset;
 
-    if (g_storage.dataFile == NULL) {
-        fprintf(stderr, "Storage Error: Storage not open in Storage_alloc.\n"); exit(EXIT_FAILURE);
+    storage_enter(st, "Storage_alloc");
+    if (st->freeCount > 0) { /* Reuse a released slot before growing the file */
+        addr = st->freeList[--st->freeCount];
+    } else if (st->shadow.enabled) { /* A logical page; its physical slot comes with the first write */
+        st->shadow.map = ints_reserve(st->shadow.map, &st->shadow.mapCap, st->nodeCount + 1);
+        st->shadow.map[st->nodeCount] = NULL_ADDR; shadow_mark_dirty(st, st->nodeCount);
+        addr = st->nodeCount++;
+    } else if (st->backend == STORAGE_BACKEND_MMAP) {
+        /* Grow the mapping in large chunks; earlier mappings stay until close */
+        if (st->nodeCount == st->mapCapacity) {
+            map_resize(st, st->mapCapacity * 2 > st->mapCapacity + MMAP_GROW_NODES ? st->mapCapacity * 2 : st->mapCapacity + MMAP_GROW_NODES);
+        }
+        memset(st->map + calculate_offset(st, st->nodeCount), 0, (size_t)st->nodeSize);
+        addr = st->nodeCount++;
+    } else { /* nodeCount mirrors the file length; extend it with one ftruncate */
+        addr = st->nodeCount;
+        if (ftruncate(st->fd, (off_t)calculate_offset(st, addr + 1)) != 0) {
+            perror("Storage Error: ftruncate failed to extend file in Storage_alloc"); exit(EXIT_FAILURE);
+        }
+        st->nodeCount = addr + 1;
+    }
+    st->stats.allocs++;
+    storage_leave(st);
+    return addr;
+}
+
+
+void Storage_read(struct Storage *st, int addr, struct Node *x) {
+    int f;
+    storage_enter(st, "Storage_read");
+    if (x == NULL || x->key == NULL || x->value == NULL || x->c == NULL) { fprintf(stderr, "Storage Error: Null node or internal buffer passed to Storage_read.\n"); exit(EXIT_FAILURE); }
+    if (st->shadow.enabled) { addr = shadow_resolve(st, addr); }
+
+    if (st->backend == STORAGE_BACKEND_MMAP) {
+        f = wal_lookup(st, addr);
+        if (f == -1) { prefetch_consume(st, addr); }
+        image_to_node(st, f != -1 ? wal_image(st, f) : map_image(st, addr), x);
+    } else if (st->pool.nframes > 0 && (f = pool_fetch(st, addr)) != -1) {
+        image_to_node(st, st->pool.frames[f].image, x);
+    } else { /* Uncached, or every frame is pinned by concurrent readers */
+        load_image(st, addr, st->pool.scratch);
+        image_to_node(st, st->pool.scratch, x);
+    }
+    st->stats.reads++;
+    storage_leave(st);
+}
+
+
+void Storage_write(struct Storage *st, int addr, const struct Node *x) {
+    int f; int *img;
+    storage_enter(st, "Storage_write");
+    if (x == NULL || x->key == NULL || x->value == NULL || x->c == NULL) { fprintf(stderr, "Storage Error: Null node or internal buffer passed to Storage_write.\n"); exit(EXIT_FAILURE); }
+    if (st->shadow.enabled) { addr = shadow_target(st, addr); }
+    bloom_touch(st);
+
+    if (st->wal.enabled) {
+        /* No-steal: the image waits in the open group; a cached copy is */
+        /* refreshed but stays clean so eviction never writes it early */
+        img = wal_stage(st, addr);
+        node_to_image(st, x, img);
+        if (st->pool.nframes > 0 && (f = pool_lookup(st, addr)) != -1) {
+            memcpy(st->pool.frames[f].image, img, (size_t)st->nodeSize);
+            st->pool.frames[f].ref = 1;
+        }
+    } else if (st->backend == STORAGE_BACKEND_MMAP) {
+        node_to_image(st, x, map_image(st, addr));
+    } else if (st->pool.nframes > 0 && ((f = pool_lookup(st, addr)) != -1 || (f = pool_install(st, addr, 0)) != -1)) {
+        /* Write-back: the full image is replaced, so a miss needs no disk read */
+        node_to_image(st, x, st->pool.frames[f].image);
+        st->pool.frames[f].dirty = 1;
+        st->pool.frames[f].ref = 1;
+    } else { /* Write-through when uncached or every frame is pinned */
+        node_to_image(st, x, st->pool.scratch);
+        disk_write_image(st, addr, st->pool.scratch);
     }
-    if (g_storage.nodeSize <= 0) {
-         fprintf(stderr, "Storage Error: Invalid node size in Storage_alloc.\n"); exit(EXIT_FAILURE);
+    st->stats.writes++;
+    storage_leave(st);
+}
+
+/* Storage_pin: Exposes the cached image of addr through view's arrays. */
+/* The frame stays resident until Storage_unpin. With the mmap backend */
+/* the view points straight into the mapping, which stays mapped until */
+/* Storage_close. Returns 0 when neither is available, including when */
+/* every frame is already pinned (caller should fall back to Storage_read). */
+int Storage_pin(struct Storage *st, int addr, struct Node *view) {
+    int f; int pinned = 0;
+    storage_enter(st, "Storage_pin");
+    if (view == NULL) { fprintf(stderr, "Storage Error: Null view passed to Storage_pin.\n"); exit(EXIT_FAILURE); }
+    if (st->shadow.enabled) { addr = shadow_resolve(st, addr); }
+    if (st->backend == STORAGE_BACKEND_MMAP) {
+        if (wal_lookup(st, addr) == -1) { /* Otherwise the mapping holds the committed image */
+            prefetch_consume(st, addr); image_view(st, map_image(st, addr), view);
+            st->stats.reads++; pinned = 1;
+        }
+    } else if (st->pool.nframes > 0 && (f = pool_fetch(st, addr)) != -1) {
+        st->pool.frames[f].pin_count++;
+        image_view(st, st->pool.frames[f].image, view);
+        st->stats.reads++; pinned = 1;
     }
-    if (fseek(g_storage.dataFile, 0, SEEK_END) != 0) {
-        perror("Storage Error: fseek to end failed in Storage_alloc"); exit(EXIT_FAILURE);
+    storage_leave(st);
+    return pinned;
+}
+
+/* Storage_unpin: Releases a pinned frame. If dirty is set, n/leaf are */
+/* copied back from view and the frame is scheduled for write-back. */
+void Storage_unpin(struct Storage *st, int addr, const struct Node *view, int dirty) {
+    int f; int *img;
+    storage_enter(st, "Storage_unpin");
+    if (dirty) { bloom_touch(st); }
+    if (st->backend == STORAGE_BACKEND_MMAP) {
+        if (dirty) {
+            img = map_image(st, addr);
+            if (st->wal.enabled) { memcpy(wal_stage(st, addr), img, (size_t)st->nodeSize); img = wal_image(st, wal_lookup(st, addr)); }
+            img[0] = view->n; img[1] = view->leaf; st->stats.writes++;
+        }
+        storage_leave(st);
+        return;
     }
-    file_size = ftell(g_storage.dataFile);
-     if (file_size < 0) {
-         perror("Storage Error: ftell failed in Storage_alloc"); exit(EXIT_FAILURE);
+    if (st->shadow.enabled) { /* Pins are read-only here: the frame may hold a committed page */
+        if (dirty) { fprintf(stderr, "Storage Error: Dirty unpin of address %d in a shadow-paged file.\n", addr); exit(EXIT_FAILURE); }
+        addr = shadow_resolve(st, addr);
     }
-    if ((file_size - HEADER_SIZE) % g_storage.nodeSize != 0) {
-        fprintf(stderr, "Storage Error: File size corruption detected before alloc (size %ld, header %ld, nodeSize %ld).\n",
-                file_size, HEADER_SIZE, g_storage.nodeSize); exit(EXIT_FAILURE);
+    f = (st->pool.nframes > 0) ? pool_lookup(st, addr) : -1;
+    if (f == -1 || st->pool.frames[f].pin_count <= 0) { fprintf(stderr, "Storage Error: Unpin of address %d that is not pinned.\n", addr); exit(EXIT_FAILURE); }
+    if (dirty) {
+        if (view == NULL) { fprintf(stderr, "Storage Error: Null view passed to dirty Storage_unpin.\n"); exit(EXIT_FAILURE); }
+        st->pool.frames[f].image[0] = view->n;
+        st->pool.frames[f].image[1] = view->leaf;
+        if (st->wal.enabled) { memcpy(wal_stage(st, addr), st->pool.frames[f].image, (size_t)st->nodeSize); }
+        else { st->pool.frames[f].dirty = 1; }
+        st->stats.writes++;
     }
+    st->pool.frames[f].pin_count--;
+    storage_leave(st);
+}
 
-    addr = (int)((file_size - HEADER_SIZE) / g_storage.nodeSize);
+/* Storage_set_prefetch: Number of children an ordered traversal (a */
+/* B-tree cursor or scan) hints ahead of itself in handles opened from now */
+/* on; 0 turns prefetching off. */
+void Storage_set_prefetch(int depth) {
+    if (depth < 0) { fprintf(stderr, "Storage Error: Invalid prefetch depth %d.\n", depth); exit(EXIT_FAILURE); }
+    g_config.prefetchDepth = depth;
+}
 
-    /* Efficiently extend file: seek to one byte before end of new block and write null */
-    target_offset = calculate_offset(addr) + g_storage.nodeSize - 1;
-    if (fseek(g_storage.dataFile, target_offset, SEEK_SET) != 0) {
-        perror("Storage Error: fseek to target offset failed in Storage_alloc"); exit(EXIT_FAILURE);
+int Storage_get_prefetch_depth(struct Storage *st) {
+    check_open(st, "Storage_get_prefetch_depth");
+    return st->prefetchDepth;
+}
+
+/* Storage_prefetch: Hints that addrs[0..n) will be read soon. Pages that */
+/* are cached, staged in the WAL or out of range are skipped; the others */
+/* get an asynchronous read-ahead request from the OS. Never blocks on I/O. */
+void Storage_prefetch(struct Storage *st, const int *addrs, int n) {
+    int i; int addr; int s; long offset; long len; long page; int err;
+    storage_enter(st, "Storage_prefetch");
+    if (st->prefetchSlots == 0 && n > 0) {
+        st->prefetchSlots = 256;
+        while (st->prefetchSlots < 16 * st->prefetchDepth) { st->prefetchSlots <<= 1; }
+        st->prefetched = malloc(st->prefetchSlots * sizeof(int));
+        if (!st->prefetched) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+        for (s = 0; s < st->prefetchSlots; ++s) { st->prefetched[s] = NULL_ADDR; }
     }
-    if (fputc('\0', g_storage.dataFile) == EOF) {
-        perror("Storage Error: fputc failed to extend file in Storage_alloc"); exit(EXIT_FAILURE);
+    for (i = 0; i < n; ++i) {
+        addr = st->shadow.enabled ? shadow_resolve(st, addrs[i]) : addrs[i];
+        if (addr < 0 || addr >= st->nodeCount || wal_lookup(st, addr) != -1) { continue; }
+        if (st->pool.nframes > 0 && pool_lookup(st, addr) != -1) { continue; }
+        offset = calculate_offset(st, addr); len = st->compressed ? st->readHint : st->nodeSize;
+        if (st->backend == STORAGE_BACKEND_MMAP) { /* madvise wants a page-aligned start */
+            page = sysconf(_SC_PAGESIZE); len += offset % page; offset -= offset % page;
+            err = posix_madvise(st->map + offset, (size_t)len, POSIX_MADV_WILLNEED);
+        } else {
+            err = posix_fadvise(st->fd, (off_t)offset, (off_t)len, POSIX_FADV_WILLNEED);
+        }
+        if (err != 0) { continue; } /* Only a hint: an unsupported file just goes without */
+        st->prefetched[prefetch_slot(st, addr)] = addr;
+        st->stats.prefetches++;
     }
+    storage_leave(st);
+}
 
-    /* Optional: Ensure write is effective */
-    /* fflush(g_storage.dataFile); */
+/* Storage_set_bloom: Bits per key of the key filter kept next to files */
+/* opened from now on (see Key Filter); 0 turns it off. About 10 bits per */
+/* key rule out 99% of absent keys. */
+void Storage_set_bloom(int bits_per_key) {
+    if (bits_per_key < 0 || bits_per_key > BLOOM_MAX_BITS) { fprintf(stderr, "Storage Error: Invalid key filter size %d bits per key (0..%d).\n", bits_per_key, BLOOM_MAX_BITS); exit(EXIT_FAILURE); }
+    g_config.bloomBits = bits_per_key;
+}
 
-    g_stats.allocs++;
-    return addr;
+int Storage_get_bloom_bits(struct Storage *st) {
+    check_open(st, "Storage_get_bloom_bits");
+    return st->bloom.bitsPerKey;
 }
 
+/* Storage_bloom_needs_rebuild: 1 if the filter is on but does not cover */
+/* the tree (new file, dirty or missing filter file) or holds more keys */
+/* than it was sized for */
+int Storage_bloom_needs_rebuild(struct Storage *st) {
+    int needed;
+    storage_enter(st, "Storage_bloom_needs_rebuild");
+    needed = st->bloom.bitsPerKey > 0 && (!st->bloom.valid || st->bloom.added > st->bloom.capacity);
+    storage_leave(st);
+    return needed;
+}
 
-void Storage_read(int addr, struct Node *x) {
-    long offset;
-    size_t elements_to_read;
-    size_t elements_read;
-    int max_keys, max_children;
+/* Storage_bloom_reset: Empties the filter, sized for twice nkeys (at least */
+/* BLOOM_MIN_KEYS) so it can grow. The caller then adds every key of the */
+/* tree before other threads use it. Returns 0 (and does nothing) if the */
+/* filter is off. */
+int Storage_bloom_reset(struct Storage *st, int nkeys) {
+    long capacity; long bits;
+    storage_enter(st, "Storage_bloom_reset");
+    if (st->bloom.bitsPerKey == 0) { storage_leave(st); return 0; }
+    capacity = nkeys > BLOOM_MIN_KEYS / 2 ? 2L * nkeys : BLOOM_MIN_KEYS;
+    if (capacity > INT_MAX_KEYS) { capacity = INT_MAX_KEYS; }
+    bits = capacity * st->bloom.bitsPerKey;
+    free(st->bloom.bits);
+    st->bloom.nblocks = (int)((bits + BLOOM_BLOCK_BYTES * 8 - 1) / (BLOOM_BLOCK_BYTES * 8));
+    st->bloom.bits = calloc((size_t)st->bloom.nblocks, BLOOM_BLOCK_BYTES);
+    if (!st->bloom.bits) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+    st->bloom.hashes = (st->bloom.bitsPerKey * 69 + 50) / 100; /* k = bits per key * ln 2 */
+    if (st->bloom.hashes < 1) { st->bloom.hashes = 1; }
+    if (st->bloom.hashes > 16) { st->bloom.hashes = 16; }
+    st->bloom.capacity = (int)capacity; st->bloom.added = 0;
+    st->bloom.valid = 1; st->bloom.changed = 1;
+    storage_leave(st);
+    return 1;
+}
 
-    if (g_storage.dataFile == NULL) { fprintf(stderr, "Storage Error: Storage not open in Storage_read.\n"); exit(EXIT_FAILURE); }
-    if (x == NULL || x->key == NULL || x->value == NULL || x->c == NULL) { fprintf(stderr, "Storage Error: Null node or internal buffer passed to Storage_read.\n"); exit(EXIT_FAILURE); }
-    if (g_storage.degree <= 1 || g_storage.nodeSize <= 0) { fprintf(stderr, "Storage Error: Storage not properly initialized (t=%d, nodeSize=%ld).\n", g_storage.degree, g_storage.nodeSize); exit(EXIT_FAILURE); }
+/* Storage_bloom_add: Adds key to the filter (no-op while it is not valid) */
+void Storage_bloom_add(struct Storage *st, int key) {
+    storage_enter(st, "Storage_bloom_add");
+    if (st->bloom.valid) {
+        (void) bloom_probe(st, key, 1);
+        if (st->bloom.added < INT_MAX_KEYS) { st->bloom.added++; }
+        st->bloom.changed = 1;
+    }
+    storage_leave(st);
+}
+
+/* Storage_bloom_may_contain: 0 if key is certainly not in the tree, 1 if */
+/* it may be (always 1 while the filter is off or not valid) */
+int Storage_bloom_may_contain(struct Storage *st, int key) {
+    int maybe = 1;
+    storage_enter(st, "Storage_bloom_may_contain");
+    if (st->bloom.valid) {
+        maybe = bloom_probe(st, key, 0);
+        st->stats.bloom_checks++;
+        if (!maybe) { st->stats.bloom_skips++; }
+    }
+    storage_leave(st);
+    return maybe;
+}
 
-    max_keys = 2 * g_storage.degree - 1;
-    max_children = 2 * g_storage.degree;
-    offset = calculate_offset(addr);
+/* Storage_get_bloom_bytes: Size of the filter in memory, 0 if not valid */
+long Storage_get_bloom_bytes(struct Storage *st) {
+    long bytes;
+    storage_enter(st, "Storage_get_bloom_bytes");
+    bytes = st->bloom.valid ? (long)st->bloom.nblocks * BLOOM_BLOCK_BYTES : 0;
+    storage_leave(st);
+    return bytes;
+}
 
-    if (fseek(g_storage.dataFile, offset, SEEK_SET) != 0) { perror("Storage Error: fseek failed in Storage_read"); fprintf(stderr, "Attempted offset: %ld for address %d\n", offset, addr); exit(EXIT_FAILURE); }
+/* Storage_latch: Takes the latch of node addr, shared or exclusive. */
+/* Latches order access to node contents between threads (see btree.c); */
+/* Storage calls themselves are atomic without them. */
+void Storage_latch(struct Storage *st, int addr, int exclusive) {
+    pthread_rwlock_t *l;
+    check_open(st, "Storage_latch");
+    l = latch_find(st, addr);
+    if ((exclusive ? pthread_rwlock_wrlock(l) : pthread_rwlock_rdlock(l)) != 0) { fprintf(stderr, "Storage Error: Cannot latch address %d.\n", addr); exit(EXIT_FAILURE); }
+}
 
-    if (fread(&(x->n), sizeof(int), 1, g_storage.dataFile) != 1 || fread(&(x->leaf), sizeof(int), 1, g_storage.dataFile) != 1) {
-        fprintf(stderr, "Storage Error: Failed to read node header (n, leaf) at addr %d.\n", addr);
-        if (feof(g_storage.dataFile)) fprintf(stderr, " Read past EOF.\n"); else if(ferror(g_storage.dataFile)) perror(" fread error"); else fprintf(stderr, " Short read.\n"); exit(EXIT_FAILURE);
+void Storage_unlatch(struct Storage *st, int addr) {
+    check_open(st, "Storage_unlatch");
+    if (pthread_rwlock_unlock(latch_find(st, addr)) != 0) { fprintf(stderr, "Storage Error: Cannot unlatch address %d.\n", addr); exit(EXIT_FAILURE); }
+}
+
+/* Commits the open WAL group and writes every dirty frame back */
+static void flush_all(struct Storage *st) {
+    int f;
+    wal_commit(st);
+    for (f = 0; f < st->pool.nframes; ++f) {
+        if (st->pool.frames[f].addr != NULL_ADDR && st->pool.frames[f].dirty) {
+            disk_write_image(st, st->pool.frames[f].addr, st->pool.frames[f].image);
+            st->pool.frames[f].dirty = 0;
+            st->stats.cache_writebacks++;
+        }
     }
-    elements_to_read = max_keys;
-    elements_read = fread(x->key, sizeof(int), elements_to_read, g_storage.dataFile); if (elements_read != elements_to_read) goto read_error;
-    elements_read = fread(x->value, sizeof(int), elements_to_read, g_storage.dataFile); if (elements_read != elements_to_read) goto read_error;
-    elements_to_read = max_children;
-    elements_read = fread(x->c, sizeof(int), elements_to_read, g_storage.dataFile); if (elements_read != elements_to_read) goto read_error;
+}
 
-    g_stats.reads++;
-    return;
+/* Storage_flush: Commits the open WAL group and writes every dirty */
+/* frame back to the file */
+void Storage_flush(struct Storage *st) {
+    storage_enter(st, "Storage_flush");
+    flush_all(st);
+    storage_leave(st);
+}
 
-read_error:
-    { long current_pos = ftell(g_storage.dataFile); long file_size_on_error = -1;
-        fprintf(stderr, "Storage Error: Failed to read node data block at addr %d. Elements read: %lu / Expected: %lu\n", addr, (unsigned long)elements_read, (unsigned long)elements_to_read);
-        if (feof(g_storage.dataFile)) fprintf(stderr, " Read past EOF.\n"); else if(ferror(g_storage.dataFile)) perror(" fread error"); else fprintf(stderr, " Short read.\n");
-        if (fseek(g_storage.dataFile, 0, SEEK_END) == 0) { file_size_on_error = ftell(g_storage.dataFile); }
-        fprintf(stderr, " File size: %ld, Expected offset: %ld, Pos after failed read: %ld\n", file_size_on_error, offset, current_pos);
-        exit(EXIT_FAILURE);
+/* Storage_set_cache_size: Number of buffer pool frames used by the next */
+/* Storage_open. 0 disables caching (every access goes to the file). */
+void Storage_set_cache_size(int frames) {
+    if (frames < 0) { fprintf(stderr, "Storage Error: Invalid cache size %d.\n", frames); exit(EXIT_FAILURE); }
+    g_config.cacheFrames = frames;
+}
+
+
+/* Storage_free: Releases a node slot for reuse by Storage_alloc. */
+/* Any cached image is dropped without write-back. The list is written */
+/* to the file at Storage_close (except for version 1 files). */
+void Storage_free(struct Storage *st, int addr) {
+    storage_enter(st, "Storage_free");
+    if (addr < 0 || addr >= st->nodeCount) { fprintf(stderr, "Storage Error: Free of invalid address %d (%d nodes).\n", addr, st->nodeCount); exit(EXIT_FAILURE); }
+    if (st->shadow.enabled) { shadow_unmap(st, addr); } else { pool_drop(st, addr, "Free"); }
+    freelist_push(st, addr);
+    st->stats.frees++;
+    storage_leave(st);
+}
+
+/* Storage_truncate: Shrinks the file to its first count node slots. */
+/* The caller guarantees every slot below count is live (see BTree_vacuum), */
+/* so the free list is discarded. */
+void Storage_truncate(struct Storage *st, int count) {
+    int f;
+    storage_enter(st, "Storage_truncate");
+    if (count < 1 || count > st->nodeCount) { fprintf(stderr, "Storage Error: Truncate to %d nodes (%d in file).\n", count, st->nodeCount); exit(EXIT_FAILURE); }
+    flush_all(st);
+    if (st->shadow.enabled) { /* Logical pages only; close trims the file */
+        while (st->nodeCount > count) { shadow_unmap(st, --st->nodeCount); }
+        st->freeCount = 0;
+        storage_leave(st);
+        return;
+    }
+    for (f = 0; f < st->pool.nframes; ++f) { /* Cut slots may still be cached */
+        if (st->pool.frames[f].addr >= count) {
+            if (st->pool.frames[f].pin_count > 0) { fprintf(stderr, "Storage Error: Truncate past pinned address %d.\n", st->pool.frames[f].addr); exit(EXIT_FAILURE); }
+            pool_unlink(st, f);
+            st->pool.frames[f].addr = NULL_ADDR; st->pool.frames[f].dirty = 0; st->pool.frames[f].ref = 0;
+        }
     }
+    if (st->wal.enabled) { wal_checkpoint(st); } /* Logged images of cut slots must not come back */
+    st->freeCount = 0;
+    st->nodeCount = count;
+    /* map_close trims a mapped file to nodeCount */
+    if (st->backend != STORAGE_BACKEND_MMAP && ftruncate(st->fd, (off_t)calculate_offset(st, count)) != 0) {
+        perror("Storage Error: ftruncate failed in Storage_truncate"); exit(EXIT_FAILURE);
+    }
+    storage_leave(st);
 }
 
+/* Storage_get_node_count: Node slots in the file, live or free */
+int Storage_get_node_count(struct Storage *st) {
+    int count;
+    storage_enter(st, "Storage_get_node_count");
+    count = st->nodeCount;
+    storage_leave(st);
+    return count;
+}
 
-void Storage_write(int addr, const struct Node *x) {
-    long offset;
-    size_t elements_to_write;
-    size_t elements_written;
-    int max_keys, max_children;
+/* Storage_get_free_page_count: Slots currently waiting for reuse */
+int Storage_get_free_page_count(struct Storage *st) {
+    int count;
+    storage_enter(st, "Storage_get_free_page_count");
+    count = st->freeCount;
+    storage_leave(st);
+    return count;
+}
 
-    if (g_storage.dataFile == NULL) { fprintf(stderr, "Storage Error: Storage not open in Storage_write.\n"); exit(EXIT_FAILURE); }
-    if (x == NULL || x->key == NULL || x->value == NULL || x->c == NULL) { fprintf(stderr, "Storage Error: Null node or internal buffer passed to Storage_write.\n"); exit(EXIT_FAILURE); }
-    if (g_storage.degree <= 1 || g_storage.nodeSize <= 0) { fprintf(stderr, "Storage Error: Storage not properly initialized (t=%d, nodeSize=%ld).\n", g_storage.degree, g_storage.nodeSize); exit(EXIT_FAILURE); }
+/* Storage_set_wal: Write-ahead logging for the next Storage_open. */
+/* group_ops > 0 enables a redo log ("<file>-wal") committed in groups of */
+/* up to group_ops operations, or earlier once the open group is window_us */
+/* microseconds old (0 = no time limit; checked at operation boundaries). */
+/* Each group costs one fdatasync. Operations of a group that has not */
+/* committed are lost on a crash, but the file is always recovered to the */
+/* end of a committed group. 0 disables the log. */
+void Storage_set_wal(int group_ops, long window_us) {
+    if (group_ops < 0 || window_us < 0) { fprintf(stderr, "Storage Error: Invalid WAL settings (%d ops, %ld us).\n", group_ops, window_us); exit(EXIT_FAILURE); }
+    g_config.walOps = group_ops; g_config.walWindowUs = window_us;
+}
+
+/* Commits the open WAL group or shadow version once no operation is in */
+/* flight, so neither ever holds part of one. Operations that have not */
+/* begun wait until it is done. Called with the handle lock held. */
+static void commit_quiesced(struct Storage *st) {
+    st->commitDue = 1;
+    while (st->activeOps > 0) { pthread_cond_wait(&st->idle, &st->lock); }
+    wal_commit(st);
+    shadow_commit(st);
+    st->commitDue = 0;
+    pthread_cond_broadcast(&st->idle);
+}
+
+/* Storage_op_begin: Marks the start of one logical operation (a put, */
+/* delete, batch or load). Waits while a commit is due. */
+void Storage_op_begin(struct Storage *st) {
+    storage_enter(st, "Storage_op_begin");
+    while (st->commitDue) { pthread_cond_wait(&st->idle, &st->lock); }
+    st->activeOps++;
+    storage_leave(st);
+}
+
+/* Storage_op_end: Marks the end of one logical operation. Writes since */
+/* the previous commit are committed together when the group is full; */
+/* with operations still in flight the last of them to end commits. */
+void Storage_op_end(struct Storage *st) {
+    int due = 0;
+    storage_enter(st, "Storage_op_end");
+    if (st->activeOps > 0) { st->activeOps--; }
+    if (st->shadow.enabled && ++st->shadow.ops >= st->shadow.groupOps) { due = 1; }
+    if (st->wal.enabled) {
+        if (st->wal.ops == 0 && st->wal.count == 0) { clock_gettime(CLOCK_MONOTONIC, &st->wal.groupStart); }
+        st->wal.ops++;
+        if (st->wal.ops >= st->wal.groupOps || (st->wal.windowUs > 0 && wal_group_age_us(st) >= st->wal.windowUs)) { due = 1; }
+    }
+    if (due || st->commitDue) {
+        if (st->activeOps == 0) { commit_quiesced(st); } else { st->commitDue = 1; }
+    }
+    storage_leave(st);
+}
+
+/* Storage_commit: Commits the open WAL group or shadow version now */
+void Storage_commit(struct Storage *st) {
+    storage_enter(st, "Storage_commit");
+    commit_quiesced(st);
+    storage_leave(st);
+}
+
+/* Storage_set_shadow: Files created by the next Storage_open use shadow */
+/* paging (version 4) when group_ops > 0, committing a new version every */
+/* group_ops operations (see Storage_op_end) and at Storage_commit. */
+/* Existing files keep their format; version 4 files are always opened */
+/* shadow-paged. Not combinable with the mmap backend or the WAL. */
+void Storage_set_shadow(int group_ops) {
+    if (group_ops < 0) { fprintf(stderr, "Storage Error: Invalid shadow commit group %d.\n", group_ops); exit(EXIT_FAILURE); }
+    g_config.shadowOps = group_ops;
+}
 
-    max_keys = 2 * g_storage.degree - 1;
-    max_children = 2 * g_storage.degree;
-    offset = calculate_offset(addr);
+/* Storage_snapshot_open: Commits, then pins the committed version for */
+/* reading. Returns a handle for Storage_set_view. Pages of the version */
+/* stay allocated until Storage_snapshot_close. */
+int Storage_snapshot_open(struct Storage *st) {
+    int i; struct Snapshot *snap;
+    storage_enter(st, "Storage_snapshot_open");
+    if (!st->shadow.enabled) { fprintf(stderr, "Storage Error: Snapshots need a shadow-paged file.\n"); exit(EXIT_FAILURE); }
+    commit_quiesced(st);
+    for (i = 0; i < SHADOW_MAX_SNAPSHOTS && st->shadow.snaps[i].live; ++i) { }
+    if (i == SHADOW_MAX_SNAPSHOTS) { fprintf(stderr, "Storage Error: Too many open snapshots (%d).\n", SHADOW_MAX_SNAPSHOTS); exit(EXIT_FAILURE); }
+    snap = &st->shadow.snaps[i];
+    snap->map = malloc((size_t)(st->shadow.committedCount > 0 ? st->shadow.committedCount : 1) * sizeof(int));
+    if (!snap->map) { perror("Storage Memory Error"); exit(EXIT_FAILURE); }
+    if (st->shadow.committedCount > 0) { memcpy(snap->map, st->shadow.committed, (size_t)st->shadow.committedCount * sizeof(int)); }
+    snap->count = st->shadow.committedCount; snap->gen = st->shadow.gen; snap->live = 1;
+    storage_leave(st);
+    return i + 1;
+}
 
-    if (fseek(g_storage.dataFile, offset, SEEK_SET) != 0) { perror("Storage Error: fseek failed in Storage_write"); fprintf(stderr, "Attempted offset: %ld for address %d\n", offset, addr); exit(EXIT_FAILURE); }
+static void check_snapshot(struct Storage *st, int id, const char *fn) {
+    if (id < 1 || id > SHADOW_MAX_SNAPSHOTS || !st->shadow.snaps[id - 1].live) { fprintf(stderr, "Storage Error: Invalid snapshot %d in %s.\n", id, fn); exit(EXIT_FAILURE); }
+}
 
-    if (fwrite(&(x->n), sizeof(int), 1, g_storage.dataFile) != 1 || fwrite(&(x->leaf), sizeof(int), 1, g_storage.dataFile) != 1) {
-        fprintf(stderr, "Storage Error: Failed to write node header (n, leaf) at addr %d.\n", addr); perror(" fwrite error"); exit(EXIT_FAILURE);
+/* Storage_snapshot_close: Releases a snapshot; pages only it kept are freed */
+void Storage_snapshot_close(struct Storage *st, int id) {
+    int i;
+    storage_enter(st, "Storage_snapshot_close");
+    check_snapshot(st, id, "Storage_snapshot_close");
+    for (i = 0; i < st->shadow.viewCount; ++i) { /* Readers of it fall back to the working version */
+        if (st->shadow.views[i].id == id) { st->shadow.views[i--] = st->shadow.views[--st->shadow.viewCount]; }
     }
-    elements_to_write = max_keys;
-    elements_written = fwrite(x->key, sizeof(int), elements_to_write, g_storage.dataFile); if (elements_written != elements_to_write) goto write_error;
-    elements_written = fwrite(x->value, sizeof(int), elements_to_write, g_storage.dataFile); if (elements_written != elements_to_write) goto write_error;
-    elements_to_write = max_children;
-    elements_written = fwrite(x->c, sizeof(int), elements_to_write, g_storage.dataFile); if (elements_written != elements_to_write) goto write_error;
+    free(st->shadow.snaps[id - 1].map); st->shadow.snaps[id - 1].map = NULL; st->shadow.snaps[id - 1].live = 0;
+    shadow_reclaim(st);
+    storage_leave(st);
+}
 
-    g_stats.writes++;
-    return;
+/* Storage_set_view: Makes the calling thread's Storage_read/Storage_pin */
+/* read snapshot id (0 = the working version, the only one that can be */
+/* written). Returns the previous view. */
+int Storage_set_view(struct Storage *st, int id) {
+    int prev;
+    storage_enter(st, "Storage_set_view");
+    if (id != 0) { check_snapshot(st, id, "Storage_set_view"); }
+    prev = shadow_set_view(st, id);
+    storage_leave(st);
+    return prev;
+}
 
-write_error:
-    fprintf(stderr, "Storage Error: Failed to write node data block at addr %d. Elements written: %lu / Expected: %lu\n", addr, (unsigned long)elements_written, (unsigned long)elements_to_write);
-    perror(" fwrite error"); exit(EXIT_FAILURE);
+/* Storage_get_retired_page_count: Slots held back for open snapshots */
+int Storage_get_retired_page_count(struct Storage *st) {
+    int count;
+    storage_enter(st, "Storage_get_retired_page_count");
+    count = st->shadow.retiredCount;
+    storage_leave(st);
+    return count;
 }
 
+/* Storage_get_physical_page_count: Node slots in the file (equal to the */
+/* node count unless shadow-paged) */
+int Storage_get_physical_page_count(struct Storage *st) {
+    int count;
+    storage_enter(st, "Storage_get_physical_page_count");
+    count = st->shadow.enabled ? st->shadow.physCount : st->nodeCount;
+    storage_leave(st);
+    return count;
+}
 
 /* --- Statistics Accessors --- */
-unsigned long Storage_get_read_count(void) { return g_stats.reads; }
-unsigned long Storage_get_write_count(void) { return g_stats.writes; }
-unsigned long Storage_get_alloc_count(void) { return g_stats.allocs; }
\ No newline at end of file
+unsigned long Storage_get_read_count(const struct Storage *st) { return st->stats.reads; }
+unsigned long Storage_get_write_count(const struct Storage *st) { return st->stats.writes; }
+unsigned long Storage_get_alloc_count(const struct Storage *st) { return st->stats.allocs; }
+unsigned long Storage_get_cache_hit_count(const struct Storage *st) { return st->stats.cache_hits; }
+unsigned long Storage_get_cache_miss_count(const struct Storage *st) { return st->stats.cache_misses; }
+unsigned long Storage_get_cache_eviction_count(const struct Storage *st) { return st->stats.cache_evictions; }
+unsigned long Storage_get_cache_writeback_count(const struct Storage *st) { return st->stats.cache_writebacks; }
+unsigned long Storage_get_free_count(const struct Storage *st) { return st->stats.frees; }
+unsigned long Storage_get_io_read_bytes(const struct Storage *st) { return st->stats.io_read_bytes; }
+unsigned long Storage_get_io_write_bytes(const struct Storage *st) { return st->stats.io_write_bytes; }
+unsigned long Storage_get_prefetch_count(const struct Storage *st) { return st->stats.prefetches; }
+unsigned long Storage_get_prefetch_hit_count(const struct Storage *st) { return st->stats.prefetch_hits; }
+unsigned long Storage_get_bloom_check_count(const struct Storage *st) { return st->stats.bloom_checks; }
+unsigned long Storage_get_bloom_skip_count(const struct Storage *st) { return st->stats.bloom_skips; }
+unsigned long Storage_get_wal_commit_count(const struct Storage *st) { return st->walStats.commits; }
+unsigned long Storage_get_sync_count(const struct Storage *st) { return st->walStats.syncs; }
+unsigned long Storage_get_wal_bytes(const struct Storage *st) { return st->walStats.logBytes; }
+unsigned long Storage_get_recovered_group_count(const struct Storage *st) { return st->walStats.recovered; }
@@ -1,13 +1,22 @@
+/* POSIX for fork, waitpid and truncate (crash simulation) */
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h> /* For rand, srand, malloc, free, exit */
 #include <string.h> /* For memcpy */
 #include <assert.h>
 #include <time.h>   /* For time */
 #include <limits.h> /* For INT_MIN, INT_MAX */
+#include <unistd.h>   /* For fork, _exit, truncate */
+#include <sys/wait.h> /* For waitpid */
+#include <pthread.h>
 
 /* Required Struct Definitions */
 struct Node { int n; int leaf; int *key; int *value; int *c; };
-struct BTree { int root; int t; };
+struct BTree { int root; int t; struct Storage *store; };
+struct BPTree { int root; int t; struct Storage *store; };
+struct VTree { int root; int t; struct Storage *store; };
+struct BETree { int root; int t; struct Storage *store; };
 
 /* Required Prototypes from btree.c */
 struct BTree BTree_open (const char *name, int t);
@@ -15,16 +24,126 @@ void        BTree_close(struct BTree *bt);
 void        BTree_put  (const struct BTree *bt, int k, int v);
 void        BTree_get  (const struct BTree *bt, int k, int *v);
 void        BTree_delete(struct BTree *bt, int k);
+struct BTree BTree_bulk_load(const char *name, int t, int fill_pct, const int *keys, const int *values, int n);
+struct BTreeCursor; /* Opaque, defined in btree.c */
+struct BTreeCursor* BTree_cursor_open(const struct BTree *bt);
+void        BTree_cursor_seek (struct BTreeCursor *cur, int k);
+int         BTree_cursor_next (struct BTreeCursor *cur, int *k, int *v);
+void        BTree_cursor_close(struct BTreeCursor *cur);
+int         BTree_get_many(const struct BTree *bt, const int *keys, int *values, int n);
+void        BTree_put_many(const struct BTree *bt, const int *keys, const int *values, int n);
+int         BTree_search_kernel(int kernel, const int *keys, int n, int k);
+int         BTree_vacuum(const char *name, int *live_pages);
+int         BTree_scan(const struct BTree *bt, int lo, int hi, int (*cb)(int k, int v, void *ctx), void *ctx);
+void        BTree_sync(const struct BTree *bt);
+int         BTree_bloom_rebuild(const struct BTree *bt);
+struct BTreeSnapshot; /* Opaque, defined in btree.c */
+struct BTreeSnapshot* BTree_snapshot_open(const struct BTree *bt);
+int         BTree_snapshot_get(const struct BTreeSnapshot *snap, int k, int *v);
+struct BTreeCursor* BTree_snapshot_cursor_open(const struct BTreeSnapshot *snap);
+void        BTree_snapshot_close(struct BTreeSnapshot *snap);
+
+/* Required Prototypes from memtable.c */
+struct BTreeMemtable; /* Opaque, defined in memtable.c */
+struct BTreeMemtable* BTree_memtable_open(const struct BTree *bt, int max_entries);
+void        BTree_memtable_put(struct BTreeMemtable *m, int k, int v);
+void        BTree_memtable_delete(struct BTreeMemtable *m, int k);
+void        BTree_memtable_get(struct BTreeMemtable *m, int k, int *v);
+void        BTree_memtable_flush(struct BTreeMemtable *m);
+int         BTree_memtable_size(struct BTreeMemtable *m);
+unsigned long BTree_memtable_flush_count(struct BTreeMemtable *m);
+void        BTree_memtable_close(struct BTreeMemtable *m);
+
+/* Required Prototypes from bptree.c */
+struct BPTree BPTree_open(const char *name, int t);
+void        BPTree_close(struct BPTree *bt);
+void        BPTree_put  (const struct BPTree *bt, int k, int v);
+void        BPTree_get  (const struct BPTree *bt, int k, int *v);
+void        BPTree_delete(struct BPTree *bt, int k);
+int         BPTree_scan (const struct BPTree *bt, int lo, int hi, int (*cb)(int k, int v, void *ctx), void *ctx);
+
+/* Required Prototypes from betree.c */
+struct BETree BETree_open(const char *name, int t);
+void        BETree_close(struct BETree *bt);
+void        BETree_sync (const struct BETree *bt);
+void        BETree_put  (const struct BETree *bt, int k, int v);
+void        BETree_get  (const struct BETree *bt, int k, int *v);
+void        BETree_delete(struct BETree *bt, int k);
+int         BETree_scan (const struct BETree *bt, int lo, int hi, int (*cb)(int k, int v, void *ctx), void *ctx);
+
+/* Required Prototypes from vtree.c */
+struct VTree VTree_open(const char *name, int t);
+void        VTree_close(struct VTree *vt);
+int         VTree_max_key_len(const struct VTree *vt);
+void        VTree_put  (const struct VTree *vt, const void *key, int len, int v);
+int         VTree_get  (const struct VTree *vt, const void *key, int len, int *v);
+int         VTree_delete(struct VTree *vt, const void *key, int len);
+int         VTree_scan (const struct VTree *vt, const void *lo, int lolen, const void *hi, int hilen,
+                        int (*cb)(const unsigned char *key, int len, int v, void *ctx), void *ctx);
+
+/* Required Prototypes from shard.c */
+struct BTreeShards; /* Opaque, defined in shard.c */
+struct BTreeShards* BTree_shards_open(const char *prefix, int nshards, int t, const int *splits);
+int         BTree_shards_shard_of(const struct BTreeShards *sh, int k);
+void        BTree_shards_put(struct BTreeShards *sh, int k, int v);
+void        BTree_shards_get(struct BTreeShards *sh, int k, int *v);
+void        BTree_shards_put_many(struct BTreeShards *sh, const int *keys, const int *values, int n);
+int         BTree_shards_get_many(struct BTreeShards *sh, const int *keys, int *values, int n);
+void        BTree_shards_sync(struct BTreeShards *sh);
+void        BTree_shards_close(struct BTreeShards *sh);
 
 /* Required Prototypes from storage.c */
-void          Storage_read (int addr, struct Node *x);
-unsigned long Storage_get_read_count(void);
-unsigned long Storage_get_write_count(void);
-unsigned long Storage_get_alloc_count(void);
+void          Storage_read (struct Storage *st, int addr, struct Node *x);
+unsigned long Storage_get_read_count(const struct Storage *st);
+unsigned long Storage_get_write_count(const struct Storage *st);
+unsigned long Storage_get_alloc_count(const struct Storage *st);
+unsigned long Storage_get_free_count(const struct Storage *st);
+int           Storage_get_node_count(struct Storage *st);
+int           Storage_get_free_page_count(struct Storage *st);
+int           Storage_pin(struct Storage *st, int addr, struct Node *view);
+void          Storage_unpin(struct Storage *st, int addr, const struct Node *view, int dirty);
+void          Storage_set_cache_size(int frames);
+void          Storage_set_backend(int backend);
+void          Storage_set_page_size(int bytes);
+int           Storage_get_page_size(struct Storage *st);
+unsigned long Storage_get_cache_hit_count(const struct Storage *st);
+unsigned long Storage_get_cache_miss_count(const struct Storage *st);
+unsigned long Storage_get_cache_eviction_count(const struct Storage *st);
+void          Storage_set_wal(int group_ops, long window_us);
+unsigned long Storage_get_wal_commit_count(const struct Storage *st);
+unsigned long Storage_get_sync_count(const struct Storage *st);
+unsigned long Storage_get_recovered_group_count(const struct Storage *st);
+void          Storage_set_shadow(int group_ops);
+int           Storage_get_retired_page_count(struct Storage *st);
+int           Storage_get_physical_page_count(struct Storage *st);
+void          Storage_set_compression(int on);
+int           Storage_is_compressed(struct Storage *st);
+unsigned long Storage_get_io_read_bytes(const struct Storage *st);
+unsigned long Storage_get_io_write_bytes(const struct Storage *st);
+void          Storage_set_prefetch(int depth);
+int           Storage_get_prefetch_depth(struct Storage *st);
+void          Storage_prefetch(struct Storage *st, const int *addrs, int n);
+unsigned long Storage_get_prefetch_count(const struct Storage *st);
+unsigned long Storage_get_prefetch_hit_count(const struct Storage *st);
+void          Storage_set_bloom(int bits_per_key);
+int           Storage_bloom_needs_rebuild(struct Storage *st);
+long          Storage_get_bloom_bytes(struct Storage *st);
+unsigned long Storage_get_bloom_check_count(const struct Storage *st);
+unsigned long Storage_get_bloom_skip_count(const struct Storage *st);
 
 /* Test file/config */
 #define TEST_DB_FILE "test_btree.db"
+#define TEST_WAL_FILE "test_btree.db-wal"
+#define TEST_DB_FILE2 "test_btree2.db"
+#define TEST_BLOOM_FILE "test_btree.db-bloom"
+#define TEST_SHARD_PREFIX "test_shard.db"
+#define TEST_SHARDS 4
+#define TEST_WRITERS 4
+#define TEST_READERS 3
+#define TEST_KEYS_PER_WRITER 1500
 #define TEST_T 3
+#define TEST_VT_T 22 /* Smallest t with string-key pages (512+ byte body) */
+#define TEST_VT_LONG 1500
 #define NUM_RANDOM_INSERTS 1000
 #define NUM_RANDOM_DELETES (NUM_RANDOM_INSERTS / 4)
 #define NUM_RANDOM_QUERIES (NUM_RANDOM_INSERTS / 2)
@@ -33,6 +152,11 @@ unsigned long Storage_get_alloc_count(void);
 #define DELETION_SENTINEL ((int)0xDEADDEAD)
 #define UNUSED_SENTINEL   ((int)0xDEADBEEF)
 #define NULL_ADDR         (-1)
+/* On-disk header: magic, version, t, free list head (must match storage.c) */
+#define TEST_HEADER_SIZE (4L * (long)sizeof(int))
+/* Storage backends (must match storage.c) */
+#define STORAGE_BACKEND_STDIO 0
+#define STORAGE_BACKEND_MMAP  1
 
 
 /* ---- Copied static helpers for invariant checker ---- */
@@ -47,10 +171,12 @@ static struct Node* BTree_allocate_node_mem_checker(int t) {
     x->n = 0; x->leaf = 1; return x;
 }
 static void BTree_free_node_mem_checker(struct Node *x) { if (x) { free(x->key); free(x->value); free(x->c); free(x); } }
-static struct Node* BTree_disk_read_checker(int t, int addr) { struct Node *x = BTree_allocate_node_mem_checker(t); Storage_read(addr, x); return x; }
+static struct Storage *g_checked_store = NULL; /* Storage of the tree being checked */
+static struct Node* BTree_disk_read_checker(int t, int addr) { struct Node *x = BTree_allocate_node_mem_checker(t); Storage_read(g_checked_store, addr, x); return x; }
 /* --- End of copied helpers --- */
 
 /* --- CLRS Invariant Checks --- */
+static int g_checked_nodes = 0; /* Nodes visited by the last full check */
 /* Replace the existing check_node_recursive function */
 static int check_node_recursive(int t, int addr, int is_root, int depth, int* tree_height, int min_bound, int max_bound) {
     /* --- Declarations (ANSI C) --- */
@@ -60,10 +186,12 @@ static int check_node_recursive(int t, int addr, int is_root, int depth, int* tr
     int expected_min_keys;
     int next_min_bound;
     int next_max_bound;
+    int prefetch = Storage_get_prefetch_depth(g_checked_store);
 
     /* --- Code --- */
     x = BTree_disk_read_checker(t, addr);
     if (x == NULL) return 0; /* Should not happen */
+    g_checked_nodes++;
 
     /* 1. Check Key Count */
     expected_min_keys = is_root ? 1 : t - 1;
@@ -105,6 +233,10 @@ static int check_node_recursive(int t, int addr, int is_root, int depth, int* tr
             fprintf(stderr, "Invariant Fail (Addr %d): Value[%d] is unused sentinel.\n", addr, i);
             result = 0; goto cleanup;
           }
+          if (x->value[i] == DELETION_SENTINEL) { /* Deletes remove keys physically */
+            fprintf(stderr, "Invariant Fail (Addr %d): Value[%d] is a deletion tombstone.\n", addr, i);
+            result = 0; goto cleanup;
+          }
     }
 
     /* 3/4. Check Leaf Depth / Recurse on Children */
@@ -123,7 +255,10 @@ static int check_node_recursive(int t, int addr, int is_root, int depth, int* tr
              fprintf(stderr, "Invariant Fail (Addr %d): Invalid child count %d.\n", addr, x->n + 1);
              result = 0; goto cleanup;
         }
+        /* Children are visited in order: keep the next `prefetch` of them hinted */
+        if (prefetch > 0) { Storage_prefetch(g_checked_store, x->c, x->n + 1 < prefetch ? x->n + 1 : prefetch); }
         for (i = 0; i <= x->n; ++i) {
+             if (prefetch > 0 && i + prefetch <= x->n) { Storage_prefetch(g_checked_store, &x->c[i + prefetch], 1); }
              if (x->c[i] == NULL_ADDR) {
                  fprintf(stderr, "Invariant Fail (Addr %d): Child pointer c[%d] is NULL_ADDR.\n", addr, i);
                  result = 0; goto cleanup;
@@ -162,11 +297,227 @@ cleanup:
     return result;
 }
 /* End Replacement Snippet */
+/* Height of the tree (number of levels) as seen by the checker */
+static int btree_height(const struct BTree *bt) {
+    int tree_height = -1;
+    g_checked_store = bt->store;
+    assert(check_node_recursive(bt->t, bt->root, 1, 0, &tree_height, INT_MIN, INT_MAX));
+    return tree_height + 1;
+}
+/* Distinct nodes a scan of [lo, hi] may read, each once: the search paths */
+/* to lo and to s (the first live key above hi, where the cursor stops) and */
+/* every node holding a key in [lo, s] */
+#define SCAN_SET_MAX 256
+static int g_scan_set[SCAN_SET_MAX];
+static int g_scan_set_size;
+
+static void scan_set_add(int addr) {
+    int i;
+    for (i = 0; i < g_scan_set_size; ++i) { if (g_scan_set[i] == addr) { return; } }
+    assert(g_scan_set_size < SCAN_SET_MAX); g_scan_set[g_scan_set_size++] = addr;
+}
+
+static void scan_set_path(int t, int addr, int k) {
+    struct Node *x; int i;
+    for (;;) {
+        scan_set_add(addr); x = BTree_disk_read_checker(t, addr);
+        for (i = 0; i < x->n && x->key[i] < k; ++i) { }
+        if (x->leaf || (i < x->n && x->key[i] == k)) { BTree_free_node_mem_checker(x); return; }
+        addr = x->c[i]; BTree_free_node_mem_checker(x);
+    }
+}
+
+static void scan_set_range(int t, int addr, int lo, int s) {
+    struct Node *x = BTree_disk_read_checker(t, addr); int i;
+    for (i = 0; i < x->n; ++i) { if (x->key[i] >= lo && x->key[i] <= s) { scan_set_add(addr); } }
+    if (!x->leaf) { for (i = 0; i <= x->n; ++i) { scan_set_range(t, x->c[i], lo, s); } }
+    BTree_free_node_mem_checker(x);
+}
+
+static int scan_node_bound(const struct BTree *bt, int lo, int hi) {
+    struct BTreeCursor *cur; int s = INT_MAX;
+    cur = BTree_cursor_open(bt); BTree_cursor_seek(cur, hi + 1);
+    if (!BTree_cursor_next(cur, &s, NULL)) { s = INT_MAX; }
+    BTree_cursor_close(cur);
+    g_checked_store = bt->store; g_scan_set_size = 0;
+    scan_set_path(bt->t, bt->root, lo); scan_set_path(bt->t, bt->root, s); scan_set_range(bt->t, bt->root, lo, s);
+    return g_scan_set_size;
+}
+
 static void check_btree_invariants(const struct BTree *bt) {
     int tree_height = -1; int is_valid;
     if (bt == NULL || bt->t < 2 || bt->root != 0) { fprintf(stderr, "Invariant Fail: BTree struct invalid (t=%d, root=%d).\n", bt ? bt->t : -1, bt ? bt->root : -1); assert(0); }
+    g_checked_nodes = 0; g_checked_store = bt->store;
     is_valid = check_node_recursive(bt->t, bt->root, 1, 0, &tree_height, INT_MIN, INT_MAX);
     if (!is_valid) { fprintf(stderr, "!!! B-Tree Invariants VIOLATED !!!\n"); assert(0); }
+    /* Every page in the file is either reachable or on the free list */
+    if (g_checked_nodes + Storage_get_free_page_count(bt->store) != Storage_get_node_count(bt->store)) {
+        fprintf(stderr, "Invariant Fail: %d reachable + %d free pages != %d pages in file.\n", g_checked_nodes, Storage_get_free_page_count(bt->store), Storage_get_node_count(bt->store));
+        assert(0);
+    }
+}
+
+/* --- B+tree Invariant Checks --- */
+/* Page layout as in bptree.c: the 6t-2 int body holds key[cap], value[cap] */
+/* and next in a leaf, key[cap] and c[cap+1] in an inner page (cap = 3t-2). */
+#define BPT_INNER 2
+#define BPT_LEAF  3
+#define BPT_CHAIN_START (-2)
+
+static int g_bpt_next_leaf; /* Leaf the chain must reach next (BPT_CHAIN_START before the first) */
+static int g_bpt_leaves;
+static int g_bpt_pages;
+
+/* Checks the subtree at addr, whose keys must lie in [lo, hi). Returns its key count. */
+static int check_bpt_recursive(int t, int addr, int is_root, int depth, int *leaf_depth, long lo, long hi) {
+    struct Node x; int *body; int cap = 3 * t - 2; int min = (cap - 1) / 2; int i; int keys = 0;
+    body = malloc((6 * t - 2) * sizeof(int)); assert(body);
+    x.key = body; x.value = body + (2 * t - 1); x.c = body + 2 * (2 * t - 1);
+    Storage_read(g_checked_store, addr, &x); g_bpt_pages++;
+    assert(x.leaf == BPT_LEAF || x.leaf == BPT_INNER);
+    assert(x.n <= cap); assert(is_root || x.n >= min); assert(!is_root || x.leaf == BPT_LEAF || x.n >= 1);
+    for (i = 0; i < x.n; ++i) { assert(x.key[i] >= lo && x.key[i] < hi); assert(i == 0 || x.key[i - 1] < x.key[i]); }
+    if (x.leaf == BPT_LEAF) {
+        if (*leaf_depth == -1) { *leaf_depth = depth; } assert(*leaf_depth == depth); /* Leaves all at one depth */
+        assert(g_bpt_next_leaf == BPT_CHAIN_START || g_bpt_next_leaf == addr); /* Chain follows key order */
+        g_bpt_next_leaf = body[2 * cap]; g_bpt_leaves++; keys = x.n;
+    } else {
+        for (i = 0; i <= x.n; ++i) {
+            keys += check_bpt_recursive(t, body[cap + i], 0, depth + 1, leaf_depth,
+                                        i == 0 ? lo : (long)x.key[i - 1], i == x.n ? hi : (long)x.key[i]);
+        }
+    }
+    free(body); return keys;
+}
+
+/* Full check; returns the height and sets *keys to the number of keys */
+static int check_bptree_invariants(const struct BPTree *bt, int *keys) {
+    int leaf_depth = -1; int n;
+    g_checked_store = bt->store; g_bpt_next_leaf = BPT_CHAIN_START; g_bpt_leaves = 0; g_bpt_pages = 0;
+    n = check_bpt_recursive(bt->t, bt->root, 1, 0, &leaf_depth, (long)INT_MIN, (long)INT_MAX + 1);
+    assert(g_bpt_next_leaf == NULL_ADDR); /* Last leaf ends the chain */
+    assert(g_bpt_pages + Storage_get_free_page_count(bt->store) == Storage_get_node_count(bt->store));
+    if (keys != NULL) { *keys = n; }
+    return leaf_depth + 1;
+}
+
+/* --- B-epsilon Tree Invariant Checks --- */
+/* Page layout as in betree.c: with L = 3t-1 and F about sqrt(L), a leaf */
+/* holds key[L] and value[L], an inner page pivot[F-1], c[F], m, mkey[B] */
+/* and mval[B] (B = L - F). */
+#define BET_INNER 6
+#define BET_LEAF  7
+
+static int g_bet_pages;
+static int g_bet_messages;
+
+static int bet_fanout(int t) { int f = 4; while ((f + 1) * (f + 1) <= 3 * t - 1) { f++; } return f; }
+
+/* Checks the subtree at addr, whose keys and messages must lie in [lo, hi). Returns its leaf key count. */
+static int check_bet_recursive(int t, int addr, int depth, int *leaf_depth, long lo, long hi) {
+    struct Node x; int *body; int L = 3 * t - 1; int F = bet_fanout(t); int B = L - F; int *c; int *mk; int m; int i; int keys = 0;
+    body = malloc((6 * t - 2) * sizeof(int)); assert(body);
+    x.key = body; x.value = body + (2 * t - 1); x.c = body + 2 * (2 * t - 1);
+    Storage_read(g_checked_store, addr, &x); g_bet_pages++;
+    assert(x.leaf == BET_LEAF || x.leaf == BET_INNER);
+    if (x.leaf == BET_LEAF) {
+        if (*leaf_depth == -1) { *leaf_depth = depth; } assert(*leaf_depth == depth); /* Leaves all at one depth */
+        assert(x.n >= 0 && x.n <= L);
+        for (i = 0; i < x.n; ++i) { assert(x.key[i] >= lo && x.key[i] < hi); assert(i == 0 || x.key[i - 1] < x.key[i]); }
+        free(body); return x.n;
+    }
+    c = body + F - 1; m = body[2 * F - 1]; mk = body + 2 * F;
+    assert(x.n >= 0 && x.n <= F - 1); assert(m >= 0 && m <= B); g_bet_messages += m;
+    for (i = 0; i < x.n; ++i) { assert(x.key[i] > lo && x.key[i] < hi); assert(i == 0 || x.key[i - 1] < x.key[i]); }
+    for (i = 0; i < m; ++i) { assert(mk[i] >= lo && mk[i] < hi); assert(i == 0 || mk[i - 1] < mk[i]); } /* One message per key */
+    for (i = 0; i <= x.n; ++i) {
+        keys += check_bet_recursive(t, c[i], depth + 1, leaf_depth, i == 0 ? lo : (long)x.key[i - 1], i == x.n ? hi : (long)x.key[i]);
+    }
+    free(body); return keys;
+}
+
+/* Full check; returns the height (pages on a root-to-leaf path) */
+static int check_betree_invariants(const struct BETree *bt) {
+    int leaf_depth = -1;
+    g_checked_store = bt->store; g_bet_pages = 0; g_bet_messages = 0;
+    (void) check_bet_recursive(bt->t, bt->root, 0, &leaf_depth, (long)INT_MIN, (long)INT_MAX + 1);
+    assert(g_bet_pages + Storage_get_free_page_count(bt->store) == Storage_get_node_count(bt->store));
+    return leaf_depth + 1;
+}
+
+/* --- String-Key Tree Invariant Checks --- */
+/* Slotted page layout as in vtree.c: the body bytes hold prefix length */
+/* (u16), cell area start (u16), link (int), prefix, n u16 slots, and cells */
+/* of suffix length (u16), suffix, ref (int) packed against the end. */
+#define VT_INNER 4
+#define VT_LEAF  5
+#define VT_HDR 8
+
+static int g_vt_next_leaf; /* As g_bpt_next_leaf */
+static int g_vt_pages;
+static long g_vt_raw_bytes;    /* Full length of every key on the leaves */
+static long g_vt_stored_bytes; /* Bytes those keys take on the pages (prefixes once, suffixes) */
+static long g_vt_sep_bytes;    /* Separator bytes in inner pages (full length) */
+static int g_vt_seps;
+
+static int vt_u16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+
+static int vt_cmp(const unsigned char *a, int alen, const unsigned char *b, int blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    return c != 0 ? c : (alen > blen) - (alen < blen);
+}
+
+/* Checks the subtree at addr, whose keys must lie in [lo, hi) (NULL: unbounded). Returns its key count. */
+static int check_vt_recursive(int t, int addr, int depth, int *leaf_depth, const unsigned char *lo, int lolen, const unsigned char *hi, int hilen) {
+    struct Node x; unsigned char *b; unsigned char *keys; int *lens; int *refs; int cap = (6 * t - 2) * sizeof(int);
+    int plen; int start; int off; int slen; int i; int count = 0; int link;
+    b = malloc(cap); keys = malloc((size_t)cap * (cap / 8 + 1)); lens = malloc((cap / 8 + 1) * sizeof(int)); refs = malloc((cap / 8 + 1) * sizeof(int));
+    assert(b && keys && lens && refs);
+    x.key = (int *)b; x.value = x.key + (2 * t - 1); x.c = x.value + (2 * t - 1);
+    Storage_read(g_checked_store, addr, &x); g_vt_pages++;
+    assert(x.leaf == VT_LEAF || x.leaf == VT_INNER);
+    plen = vt_u16(b); start = vt_u16(b + 2); memcpy(&link, b + 4, sizeof(int));
+    assert(VT_HDR + plen + 2 * x.n <= start && start <= cap); /* Slots end before the cells */
+    for (i = 0; i < x.n; ++i) {
+        off = vt_u16(b + VT_HDR + plen + 2 * i); assert(off >= start && off + 2 <= cap);
+        slen = vt_u16(b + off); assert(off + 2 + slen + (int)sizeof(int) <= cap);
+        assert(plen + slen <= cap);
+        memcpy(keys + i * cap, b + VT_HDR, plen); memcpy(keys + i * cap + plen, b + off + 2, slen);
+        lens[i] = plen + slen; memcpy(&refs[i], b + off + 2 + slen, sizeof(int));
+        assert(i == 0 || vt_cmp(keys + (i - 1) * cap, lens[i - 1], keys + i * cap, lens[i]) < 0);
+        assert(lo == NULL || vt_cmp(lo, lolen, keys + i * cap, lens[i]) <= 0);
+        assert(hi == NULL || vt_cmp(keys + i * cap, lens[i], hi, hilen) < 0);
+    }
+    if (x.n > 0) { /* The prefix is the longest one all keys share */
+        assert(lens[0] == plen || lens[x.n - 1] == plen || keys[plen] != keys[(x.n - 1) * cap + plen]);
+    }
+    if (x.leaf == VT_LEAF) {
+        if (*leaf_depth == -1) { *leaf_depth = depth; } assert(*leaf_depth == depth);
+        assert(g_vt_next_leaf == BPT_CHAIN_START || g_vt_next_leaf == addr);
+        g_vt_next_leaf = link; count = x.n; g_vt_stored_bytes += plen;
+        for (i = 0; i < x.n; ++i) { g_vt_raw_bytes += lens[i]; g_vt_stored_bytes += lens[i] - plen; }
+    } else {
+        assert(x.n >= 1 || depth > 0);
+        for (i = 0; i < x.n; ++i) { g_vt_sep_bytes += lens[i]; g_vt_seps++; }
+        for (i = 0; i <= x.n; ++i) {
+            count += check_vt_recursive(t, i == 0 ? link : refs[i - 1], depth + 1, leaf_depth,
+                                        i == 0 ? lo : keys + (i - 1) * cap, i == 0 ? lolen : lens[i - 1],
+                                        i == x.n ? hi : keys + i * cap, i == x.n ? hilen : lens[i]);
+        }
+    }
+    free(b); free(keys); free(lens); free(refs); return count;
+}
+
+/* Full check; returns the height and sets *keys to the number of keys */
+static int check_vtree_invariants(const struct VTree *vt, int *keys) {
+    int leaf_depth = -1; int n;
+    g_checked_store = vt->store; g_vt_next_leaf = BPT_CHAIN_START; g_vt_pages = 0;
+    g_vt_raw_bytes = 0; g_vt_stored_bytes = 0; g_vt_sep_bytes = 0; g_vt_seps = 0;
+    n = check_vt_recursive(vt->t, vt->root, 0, &leaf_depth, NULL, 0, NULL, 0);
+    assert(g_vt_next_leaf == NULL_ADDR);
+    assert(g_vt_pages + Storage_get_free_page_count(vt->store) == Storage_get_node_count(vt->store));
+    if (keys != NULL) { *keys = n; }
+    return leaf_depth + 1;
 }
 
 /* --- Test Helper Functions (Use stdlib rand) --- */
@@ -236,7 +587,7 @@ void test_random_inserts_and_queries() {
     }
     end = clock(); printf("Query time: %.2f seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
     val = not_found_marker; BTree_get(&bt, -1, &val); assert(val == not_found_marker);
-    printf("Storage Stats: Reads=%lu, Writes=%lu, Allocs=%lu\n", Storage_get_read_count(), Storage_get_write_count(), Storage_get_alloc_count());
+    printf("Storage Stats: Reads=%lu, Writes=%lu, Allocs=%lu\n", Storage_get_read_count(bt.store), Storage_get_write_count(bt.store), Storage_get_alloc_count(bt.store));
     BTree_close(&bt); free(keys); free(values); printf("Random Inserts/Queries Test Passed.\n");
 }
 
@@ -244,7 +595,7 @@ void test_delete_and_update() {
     struct BTree bt; int i; int keys_to_use[] = {10, 20, 5, 15, 25, 30, 3, 8, 12, 18, 22, 28}; int num_keys = sizeof(keys_to_use) / sizeof(keys_to_use[0]);
     int keys_to_delete[] = {15, 3, 30, 99}; int num_to_delete = sizeof(keys_to_delete) / sizeof(keys_to_delete[0]);
     int val; int not_found_marker = -555; int current_key; int is_deleted; int j;
-    printf("--- Test Delete and Update (Marking) ---\n"); remove(TEST_DB_FILE);
+    printf("--- Test Delete and Update ---\n"); remove(TEST_DB_FILE);
     bt = BTree_open(TEST_DB_FILE, TEST_T); check_btree_invariants(&bt);
     printf("Inserting initial keys...\n"); for (i = 0; i < num_keys; ++i) { BTree_put(&bt, keys_to_use[i], keys_to_use[i] * 10); check_btree_invariants(&bt); }
     printf("Deleting selected keys...\n"); for (i = 0; i < num_to_delete; ++i) { printf(" Deleting %d\n", keys_to_delete[i]); BTree_delete(&bt, keys_to_delete[i]); check_btree_invariants(&bt); val = not_found_marker; BTree_get(&bt, keys_to_delete[i], &val); assert(val == not_found_marker); }
@@ -255,6 +606,1203 @@ void test_delete_and_update() {
     BTree_close(&bt); printf("Delete and Update Test Passed.\n");
 }
 
+void test_delete_heavy() {
+    struct BTree bt; int *keys = NULL; int *model = NULL; int n = 1500; int ts[] = {2, 3, 7}; int f; int i; int j; int val; int height; int pages;
+    int not_found_marker = -777; unsigned long reads; unsigned long writes;
+    printf("--- Test Delete-Heavy Workload (merge/borrow, page reuse) ---\n");
+    keys = malloc(n * sizeof(int)); model = malloc(n * sizeof(int)); assert(keys && model);
+    for (f = 0; f < (int)(sizeof(ts) / sizeof(ts[0])); ++f) {
+        remove(TEST_DB_FILE); bt = BTree_open(TEST_DB_FILE, ts[f]);
+        for (i = 0; i < n; ++i) { keys[i] = i; model[i] = i * 3; } test_shuffle(keys, n);
+        for (i = 0; i < n; ++i) { BTree_put(&bt, keys[i], keys[i] * 3); }
+        check_btree_invariants(&bt); pages = Storage_get_node_count(bt.store);
+        test_shuffle(keys, n);
+        for (i = 0; i < n; ++i) {
+            height = btree_height(&bt); reads = Storage_get_read_count(bt.store); writes = Storage_get_write_count(bt.store);
+            BTree_delete(&bt, keys[i]); model[keys[i]] = not_found_marker;
+            /* Per level: the node plus at most two siblings */
+            assert(Storage_get_read_count(bt.store) - reads <= 3UL * height); assert(Storage_get_write_count(bt.store) - writes <= 3UL * height);
+            if (i % 97 == 0 || i > n - 20) {
+                check_btree_invariants(&bt);
+                for (j = 0; j < n; j += 7) { val = not_found_marker; BTree_get(&bt, j, &val); assert(val == model[j]); }
+            }
+        }
+        check_btree_invariants(&bt); assert(g_checked_nodes == 1); /* Just the empty root leaf */
+        printf("  t=%d: %d pages before, %d free after deleting all, %lu frees\n", ts[f], pages, Storage_get_free_page_count(bt.store), Storage_get_free_count(bt.store));
+        assert(Storage_get_free_page_count(bt.store) == pages - 1);
+        BTree_delete(&bt, 5); check_btree_invariants(&bt); /* Delete from empty tree is a no-op */
+        /* Re-inserting reuses released pages instead of growing the file */
+        for (i = 0; i < n; ++i) { BTree_put(&bt, keys[i], keys[i]); }
+        check_btree_invariants(&bt); assert(Storage_get_node_count(bt.store) == pages || Storage_get_free_page_count(bt.store) == 0);
+        for (i = 0; i < n; i += 13) { val = not_found_marker; BTree_get(&bt, i, &val); assert(val == i); }
+        BTree_close(&bt);
+    }
+    free(keys); free(model); printf("Delete-Heavy Test Passed.\n");
+}
+
+void test_single_descent_put() {
+    struct BTree bt; int i; int val; int height; int not_found_marker = -999; unsigned long reads, writes;
+    printf("--- Test Single-Descent Put (I/O per put, median update) ---\n"); remove(TEST_DB_FILE);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    /* Fill the root, then re-put its median: the root split must update it in place */
+    for (i = 1; i <= 2 * TEST_T - 1; ++i) { BTree_put(&bt, i * 10, i); }
+    BTree_put(&bt, TEST_T * 10, -TEST_T); check_btree_invariants(&bt);
+    val = not_found_marker; BTree_get(&bt, TEST_T * 10, &val); assert(val == -TEST_T);
+    for (i = 1; i <= 2 * TEST_T - 1; ++i) { BTree_put(&bt, i * 10 + 5, i); }
+    BTree_put(&bt, 15, 0); check_btree_invariants(&bt); /* Existing key inside a (possibly full) child */
+    for (i = 0; i < 500; ++i) { BTree_put(&bt, 1000 + (i * 211) % 500, i); }
+    check_btree_invariants(&bt); height = btree_height(&bt);
+    printf("Height: %d\n", height);
+    for (i = 0; i < 50; ++i) {
+        reads = Storage_get_read_count(bt.store); writes = Storage_get_write_count(bt.store);
+        BTree_put(&bt, 5000 + i * 3, i);
+        /* Each level is read once; a write happens per level only when splitting */
+        assert(Storage_get_read_count(bt.store) - reads <= (unsigned long)height + 1);
+        assert(Storage_get_write_count(bt.store) - writes <= 2UL * (height + 1));
+    }
+    check_btree_invariants(&bt);
+    for (i = 0; i < 50; ++i) { val = not_found_marker; BTree_get(&bt, 5000 + i * 3, &val); assert(val == i); }
+    BTree_close(&bt); printf("Single-Descent Put Test Passed.\n");
+}
+
+void test_bulk_load() {
+    struct BTree bt; int *keys = NULL; int *values = NULL; int n; int i; int f; int val; int not_found_marker = -999;
+    int fills[] = { 1, 50, 70, 100 }; int sizes[] = { 0, 1, 2, 4, 5, 6, 7, 11, 12, 13, 29, 30, 31, 200, 5000 };
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]); int s_idx;
+    printf("--- Test Bulk Load (sizes x fill factors) ---\n");
+    keys = malloc(5000 * sizeof(int)); values = malloc(5000 * sizeof(int)); assert(keys && values);
+    for (i = 0; i < 5000; ++i) { keys[i] = i * 3 - 7000; values[i] = i; }
+    for (f = 0; f < 4; ++f) {
+        for (s_idx = 0; s_idx < num_sizes; ++s_idx) {
+            n = sizes[s_idx]; remove(TEST_DB_FILE);
+            bt = BTree_bulk_load(TEST_DB_FILE, TEST_T, fills[f], keys, values, n); check_btree_invariants(&bt);
+            BTree_close(&bt);
+            bt = BTree_open(TEST_DB_FILE, TEST_T); check_btree_invariants(&bt); /* Reads back normally */
+            for (i = 0; i < n; ++i) { val = not_found_marker; BTree_get(&bt, keys[i], &val); assert(val == i); }
+            val = not_found_marker; BTree_get(&bt, keys[0] - 1, &val); assert(val == not_found_marker);
+            BTree_put(&bt, 1, 1); BTree_put(&bt, 100000, 2); check_btree_invariants(&bt); /* Still updatable */
+            val = not_found_marker; BTree_get(&bt, 100000, &val); assert(val == 2);
+            BTree_close(&bt);
+        }
+        printf("  fill=%d%%: %d sizes OK\n", fills[f], num_sizes);
+    }
+    free(keys); free(values); printf("Bulk Load Test Passed.\n");
+}
+
+/* Scan callback state: checks keys against the expected even-key layout */
+struct ScanCheck { int next_expected; int count; int stop_after; };
+static int scan_check_cb(int k, int v, void *ctx) {
+    struct ScanCheck *chk = ctx;
+    while (chk->next_expected % 6 == 0) { chk->next_expected += 2; } /* Multiples of 6 are deleted */
+    assert(k == chk->next_expected); assert(v == k * 10);
+    chk->next_expected += 2; chk->count++;
+    return chk->stop_after > 0 && chk->count >= chk->stop_after;
+}
+
+void test_cursor_and_scan() {
+    struct BTree bt; struct BTreeCursor *cur = NULL; int *keys = NULL; int n = 600; int i; int k; int v; int expected;
+    struct ScanCheck chk; unsigned long reads; unsigned long nodes; int count; int height; int bound;
+    printf("--- Test Cursor and Range Scan ---\n"); remove(TEST_DB_FILE);
+    bt = BTree_open(TEST_DB_FILE, TEST_T); keys = malloc(n * sizeof(int)); assert(keys);
+    for (i = 0; i < n; ++i) { keys[i] = i * 2; } test_shuffle(keys, n);
+    for (i = 0; i < n; ++i) { BTree_put(&bt, keys[i], keys[i] * 10); }
+    for (i = 0; i < n * 2; i += 6) { BTree_delete(&bt, i); }
+    check_btree_invariants(&bt); nodes = (unsigned long)g_checked_nodes; /* Live nodes after merges */
+
+    printf("Full cursor walk...\n");
+    reads = Storage_get_read_count(bt.store); cur = BTree_cursor_open(&bt); expected = 2; count = 0;
+    while (BTree_cursor_next(cur, &k, &v)) { assert(k == expected); assert(v == k * 10); count++; expected += 2; if (expected % 6 == 0) expected += 2; }
+    printf("Walked %d keys, %lu reads for %lu nodes\n", count, Storage_get_read_count(bt.store) - reads, nodes);
+    assert(count == n - n / 3); assert(Storage_get_read_count(bt.store) - reads == nodes); /* Every node read exactly once */
+    assert(!BTree_cursor_next(cur, &k, &v));
+
+    printf("Seek to present, absent, deleted, and out-of-range keys...\n");
+    BTree_cursor_seek(cur, 100); assert(BTree_cursor_next(cur, &k, &v) && k == 100);
+    BTree_cursor_seek(cur, 101); assert(BTree_cursor_next(cur, &k, &v) && k == 104); /* 102 is deleted */
+    BTree_cursor_seek(cur, -50); assert(BTree_cursor_next(cur, &k, &v) && k == 2);
+    BTree_cursor_seek(cur, n * 2); assert(!BTree_cursor_next(cur, &k, &v));
+    BTree_cursor_close(cur);
+
+    printf("Range scans...\n");
+    for (i = -3; i < n * 2 + 3; i += 37) {
+        chk.next_expected = i < 2 ? 2 : (i % 2 ? i + 1 : i); chk.count = 0; chk.stop_after = 0;
+        count = BTree_scan(&bt, i, i + 150, scan_check_cb, &chk); assert(count == chk.count);
+        while (chk.next_expected % 6 == 0) { chk.next_expected += 2; }
+        assert(chk.next_expected > i + 150 || chk.next_expected >= n * 2); /* Nothing in range was missed */
+    }
+    chk.next_expected = 2; chk.count = 0; chk.stop_after = 5;
+    assert(BTree_scan(&bt, 0, n * 2, scan_check_cb, &chk) == 5);
+    assert(BTree_scan(&bt, 10, 5, scan_check_cb, &chk) == 0);
+    height = btree_height(&bt); bound = scan_node_bound(&bt, 400, 420);
+    reads = Storage_get_read_count(bt.store); chk.next_expected = 400; chk.count = 0; chk.stop_after = 0;
+    BTree_scan(&bt, 400, 420, scan_check_cb, &chk); reads = Storage_get_read_count(bt.store) - reads;
+    printf("Narrow scan [400,420]: %d keys, %lu reads (height %d, %d nodes on the range)\n", chk.count, reads, height, bound);
+    /* No read off the range and none repeated: not even the root twice */
+    assert(chk.count == 7); assert(reads <= (unsigned long)bound);
+    free(keys); BTree_close(&bt); printf("Cursor and Range Scan Test Passed.\n");
+}
+
+void test_get_many() {
+    struct BTree bt; int n = 800; int nprobe = 300; int *probes = NULL; int *batch_vals = NULL; int *single_vals = NULL; int i; int val; int found; int expected_found = 0;
+    unsigned long reads_single; unsigned long reads_batch; int not_found_marker = -4242;
+    printf("--- Test Batched Lookup (BTree_get_many) ---\n"); remove(TEST_DB_FILE);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    probes = malloc(n * sizeof(int)); batch_vals = malloc(n * sizeof(int)); single_vals = malloc(nprobe * sizeof(int)); assert(probes && batch_vals && single_vals);
+    for (i = 0; i < n; ++i) { probes[i] = i; } test_shuffle(probes, n);
+    for (i = 0; i < n; ++i) { BTree_put(&bt, probes[i] * 2, probes[i]); } /* Even keys present */
+    for (i = 0; i < n; i += 10) { BTree_delete(&bt, i * 2); }
+    /* Probes: present, deleted, odd (absent), out of range, and duplicates */
+    for (i = 0; i < nprobe; ++i) { probes[i] = (rand() % (n * 2 + 40)) - 20; }
+    probes[0] = probes[1]; probes[2] = 0;
+    reads_single = Storage_get_read_count(bt.store);
+    for (i = 0; i < nprobe; ++i) { val = not_found_marker; BTree_get(&bt, probes[i], &val); if (val != not_found_marker) expected_found++; single_vals[i] = val; batch_vals[i] = not_found_marker; }
+    reads_single = Storage_get_read_count(bt.store) - reads_single;
+    reads_batch = Storage_get_read_count(bt.store);
+    found = BTree_get_many(&bt, probes, batch_vals, nprobe);
+    reads_batch = Storage_get_read_count(bt.store) - reads_batch;
+    printf("Found %d / %d, reads single=%lu batch=%lu\n", found, nprobe, reads_single, reads_batch);
+    assert(found == expected_found); assert(reads_batch < reads_single);
+    for (i = 0; i < nprobe; ++i) { assert(batch_vals[i] == single_vals[i]); }
+    /* Every key at once reads every node exactly once */
+    for (i = 0; i < n; ++i) { probes[i] = i * 2; } check_btree_invariants(&bt);
+    reads_batch = Storage_get_read_count(bt.store); found = BTree_get_many(&bt, probes, batch_vals, n);
+    assert(found == n - n / 10); assert(Storage_get_read_count(bt.store) - reads_batch == (unsigned long)g_checked_nodes);
+    assert(BTree_get_many(&bt, probes, batch_vals, 0) == 0);
+    free(probes); free(batch_vals); free(single_vals); BTree_close(&bt); printf("Batched Lookup Test Passed.\n");
+}
+
+void test_put_many() {
+    struct BTree bt; int key_space = 3000; int *model = NULL; int keys[700]; int values[700]; int round; int b; int i; int val;
+    int batch_sizes[] = { 1, 7, 50, 700, 300, 2 }; int num_rounds = sizeof(batch_sizes) / sizeof(batch_sizes[0]); int not_found_marker = -31337;
+    unsigned long reads; unsigned long writes; unsigned long allocs;
+    printf("--- Test Batched Upsert (BTree_put_many) ---\n"); remove(TEST_DB_FILE);
+    bt = BTree_open(TEST_DB_FILE, TEST_T); model = malloc(key_space * sizeof(int)); assert(model);
+    for (i = 0; i < key_space; ++i) { model[i] = not_found_marker; }
+    printf("One 700-key batch into an empty tree (multi-level root growth)...\n");
+    for (i = 0; i < 700; ++i) { keys[i] = (i * 13) % key_space; values[i] = i; model[keys[i]] = i; }
+    BTree_put_many(&bt, keys, values, 700); check_btree_invariants(&bt);
+    for (round = 0; round < 20; ++round) {
+        b = batch_sizes[round % num_rounds];
+        for (i = 0; i < b; ++i) { keys[i] = rand() % key_space; values[i] = round * 1000 + i; }
+        if (b > 2) { keys[b - 1] = keys[0]; } /* Duplicate in batch: last one wins */
+        for (i = 0; i < b; ++i) { model[keys[i]] = values[i]; }
+        reads = Storage_get_read_count(bt.store); writes = Storage_get_write_count(bt.store); allocs = Storage_get_alloc_count(bt.store);
+        BTree_put_many(&bt, keys, values, b);
+        /* Each touched node is read and written once; new pieces are written once */
+        assert(Storage_get_write_count(bt.store) - writes <= (Storage_get_read_count(bt.store) - reads) + (Storage_get_alloc_count(bt.store) - allocs));
+        check_btree_invariants(&bt);
+    }
+    for (i = 0; i < key_space; ++i) { val = not_found_marker; BTree_get(&bt, i, &val); assert(val == model[i]); }
+    printf("Verified %d keys against model after 20 batches.\n", key_space);
+    BTree_put_many(&bt, keys, values, 0);
+    free(model); BTree_close(&bt); printf("Batched Upsert Test Passed.\n");
+}
+
+void test_buffer_pool() {
+    struct BTree bt; struct Node view; struct Node pinned[5]; struct Node *x; int i; int val; int not_found_marker = -777; int n_keys = 400;
+    unsigned long hits, misses;
+    printf("--- Test Buffer Pool (4 frames, forced evictions) ---\n"); remove(TEST_DB_FILE);
+    Storage_set_cache_size(4);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    for (i = 0; i < n_keys; ++i) { BTree_put(&bt, (i * 37) % n_keys, i); }
+    check_btree_invariants(&bt);
+    printf("Evictions: %lu\n", Storage_get_cache_eviction_count(bt.store)); assert(Storage_get_cache_eviction_count(bt.store) > 0);
+    hits = Storage_get_cache_hit_count(bt.store); misses = Storage_get_cache_miss_count(bt.store);
+    assert(Storage_pin(bt.store, bt.root, &view)); assert(Storage_get_cache_hit_count(bt.store) + Storage_get_cache_miss_count(bt.store) == hits + misses + 1);
+    assert(view.n >= 1 && !view.leaf); Storage_unpin(bt.store, bt.root, &view, 0);
+    /* Pin every frame: a fifth pin is refused, reads and writes bypass the pool */
+    assert(Storage_get_node_count(bt.store) > 5);
+    for (i = 0; i < 4; ++i) { assert(Storage_pin(bt.store, i, &pinned[i])); }
+    assert(!Storage_pin(bt.store, 4, &pinned[4]));
+    x = BTree_disk_read_checker(TEST_T, 4); assert(x->n >= 1); BTree_free_node_mem_checker(x);
+    for (i = 0; i < n_keys; ++i) { val = not_found_marker; BTree_get(&bt, (i * 37) % n_keys, &val); assert(val == i); }
+    for (i = 0; i < n_keys; ++i) { BTree_put(&bt, n_keys + i, -i); }
+    for (i = 0; i < 4; ++i) { Storage_unpin(bt.store, i, &pinned[i], 0); }
+    check_btree_invariants(&bt);
+    BTree_close(&bt);
+    printf("Reopening uncached to verify write-back...\n");
+    Storage_set_cache_size(0);
+    bt = BTree_open(TEST_DB_FILE, TEST_T); check_btree_invariants(&bt);
+    for (i = 0; i < n_keys; ++i) { val = not_found_marker; BTree_get(&bt, (i * 37) % n_keys, &val); assert(val == i); }
+    for (i = 0; i < n_keys; ++i) { val = not_found_marker; BTree_get(&bt, n_keys + i, &val); assert(val == -i); }
+    assert(Storage_get_cache_hit_count(bt.store) == 0 && Storage_get_cache_miss_count(bt.store) == 0); assert(!Storage_pin(bt.store, bt.root, &view));
+    BTree_close(&bt); Storage_set_cache_size(256); printf("Buffer Pool Test Passed.\n");
+}
+
+void test_mmap_backend() {
+    struct BTree bt; int i; int val; int not_found_marker = -777; int n_keys = 5000; FILE *f; long file_size;
+    printf("--- Test mmap Backend (N=%d, growth past one chunk) ---\n", n_keys); remove(TEST_DB_FILE);
+    Storage_set_backend(STORAGE_BACKEND_MMAP);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    for (i = 0; i < n_keys; ++i) { BTree_put(&bt, (i * 7919) % n_keys, i); }
+    check_btree_invariants(&bt);
+    for (i = 0; i < n_keys; i += 7) { val = not_found_marker; BTree_get(&bt, (i * 7919) % n_keys, &val); assert(val == i); }
+    printf("Allocated nodes: %lu\n", Storage_get_alloc_count(bt.store));
+    BTree_close(&bt);
+    f = fopen(TEST_DB_FILE, "rb"); assert(f); fseek(f, 0, SEEK_END); file_size = ftell(f); fclose(f);
+    printf("File size after close: %ld\n", file_size);
+    assert((file_size - TEST_HEADER_SIZE) % (6L * TEST_T * (long)sizeof(int)) == 0); /* Preallocated tail trimmed */
+    printf("Reopening with stdio backend...\n");
+    Storage_set_backend(STORAGE_BACKEND_STDIO);
+    bt = BTree_open(TEST_DB_FILE, TEST_T); check_btree_invariants(&bt);
+    for (i = 0; i < n_keys; ++i) { val = not_found_marker; BTree_get(&bt, (i * 7919) % n_keys, &val); assert(val == i); }
+    BTree_close(&bt); printf("mmap Backend Test Passed.\n");
+}
+
+/* File size in bytes, or -1 if it cannot be opened */
+static long test_file_size(const char *name) {
+    FILE *f = fopen(name, "rb"); long size;
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END); size = ftell(f); fclose(f); return size;
+}
+
+void test_page_aligned_format() {
+    struct BTree bt; int pages[] = {4096, 8192, 16384}; int p; int i; int val; int backend; int not_found_marker = -777; int n = 3000;
+    FILE *f; int header[5]; long size;
+    printf("--- Test Page-Aligned Format (version 3) ---\n");
+    for (p = 0; p < 3; ++p) {
+        for (backend = STORAGE_BACKEND_STDIO; backend <= STORAGE_BACKEND_MMAP; ++backend) {
+            remove(TEST_DB_FILE); Storage_set_page_size(pages[p]); Storage_set_backend(backend);
+            bt = BTree_open(TEST_DB_FILE, 0); /* Largest t that fits a page */
+            assert(bt.t == pages[p] / (6 * (int)sizeof(int))); assert(6L * bt.t * (long)sizeof(int) <= pages[p]);
+            assert(Storage_get_page_size(bt.store) == pages[p]);
+            for (i = 0; i < n; ++i) { BTree_put(&bt, (i * 7919) % n, i); }
+            for (i = 0; i < n; i += 4) { BTree_delete(&bt, (i * 7919) % n); }
+            check_btree_invariants(&bt); BTree_close(&bt);
+            Storage_set_page_size(0); Storage_set_backend(STORAGE_BACKEND_STDIO);
+            /* Header page then whole pages per node */
+            size = test_file_size(TEST_DB_FILE); assert(size % pages[p] == 0);
+            f = fopen(TEST_DB_FILE, "rb"); assert(f); assert(fread(header, sizeof(int), 5, f) == 5); fclose(f);
+            assert(header[1] == 3 && header[4] == pages[p]);
+            bt = BTree_open(TEST_DB_FILE, 5); /* t and page size come from the file */
+            assert(bt.t == pages[p] / (6 * (int)sizeof(int))); assert(Storage_get_page_size(bt.store) == pages[p]);
+            check_btree_invariants(&bt);
+            for (i = 0; i < n; ++i) { val = not_found_marker; BTree_get(&bt, (i * 7919) % n, &val); assert(val == (i % 4 ? i : not_found_marker)); }
+            BTree_close(&bt);
+        }
+        printf("  page=%d: t=%d, %ld bytes\n", pages[p], pages[p] / (6 * (int)sizeof(int)), size);
+    }
+    printf("Small t padded to a page, vacuum keeps the layout...\n");
+    remove(TEST_DB_FILE); Storage_set_page_size(4096);
+    bt = BTree_open(TEST_DB_FILE, 3);
+    for (i = 0; i < 500; ++i) { BTree_put(&bt, i, i); }
+    for (i = 0; i < 500; i += 2) { BTree_delete(&bt, i); }
+    BTree_close(&bt); Storage_set_page_size(0);
+    BTree_vacuum(TEST_DB_FILE, &n); assert(test_file_size(TEST_DB_FILE) == 4096L * (n + 1));
+    bt = BTree_open(TEST_DB_FILE, 3); check_btree_invariants(&bt);
+    for (i = 1; i < 500; i += 2) { val = not_found_marker; BTree_get(&bt, i, &val); assert(val == i); }
+    BTree_close(&bt);
+    bt = BTree_open("test_btree_packed.db", 0); assert(bt.t == 4096 / (6 * (int)sizeof(int))); assert(Storage_get_page_size(bt.store) == 0);
+    BTree_close(&bt); remove("test_btree_packed.db");
+    printf("Page-Aligned Format Test Passed.\n");
+}
+
+void test_search_kernels() {
+    int keys[1100]; int n; int i; int kr; int k; int expected; int trial;
+    printf("--- Test Intra-Node Search Kernels ---\n");
+    for (n = 0; n <= 1100; n = (n < 70 ? n + 1 : n * 2 + 1)) {
+        if (n > 1100) { n = 1100; }
+        for (trial = 0; trial < 3; ++trial) {
+            /* Sorted distinct keys with gaps, including negatives and the int extremes */
+            k = trial == 0 ? INT_MIN : -(rand() % 1000);
+            for (i = 0; i < n; ++i) { keys[i] = k; k += 1 + rand() % 5; }
+            if (trial == 2 && n > 0) { keys[n - 1] = INT_MAX; }
+            for (i = -1; i <= 2 * n; ++i) {
+                k = i < 0 ? INT_MIN : (i == 2 * n ? INT_MAX : (i % 2 ? keys[i / 2] : keys[i / 2] - 1));
+                if (i >= 0 && i < 2 * n && i % 2 == 0 && keys[i / 2] == INT_MIN) { continue; }
+                expected = 0; while (expected < n && keys[expected] < k) { expected++; }
+                for (kr = 0; kr <= 3; ++kr) { assert(BTree_search_kernel(kr, keys, n, k) == expected); }
+            }
+        }
+        if (n == 1100) { break; }
+    }
+    printf("Search Kernels Test Passed.\n");
+}
+
+void test_free_list_and_vacuum() {
+    struct BTree bt; int n = 2000; int i; int val; int pages; int free_pages; int live_pages; int reclaimed; int backend;
+    int not_found_marker = -777; long node_size = 6L * TEST_T * (long)sizeof(int); FILE *f; int header[3]; int image[6 * 2];
+    printf("--- Test Persistent Free List and Vacuum ---\n");
+    for (backend = STORAGE_BACKEND_STDIO; backend <= STORAGE_BACKEND_MMAP; ++backend) {
+        printf("Backend %s...\n", backend == STORAGE_BACKEND_MMAP ? "mmap" : "stdio");
+        remove(TEST_DB_FILE); Storage_set_backend(backend);
+        bt = BTree_open(TEST_DB_FILE, TEST_T);
+        for (i = 0; i < n; ++i) { BTree_put(&bt, (i * 7919) % n, i); }
+        for (i = 0; i < n; i += 3) { BTree_delete(&bt, i); }
+        for (i = n / 2; i < n; ++i) { BTree_delete(&bt, i); }
+        check_btree_invariants(&bt); pages = Storage_get_node_count(bt.store); free_pages = Storage_get_free_page_count(bt.store);
+        printf("  %d pages, %d free before reopen\n", pages, free_pages); assert(free_pages > 0);
+        BTree_close(&bt);
+
+        /* The free list survives a reopen and is drawn from before the file grows */
+        bt = BTree_open(TEST_DB_FILE, TEST_T);
+        assert(Storage_get_node_count(bt.store) == pages); assert(Storage_get_free_page_count(bt.store) == free_pages);
+        check_btree_invariants(&bt); /* Reachable + free == all pages */
+        for (i = n / 2; i < n / 2 + 200; ++i) { BTree_put(&bt, i, -i); }
+        check_btree_invariants(&bt); assert(Storage_get_node_count(bt.store) == pages); assert(Storage_get_free_page_count(bt.store) < free_pages);
+        for (i = n / 2; i < n; ++i) { BTree_delete(&bt, i); }
+        free_pages = Storage_get_free_page_count(bt.store); BTree_close(&bt);
+        assert(test_file_size(TEST_DB_FILE) == TEST_HEADER_SIZE + pages * node_size);
+
+        /* Vacuum compacts to exactly the reachable pages and keeps every key */
+        reclaimed = BTree_vacuum(TEST_DB_FILE, &live_pages);
+        printf("  vacuum: %d live pages, %d reclaimed\n", live_pages, reclaimed);
+        assert(reclaimed == free_pages); assert(live_pages == pages - free_pages);
+        assert(test_file_size(TEST_DB_FILE) == TEST_HEADER_SIZE + live_pages * node_size);
+        bt = BTree_open(TEST_DB_FILE, TEST_T);
+        assert(Storage_get_node_count(bt.store) == live_pages); assert(Storage_get_free_page_count(bt.store) == 0);
+        check_btree_invariants(&bt);
+        for (i = 0; i < n; ++i) {
+            val = not_found_marker; BTree_get(&bt, (i * 7919) % n, &val);
+            if ((i * 7919) % n % 3 == 0 || (i * 7919) % n >= n / 2) { assert(val == not_found_marker); } else { assert(val == i); }
+        }
+        BTree_put(&bt, n * 2, 1); check_btree_invariants(&bt); /* Grows normally after vacuum */
+        BTree_close(&bt);
+        assert(BTree_vacuum(TEST_DB_FILE, NULL) == 0); /* Nothing left to reclaim */
+    }
+    Storage_set_backend(STORAGE_BACKEND_STDIO);
+
+    printf("Version 1 file (no free list slot) still opens...\n");
+    remove(TEST_DB_FILE); f = fopen(TEST_DB_FILE, "wb"); assert(f);
+    header[0] = (int)0xBEEFCAFE; header[1] = 1; header[2] = 2; /* magic, version 1, t=2 */
+    for (i = 0; i < 12; ++i) { image[i] = i < 8 ? UNUSED_SENTINEL : NULL_ADDR; }
+    image[0] = 0; image[1] = 1; /* Empty root leaf */
+    assert(fwrite(header, sizeof(int), 3, f) == 3 && fwrite(image, sizeof(int), 12, f) == 12); fclose(f);
+    bt = BTree_open(TEST_DB_FILE, 2); assert(bt.t == 2);
+    for (i = 0; i < 100; ++i) { BTree_put(&bt, i, i + 1); }
+    for (i = 0; i < 100; i += 2) { BTree_delete(&bt, i); }
+    check_btree_invariants(&bt); BTree_close(&bt);
+    bt = BTree_open(TEST_DB_FILE, 2);
+    for (i = 0; i < 100; ++i) { val = not_found_marker; BTree_get(&bt, i, &val); assert(val == (i % 2 ? i + 1 : not_found_marker)); }
+    assert(Storage_get_free_page_count(bt.store) == 0); BTree_close(&bt); /* Free pages are not persisted in v1 */
+    reclaimed = BTree_vacuum(TEST_DB_FILE, &live_pages); printf("  v1 vacuum: %d live pages, %d reclaimed\n", live_pages, reclaimed);
+    bt = BTree_open(TEST_DB_FILE, 2); check_btree_invariants(&bt);
+    for (i = 1; i < 100; i += 2) { val = not_found_marker; BTree_get(&bt, i, &val); assert(val == i + 1); }
+    BTree_close(&bt); printf("Free List and Vacuum Test Passed.\n");
+}
+
+/* Runs a workload in a child process that exits without closing the tree, */
+/* as if it crashed; fails the test if the workload itself failed */
+static void test_crash_child(void (*workload)(int arg), int arg) {
+    pid_t pid; int status;
+    fflush(stdout); fflush(stderr);
+    pid = fork(); assert(pid >= 0);
+    if (pid == 0) { workload(arg); _exit(0); }
+    assert(waitpid(pid, &status, 0) == pid); assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/* Puts 0..1999, syncs, then puts 2000..2499 in groups of 8 and crashes */
+static void wal_workload_sync_then_crash(int backend) {
+    struct BTree bt; int i;
+    Storage_set_backend(backend); Storage_set_wal(8, 0);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    for (i = 0; i < 2000; ++i) { BTree_put(&bt, (i * 7919) % 2000, i); }
+    for (i = 0; i < 2000; i += 5) { BTree_delete(&bt, i); }
+    BTree_sync(&bt); assert(Storage_get_wal_commit_count(bt.store) > 0);
+    for (i = 2000; i < 2500; ++i) { BTree_put(&bt, i, -i); }
+}
+
+/* Puts with a group that never fills, through a 4-frame cache */
+static void wal_workload_uncommitted(int backend) {
+    struct BTree bt; int i;
+    Storage_set_backend(backend); Storage_set_cache_size(4); Storage_set_wal(1000000, 0);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    for (i = 5000; i < 5300; ++i) { BTree_put(&bt, i, i); }
+    for (i = 0; i < 2000; i += 2) { BTree_delete(&bt, i); }
+    assert(Storage_get_wal_commit_count(bt.store) == 0);
+}
+
+/* Fresh file, then 100 puts committed 4 at a time */
+static void wal_workload_groups_of_four(int unused) {
+    struct BTree bt; int i; (void)unused;
+    Storage_set_wal(4, 0);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    for (i = 0; i < 100; ++i) { BTree_put(&bt, i, i + 1); }
+    assert(Storage_get_wal_commit_count(bt.store) == 26); /* Root creation commits alone */
+}
+
+/* Reads a whole file into a malloc'd buffer */
+static char *test_read_file(const char *name, long *size) {
+    FILE *f = fopen(name, "rb"); char *buf;
+    assert(f != NULL); fseek(f, 0, SEEK_END); *size = ftell(f); fseek(f, 0, SEEK_SET);
+    buf = malloc(*size > 0 ? (size_t)*size : 1); assert(buf != NULL);
+    assert(fread(buf, 1, (size_t)*size, f) == (size_t)*size); fclose(f); return buf;
+}
+
+void test_wal_recovery() {
+    struct BTree bt; int backend; int i; int val; int not_found_marker = -777; int committed; int reclaimed;
+    long before_size; long after_size; long log_size; char *before; char *after; FILE *f; int junk[40];
+    printf("--- Test Write-Ahead Log and Crash Recovery ---\n");
+    for (backend = STORAGE_BACKEND_STDIO; backend <= STORAGE_BACKEND_MMAP; ++backend) {
+        printf("Backend %s: synced operations survive, later ones form whole groups...\n", backend == STORAGE_BACKEND_MMAP ? "mmap" : "stdio");
+        remove(TEST_DB_FILE); remove(TEST_WAL_FILE);
+        test_crash_child(wal_workload_sync_then_crash, backend);
+        assert(test_file_size(TEST_WAL_FILE) > 0);
+        Storage_set_backend(backend);
+        bt = BTree_open(TEST_DB_FILE, TEST_T); /* Recovery runs even with the WAL off */
+        printf("  %lu groups replayed\n", Storage_get_recovered_group_count(bt.store));
+        assert(Storage_get_recovered_group_count(bt.store) > 0); assert(test_file_size(TEST_WAL_FILE) == -1);
+        btree_height(&bt); /* Structurally valid; pages of lost groups may leak */
+        for (i = 0; i < 2000; ++i) { val = not_found_marker; BTree_get(&bt, (i * 7919) % 2000, &val); assert(val == ((i * 7919) % 2000 % 5 ? i : not_found_marker)); }
+        committed = 0;
+        while (committed < 500) { val = not_found_marker; BTree_get(&bt, 2000 + committed, &val); if (val == not_found_marker) { break; } assert(val == -(2000 + committed)); committed++; }
+        for (i = 2000 + committed; i < 2500; ++i) { val = not_found_marker; BTree_get(&bt, i, &val); assert(val == not_found_marker); }
+        printf("  %d of 500 unsynced puts recovered\n", committed);
+        assert(committed == 500 / 8 * 8); /* Every full group, not the open one */
+        BTree_close(&bt);
+        reclaimed = BTree_vacuum(TEST_DB_FILE, NULL);
+        bt = BTree_open(TEST_DB_FILE, TEST_T); check_btree_invariants(&bt); BTree_close(&bt);
+        printf("  vacuum reclaimed %d leaked pages\n", reclaimed);
+
+        printf("Backend %s: uncommitted writes never reach the data file...\n", backend == STORAGE_BACKEND_MMAP ? "mmap" : "stdio");
+        before = test_read_file(TEST_DB_FILE, &before_size);
+        test_crash_child(wal_workload_uncommitted, backend);
+        after = test_read_file(TEST_DB_FILE, &after_size);
+        assert(after_size >= before_size); assert(memcmp(before, after, (size_t)before_size) == 0);
+        free(before); free(after);
+        Storage_set_cache_size(256);
+        bt = BTree_open(TEST_DB_FILE, TEST_T); assert(Storage_get_recovered_group_count(bt.store) == 0);
+        btree_height(&bt);
+        for (i = 0; i < 2000; ++i) { val = not_found_marker; BTree_get(&bt, (i * 7919) % 2000, &val); assert(val == ((i * 7919) % 2000 % 5 ? i : not_found_marker)); }
+        for (i = 5000; i < 5300; ++i) { val = not_found_marker; BTree_get(&bt, i, &val); assert(val == not_found_marker); }
+        BTree_close(&bt);
+        BTree_vacuum(TEST_DB_FILE, NULL);
+        bt = BTree_open(TEST_DB_FILE, TEST_T); check_btree_invariants(&bt); BTree_close(&bt);
+    }
+    Storage_set_backend(STORAGE_BACKEND_STDIO);
+
+    printf("Torn and corrupt log tails are ignored...\n");
+    remove(TEST_DB_FILE); remove(TEST_WAL_FILE);
+    test_crash_child(wal_workload_groups_of_four, 0);
+    log_size = test_file_size(TEST_WAL_FILE); assert(log_size > 0);
+    assert(truncate(TEST_WAL_FILE, (off_t)(log_size * 2 / 3)) == 0); /* Tear a group in the middle */
+    f = fopen(TEST_WAL_FILE, "ab"); assert(f != NULL);
+    for (i = 0; i < 40; ++i) { junk[i] = i == 0 ? 0x57414C31 : (i == 1 ? 2 : rand()); } /* Garbage commit record */
+    assert(fwrite(junk, sizeof(int), 40, f) == 40); fclose(f);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    printf("  %lu of 26 groups replayed\n", Storage_get_recovered_group_count(bt.store));
+    assert(Storage_get_recovered_group_count(bt.store) >= 1 && Storage_get_recovered_group_count(bt.store) < 26);
+    btree_height(&bt);
+    for (i = 0; i < 100; ++i) { val = not_found_marker; BTree_get(&bt, i, &val); if (val == not_found_marker) { break; } assert(val == i + 1); }
+    assert(i == 4 * ((int)Storage_get_recovered_group_count(bt.store) - 1));
+    for (; i < 100; ++i) { val = not_found_marker; BTree_get(&bt, i, &val); assert(val == not_found_marker); }
+    BTree_close(&bt);
+
+    printf("Clean close removes the log, reopen needs no recovery...\n");
+    remove(TEST_DB_FILE); Storage_set_wal(16, 1000);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    for (i = 0; i < 1000; ++i) { BTree_put(&bt, (i * 7919) % 1000, i); }
+    for (i = 0; i < 1000; i += 2) { BTree_delete(&bt, i); }
+    check_btree_invariants(&bt); assert(Storage_get_wal_commit_count(bt.store) > 0 && Storage_get_sync_count(bt.store) >= Storage_get_wal_commit_count(bt.store));
+    BTree_close(&bt); Storage_set_wal(0, 0);
+    assert(test_file_size(TEST_WAL_FILE) == -1);
+    bt = BTree_open(TEST_DB_FILE, TEST_T); assert(Storage_get_recovered_group_count(bt.store) == 0);
+    check_btree_invariants(&bt); /* Free list was saved at close */
+    for (i = 0; i < 1000; ++i) { val = not_found_marker; BTree_get(&bt, (i * 7919) % 1000, &val); assert(val == ((i * 7919) % 1000 % 2 ? i : not_found_marker)); }
+    BTree_close(&bt);
+    printf("Write-Ahead Log Test Passed.\n");
+}
+
+/* Reopens the shadow file, commits 50 operations at a time and crashes */
+static void shadow_workload_crash(int unused) {
+    struct BTree bt; int i; (void)unused;
+    bt = BTree_open(TEST_DB_FILE, TEST_T); /* Version 4 file: shadow-paged whatever is requested */
+    for (i = 0; i < 1000; i += 2) { BTree_delete(&bt, i); }
+    BTree_sync(&bt);
+    for (i = 1000; i < 1175; ++i) { BTree_put(&bt, i, -i); }
+}
+
+void test_shadow_paging() {
+    struct BTree bt; struct BTreeSnapshot *snap; struct BTreeSnapshot *old; struct BTreeCursor *cur;
+    int n = 1000; int i; int k; int v; int val; int not_found_marker = -777; int seen; int pages; int committed;
+    FILE *f; int header[8];
+    printf("--- Test Copy-On-Write Shadow Paging and Snapshots ---\n");
+    remove(TEST_DB_FILE); Storage_set_shadow(1);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    for (i = 0; i < n; ++i) { BTree_put(&bt, (i * 7919) % n, (i * 7919) % n); }
+    check_btree_invariants(&bt);
+    pages = Storage_get_node_count(bt.store);
+    printf("  %d logical pages in %d physical slots\n", pages, Storage_get_physical_page_count(bt.store));
+    assert(Storage_get_retired_page_count(bt.store) == 0); /* No snapshot holds old versions */
+
+    printf("Snapshot scan stays consistent while the live tree changes...\n");
+    snap = BTree_snapshot_open(&bt); cur = BTree_snapshot_cursor_open(snap); seen = 0;
+    while (BTree_cursor_next(cur, &k, &v)) {
+        assert(k == seen && v == seen); seen++;
+        BTree_delete(&bt, k); /* Writer runs between cursor steps */
+        BTree_put(&bt, n + k, k); BTree_put(&bt, (k * 31) % n, -1);
+    }
+    BTree_cursor_close(cur); assert(seen == n);
+    assert(Storage_get_retired_page_count(bt.store) > 0); /* Old version kept for the snapshot */
+    old = snap; snap = BTree_snapshot_open(&bt); /* Second, newer snapshot */
+    for (i = 0; i < n; ++i) {
+        val = not_found_marker; assert(BTree_snapshot_get(old, i, &val) && val == i);
+        val = not_found_marker; BTree_get(&bt, i, &val); assert(val == not_found_marker || val == -1);
+        val = not_found_marker; assert(BTree_snapshot_get(snap, n + i, &val) && val == i);
+    }
+    BTree_snapshot_close(old);
+    BTree_put(&bt, 5 * n, 1);
+    for (i = 0; i < n; ++i) { val = not_found_marker; assert(BTree_snapshot_get(snap, n + i, &val) && val == i); }
+    val = not_found_marker; assert(!BTree_snapshot_get(snap, 5 * n, &val));
+    BTree_snapshot_close(snap);
+    assert(Storage_get_retired_page_count(bt.store) == 0); /* Reclaimed with the last snapshot */
+    check_btree_invariants(&bt);
+    printf("  %d logical pages in %d physical slots after churn\n", Storage_get_node_count(bt.store), Storage_get_physical_page_count(bt.store));
+    pages = Storage_get_physical_page_count(bt.store);
+    for (i = 0; i < n; ++i) { BTree_put(&bt, n + i, i); } /* Churn reuses the released slots */
+    assert(Storage_get_physical_page_count(bt.store) == pages);
+    BTree_close(&bt); Storage_set_shadow(0);
+
+    f = fopen(TEST_DB_FILE, "rb"); assert(f && fread(header, sizeof(int), 8, f) == 8); fclose(f);
+    assert(header[1] == 4 && header[5] != NULL_ADDR && header[6] > 0); /* Version, table root, page count */
+
+    printf("Reopen and vacuum keep the version 4 layout...\n");
+    bt = BTree_open(TEST_DB_FILE, TEST_T); check_btree_invariants(&bt);
+    for (i = 0; i < n; ++i) { val = not_found_marker; BTree_get(&bt, n + i, &val); assert(val == i); }
+    for (i = n; i < 2 * n; i += 2) { BTree_delete(&bt, i); }
+    pages = Storage_get_node_count(bt.store); BTree_close(&bt);
+    printf("  vacuum: %d of %d pages reclaimed\n", BTree_vacuum(TEST_DB_FILE, NULL), pages);
+    bt = BTree_open(TEST_DB_FILE, TEST_T); check_btree_invariants(&bt); assert(Storage_get_free_page_count(bt.store) == 0);
+    for (i = n; i < 2 * n; ++i) { val = not_found_marker; BTree_get(&bt, i, &val); assert(val == (i % 2 ? i - n : not_found_marker)); }
+    for (i = 0; i < n; ++i) { BTree_put(&bt, i, i); }
+    BTree_close(&bt);
+
+    printf("Crash keeps the last committed version...\n");
+    Storage_set_shadow(50); test_crash_child(shadow_workload_crash, 0); Storage_set_shadow(0);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    check_btree_invariants(&bt); /* Free pages come from the table: nothing leaks */
+    for (i = 0; i < n; ++i) { val = not_found_marker; BTree_get(&bt, i, &val); assert(val == (i % 2 ? i : not_found_marker)); }
+    committed = 0;
+    while (committed < 175) { val = not_found_marker; BTree_get(&bt, 1000 + committed, &val); if (val == not_found_marker) { break; } committed++; }
+    printf("  %d of 175 unsynced puts committed\n", committed);
+    for (i = 0; i < committed; ++i) { val = not_found_marker; BTree_get(&bt, 1000 + i, &val); assert(val == -(1000 + i) || (1000 + i) % 2); }
+    assert(committed == 150);
+    BTree_close(&bt);
+    printf("Shadow Paging Test Passed.\n");
+}
+
+/* Uses two trees opened by another thread: each call finds its store through the tree */
+static void* many_trees_worker(void *arg) {
+    struct BTree *trees = arg; int i; int val;
+    for (i = 0; i < 500; ++i) {
+        BTree_put(&trees[0], 2000 + i, i);
+        val = 0; BTree_get(&trees[1], i, &val); assert(val == -i);
+    }
+    return NULL;
+}
+
+void test_many_open_trees() {
+    struct BTree a; struct BTree b; struct BTree pair[2]; pthread_t worker;
+    int i; int val; int not_found_marker = -4242; unsigned long writes_b;
+    printf("--- Test Two Trees Open At Once ---\n");
+    remove(TEST_DB_FILE); remove(TEST_DB_FILE2);
+    a = BTree_open(TEST_DB_FILE, TEST_T); b = BTree_open(TEST_DB_FILE2, TEST_T + 2);
+    assert(a.t == TEST_T && b.t == TEST_T + 2 && a.store != b.store);
+    for (i = 0; i < 500; ++i) { BTree_put(&a, i, i); BTree_put(&b, i, -i); }
+    writes_b = Storage_get_write_count(b.store);
+    for (i = 0; i < 500; i += 2) { BTree_delete(&a, i); }
+    assert(Storage_get_write_count(b.store) == writes_b); /* Counters are per tree */
+    check_btree_invariants(&a); check_btree_invariants(&b);
+    for (i = 0; i < 500; ++i) {
+        val = not_found_marker; BTree_get(&a, i, &val); assert(val == (i % 2 ? i : not_found_marker));
+        val = not_found_marker; BTree_get(&b, i, &val); assert(val == -i);
+    }
+    pair[0] = a; pair[1] = b;
+    assert(pthread_create(&worker, NULL, many_trees_worker, pair) == 0); assert(pthread_join(worker, NULL) == 0);
+    a = pair[0]; /* The worker may have grown the root */
+    for (i = 0; i < 500; ++i) { val = not_found_marker; BTree_get(&a, 2000 + i, &val); assert(val == i); }
+    check_btree_invariants(&a);
+    BTree_close(&a);
+    BTree_put(&b, 1000, 1); check_btree_invariants(&b); /* Closing one leaves the other usable */
+    BTree_close(&b);
+    b = BTree_open(TEST_DB_FILE2, 0); assert(b.t == TEST_T + 2);
+    val = not_found_marker; BTree_get(&b, 499, &val); assert(val == -499);
+    BTree_close(&b); remove(TEST_DB_FILE2);
+    printf("Many Open Trees Test Passed.\n");
+}
+
+/* Checks that every key k in shard file i has owner[k] == i */
+static void check_shard_files(const int *owner, int expected_keys) {
+    struct BTree bt; struct BTreeCursor *cur; char name[64]; int s; int k; int total = 0;
+    for (s = 0; s < TEST_SHARDS; ++s) {
+        sprintf(name, "%s.%d", TEST_SHARD_PREFIX, s);
+        bt = BTree_open(name, TEST_T); check_btree_invariants(&bt);
+        cur = BTree_cursor_open(&bt);
+        while (BTree_cursor_next(cur, &k, NULL)) { assert(k >= 0 && k < expected_keys && owner[k] == s); total++; }
+        BTree_cursor_close(cur); BTree_close(&bt);
+    }
+    assert(total == expected_keys);
+}
+
+static void remove_shard_files(void) {
+    char name[64]; int s;
+    for (s = 0; s < TEST_SHARDS; ++s) { sprintf(name, "%s.%d", TEST_SHARD_PREFIX, s); remove(name); }
+}
+
+void test_sharded_index() {
+    struct BTreeShards *sh; int n = 3000; int *keys; int *values; int *out; int *owner; int i; int mode; int found; int val;
+    int splits[TEST_SHARDS - 1] = { 750, 1500, 2250 }; int not_found_marker = -5151;
+    printf("--- Test Sharded Index (one worker thread per shard) ---\n");
+    keys = malloc(n * sizeof(int)); values = malloc(n * sizeof(int)); out = malloc(n * sizeof(int)); owner = malloc((n + 1) * sizeof(int));
+    assert(keys && values && out && owner);
+    for (mode = 0; mode < 2; ++mode) {
+        printf("%s partitioning...\n", mode == 0 ? "Hash" : "Range");
+        remove_shard_files();
+        sh = BTree_shards_open(TEST_SHARD_PREFIX, TEST_SHARDS, TEST_T, mode == 0 ? NULL : splits);
+        for (i = 0; i < n; ++i) { keys[i] = i; }
+        test_shuffle(keys, n);
+        for (i = 0; i < n; ++i) { values[i] = keys[i] * 3; }
+        for (i = 0; i < n; i += 500) { BTree_shards_put_many(sh, keys + i, values + i, 500); }
+        keys[0] = 7; values[0] = 1; keys[1] = 7; values[1] = 2; /* Last occurrence wins */
+        BTree_shards_put_many(sh, keys, values, 2);
+        BTree_shards_put(sh, n, -1);
+        for (i = 0; i < n; ++i) { keys[i] = n - i; out[i] = not_found_marker; }
+        keys[n - 1] = -10; /* Absent */
+        found = BTree_shards_get_many(sh, keys, out, n);
+        assert(found == n - 1);
+        for (i = 0; i < n - 1; ++i) { assert(out[i] == (keys[i] == n ? -1 : (keys[i] == 7 ? 2 : keys[i] * 3))); }
+        assert(out[n - 1] == not_found_marker);
+        val = not_found_marker; BTree_shards_get(sh, 42, &val); assert(val == 126);
+        BTree_shards_sync(sh); BTree_shards_close(sh);
+        sh = BTree_shards_open(TEST_SHARD_PREFIX, TEST_SHARDS, TEST_T, mode == 0 ? NULL : splits);
+        val = not_found_marker; BTree_shards_get(sh, n, &val); assert(val == -1);
+        for (i = 0; i <= n; ++i) { owner[i] = BTree_shards_shard_of(sh, i); }
+        BTree_shards_close(sh);
+        check_shard_files(owner, n + 1); /* Each key went to its own shard only */
+    }
+    remove_shard_files(); free(keys); free(values); free(out); free(owner);
+    printf("Sharded Index Test Passed.\n");
+}
+
+/* One thread of test_concurrent_access. Writer id owns keys */
+/* [id*K, (id+1)*K); every value ever stored for k is k or -k. */
+struct ConcurrentWorker { pthread_t thread; struct BTree *bt; int id; int bad; };
+
+static void* concurrent_writer(void *arg) {
+    struct ConcurrentWorker *w = arg; int base = w->id * TEST_KEYS_PER_WRITER; int i; int k;
+    int keys[100]; int values[100];
+    for (i = 0; i < TEST_KEYS_PER_WRITER - 100; ++i) { k = base + (i * 11) % (TEST_KEYS_PER_WRITER - 100); BTree_put(w->bt, k, k); }
+    for (i = 0; i < 100; ++i) { keys[i] = base + TEST_KEYS_PER_WRITER - 100 + i; values[i] = keys[i]; }
+    BTree_put_many(w->bt, keys, values, 100);
+    for (i = 0; i < TEST_KEYS_PER_WRITER; i += 3) { BTree_delete(w->bt, base + i); BTree_put(w->bt, base + i + 1, -(base + i + 1)); }
+    return NULL;
+}
+
+static void* concurrent_reader(void *arg) {
+    struct ConcurrentWorker *w = arg; unsigned int seed = 12345u + (unsigned int)w->id; int round; int i; int k; int v;
+    int keys[64]; int values[64]; int total = TEST_WRITERS * TEST_KEYS_PER_WRITER;
+    for (round = 0; round < 300; ++round) { /* rand() is not thread-safe: private LCG */
+        for (i = 0; i < 64; ++i) { seed = seed * 1103515245u + 12345u; keys[i] = (int)((seed >> 8) % (unsigned int)total); values[i] = keys[i]; }
+        (void) BTree_get_many(w->bt, keys, values, 64);
+        for (i = 0; i < 64; ++i) { if (values[i] != keys[i] && values[i] != -keys[i]) { w->bad++; } }
+        k = keys[round % 64]; v = k; BTree_get(w->bt, k, &v);
+        if (v != k && v != -k) { w->bad++; }
+    }
+    return NULL;
+}
+
+/* Writers on disjoint key ranges race readers over the whole tree */
+void test_concurrent_access() {
+    struct BTree bt; struct ConcurrentWorker w[TEST_WRITERS + TEST_READERS]; int mode; int i; int k; int val; int expect;
+    int not_found_marker = -999999;
+    const char *names[4] = { "buffer pool", "mmap", "WAL group commit", "shadow paging" };
+    printf("--- Test Concurrent Readers and Writers (%d + %d threads) ---\n", TEST_WRITERS, TEST_READERS);
+    for (mode = 0; mode < 4; ++mode) {
+        printf("%s...\n", names[mode]);
+        remove(TEST_DB_FILE); remove(TEST_WAL_FILE);
+        if (mode == 0) { Storage_set_cache_size(4); } /* Fewer frames than threads: pins run out and fall back to reads */
+        if (mode == 1) { Storage_set_backend(STORAGE_BACKEND_MMAP); }
+        if (mode == 2) { Storage_set_wal(8, 0); }
+        if (mode == 3) { Storage_set_shadow(4); }
+        bt = BTree_open(TEST_DB_FILE, TEST_T);
+        for (i = 0; i < TEST_WRITERS + TEST_READERS; ++i) {
+            w[i].bt = &bt; w[i].id = i < TEST_WRITERS ? i : i - TEST_WRITERS; w[i].bad = 0;
+            assert(pthread_create(&w[i].thread, NULL, i < TEST_WRITERS ? concurrent_writer : concurrent_reader, &w[i]) == 0);
+        }
+        for (i = 0; i < TEST_WRITERS + TEST_READERS; ++i) { pthread_join(w[i].thread, NULL); assert(w[i].bad == 0); }
+        check_btree_invariants(&bt);
+        for (k = 0; k < TEST_WRITERS * TEST_KEYS_PER_WRITER; ++k) {
+            i = k % TEST_KEYS_PER_WRITER; expect = i % 3 == 0 ? not_found_marker : (i % 3 == 1 ? -k : k);
+            val = not_found_marker; BTree_get(&bt, k, &val); assert(val == expect);
+        }
+        BTree_close(&bt);
+        Storage_set_cache_size(256); Storage_set_backend(STORAGE_BACKEND_STDIO); Storage_set_wal(0, 0); Storage_set_shadow(0);
+    }
+    remove(TEST_WAL_FILE);
+    printf("Concurrent Access Test Passed.\n");
+}
+
+/* Checks a B+tree scan against the model: keys arrive in order, none skipped */
+struct BPTScanCheck { const int *model; int next; int count; };
+
+static int bpt_scan_cb(int k, int v, void *ctx) {
+    struct BPTScanCheck *chk = ctx;
+    while (chk->model[chk->next] == INT_MIN) { chk->next++; }
+    assert(k == chk->next); assert(v == chk->model[k]);
+    chk->next++; chk->count++;
+    return 0;
+}
+
+void test_bplus_tree() {
+    struct BPTree bt; struct BTree clrs; struct BPTScanCheck chk; int *model; int m = 3000; int i; int k; int v; int op;
+    int live = 0; int keys; int height; int lo; int hi; int count; unsigned long reads; int not_found_marker = -4242;
+    printf("--- Test B+tree (leaf-only values, linked leaves) ---\n");
+    remove(TEST_DB_FILE); model = malloc((m + 1) * sizeof(int)); assert(model);
+    for (i = 0; i <= m; ++i) { model[i] = INT_MIN; } /* model[m] stays absent: stops scan checks */
+    bt = BPTree_open(TEST_DB_FILE, TEST_T); assert(bt.t == TEST_T);
+
+    printf("Random puts and deletes against a model...\n");
+    for (op = 0; op < 20000; ++op) {
+        k = rand() % m;
+        if (op < 4000 || rand() % 3 != 0) { v = rand(); BPTree_put(&bt, k, v); if (model[k] == INT_MIN) { live++; } model[k] = v; }
+        else { BPTree_delete(&bt, k); if (model[k] != INT_MIN) { live--; } model[k] = INT_MIN; }
+        if (op % 2500 == 0) { check_bptree_invariants(&bt, &keys); assert(keys == live); }
+    }
+    height = check_bptree_invariants(&bt, &keys); assert(keys == live);
+    for (k = -1; k <= m; ++k) {
+        v = not_found_marker; BPTree_get(&bt, k, &v);
+        assert(v == (k >= 0 && k < m && model[k] != INT_MIN ? model[k] : not_found_marker));
+    }
+    printf("  %d keys, height %d, %d pages (%d leaves)\n", live, height, g_bpt_pages, g_bpt_leaves);
+
+    printf("Range scans follow the leaf chain...\n");
+    for (lo = -5; lo < m; lo += 173) {
+        hi = lo + 250; chk.model = model; chk.next = lo < 0 ? 0 : lo; chk.count = 0;
+        count = BPTree_scan(&bt, lo, hi, bpt_scan_cb, &chk); assert(count == chk.count);
+        for (k = chk.next; k <= hi && k < m; ++k) { assert(model[k] == INT_MIN); } /* Nothing in range was missed */
+    }
+    assert(BPTree_scan(&bt, 10, 5, bpt_scan_cb, &chk) == 0);
+    reads = Storage_get_read_count(bt.store); chk.next = 0; chk.count = 0;
+    assert(BPTree_scan(&bt, INT_MIN, INT_MAX, bpt_scan_cb, &chk) == live);
+    reads = Storage_get_read_count(bt.store) - reads;
+    printf("  Full scan: %lu reads (%d inner pages on the path + %d leaves)\n", reads, height - 1, g_bpt_leaves);
+    assert(reads == (unsigned long)(height - 1 + g_bpt_leaves)); /* One descent, then each leaf once */
+
+    printf("Reopen keeps the tree...\n");
+    BPTree_close(&bt); bt = BPTree_open(TEST_DB_FILE, 0); assert(bt.t == TEST_T);
+    check_bptree_invariants(&bt, &keys); assert(keys == live);
+
+    printf("Deleting every key leaves an empty root leaf...\n");
+    for (k = 0; k < m; ++k) { BPTree_delete(&bt, k); model[k] = INT_MIN; }
+    height = check_bptree_invariants(&bt, &keys); assert(keys == 0 && height == 1 && g_bpt_pages == 1);
+    BPTree_close(&bt);
+
+    printf("Fanout against the CLRS layout (sequential keys, same t)...\n");
+    remove(TEST_DB_FILE); remove(TEST_DB_FILE2);
+    bt = BPTree_open(TEST_DB_FILE, TEST_T); clrs = BTree_open(TEST_DB_FILE2, TEST_T);
+    for (k = 0; k < m; ++k) { BPTree_put(&bt, k, k); BTree_put(&clrs, k, k); }
+    height = check_bptree_invariants(&bt, NULL); check_btree_invariants(&clrs);
+    printf("  B+tree: height %d, %d pages; B-tree: height %d, %d pages\n", height, g_bpt_pages, btree_height(&clrs), g_checked_nodes);
+    assert(height <= btree_height(&clrs)); assert(g_bpt_pages < g_checked_nodes);
+    BPTree_close(&bt); BTree_close(&clrs); remove(TEST_DB_FILE2);
+    free(model); printf("B+tree Test Passed.\n");
+}
+
+/* Puts keys 0..n-1 into a new file and reads them back after a reopen; */
+/* returns the bytes written and sets *read_bytes (cache off: every access is I/O) */
+static unsigned long compressed_io_run(int compress, int t, int n, unsigned long *read_bytes) {
+    struct BTree bt; int k; int v; unsigned long written;
+    remove(TEST_DB_FILE2); Storage_set_compression(compress);
+    bt = BTree_open(TEST_DB_FILE2, t);
+    for (k = 0; k < n; ++k) { BTree_put(&bt, k, 1000000 + 7 * k); }
+    written = Storage_get_io_write_bytes(bt.store);
+    BTree_close(&bt); bt = BTree_open(TEST_DB_FILE2, 0); assert(Storage_is_compressed(bt.store) == compress);
+    for (k = 0; k < n; ++k) { v = -1; BTree_get(&bt, k, &v); assert(v == 1000000 + 7 * k); }
+    *read_bytes = Storage_get_io_read_bytes(bt.store);
+    BTree_close(&bt); remove(TEST_DB_FILE2);
+    return written;
+}
+
+void test_compressed_nodes() {
+    struct BTree bt; struct BPTree bpt; int m = 2001; int *keys; int *model; int i; int op; int v; int not_found_marker = 4242;
+    unsigned long plain_w; unsigned long plain_r; unsigned long packed_w; unsigned long packed_r;
+    printf("--- Test Compressed Node Encoding ---\n");
+    keys = malloc(m * sizeof(int)); model = malloc(m * sizeof(int)); assert(keys && model);
+    for (i = 0; i < m - 1; ++i) { keys[i] = (int)((long)INT_MIN + (long)i * 2147483L); model[i] = not_found_marker; }
+    keys[m - 1] = INT_MAX; model[m - 1] = not_found_marker; /* Gaps up to the whole int range */
+
+    printf("Random puts and deletes across the int range...\n");
+    remove(TEST_DB_FILE); Storage_set_compression(1); Storage_set_cache_size(8);
+    bt = BTree_open(TEST_DB_FILE, TEST_T); assert(Storage_is_compressed(bt.store));
+    for (op = 0; op < 8000; ++op) {
+        i = rand() % m;
+        if (op < 2000 || rand() % 3 != 0) { v = rand() % 3 == 0 ? INT_MIN : rand() - RAND_MAX / 2; BTree_put(&bt, keys[i], v); model[i] = v; }
+        else { BTree_delete(&bt, keys[i]); model[i] = not_found_marker; }
+    }
+    check_btree_invariants(&bt);
+    Storage_set_compression(0); /* Existing files keep their format */
+    BTree_close(&bt); bt = BTree_open(TEST_DB_FILE, 0); assert(Storage_is_compressed(bt.store));
+    check_btree_invariants(&bt);
+    for (i = 0; i < m; ++i) { v = not_found_marker; BTree_get(&bt, keys[i], &v); assert(v == model[i]); }
+    BTree_close(&bt);
+
+    printf("Sequential IDs, t=64: bytes moved with and without encoding...\n");
+    Storage_set_cache_size(0);
+    plain_w = compressed_io_run(0, 64, 20000, &plain_r);
+    packed_w = compressed_io_run(1, 64, 20000, &packed_r);
+    printf("  Written: %lu plain, %lu encoded; read back: %lu plain, %lu encoded\n", plain_w, packed_w, plain_r, packed_r);
+    assert(packed_w * 2 < plain_w); assert(packed_r * 2 < plain_r);
+
+    printf("B+tree pages and the WAL on a compressed file...\n");
+    remove(TEST_DB_FILE); Storage_set_compression(1); Storage_set_cache_size(256); Storage_set_wal(4, 0);
+    bpt = BPTree_open(TEST_DB_FILE, TEST_T); /* Not B-tree pages: stored plain */
+    for (i = 0; i < 500; ++i) { BPTree_put(&bpt, i * 3, -i); }
+    BPTree_close(&bpt); bpt = BPTree_open(TEST_DB_FILE, 0);
+    for (i = 0; i < 500; ++i) { v = 0; BPTree_get(&bpt, i * 3, &v); assert(v == -i); }
+    check_bptree_invariants(&bpt, &op); assert(op == 500);
+    BPTree_close(&bpt); remove(TEST_DB_FILE);
+    Storage_set_wal(0, 0); Storage_set_compression(0);
+    free(keys); free(model);
+    printf("Compressed Node Encoding Test Passed.\n");
+}
+
+static int prefetch_order_cb(int k, int v, void *ctx) { int *next = ctx; assert(k == *next); (void) v; ++*next; return 0; }
+
+/* Full scan with the given prefetch depth; returns the keys seen */
+static int prefetch_scan(int backend, int depth, unsigned long *hints, unsigned long *hits, unsigned long *misses) {
+    struct BTree bt; int next = 0; int count;
+    Storage_set_backend(backend); Storage_set_prefetch(depth);
+    bt = BTree_open(TEST_DB_FILE, 0);
+    count = BTree_scan(&bt, INT_MIN, INT_MAX, prefetch_order_cb, &next); assert(count == next);
+    *hints = Storage_get_prefetch_count(bt.store); *hits = Storage_get_prefetch_hit_count(bt.store);
+    *misses = backend == STORAGE_BACKEND_MMAP ? Storage_get_read_count(bt.store) : Storage_get_cache_miss_count(bt.store);
+    BTree_close(&bt);
+    Storage_set_backend(STORAGE_BACKEND_STDIO); Storage_set_prefetch(0);
+    return count;
+}
+
+void test_prefetch() {
+    struct BTree bt; struct BTreeCursor *cur; struct BTreeSnapshot *snap; int n = 4000; int i; int k; int v; int backend; unsigned long hints; unsigned long hits; unsigned long misses;
+    printf("--- Test Child Prefetch During Ordered Traversal ---\n");
+    remove(TEST_DB_FILE); Storage_set_cache_size(16); /* Small pool: a scan misses on every page */
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    for (i = 0; i < n; ++i) { BTree_put(&bt, (i * 7919) % n, i); }
+    BTree_close(&bt);
+
+    printf("Prefetch off issues no hints...\n");
+    assert(prefetch_scan(STORAGE_BACKEND_STDIO, 0, &hints, &hits, &misses) == n); assert(hints == 0 && hits == 0);
+    for (backend = STORAGE_BACKEND_STDIO; backend <= STORAGE_BACKEND_MMAP; ++backend) {
+        printf("Depth 8, %s: full scan...\n", backend == STORAGE_BACKEND_MMAP ? "mmap" : "buffer pool");
+        assert(prefetch_scan(backend, 8, &hints, &hits, &misses) == n);
+        printf("  %lu pages fetched, %lu hinted, %lu of them hits\n", misses, hints, hits);
+        assert(hits > 0 && hits <= hints && hits <= misses);
+        assert(hits * 10 >= misses * 6); /* Every child but the first of each node is hinted before it is read */
+    }
+
+    printf("Seek, snapshot cursor and the invariant checker hint too...\n");
+    Storage_set_prefetch(4); bt = BTree_open(TEST_DB_FILE, 0);
+    cur = BTree_cursor_open(&bt); BTree_cursor_seek(cur, n / 2);
+    for (i = n / 2; i < n; ++i) { assert(BTree_cursor_next(cur, &k, &v) && k == i); }
+    assert(!BTree_cursor_next(cur, &k, &v)); BTree_cursor_close(cur);
+    hints = Storage_get_prefetch_count(bt.store); assert(hints > 0);
+    check_btree_invariants(&bt); assert(Storage_get_prefetch_count(bt.store) > hints);
+    BTree_close(&bt);
+    remove(TEST_DB_FILE); Storage_set_shadow(4);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    for (i = 0; i < n; ++i) { BTree_put(&bt, i, i); }
+    snap = BTree_snapshot_open(&bt);
+    for (i = 0; i < n; i += 2) { BTree_delete(&bt, i); } /* The snapshot still holds them */
+    cur = BTree_snapshot_cursor_open(snap); hints = Storage_get_prefetch_count(bt.store);
+    for (i = 0; i < n; ++i) { assert(BTree_cursor_next(cur, &k, &v) && k == i); }
+    assert(!BTree_cursor_next(cur, &k, &v)); BTree_cursor_close(cur); BTree_snapshot_close(snap);
+    assert(Storage_get_prefetch_count(bt.store) > hints);
+    BTree_close(&bt); Storage_set_shadow(0); Storage_set_prefetch(0); Storage_set_cache_size(256);
+    printf("Prefetch Test Passed.\n");
+}
+
+/* Gets 0..2n-1, where the even keys not divisible by del (0 = none) hold */
+/* k + 1 and the rest are absent; returns the lookups the filter skipped */
+static unsigned long bloom_lookups(const struct BTree *bt, int n, int del) {
+    int k; int val; unsigned long before = Storage_get_bloom_skip_count(bt->store);
+    for (k = 0; k < 2 * n; ++k) {
+        val = -777; BTree_get(bt, k, &val);
+        assert(val == (k % 2 == 0 && (del == 0 || k % del != 0) ? k + 1 : -777));
+    }
+    return Storage_get_bloom_skip_count(bt->store) - before;
+}
+
+/* Puts odd keys from base with a commit per put, then crashes */
+static void bloom_workload_crash(int base) {
+    struct BTree bt; int k;
+    Storage_set_bloom(10); Storage_set_wal(1, 0);
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    for (k = base + 1; k < base + 200; k += 2) { BTree_put(&bt, k, k + 1); }
+}
+
+void test_bloom_filter() {
+    struct BTree bt; int n = 3000; int i; int k; int val; int found; unsigned long skips; unsigned long vacuumed;
+    int keys[64]; int vals[64]; int *sorted = NULL; int *sorted_vals = NULL;
+    printf("--- Test Key Filter (Bloom) ---\n");
+    remove(TEST_DB_FILE); remove(TEST_BLOOM_FILE); Storage_set_bloom(10);
+    bt = BTree_open(TEST_DB_FILE, TEST_T); assert(Storage_get_bloom_bytes(bt.store) > 0);
+    for (i = 0; i < n; ++i) { k = 2 * ((i * 7919) % n); BTree_put(&bt, k, k + 1); }
+    assert(Storage_bloom_needs_rebuild(bt.store)); /* Sized for a new file's first 1024 keys */
+    BTree_close(&bt); assert(test_file_size(TEST_BLOOM_FILE) > 0);
+
+    printf("Reopen rebuilds the outgrown filter; absent keys skip the descent...\n");
+    bt = BTree_open(TEST_DB_FILE, 0); assert(!Storage_bloom_needs_rebuild(bt.store));
+    skips = bloom_lookups(&bt, n, 0);
+    printf("  %lu of %d absent keys skipped (%lu checks)\n", skips, n, Storage_get_bloom_check_count(bt.store));
+    assert(skips <= (unsigned long)n && skips * 100 >= (unsigned long)n * 97);
+    for (i = 0; i < 64; ++i) { keys[i] = i; vals[i] = -777; }
+    skips = Storage_get_bloom_skip_count(bt.store);
+    found = BTree_get_many(&bt, keys, vals, 64); assert(found == 32);
+    for (i = 0; i < 64; ++i) { assert(vals[i] == (i % 2 == 0 ? i + 1 : -777)); }
+    assert(Storage_get_bloom_skip_count(bt.store) - skips >= 28);
+    BTree_close(&bt);
+
+    printf("A clean filter is loaded, not rebuilt...\n");
+    bt = BTree_open(TEST_DB_FILE, 0); assert(Storage_get_read_count(bt.store) <= 1);
+    assert(bloom_lookups(&bt, n, 0) * 100 >= (unsigned long)n * 97);
+    BTree_close(&bt);
+
+    printf("A crash leaves it dirty: the next open rebuilds it...\n");
+    test_crash_child(bloom_workload_crash, 2 * n);
+    bt = BTree_open(TEST_DB_FILE, 0); assert(Storage_get_recovered_group_count(bt.store) > 0);
+    assert(Storage_get_read_count(bt.store) > (unsigned long)Storage_get_node_count(bt.store) / 2);
+    for (k = 2 * n + 1; k < 2 * n + 200; k += 2) { val = -777; BTree_get(&bt, k, &val); assert(val == k + 1); }
+    BTree_close(&bt);
+
+    printf("Writes with the filter off invalidate it...\n");
+    Storage_set_bloom(0);
+    bt = BTree_open(TEST_DB_FILE, 0); assert(Storage_get_bloom_bytes(bt.store) == 0);
+    BTree_put(&bt, 4 * n + 1, 1); assert(bloom_lookups(&bt, n, 0) == 0);
+    BTree_close(&bt);
+    Storage_set_bloom(10);
+    bt = BTree_open(TEST_DB_FILE, 0); val = -777; BTree_get(&bt, 4 * n + 1, &val); assert(val == 1);
+
+    printf("Deleted keys stay in the filter until vacuum rebuilds it...\n");
+    for (k = 0; k < 2 * n; k += 4) { BTree_delete(&bt, k); }
+    skips = bloom_lookups(&bt, n, 4);
+    BTree_close(&bt);
+    BTree_vacuum(TEST_DB_FILE, NULL);
+    bt = BTree_open(TEST_DB_FILE, 0); assert(Storage_get_read_count(bt.store) <= 1);
+    vacuumed = bloom_lookups(&bt, n, 4); check_btree_invariants(&bt);
+    printf("  %lu lookups skipped before vacuum, %lu after\n", skips, vacuumed);
+    assert(vacuumed >= skips + (unsigned long)n / 2 * 97 / 100);
+    BTree_close(&bt);
+
+    printf("Bulk load builds it...\n");
+    sorted = malloc(n * sizeof(int)); sorted_vals = malloc(n * sizeof(int)); assert(sorted && sorted_vals);
+    for (i = 0; i < n; ++i) { sorted[i] = 2 * i; sorted_vals[i] = 2 * i + 1; }
+    remove(TEST_DB_FILE);
+    bt = BTree_bulk_load(TEST_DB_FILE, TEST_T, 100, sorted, sorted_vals, n);
+    assert(!Storage_bloom_needs_rebuild(bt.store));
+    assert(bloom_lookups(&bt, n, 0) * 100 >= (unsigned long)n * 97);
+    assert(BTree_bloom_rebuild(&bt) == n);
+    BTree_close(&bt); free(sorted); free(sorted_vals);
+    Storage_set_bloom(0); remove(TEST_BLOOM_FILE);
+    printf("Key Filter Test Passed.\n");
+}
+
+/* Key of id for the string-key tests: shared prefixes, tails of 0..44 bytes, id order = key order */
+static int vt_test_key(int id, unsigned char *buf) {
+    const char *tails[4] = { "", "orders", "address/billing", "profile/preferences/notifications" };
+    int len = sprintf((char *)buf, "customer/%06d/%s", id, tails[id % 4]);
+    while (id % 5 == 0 && len < 16 + id % 45) { buf[len++] = 'x'; }
+    return len;
+}
+
+/* Checks a string-key scan against the model, as bpt_scan_cb */
+static int vt_scan_cb(const unsigned char *key, int len, int v, void *ctx) {
+    struct BPTScanCheck *chk = ctx; unsigned char expect[128]; int elen;
+    while (chk->model[chk->next] == INT_MIN) { chk->next++; }
+    elen = vt_test_key(chk->next, expect);
+    assert(len == elen && memcmp(key, expect, len) == 0); assert(v == chk->model[chk->next]);
+    chk->next++; chk->count++;
+    return 0;
+}
+
+void test_string_keys() {
+    struct VTree vt; struct BPTScanCheck chk; int *model; int m = 3000; int i; int k; int v; int op; int live = 0; int keys; int height;
+    int lo; int hi; int count; int len; int hilen; unsigned char key[128]; unsigned char hikey[128]; unsigned char *big; int maxlen; unsigned char *longs; int *longlen;
+    const unsigned char binary[6] = { 'a', 0, 'b', 0, 0, 'c' };
+    printf("--- Test Variable-Length String Keys (slotted pages) ---\n");
+    remove(TEST_DB_FILE); model = malloc((m + 1) * sizeof(int)); assert(model);
+    for (i = 0; i <= m; ++i) { model[i] = INT_MIN; }
+    vt = VTree_open(TEST_DB_FILE, TEST_VT_T); assert(vt.t == TEST_VT_T);
+
+    printf("Random puts and deletes against a model...\n");
+    for (op = 0; op < 20000; ++op) {
+        k = rand() % m; len = vt_test_key(k, key);
+        if (op < 4000 || rand() % 3 != 0) { v = rand(); VTree_put(&vt, key, len, v); if (model[k] == INT_MIN) { live++; } model[k] = v; }
+        else { assert(VTree_delete(&vt, key, len) == (model[k] != INT_MIN)); if (model[k] != INT_MIN) { live--; } model[k] = INT_MIN; }
+        if (op % 2500 == 0) { check_vtree_invariants(&vt, &keys); assert(keys == live); }
+    }
+    height = check_vtree_invariants(&vt, &keys); assert(keys == live);
+    for (k = 0; k < m; ++k) {
+        len = vt_test_key(k, key); v = -1;
+        assert(VTree_get(&vt, key, len, &v) == (model[k] != INT_MIN)); assert(model[k] == INT_MIN || v == model[k]);
+        assert(!VTree_get(&vt, key, len - 1, &v)); /* Proper prefixes of a key are other keys */
+    }
+    printf("  %d keys, height %d, %d pages\n", live, height, g_vt_pages);
+    printf("  Leaf key bytes: %ld raw, %ld stored with page prefixes\n", g_vt_raw_bytes, g_vt_stored_bytes);
+    printf("  Separators: %.1f bytes on average vs %.1f per key\n", (double)g_vt_sep_bytes / g_vt_seps, (double)g_vt_raw_bytes / live);
+    assert(g_vt_stored_bytes < g_vt_raw_bytes * 3 / 4);                       /* Prefix compression pays */
+    assert(g_vt_sep_bytes * live < g_vt_raw_bytes * (long)g_vt_seps);         /* Separators are shortened */
+
+    printf("Range scans follow the leaf chain...\n");
+    for (lo = 0; lo < m; lo += 173) {
+        hi = lo + 250 < m ? lo + 250 : m - 1;
+        len = vt_test_key(lo, key); hilen = vt_test_key(hi, hikey);
+        chk.model = model; chk.next = lo; chk.count = 0;
+        count = VTree_scan(&vt, key, len, hikey, hilen, vt_scan_cb, &chk); assert(count == chk.count);
+        for (k = chk.next; k <= hi; ++k) { assert(model[k] == INT_MIN); } /* Nothing in range was missed */
+    }
+    chk.next = 0; chk.count = 0;
+    assert(VTree_scan(&vt, NULL, 0, NULL, 0, vt_scan_cb, &chk) == live);
+    assert(VTree_scan(&vt, hikey, hilen, key, len, vt_scan_cb, &chk) == 0);
+    chk.next = 0; chk.count = 0; /* Bounds need not be keys: "customer/" precedes them all */
+    assert(VTree_scan(&vt, "customer/", 9, "customer0", 9, vt_scan_cb, &chk) == live);
+
+    printf("Empty, binary and maximum-length keys...\n");
+    maxlen = VTree_max_key_len(&vt); big = malloc(maxlen); assert(big);
+    for (i = 0; i < maxlen; ++i) { big[i] = (unsigned char)(255 - i % 7); }
+    VTree_put(&vt, "", 0, 11); VTree_put(&vt, binary, 6, 12); VTree_put(&vt, binary, 2, 13); VTree_put(&vt, big, maxlen, 14);
+    v = 0; assert(VTree_get(&vt, "", 0, &v) && v == 11);
+    v = 0; assert(VTree_get(&vt, binary, 6, &v) && v == 12);
+    v = 0; assert(VTree_get(&vt, binary, 2, &v) && v == 13);
+    v = 0; assert(VTree_get(&vt, big, maxlen, &v) && v == 14);
+    assert(!VTree_get(&vt, binary, 1, &v) && !VTree_get(&vt, big, maxlen - 1, &v));
+    check_vtree_invariants(&vt, &keys); assert(keys == live + 4);
+    assert(VTree_delete(&vt, "", 0) && VTree_delete(&vt, binary, 6) && VTree_delete(&vt, binary, 2) && VTree_delete(&vt, big, maxlen));
+    assert(!VTree_delete(&vt, "", 0));
+
+    printf("Long keys over a two-letter alphabet (deep shared prefixes)...\n");
+    longs = malloc(TEST_VT_LONG * (size_t)maxlen); longlen = malloc(TEST_VT_LONG * sizeof(int)); assert(longs && longlen);
+    for (i = 0; i < TEST_VT_LONG; ++i) {
+        longlen[i] = rand() % (maxlen + 1);
+        for (k = 0; k < longlen[i]; ++k) { longs[i * maxlen + k] = rand() % 8 == 0 ? 'b' : 'a'; }
+        VTree_put(&vt, longs + i * maxlen, longlen[i], m + i);
+        if (i % 300 == 0) { check_vtree_invariants(&vt, NULL); }
+    }
+    check_vtree_invariants(&vt, &keys);
+    for (i = 0; i < TEST_VT_LONG; ++i) { /* A repeated key holds the value of its last put */
+        for (k = TEST_VT_LONG - 1; longlen[k] != longlen[i] || memcmp(longs + k * maxlen, longs + i * maxlen, longlen[i]) != 0; --k) { }
+        assert(VTree_get(&vt, longs + i * maxlen, longlen[i], &v) && v == m + k);
+        if (k == i) { keys--; }
+    }
+    assert(keys == live);
+    for (i = 0; i < TEST_VT_LONG; ++i) { (void) VTree_delete(&vt, longs + i * maxlen, longlen[i]); }
+    check_vtree_invariants(&vt, &keys); assert(keys == live);
+    free(longs); free(longlen);
+    free(big);
+
+    printf("Reopen keeps the tree...\n");
+    VTree_close(&vt); vt = VTree_open(TEST_DB_FILE, 0); assert(vt.t == TEST_VT_T);
+    check_vtree_invariants(&vt, &keys); assert(keys == live);
+
+    printf("Deleting every key leaves an empty root leaf...\n");
+    for (k = 0; k < m; ++k) { len = vt_test_key(k, key); (void) VTree_delete(&vt, key, len); model[k] = INT_MIN; }
+    height = check_vtree_invariants(&vt, &keys); assert(keys == 0 && height == 1 && g_vt_pages == 1);
+    VTree_close(&vt);
+    free(model); printf("String Keys Test Passed.\n");
+}
+
+/* Random puts into a new file with a small cache; returns bytes written per put */
+static double betree_ingest_bytes(int betree, int t, int n) {
+    struct BTree bt; struct BETree be; int i; unsigned long bytes;
+    remove(TEST_DB_FILE2); Storage_set_cache_size(16);
+    if (betree) { be = BETree_open(TEST_DB_FILE2, t); for (i = 0; i < n; ++i) { BETree_put(&be, rand(), i); } bytes = Storage_get_io_write_bytes(be.store); BETree_close(&be); }
+    else { bt = BTree_open(TEST_DB_FILE2, t); for (i = 0; i < n; ++i) { BTree_put(&bt, rand(), i); } bytes = Storage_get_io_write_bytes(bt.store); BTree_close(&bt); }
+    Storage_set_cache_size(256); remove(TEST_DB_FILE2);
+    return (double)bytes / n;
+}
+
+void test_betree() {
+    struct BETree bt; struct BPTScanCheck chk; int *model; int m = 3000; int i; int k; int v; int op; int t;
+    int live = 0; int height; int lo; int hi; int count; int not_found_marker = -4242; double plain; double buffered;
+    printf("--- Test B-epsilon Tree (buffered inner pages) ---\n");
+    model = malloc((m + 1) * sizeof(int)); assert(model);
+    for (t = 2; t <= 6; t += 4) {
+        printf("Random puts and deletes against a model (t=%d)...\n", t);
+        remove(TEST_DB_FILE); live = 0;
+        for (i = 0; i <= m; ++i) { model[i] = INT_MIN; } /* model[m] stays absent: stops scan checks */
+        bt = BETree_open(TEST_DB_FILE, t); assert(bt.t == t);
+        for (op = 0; op < 30000; ++op) {
+            k = rand() % m;
+            if (op < 5000 || rand() % 3 != 0) { v = rand(); BETree_put(&bt, k, v); if (model[k] == INT_MIN) { live++; } model[k] = v; }
+            else { BETree_delete(&bt, k); if (model[k] != INT_MIN) { live--; } model[k] = INT_MIN; }
+            if (op % 3000 == 0) { check_betree_invariants(&bt); }
+        }
+        height = check_betree_invariants(&bt);
+        for (k = -1; k <= m; ++k) {
+            v = not_found_marker; BETree_get(&bt, k, &v);
+            assert(v == (k >= 0 && k < m && model[k] != INT_MIN ? model[k] : not_found_marker));
+        }
+        printf("  %d keys, height %d, %d pages, %d messages buffered\n", live, height, g_bet_pages, g_bet_messages);
+        assert(g_bet_messages > 0); /* Updates wait in the buffers */
+
+        printf("Range scans merge buffered messages...\n");
+        for (lo = -5; lo < m; lo += 173) {
+            hi = lo + 250; chk.model = model; chk.next = lo < 0 ? 0 : lo; chk.count = 0;
+            count = BETree_scan(&bt, lo, hi, bpt_scan_cb, &chk); assert(count == chk.count);
+            for (k = chk.next; k <= hi && k < m; ++k) { assert(model[k] == INT_MIN); } /* Nothing in range was missed */
+        }
+        assert(BETree_scan(&bt, 10, 5, bpt_scan_cb, &chk) == 0);
+        chk.next = 0; chk.count = 0; assert(BETree_scan(&bt, INT_MIN, INT_MAX, bpt_scan_cb, &chk) == live);
+
+        printf("Reopen keeps the tree and its buffers...\n");
+        BETree_sync(&bt); BETree_close(&bt); bt = BETree_open(TEST_DB_FILE, 0); assert(bt.t == t);
+        check_betree_invariants(&bt);
+        for (k = 0; k < m; ++k) { v = not_found_marker; BETree_get(&bt, k, &v); assert(v == (model[k] != INT_MIN ? model[k] : not_found_marker)); }
+
+        printf("Deleting every key...\n");
+        for (k = 0; k < m; ++k) { BETree_delete(&bt, k); model[k] = INT_MIN; }
+        check_betree_invariants(&bt);
+        for (k = 0; k < m; ++k) { v = not_found_marker; BETree_get(&bt, k, &v); assert(v == not_found_marker); }
+        chk.next = 0; chk.count = 0; assert(BETree_scan(&bt, INT_MIN, INT_MAX, bpt_scan_cb, &chk) == 0);
+        BETree_close(&bt);
+    }
+
+    printf("Random ingest writes less than the B-tree (t=32, 16-frame cache)...\n");
+    plain = betree_ingest_bytes(0, 32, 40000); buffered = betree_ingest_bytes(1, 32, 40000);
+    printf("  B-tree: %.0f bytes/put; B-epsilon tree: %.0f bytes/put\n", plain, buffered);
+    assert(buffered < plain);
+    remove(TEST_DB_FILE); free(model); printf("B-epsilon Tree Test Passed.\n");
+}
+
+void test_memtable() {
+    struct BTree bt; struct BTreeMemtable *mt; int *model; int m = 4000; int i; int k; int v; int op; int not_found_marker = -4242;
+    unsigned long writes;
+    printf("--- Test Memtable Front-End ---\n");
+    remove(TEST_DB_FILE); model = malloc(m * sizeof(int)); assert(model);
+    for (i = 0; i < m; ++i) { model[i] = INT_MIN; }
+    bt = BTree_open(TEST_DB_FILE, TEST_T);
+    for (k = 0; k < m; k += 2) { BTree_put(&bt, k, k); model[k] = k; } /* Older values already in the tree */
+
+    printf("Random puts, deletes and gets while tables flush in the background...\n");
+    mt = BTree_memtable_open(&bt, 300);
+    for (op = 0; op < 40000; ++op) {
+        k = rand() % m;
+        if (op % 4 == 0) { v = not_found_marker; BTree_memtable_get(mt, k, &v); assert(v == (model[k] != INT_MIN ? model[k] : not_found_marker)); }
+        else if (rand() % 3 != 0) { v = rand() % 1000000; BTree_memtable_put(mt, k, v); model[k] = v; }
+        else { BTree_memtable_delete(mt, k); model[k] = INT_MIN; }
+        assert(BTree_memtable_size(mt) <= 600);
+    }
+    printf("  %lu tables written to the tree\n", BTree_memtable_flush_count(mt));
+    assert(BTree_memtable_flush_count(mt) > 10);
+
+    printf("Flush puts every buffered write in the tree...\n");
+    BTree_memtable_flush(mt); assert(BTree_memtable_size(mt) == 0);
+    check_btree_invariants(&bt);
+    for (k = 0; k < m; ++k) { v = not_found_marker; BTree_get(&bt, k, &v); assert(v == (model[k] != INT_MIN ? model[k] : not_found_marker)); }
+
+    printf("Writes stay in memory until the table fills...\n");
+    writes = Storage_get_write_count(bt.store);
+    for (k = 0; k < 100; ++k) { BTree_memtable_put(mt, k, -k); model[k] = -k; }
+    assert(Storage_get_write_count(bt.store) == writes && BTree_memtable_size(mt) == 100);
+    for (k = 0; k < 100; ++k) { v = not_found_marker; BTree_memtable_get(mt, k, &v); assert(v == -k); }
+    BTree_memtable_close(mt); /* Flushes */
+    assert(Storage_get_write_count(bt.store) > writes);
+
+    printf("Reopen sees the flushed writes...\n");
+    BTree_sync(&bt); BTree_close(&bt); bt = BTree_open(TEST_DB_FILE, 0);
+    for (k = 0; k < m; ++k) { v = not_found_marker; BTree_get(&bt, k, &v); assert(v == (model[k] != INT_MIN ? model[k] : not_found_marker)); }
+    BTree_close(&bt); remove(TEST_DB_FILE);
+    free(model); printf("Memtable Test Passed.\n");
+}
+
 int main() {
     /* Seed random number generator ONCE */
     srand((unsigned int)time(NULL));
@@ -264,6 +1812,29 @@ int main() {
     test_node_split(); printf("\n");
     test_random_inserts_and_queries(); printf("\n");
     test_delete_and_update(); printf("\n");
+    test_delete_heavy(); printf("\n");
+    test_single_descent_put(); printf("\n");
+    test_bulk_load(); printf("\n");
+    test_cursor_and_scan(); printf("\n");
+    test_get_many(); printf("\n");
+    test_put_many(); printf("\n");
+    test_buffer_pool(); printf("\n");
+    test_mmap_backend(); printf("\n");
+    test_free_list_and_vacuum(); printf("\n");
+    test_search_kernels(); printf("\n");
+    test_page_aligned_format(); printf("\n");
+    test_wal_recovery(); printf("\n");
+    test_shadow_paging(); printf("\n");
+    test_many_open_trees(); printf("\n");
+    test_sharded_index(); printf("\n");
+    test_concurrent_access(); printf("\n");
+    test_bplus_tree(); printf("\n");
+    test_string_keys(); printf("\n");
+    test_compressed_nodes(); printf("\n");
+    test_prefetch(); printf("\n");
+    test_bloom_filter(); printf("\n");
+    test_betree(); printf("\n");
+    test_memtable(); printf("\n");
     printf("All B-Tree Tests Passed!\n");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,21 @@
+#include <stdio.h>
+#include <stdlib.h> /* For EXIT_SUCCESS */
+
+/* Required Prototypes from btree.c */
+int BTree_vacuum(const char *name, int *live_pages);
+
+/* Offline vacuum: compacts a B-Tree file in place and truncates free pages */
+int main(int argc, const char *argv[]) {
+    int i; int reclaimed; int live_pages;
+    if (argc < 2) {
+        printf("Usage: %s <file.db> [more files...]\n", argv[0]);
+        printf("Moves live nodes to the front of each file, rewrites child addresses and truncates.\n");
+        printf("The file must not be open in another process.\n");
+        return 1;
+    }
+    for (i = 1; i < argc; ++i) {
+        reclaimed = BTree_vacuum(argv[i], &live_pages);
+        printf("%s: %d live pages, %d pages reclaimed\n", argv[i], live_pages, reclaimed);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,465 @@
+#include <stdio.h>
+#include <stdlib.h> /* For malloc, realloc, free, exit */
+#include <string.h> /* For memcmp, memcpy, memmove */
+#include <assert.h>
+
+/* Required Struct Definitions */
+struct Node { int n; int leaf; int *key; int *value; int *c; };
+struct VTree { int root; int t; struct Storage *store; };
+
+/* Required Prototypes from storage.c */
+struct Storage* Storage_open(const char *fname, int t);
+void          Storage_close(struct Storage *st);
+int           Storage_empty(struct Storage *st);
+int           Storage_alloc(struct Storage *st);
+void          Storage_read (struct Storage *st, int addr, struct Node *x);
+void          Storage_write(struct Storage *st, int addr, const struct Node *x);
+void          Storage_free (struct Storage *st, int addr);
+int           Storage_get_t(struct Storage *st);
+int           Storage_pin  (struct Storage *st, int addr, struct Node *view);
+void          Storage_unpin(struct Storage *st, int addr, const struct Node *view, int dirty);
+void          Storage_op_begin(struct Storage *st);
+void          Storage_op_end(struct Storage *st);
+void          Storage_commit(struct Storage *st);
+
+/* --- Constants --- */
+#define NULL_ADDR (-1)
+/* Page kinds, kept in the leaf field (btree.c uses 0/1, bptree.c 2/3) */
+#define VT_INNER 4
+#define VT_LEAF  5
+/* Page body limits: room for a useful fanout, offsets that fit 16 bits */
+#define VT_MIN_BODY 512
+#define VT_MAX_BODY 65535
+/* Deepest tree the per-thread scratch levels cover */
+#define VT_MAX_HEIGHT 32
+
+/* --- Slotted Page Layout --- */
+/* Keys are byte strings of 0..VTree_max_key_len bytes, compared like */
+/* memcmp with the shorter string first on a tie. A page's body (the 6t-2 */
+/* ints after n and leaf, taken as bytes) is a slotted page: */
+/*   0: prefix length (u16)   2: start of the cell area (u16) */
+/*   4: link (int): next leaf, or the leftmost child of an inner page */
+/*   8: prefix, then n slots (u16 cell offsets, in key order), free space, */
+/*      and the cells packed against the end: suffix length (u16), suffix */
+/*      bytes, ref (int) */
+/* The prefix is the longest one shared by every key on the page and is */
+/* stored once. ref is the value in a leaf; in an inner page it is the */
+/* child right of the key, so child i holds keys in [key[i-1], key[i]). */
+/* Separators copied up from leaf splits are cut to the shortest string */
+/* that still divides the two leaves. */
+#define VT_HDR 8
+/* Bytes per entry besides its suffix: slot, suffix length and ref */
+#define VT_CELL 8
+
+/* Decoded page: entries point at full keys in a private arena */
+struct VEntry { int off; int len; int ref; };
+struct VNode {
+    int kind; int n; int link;
+    struct VEntry *e; int ecap;
+    unsigned char *arena; int used; int acap;
+};
+
+/* Scratch for one level of a descent: a page buffer and its decoding */
+struct VLevel { struct Node *page; struct VNode node; };
+
+/* Per-thread scratch for descents, sized for g_level_t */
+static __thread struct VLevel g_level[VT_MAX_HEIGHT + 2]; /* Last two: merge siblings */
+static __thread int g_level_t = 0;
+static __thread unsigned char *g_sep = NULL; /* Separator handed up by a split */
+
+/* --- Byte Helpers --- */
+static int VTree_get16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+static void VTree_put16(unsigned char *p, int v) { p[0] = (unsigned char)(v & 0xFF); p[1] = (unsigned char)((v >> 8) & 0xFF); }
+static int VTree_get32(const unsigned char *p) { int v; memcpy(&v, p, sizeof(int)); return v; }
+static void VTree_put32(unsigned char *p, int v) { memcpy(p, &v, sizeof(int)); }
+
+static int VTree_compare(const unsigned char *a, int alen, const unsigned char *b, int blen) {
+    int c = memcmp(a, b, (size_t)(alen < blen ? alen : blen));
+    if (c != 0) { return c; }
+    return (alen > blen) - (alen < blen);
+}
+
+static int VTree_lcp(const unsigned char *a, int alen, const unsigned char *b, int blen) {
+    int i = 0; int m = alen < blen ? alen : blen;
+    while (i < m && a[i] == b[i]) { i++; }
+    return i;
+}
+
+static int VTree_body_bytes(int t) { return (6 * t - 2) * (int)sizeof(int); }
+
+/* Longest key: small enough that any overfull page splits into two that fit */
+static int VTree_max_key(int cap) { return (cap - VT_HDR) / 6 - VT_CELL; }
+
+/* --- Page Buffers --- */
+
+/* Node buffer whose arrays lie back to back, so the body is one block */
+static struct Node* VTree_page_mem(int t) {
+    struct Node *x = malloc(sizeof(struct Node) + (size_t)VTree_body_bytes(t));
+    if (!x) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    x->key = (int *)(x + 1); x->value = x->key + (2 * t - 1); x->c = x->value + (2 * t - 1);
+    memset(x->key, 0, (size_t)VTree_body_bytes(t));
+    x->n = 0; x->leaf = VT_LEAF; return x;
+}
+
+static unsigned char *VTree_body(const struct Node *x) { return (unsigned char *)x->key; }
+
+static void VTree_levels_free(void) {
+    int i;
+    for (i = 0; i < VT_MAX_HEIGHT + 2; ++i) {
+        free(g_level[i].page); free(g_level[i].node.e); free(g_level[i].node.arena);
+        memset(&g_level[i], 0, sizeof(struct VLevel));
+    }
+    free(g_sep); g_sep = NULL; g_level_t = 0;
+}
+
+/* Sizes the calling thread's scratch levels for vt */
+static void VTree_levels(const struct VTree *vt) {
+    int i;
+    if (g_level_t == vt->t) { return; }
+    VTree_levels_free();
+    for (i = 0; i < VT_MAX_HEIGHT + 2; ++i) { g_level[i].page = VTree_page_mem(vt->t); }
+    g_sep = malloc((size_t)VTree_body_bytes(vt->t));
+    if (!g_sep) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    g_level_t = vt->t;
+}
+
+static void VTree_read(const struct VTree *vt, int addr, struct Node *x) {
+    Storage_read(vt->store, addr, x);
+    if (x->leaf != VT_LEAF && x->leaf != VT_INNER) { fprintf(stderr, "BTree Error: Page %d is not a string-key page (kind %d).\n", addr, x->leaf); exit(EXIT_FAILURE); }
+}
+
+/* --- Page Access (no decoding) --- */
+
+static const unsigned char *VTree_cell(const unsigned char *b, int i) {
+    return b + VTree_get16(b + VT_HDR + VTree_get16(b) + 2 * i);
+}
+
+static int VTree_ref(const unsigned char *b, int i) {
+    const unsigned char *cell = VTree_cell(b, i);
+    return VTree_get32(cell + 2 + VTree_get16(cell));
+}
+
+/* First slot whose key is >= key; *exact is set when it is equal */
+static int VTree_page_search(const unsigned char *b, int n, const unsigned char *key, int len, int *exact) {
+    int plen = VTree_get16(b); int c; int lo = 0; int hi = n; int mid; const unsigned char *cell;
+    *exact = 0;
+    c = memcmp(key, b + VT_HDR, (size_t)(len < plen ? len : plen));
+    if (c < 0 || (c == 0 && len < plen)) { return 0; } /* Below every key on the page */
+    if (c > 0) { return n; }                             /* Above every key */
+    key += plen; len -= plen;
+    while (lo < hi) {
+        mid = (lo + hi) / 2; cell = VTree_cell(b, mid);
+        if (VTree_compare(cell + 2, VTree_get16(cell), key, len) < 0) { lo = mid + 1; } else { hi = mid; }
+    }
+    if (lo < n) { cell = VTree_cell(b, lo); *exact = VTree_compare(cell + 2, VTree_get16(cell), key, len) == 0; }
+    return lo;
+}
+
+/* Child of inner page b covering key */
+static int VTree_child_for(const unsigned char *b, int n, const unsigned char *key, int len) {
+    int exact; int i = VTree_page_search(b, n, key, len, &exact) + exact;
+    return i == 0 ? VTree_get32(b + 4) : VTree_ref(b, i - 1);
+}
+
+/* Copies the full key of slot i into out; returns its length */
+static int VTree_key_at(const unsigned char *b, int i, unsigned char *out) {
+    int plen = VTree_get16(b); const unsigned char *cell = VTree_cell(b, i); int slen = VTree_get16(cell);
+    memcpy(out, b + VT_HDR, (size_t)plen); memcpy(out + plen, cell + 2, (size_t)slen);
+    return plen + slen;
+}
+
+/* --- Decoded Pages --- */
+
+static void VTree_node_reserve(struct VNode *v, int entries, int bytes) {
+    if (entries > v->ecap) {
+        v->ecap = entries * 2; v->e = realloc(v->e, (size_t)v->ecap * sizeof(struct VEntry));
+        if (!v->e) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    }
+    if (bytes > v->acap) {
+        v->acap = bytes * 2; v->arena = realloc(v->arena, (size_t)v->acap);
+        if (!v->arena) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    }
+}
+
+static const unsigned char *VTree_entry_key(const struct VNode *v, int i) { return v->arena + v->e[i].off; }
+
+/* Inserts an entry at position pos */
+static void VTree_node_insert(struct VNode *v, int pos, const unsigned char *key, int len, int ref) {
+    VTree_node_reserve(v, v->n + 1, v->used + len);
+    memmove(&v->e[pos + 1], &v->e[pos], (size_t)(v->n - pos) * sizeof(struct VEntry));
+    memcpy(v->arena + v->used, key, (size_t)len);
+    v->e[pos].off = v->used; v->e[pos].len = len; v->e[pos].ref = ref;
+    v->used += len; v->n++;
+}
+
+static void VTree_node_remove(struct VNode *v, int pos) {
+    memmove(&v->e[pos], &v->e[pos + 1], (size_t)(v->n - pos - 1) * sizeof(struct VEntry));
+    v->n--;
+}
+
+/* Appends entries [from, to) of src */
+static void VTree_node_append(struct VNode *v, const struct VNode *src, int from, int to) {
+    int i;
+    for (i = from; i < to; ++i) { VTree_node_insert(v, v->n, VTree_entry_key(src, i), src->e[i].len, src->e[i].ref); }
+}
+
+static void VTree_decode(const struct Node *page, struct VNode *v) {
+    const unsigned char *b = VTree_body(page); int plen = VTree_get16(b); int i; const unsigned char *cell; int slen;
+    v->kind = page->leaf; v->link = VTree_get32(b + 4); v->n = 0; v->used = 0;
+    for (i = 0; i < page->n; ++i) {
+        cell = VTree_cell(b, i); slen = VTree_get16(cell);
+        VTree_node_reserve(v, v->n + 1, v->used + plen + slen);
+        memcpy(v->arena + v->used, b + VT_HDR, (size_t)plen); memcpy(v->arena + v->used + plen, cell + 2, (size_t)slen);
+        v->e[v->n].off = v->used; v->e[v->n].len = plen + slen; v->e[v->n].ref = VTree_get32(cell + 2 + slen);
+        v->used += plen + slen; v->n++;
+    }
+}
+
+/* Shared prefix of entries [from, to): that of the first and last key */
+static int VTree_range_prefix(const struct VNode *v, int from, int to) {
+    if (to - from < 1) { return 0; }
+    return VTree_lcp(VTree_entry_key(v, from), v->e[from].len, VTree_entry_key(v, to - 1), v->e[to - 1].len);
+}
+
+/* Encoded size of a page holding entries [from, to) */
+static long VTree_range_size(const struct VNode *v, int from, int to) {
+    int plen = VTree_range_prefix(v, from, to); long size = VT_HDR + plen; int i;
+    for (i = from; i < to; ++i) { size += VT_CELL + v->e[i].len - plen; }
+    return size;
+}
+
+/* Writes entries [from, to) of v with the given kind and link to page addr */
+static void VTree_encode_write(const struct VTree *vt, int addr, const struct VNode *v, int from, int to, int kind, int link, struct Node *page) {
+    unsigned char *b = VTree_body(page); int plen = VTree_range_prefix(v, from, to); int end = VTree_body_bytes(vt->t); int i; int slen;
+    if (VTree_range_size(v, from, to) > end) { fprintf(stderr, "BTree Error: String-key page overflow (%ld bytes).\n", VTree_range_size(v, from, to)); exit(EXIT_FAILURE); }
+    page->n = to - from; page->leaf = kind;
+    VTree_put16(b, plen); VTree_put32(b + 4, link);
+    if (plen > 0) { memcpy(b + VT_HDR, VTree_entry_key(v, from), (size_t)plen); }
+    for (i = from; i < to; ++i) {
+        slen = v->e[i].len - plen; end -= 2 + slen + (int)sizeof(int);
+        VTree_put16(b + end, slen); memcpy(b + end + 2, VTree_entry_key(v, i) + plen, (size_t)slen);
+        VTree_put32(b + end + 2 + slen, v->e[i].ref);
+        VTree_put16(b + VT_HDR + plen + 2 * (i - from), end);
+    }
+    VTree_put16(b + 2, end);
+    Storage_write(vt->store, addr, page);
+}
+
+/* Split point m: leaves keep [0, m) | [m, n); inner pages [0, m) | m | [m+1, n) */
+/* with entry m moving up. Picks the fitting m with the smaller larger half. */
+static int VTree_split_point(const struct VNode *v, int cap) {
+    int m; int best = -1; long worst; long best_worst = 0; long l; long r; int inner = v->kind == VT_INNER;
+    for (m = 1; m < v->n - inner; ++m) {
+        l = VTree_range_size(v, 0, m); r = VTree_range_size(v, m + inner, v->n);
+        worst = l > r ? l : r;
+        if (worst <= cap && (best == -1 || worst < best_worst)) { best = m; best_worst = worst; }
+    }
+    if (best == -1) { fprintf(stderr, "BTree Error: String-key page of %d entries cannot be split.\n", v->n); exit(EXIT_FAILURE); }
+    return best;
+}
+
+
+/* --- Insert --- */
+/* Recursive: a page that overflows after the change below it splits and */
+/* hands a separator and its new right sibling to its parent. */
+struct VSplit { int split; unsigned char *sep; int len; int right; };
+
+static void VTree_insert_rec(const struct VTree *vt, int level, int addr, const unsigned char *key, int len, int value, struct VSplit *out) {
+    struct VLevel *L = &g_level[level]; struct VNode *v = &L->node; unsigned char *b; int pos; int exact; int m; int right; int left;
+    int inner; int sep_from; int sep_len; unsigned char *cell; int cap = VTree_body_bytes(vt->t);
+    if (level >= VT_MAX_HEIGHT) { fprintf(stderr, "BTree Error: String-key tree deeper than %d.\n", VT_MAX_HEIGHT); exit(EXIT_FAILURE); }
+    out->split = 0;
+    VTree_read(vt, addr, L->page); b = VTree_body(L->page);
+    pos = VTree_page_search(b, L->page->n, key, len, &exact);
+    if (L->page->leaf == VT_LEAF) {
+        if (exact) { /* Update in place: the value is a fixed-size field */
+            cell = (unsigned char *)VTree_cell(b, pos); VTree_put32(cell + 2 + VTree_get16(cell), value);
+            Storage_write(vt->store, addr, L->page); return;
+        }
+        VTree_decode(L->page, v); VTree_node_insert(v, pos, key, len, value);
+    } else {
+        VTree_insert_rec(vt, level + 1, pos + exact == 0 ? VTree_get32(b + 4) : VTree_ref(b, pos + exact - 1), key, len, value, out);
+        if (!out->split) { return; }
+        VTree_decode(L->page, v); VTree_node_insert(v, pos + exact, out->sep, out->len, out->right);
+        out->split = 0;
+    }
+    if (VTree_range_size(v, 0, v->n) <= cap) { VTree_encode_write(vt, addr, v, 0, v->n, v->kind, v->link, L->page); return; }
+
+    m = VTree_split_point(v, cap); inner = v->kind == VT_INNER; right = Storage_alloc(vt->store);
+    if (inner) { sep_from = VTree_entry_key(v, m) - v->arena; sep_len = v->e[m].len; }
+    else { /* Shortest string above the left half's last key and at most the right's first */
+        sep_from = VTree_entry_key(v, m) - v->arena;
+        sep_len = VTree_lcp(VTree_entry_key(v, m - 1), v->e[m - 1].len, VTree_entry_key(v, m), v->e[m].len) + 1;
+    }
+    memcpy(out->sep, v->arena + sep_from, (size_t)sep_len); out->len = sep_len; out->right = right; out->split = 1;
+    VTree_encode_write(vt, right, v, m + inner, v->n, v->kind, inner ? v->e[m].ref : v->link, L->page);
+    if (level > 0) { VTree_encode_write(vt, addr, v, 0, m, v->kind, inner ? v->link : right, L->page); return; }
+    /* Root split: the root address is fixed, so the left half moves too */
+    left = Storage_alloc(vt->store);
+    VTree_encode_write(vt, left, v, 0, m, v->kind, inner ? v->link : right, L->page);
+    v->n = 0; v->used = 0; VTree_node_insert(v, 0, out->sep, out->len, right);
+    VTree_encode_write(vt, addr, v, 0, 1, VT_INNER, left, L->page);
+    out->split = 0;
+}
+
+
+/* --- Delete --- */
+/* Recursive: a page left under half full is merged with a sibling when */
+/* the two fit in one page (otherwise both stay as they are). */
+
+/* Returns 1 if the page at addr is now under half full */
+static int VTree_delete_rec(const struct VTree *vt, int level, int addr, const unsigned char *key, int len, int *found) {
+    struct VLevel *L = &g_level[level]; struct VNode *v = &L->node; struct VNode *l; struct VNode *r; unsigned char *b;
+    int pos; int exact; int ci; int j; int addr_l; int addr_r; int kind; int cap = VTree_body_bytes(vt->t);
+    if (level >= VT_MAX_HEIGHT) { fprintf(stderr, "BTree Error: String-key tree deeper than %d.\n", VT_MAX_HEIGHT); exit(EXIT_FAILURE); }
+    VTree_read(vt, addr, L->page); b = VTree_body(L->page);
+    pos = VTree_page_search(b, L->page->n, key, len, &exact);
+    if (L->page->leaf == VT_LEAF) {
+        if (!exact) { return 0; }
+        *found = 1; VTree_decode(L->page, v); VTree_node_remove(v, pos);
+        VTree_encode_write(vt, addr, v, 0, v->n, v->kind, v->link, L->page);
+        return VTree_range_size(v, 0, v->n) < cap / 2;
+    }
+    ci = pos + exact;
+    /* The child works in deeper slots, so L->page still holds this page */
+    if (!VTree_delete_rec(vt, level + 1, ci == 0 ? VTree_get32(b + 4) : VTree_ref(b, ci - 1), key, len, found)) { return 0; }
+    j = ci < L->page->n ? ci : ci - 1; /* Separator between the pair: child j and j+1 */
+    if (j < 0) { return 0; }           /* Only child (root during collapse) */
+    addr_l = j == 0 ? VTree_get32(b + 4) : VTree_ref(b, j - 1); addr_r = VTree_ref(b, j);
+    VTree_decode(L->page, v);
+    l = &g_level[VT_MAX_HEIGHT].node; r = &g_level[VT_MAX_HEIGHT + 1].node;
+    VTree_read(vt, addr_l, g_level[VT_MAX_HEIGHT].page); VTree_decode(g_level[VT_MAX_HEIGHT].page, l);
+    VTree_read(vt, addr_r, g_level[VT_MAX_HEIGHT + 1].page); VTree_decode(g_level[VT_MAX_HEIGHT + 1].page, r);
+    kind = l->kind;
+    if (kind == VT_INNER) { VTree_node_insert(l, l->n, VTree_entry_key(v, j), v->e[j].len, r->link); }
+    VTree_node_append(l, r, 0, r->n);
+    if (VTree_range_size(l, 0, l->n) > cap) { return 0; } /* Pair too full to merge */
+    VTree_node_remove(v, j); Storage_free(vt->store, addr_r);
+    if (level == 0 && v->n == 0) { /* Root collapse: the merged child moves to the root address */
+        VTree_encode_write(vt, addr, l, 0, l->n, kind, kind == VT_INNER ? l->link : r->link, L->page);
+        Storage_free(vt->store, addr_l); return 0;
+    }
+    VTree_encode_write(vt, addr_l, l, 0, l->n, kind, kind == VT_INNER ? l->link : r->link, g_level[VT_MAX_HEIGHT].page);
+    VTree_encode_write(vt, addr, v, 0, v->n, v->kind, v->link, L->page);
+    return VTree_range_size(v, 0, v->n) < cap / 2;
+}
+
+
+/* --- Public API Implementation --- */
+
+/* VTree_open: Opens or creates a tree of byte-string keys. t_user sizes */
+/* the pages as for BTree_open (0 picks one page, see Storage_set_page_size); */
+/* it must give a page body of 512 to 65535 bytes (22 <= t <= 2730). */
+struct VTree VTree_open(const char *name, int t_user) {
+    struct VTree vt; struct Node *x;
+    vt.store = Storage_open(name, t_user);
+    vt.t = Storage_get_t(vt.store); vt.root = 0;
+    if (VTree_body_bytes(vt.t) < VT_MIN_BODY || VTree_body_bytes(vt.t) > VT_MAX_BODY) {
+        fprintf(stderr, "BTree Error: t=%d gives %d byte string-key pages (need %d..%d).\n", vt.t, VTree_body_bytes(vt.t), VT_MIN_BODY, VT_MAX_BODY);
+        Storage_close(vt.store); exit(EXIT_FAILURE);
+    }
+    x = VTree_page_mem(vt.t);
+    if (Storage_empty(vt.store)) {
+        if (Storage_alloc(vt.store) != 0) { fprintf(stderr, "BTree Error: Initial root alloc not addr 0.\n"); Storage_close(vt.store); exit(EXIT_FAILURE); }
+        VTree_put16(VTree_body(x) + 2, VTree_body_bytes(vt.t)); VTree_put32(VTree_body(x) + 4, NULL_ADDR);
+        Storage_write(vt.store, 0, x);
+        Storage_commit(vt.store); /* A new file is durable before the first operation */
+    } else {
+        Storage_read(vt.store, 0, x);
+        if (x->leaf != VT_LEAF && x->leaf != VT_INNER) { fprintf(stderr, "BTree Error: %s does not hold a string-key tree.\n", name); Storage_close(vt.store); exit(EXIT_FAILURE); }
+    }
+    free(x); return vt;
+}
+
+void VTree_close(struct VTree *vt) {
+    Storage_close(vt->store);
+    VTree_levels_free(); vt->root = -1; vt->t = 0; vt->store = NULL;
+}
+
+/* VTree_sync: Makes every completed operation durable (see BTree_sync) */
+void VTree_sync(const struct VTree *vt) { assert(vt != NULL && vt->t >= 2); Storage_commit(vt->store); }
+
+/* VTree_max_key_len: Longest key the tree accepts (about a sixth of a page) */
+int VTree_max_key_len(const struct VTree *vt) { assert(vt != NULL); return VTree_max_key(VTree_body_bytes(vt->t)); }
+
+static void VTree_check_key(const struct VTree *vt, const unsigned char *key, int len) {
+    int max = VTree_max_key(VTree_body_bytes(vt->t));
+    if ((key == NULL && len > 0) || len < 0 || len > max) { fprintf(stderr, "BTree Error: Invalid key length %d (max %d).\n", len, max); exit(EXIT_FAILURE); }
+}
+
+/* VTree_get: Sets *v and returns 1 if key[0..len) is present, else 0. */
+/* Pages are searched in place (pinned) without being decoded. */
+int VTree_get(const struct VTree *vt, const void *key, int len, int *v) {
+    struct Node view; struct Node *x; const unsigned char *b; int addr; int pos; int exact; int found = 0;
+    assert(vt != NULL); assert(v != NULL);
+    VTree_levels(vt); VTree_check_key(vt, key, len); addr = vt->root;
+    for (;;) {
+        x = Storage_pin(vt->store, addr, &view) ? &view : (VTree_read(vt, addr, g_level[0].page), g_level[0].page);
+        b = VTree_body(x);
+        if (x->leaf == VT_LEAF) {
+            pos = VTree_page_search(b, x->n, key, len, &exact);
+            if (exact) { *v = VTree_ref(b, pos); found = 1; }
+            if (x == &view) { Storage_unpin(vt->store, addr, &view, 0); }
+            return found;
+        }
+        if (x->leaf != VT_INNER) { fprintf(stderr, "BTree Error: Page %d is not a string-key page (kind %d).\n", addr, x->leaf); exit(EXIT_FAILURE); }
+        pos = VTree_child_for(b, x->n, key, len);
+        if (x == &view) { Storage_unpin(vt->store, addr, &view, 0); }
+        addr = pos;
+    }
+}
+
+/* VTree_put: Inserts or updates key[0..len) -> v */
+void VTree_put(const struct VTree *vt, const void *key, int len, int v) {
+    struct VSplit out;
+    assert(vt != NULL);
+    VTree_levels(vt); VTree_check_key(vt, key, len);
+    out.sep = g_sep;
+    Storage_op_begin(vt->store);
+    VTree_insert_rec(vt, 0, vt->root, key, len, v, &out);
+    Storage_op_end(vt->store);
+}
+
+/* VTree_delete: Removes key[0..len); returns 1 if it was present */
+int VTree_delete(struct VTree *vt, const void *key, int len) {
+    int found = 0;
+    assert(vt != NULL);
+    VTree_levels(vt); VTree_check_key(vt, key, len);
+    Storage_op_begin(vt->store);
+    (void) VTree_delete_rec(vt, 0, vt->root, key, len, &found);
+    Storage_op_end(vt->store);
+    return found;
+}
+
+/* VTree_scan: Calls cb(key, len, v, ctx) for every key in [lo, hi] in */
+/* order, following the leaf chain. lo == NULL starts at the first key and */
+/* hi == NULL runs to the last. A nonzero return from cb stops the scan. */
+/* Returns the number of calls. */
+int VTree_scan(const struct VTree *vt, const void *lo, int lolen, const void *hi, int hilen,
+               int (*cb)(const unsigned char *key, int len, int v, void *ctx), void *ctx) {
+    struct Node *x; unsigned char *b; unsigned char *buf; int addr; int i; int exact; int klen; int count = 0;
+    assert(vt != NULL); assert(cb != NULL);
+    if (lo != NULL && hi != NULL && VTree_compare(lo, lolen, hi, hilen) > 0) { return 0; }
+    x = VTree_page_mem(vt->t); buf = malloc((size_t)VTree_body_bytes(vt->t)); /* Own buffers: cb may use the tree */
+    if (!buf) { perror("BTree Memory Error"); exit(EXIT_FAILURE); }
+    addr = vt->root;
+    for (;;) {
+        VTree_read(vt, addr, x); b = VTree_body(x);
+        if (x->leaf == VT_LEAF) { break; }
+        addr = lo == NULL ? VTree_get32(b + 4) : VTree_child_for(b, x->n, lo, lolen);
+    }
+    i = lo == NULL ? 0 : VTree_page_search(b, x->n, lo, lolen, &exact);
+    for (;;) {
+        for (; i < x->n; ++i) {
+            klen = VTree_key_at(b, i, buf);
+            if (hi != NULL && VTree_compare(buf, klen, hi, hilen) > 0) { goto done; }
+            count++;
+            if (cb(buf, klen, VTree_ref(b, i), ctx)) { goto done; }
+        }
+        addr = VTree_get32(b + 4);
+        if (addr == NULL_ADDR) { break; }
+        VTree_read(vt, addr, x); i = 0;
+    }
+done:
+    free(x); free(buf); return count;
+}
@@ -0,0 +1,351 @@
+/* POSIX for clock_gettime (per-operation wall time) */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h> /* For malloc, free, atoi, strtoul */
+#include <string.h> /* For strcmp, strstr */
+#include <math.h>   /* For pow, ceil (zipfian generator, percentiles) */
+#include <time.h>   /* For clock_gettime */
+
+/* Required Struct Definitions */
+struct BTree { int root; int t; struct Storage *store; };
+
+/* Required Prototypes from btree.c */
+struct BTree BTree_open (const char *name, int t);
+void        BTree_close(struct BTree *bt);
+void        BTree_put  (const struct BTree *bt, int k, int v);
+void        BTree_get  (const struct BTree *bt, int k, int *v);
+int         BTree_scan (const struct BTree *bt, int lo, int hi, int (*cb)(int k, int v, void *ctx), void *ctx);
+
+/* Required Prototypes from storage.c */
+void          Storage_set_cache_size(int frames);
+unsigned long Storage_get_read_count(const struct Storage *st);
+unsigned long Storage_get_write_count(const struct Storage *st);
+
+/* --- Workload Benchmark --- */
+/* YCSB-style workloads against one tree: a load phase puts the records, */
+/* then each workload runs its operation mix on a fresh copy of the loaded */
+/* file, with keys drawn from the chosen distribution. Every operation is */
+/* timed on the wall clock into a per-type latency histogram. Results go */
+/* to stdout as a table, CSV or JSON (one row per run and operation type, */
+/* plus an "all" row); progress goes to stderr so the output can be saved */
+/* and compared across builds. */
+
+#define YCSB_BASE_FILE "ycsb_btree_base.db"
+#define YCSB_RUN_FILE  "ycsb_btree_run.db"
+#define NUM_RECORDS 100000
+#define NUM_OPERATIONS 100000
+#define CACHE_FRAMES 256
+#define DEFAULT_T 64
+#define MAX_SCAN 100       /* Scan lengths are uniform in [1, MAX_SCAN] */
+#define ZIPF_THETA 0.99    /* YCSB's default skew */
+#define HIST_SUB 16        /* Buckets per power of two: values within 1/16 */
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+#define OP_READ   0
+#define OP_UPDATE 1
+#define OP_INSERT 2
+#define OP_SCAN   3
+#define OP_RMW    4
+#define NUM_OPS   5
+static const char *g_op_names[NUM_OPS] = { "read", "update", "insert", "scan", "rmw" };
+
+/* Operation mix in percent, indexed by OP_* */
+struct Workload { char name; const char *mix; int pct[NUM_OPS]; };
+static const struct Workload g_workloads[] = {
+    { 'A', "update-heavy",      { 50, 50, 0,  0,  0 } },
+    { 'B', "read-heavy",        { 95,  5, 0,  0,  0 } },
+    { 'C', "read-only",         { 100, 0, 0,  0,  0 } },
+    { 'E', "short-scans",       {  0,  0, 5, 95,  0 } },
+    { 'F', "read-modify-write", { 50,  0, 0,  0, 50 } }
+};
+#define NUM_WORKLOADS ((int)(sizeof(g_workloads) / sizeof(g_workloads[0])))
+
+/* Key distributions. Uniform and zipfian records have hashed keys (spread */
+/* over the int range, inserted in random order); sequential records have */
+/* keys 0, 1, 2, ... and are loaded, read and appended in key order. */
+#define DIST_UNIFORM    0
+#define DIST_ZIPFIAN    1
+#define DIST_SEQUENTIAL 2
+#define NUM_DISTS       3
+static const char *g_dist_names[NUM_DISTS] = { "uniform", "zipfian", "sequential" };
+
+#define FORMAT_TABLE 0
+#define FORMAT_CSV   1
+#define FORMAT_JSON  2
+
+/* Latency histogram in ns: exact below HIST_SUB, then HIST_SUB buckets per */
+/* octave; also the node reads and writes of the operations it holds */
+struct Hist { unsigned long count; unsigned long max; double sum; unsigned long reads; unsigned long writes; unsigned long bucket[HIST_BUCKETS]; };
+
+/* Chooses record indices; count grows with inserts */
+struct KeyGen {
+    int dist;
+    unsigned int rng;    /* xorshift32 state */
+    long count;          /* Records in the tree */
+    long cursor;         /* Next sequential index */
+    long zeta_n;         /* Items covered by zetan */
+    double zetan;        /* Sum of 1/i^theta for i in [1, zeta_n] */
+    double zeta2;
+    double eta;
+};
+
+/* Murmur3 finalizer: a bijection on 32 bits, so distinct indices give distinct keys */
+static unsigned int ycsb_mix(unsigned int h) {
+    h ^= h >> 16; h *= 0x85EBCA6BU; h ^= h >> 13; h *= 0xC2B2AE35U; h ^= h >> 16;
+    return h;
+}
+
+static int ycsb_key(int dist, long i) { return dist == DIST_SEQUENTIAL ? (int)i : (int)ycsb_mix((unsigned int)i); }
+
+static unsigned int ycsb_rand(struct KeyGen *g) { g->rng ^= g->rng << 13; g->rng ^= g->rng >> 17; g->rng ^= g->rng << 5; return g->rng; }
+
+/* Uniform in [0, 1) with 53 random bits */
+static double ycsb_rand_double(struct KeyGen *g) {
+    double hi = (double)(ycsb_rand(g) >> 5); double lo = (double)(ycsb_rand(g) >> 6);
+    return (hi * 67108864.0 + lo) / 9007199254740992.0;
+}
+
+static void ycsb_keygen_init(struct KeyGen *g, int dist, long count, unsigned int seed) {
+    g->dist = dist; g->rng = seed != 0 ? seed : 1; g->count = count; g->cursor = 0;
+    g->zeta_n = 0; g->zetan = 0.0; g->zeta2 = 1.0 + 1.0 / pow(2.0, ZIPF_THETA); g->eta = 0.0;
+}
+
+/* Extends zetan to the current count (inserts add one term each) */
+static void ycsb_zipf_grow(struct KeyGen *g) {
+    while (g->zeta_n < g->count) { g->zeta_n++; g->zetan += 1.0 / pow((double)g->zeta_n, ZIPF_THETA); }
+    g->eta = (1.0 - pow(2.0 / (double)g->count, 1.0 - ZIPF_THETA)) / (1.0 - g->zeta2 / g->zetan);
+}
+
+/* Next record index in [0, count). Zipfian ranks come from Gray et al.'s */
+/* generator (as in YCSB) and are scrambled so the hot records are spread */
+/* over the tree instead of sharing the first leaves. */
+static long ycsb_next_index(struct KeyGen *g) {
+    double u; double uz; long rank;
+    if (g->dist == DIST_SEQUENTIAL) { if (g->cursor >= g->count) { g->cursor = 0; } return g->cursor++; }
+    if (g->dist == DIST_UNIFORM) { return (long)(ycsb_rand_double(g) * (double)g->count); }
+    if (g->zeta_n != g->count) { ycsb_zipf_grow(g); }
+    u = ycsb_rand_double(g); uz = u * g->zetan;
+    if (uz < 1.0) { rank = 0; }
+    else if (uz < 1.0 + pow(0.5, ZIPF_THETA)) { rank = 1; }
+    else { rank = (long)((double)g->count * pow(g->eta * u - g->eta + 1.0, 1.0 / (1.0 - ZIPF_THETA))); }
+    if (rank >= g->count) { rank = g->count - 1; }
+    return (long)(ycsb_mix((unsigned int)rank) % (unsigned long)g->count);
+}
+
+static unsigned long ycsb_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+}
+
+static int hist_bucket(unsigned long ns) {
+    int e = 0;
+    if (ns < HIST_SUB) { return (int)ns; }
+    while (ns >= 2 * HIST_SUB) { ns >>= 1; e++; } /* ns now in [HIST_SUB, 2*HIST_SUB) */
+    return (e + 1) * HIST_SUB + (int)(ns - HIST_SUB);
+}
+
+/* Largest value that falls in bucket b */
+static double hist_upper(int b) {
+    int e = b / HIST_SUB - 1; int m = b % HIST_SUB;
+    if (b < HIST_SUB) { return (double)b; }
+    return ldexp((double)(HIST_SUB + m + 1), e) - 1.0;
+}
+
+static void hist_add(struct Hist *h, unsigned long ns, unsigned long reads, unsigned long writes) {
+    h->count++; h->sum += (double)ns; if (ns > h->max) { h->max = ns; }
+    h->reads += reads; h->writes += writes;
+    h->bucket[hist_bucket(ns)]++;
+}
+
+static void hist_merge(struct Hist *into, const struct Hist *h) {
+    int b;
+    into->count += h->count; into->sum += h->sum; if (h->max > into->max) { into->max = h->max; }
+    into->reads += h->reads; into->writes += h->writes;
+    for (b = 0; b < HIST_BUCKETS; ++b) { into->bucket[b] += h->bucket[b]; }
+}
+
+/* Latency (us) at or below which a fraction q of the operations finished */
+static double hist_percentile_us(const struct Hist *h, double q) {
+    unsigned long target; unsigned long seen = 0; int b; double v;
+    if (h->count == 0) { return 0.0; }
+    target = (unsigned long)ceil(q * (double)h->count); if (target < 1) { target = 1; }
+    for (b = 0; b < HIST_BUCKETS; ++b) {
+        seen += h->bucket[b];
+        if (seen >= target) { v = hist_upper(b); return (v < (double)h->max ? v : (double)h->max) / 1000.0; }
+    }
+    return (double)h->max / 1000.0;
+}
+
+/* Scan callback: stops after the requested number of keys */
+static int ycsb_scan_cb(int k, int v, void *ctx) { (void)k; (void)v; return --*(int *)ctx <= 0; }
+
+/* Copies the loaded file so every run starts from the same tree */
+static void ycsb_copy_file(const char *from, const char *to) {
+    FILE *in; FILE *out; char buf[65536]; size_t n;
+    in = fopen(from, "rb"); out = fopen(to, "wb");
+    if (!in || !out) { perror("ycsb copy"); exit(EXIT_FAILURE); }
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) { perror("ycsb copy"); exit(EXIT_FAILURE); }
+    }
+    fclose(in); if (fclose(out) != 0) { perror("ycsb copy"); exit(EXIT_FAILURE); }
+}
+
+/* --- Output --- */
+struct RunInfo { const char *workload; const char *dist; long records; long ops; int t; int cache; double seconds; };
+
+static int g_format = FORMAT_TABLE;
+static int g_rows = 0; /* Rows printed (JSON separators) */
+
+static void ycsb_print_header(const struct RunInfo *cfg, unsigned int seed) {
+    if (g_format == FORMAT_CSV) {
+        printf("workload,distribution,records,operations,t,cache_frames,op,count,ops_per_sec,avg_us,p50_us,p99_us,p999_us,max_us,reads_per_op,writes_per_op\n");
+    } else if (g_format == FORMAT_JSON) {
+        printf("{\"benchmark\": \"ycsb_btree\", \"records\": %ld, \"operations\": %ld, \"t\": %d, \"cache_frames\": %d, \"seed\": %u, \"results\": [\n",
+               cfg->records, cfg->ops, cfg->t, cfg->cache, seed);
+    } else {
+        printf("Workloads on %ld records, t=%d, %d cache frames (latency in us, reads/writes are node accesses per operation)\n", cfg->records, cfg->t, cfg->cache);
+        printf("-----------------------------------------------------------------------------------------------------------------------------\n");
+        printf("| %8s | %10s | %6s | %9s | %11s | %8s | %8s | %8s | %9s | %9s | %8s | %9s |\n",
+               "Workload", "Dist", "Op", "Count", "Ops/s", "Avg", "p50", "p99", "p99.9", "Max", "Reads/Op", "Writes/Op");
+        printf("-----------------------------------------------------------------------------------------------------------------------------\n");
+    }
+}
+
+static void ycsb_print_row(const struct RunInfo *r, const char *op, const struct Hist *h) {
+    double ops_per_sec = r->seconds > 0 ? (double)r->ops / r->seconds : 0.0; double avg = h->count > 0 ? h->sum / (double)h->count / 1000.0 : 0.0;
+    double reads = h->count > 0 ? (double)h->reads / (double)h->count : 0.0; double writes = h->count > 0 ? (double)h->writes / (double)h->count : 0.0;
+    if (g_format == FORMAT_CSV) {
+        printf("%s,%s,%ld,%ld,%d,%d,%s,%lu,%.1f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", r->workload, r->dist, r->records, r->ops, r->t, r->cache, op, h->count, ops_per_sec,
+               avg, hist_percentile_us(h, 0.50), hist_percentile_us(h, 0.99), hist_percentile_us(h, 0.999), (double)h->max / 1000.0, reads, writes);
+    } else if (g_format == FORMAT_JSON) {
+        printf("%s  {\"workload\": \"%s\", \"distribution\": \"%s\", \"op\": \"%s\", \"count\": %lu, \"ops_per_sec\": %.1f, \"avg_us\": %.3f, "
+               "\"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f, \"max_us\": %.3f, \"reads_per_op\": %.3f, \"writes_per_op\": %.3f}",
+               g_rows > 0 ? ",\n" : "", r->workload, r->dist, op, h->count, ops_per_sec, avg, hist_percentile_us(h, 0.50), hist_percentile_us(h, 0.99),
+               hist_percentile_us(h, 0.999), (double)h->max / 1000.0, reads, writes);
+    } else {
+        printf("| %8s | %10s | %6s | %9lu | %11.1f | %8.2f | %8.2f | %8.2f | %9.2f | %9.2f | %8.2f | %9.2f |\n", r->workload, r->dist, op, h->count, ops_per_sec,
+               avg, hist_percentile_us(h, 0.50), hist_percentile_us(h, 0.99), hist_percentile_us(h, 0.999), (double)h->max / 1000.0, reads, writes);
+    }
+    g_rows++;
+}
+
+static void ycsb_print_footer(void) {
+    if (g_format == FORMAT_JSON) { printf("\n]}\n"); }
+    else if (g_format == FORMAT_TABLE) { printf("-----------------------------------------------------------------------------------------------------------------------------\n"); }
+}
+
+/* One row per operation type that ran, then the "all" row */
+static void ycsb_report(const struct RunInfo *r, struct Hist *hist) {
+    struct Hist *all; int op; int used = 0;
+    all = calloc(1, sizeof(struct Hist));
+    if (!all) { perror("Failed to allocate histogram"); exit(EXIT_FAILURE); }
+    for (op = 0; op < NUM_OPS; ++op) {
+        if (hist[op].count == 0) { continue; }
+        ycsb_print_row(r, g_op_names[op], &hist[op]); hist_merge(all, &hist[op]); used++;
+    }
+    if (used > 1) { ycsb_print_row(r, "all", all); }
+    free(all);
+}
+
+/* --- Phases --- */
+
+/* Puts records 0..records-1 into a new base file */
+static void ycsb_load(struct RunInfo *r, int dist, int t) {
+    struct BTree bt; struct Hist *hist; long i; unsigned long t0; unsigned long ns; unsigned long start; unsigned long reads; unsigned long writes;
+    hist = calloc(NUM_OPS, sizeof(struct Hist));
+    if (!hist) { perror("Failed to allocate histogram"); exit(EXIT_FAILURE); }
+    remove(YCSB_BASE_FILE);
+    bt = BTree_open(YCSB_BASE_FILE, t);
+    start = ycsb_now_ns();
+    for (i = 0; i < r->records; ++i) {
+        reads = Storage_get_read_count(bt.store); writes = Storage_get_write_count(bt.store);
+        t0 = ycsb_now_ns(); BTree_put(&bt, ycsb_key(dist, i), (int)i); ns = ycsb_now_ns() - t0;
+        hist_add(&hist[OP_INSERT], ns, Storage_get_read_count(bt.store) - reads, Storage_get_write_count(bt.store) - writes);
+    }
+    r->seconds = (double)(ycsb_now_ns() - start) / 1e9;
+    r->t = bt.t; BTree_close(&bt);
+    r->workload = "load"; r->ops = r->records;
+    ycsb_report(r, hist); free(hist);
+}
+
+/* Runs workload w on a copy of the base file */
+static void ycsb_run(struct RunInfo *r, const struct Workload *w, int dist, unsigned int seed) {
+    struct BTree bt; struct KeyGen gen; struct Hist *hist; char name[2]; long i; int op; int roll; int k; int v; int left;
+    unsigned long t0; unsigned long ns; unsigned long start; unsigned long reads; unsigned long writes;
+    hist = calloc(NUM_OPS, sizeof(struct Hist));
+    if (!hist) { perror("Failed to allocate histogram"); exit(EXIT_FAILURE); }
+    ycsb_copy_file(YCSB_BASE_FILE, YCSB_RUN_FILE);
+    bt = BTree_open(YCSB_RUN_FILE, 0);
+    ycsb_keygen_init(&gen, dist, r->records, seed);
+    if (dist == DIST_ZIPFIAN) { ycsb_zipf_grow(&gen); } /* Outside the timed loop */
+    start = ycsb_now_ns();
+    for (i = 0; i < r->ops; ++i) {
+        roll = (int)(ycsb_rand(&gen) % 100U);
+        for (op = 0; op < NUM_OPS - 1 && roll >= w->pct[op]; ++op) { roll -= w->pct[op]; }
+        reads = Storage_get_read_count(bt.store); writes = Storage_get_write_count(bt.store); /* Outside the timed window */
+        t0 = ycsb_now_ns();
+        if (op == OP_INSERT) {
+            BTree_put(&bt, ycsb_key(dist, gen.count), (int)gen.count); gen.count++;
+        } else {
+            k = ycsb_key(dist, ycsb_next_index(&gen));
+            if (op == OP_READ) { v = 0; BTree_get(&bt, k, &v); }
+            else if (op == OP_UPDATE) { BTree_put(&bt, k, (int)(ycsb_rand(&gen) >> 1)); }
+            else if (op == OP_SCAN) { left = 1 + (int)(ycsb_rand(&gen) % MAX_SCAN); (void) BTree_scan(&bt, k, 0x7FFFFFFF, ycsb_scan_cb, &left); }
+            else { v = 0; BTree_get(&bt, k, &v); BTree_put(&bt, k, (v + 1) & 0x7FFFFFFF); }
+        }
+        ns = ycsb_now_ns() - t0;
+        hist_add(&hist[op], ns, Storage_get_read_count(bt.store) - reads, Storage_get_write_count(bt.store) - writes);
+    }
+    r->seconds = (double)(ycsb_now_ns() - start) / 1e9;
+    BTree_close(&bt); remove(YCSB_RUN_FILE);
+    name[0] = w->name; name[1] = '\0'; r->workload = name;
+    ycsb_report(r, hist); free(hist);
+}
+
+static int ycsb_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [records] [operations] [workloads=ABCEF] [distributions=all|uniform,zipfian,sequential] [t] [cache_frames] [table|csv|json] [seed]\n", prog);
+    return 1;
+}
+
+int main(int argc, const char *argv[]) {
+    struct RunInfo r; const char *workloads = "ABCEF"; const char *dists = "all"; const char *format = "table";
+    unsigned int seed = 42; int t = DEFAULT_T; int cache = CACHE_FRAMES; long records = NUM_RECORDS; long ops = NUM_OPERATIONS;
+    int d; int w; const char *c;
+
+    if (argc > 1) records = atol(argv[1]);
+    if (argc > 2) ops = atol(argv[2]);
+    if (argc > 3) workloads = argv[3];
+    if (argc > 4) dists = argv[4];
+    if (argc > 5) t = atoi(argv[5]);
+    if (argc > 6) cache = atoi(argv[6]);
+    if (argc > 7) format = argv[7];
+    if (argc > 8) seed = (unsigned int)strtoul(argv[8], NULL, 10);
+
+    g_format = strcmp(format, "csv") == 0 ? FORMAT_CSV : strcmp(format, "json") == 0 ? FORMAT_JSON : strcmp(format, "table") == 0 ? FORMAT_TABLE : -1;
+    if (records < 1 || records > 0x7FFFFFFFL || ops < 0 || t < 2 || cache < 0 || g_format < 0) { fprintf(stderr, "Invalid arguments.\n"); return ycsb_usage(argv[0]); }
+    for (c = workloads; *c != '\0'; ++c) {
+        for (w = 0; w < NUM_WORKLOADS && g_workloads[w].name != *c; ++w) { }
+        if (w == NUM_WORKLOADS) { fprintf(stderr, "Unknown workload '%c' (known: A B C E F).\n", *c); return ycsb_usage(argv[0]); }
+    }
+
+    Storage_set_cache_size(cache);
+    r.records = records; r.t = t; r.cache = cache; r.ops = ops;
+    ycsb_print_header(&r, seed);
+    for (d = 0; d < NUM_DISTS; ++d) {
+        if (strcmp(dists, "all") != 0 && strstr(dists, g_dist_names[d]) == NULL) { continue; }
+        r.dist = g_dist_names[d];
+        fprintf(stderr, "Loading %ld %s records...\n", records, g_dist_names[d]);
+        ycsb_load(&r, d, t);
+        r.ops = ops;
+        for (c = workloads; *c != '\0'; ++c) {
+            for (w = 0; g_workloads[w].name != *c; ++w) { }
+            fprintf(stderr, "Workload %c (%s), %s keys, %ld operations...\n", g_workloads[w].name, g_workloads[w].mix, g_dist_names[d], ops);
+            ycsb_run(&r, &g_workloads[w], d, seed);
+        }
+    }
+    ycsb_print_footer();
+    remove(YCSB_BASE_FILE);
+    return 0;
+}